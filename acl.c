@@ -0,0 +1,110 @@
+/*
+ * ProFTPD - mod_snmp ACL decision cache
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "acl.h"
+#include "hash.h"
+
+/* Nearly all requests come from the same few managers, so the Class match
+ * and <Limit SNMP> evaluation (which may involve DNS lookups) are done once
+ * per source address, and cached in a small direct-mapped table.  The
+ * decisions depend only on the address, not the port.
+ */
+
+struct snmp_acl_entry {
+  int in_use;
+  struct snmp_addr_key key;
+
+  int allowed;
+  pr_class_t *cls;
+};
+
+static struct snmp_acl_entry acl_cache[SNMP_ACL_CACHE_SIZE];
+
+static const char *trace_channel = "snmp.acl";
+
+/* Returns the address key, and its slot in the cache. */
+static int acl_get_slot(const pr_netaddr_t *addr, struct snmp_addr_key *key) {
+  uint32_t h;
+
+  if (snmp_addr_key_init(key, addr, &h) < 0) {
+    return -1;
+  }
+
+  return (int) (h & (SNMP_ACL_CACHE_SIZE - 1));
+}
+
+int snmp_acl_cache_get(const pr_netaddr_t *addr, int *allowed,
+    pr_class_t **cls) {
+  struct snmp_acl_entry *entry;
+  struct snmp_addr_key key;
+  int slot;
+
+  slot = acl_get_slot(addr, &key);
+  if (slot < 0) {
+    return -1;
+  }
+
+  entry = &(acl_cache[slot]);
+  if (entry->in_use == FALSE ||
+      snmp_addr_key_match(&(entry->key), &key) == FALSE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  *allowed = entry->allowed;
+  *cls = entry->cls;
+  return 0;
+}
+
+int snmp_acl_cache_add(const pr_netaddr_t *addr, int allowed,
+    pr_class_t *cls) {
+  struct snmp_acl_entry *entry;
+  struct snmp_addr_key key;
+  int slot;
+
+  slot = acl_get_slot(addr, &key);
+  if (slot < 0) {
+    return -1;
+  }
+
+  entry = &(acl_cache[slot]);
+  if (entry->in_use == TRUE) {
+    pr_trace_msg(trace_channel, 17,
+      "replacing cached ACL decision in slot %d", slot);
+  }
+
+  entry->in_use = TRUE;
+  entry->key = key;
+  entry->allowed = allowed;
+  entry->cls = cls;
+
+  pr_trace_msg(trace_channel, 15, "cached ACL decision (%s) for %s",
+    allowed ? "allow" : "deny", pr_netaddr_get_ipstr(addr));
+  return 0;
+}
+
+void snmp_acl_cache_clear(void) {
+  memset(acl_cache, 0, sizeof(acl_cache));
+}
@@ -0,0 +1,51 @@
+/*
+ * ProFTPD - mod_snmp ACL decision cache
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_ACL_H
+#define MOD_SNMP_ACL_H
+
+/* Number of source addresses whose decisions are cached; a power of 2. */
+#define SNMP_ACL_CACHE_SIZE		256
+
+/* Looks up the cached <Limit SNMP> decision (TRUE if allowed), and the
+ * matched Class, for the given source address.  Returns -1, with errno set
+ * to ENOENT, if the address is not cached.
+ */
+int snmp_acl_cache_get(const pr_netaddr_t *addr, int *allowed,
+  pr_class_t **cls);
+
+/* Caches the decision for the given source address, replacing any other
+ * address cached in the same slot.
+ */
+int snmp_acl_cache_add(const pr_netaddr_t *addr, int allowed,
+  pr_class_t *cls);
+
+/* Discards all cached decisions, e.g. when the configuration (and thus the
+ * <Limit SNMP> rules and Classes) is reloaded.
+ */
+void snmp_acl_cache_clear(void);
+
+#endif
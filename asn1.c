@@ -592,6 +592,55 @@ int snmp_asn1_read_string(pool *p, unsigned char **buf, size_t *buflen,
   return 0;
 }
 
+/* Unlike snmp_asn1_read_string(), this does not copy the value; the returned
+ * pointer refers to the value within the buffer.  This is used for values
+ * which may contain NULs (e.g. SNMPv3 engine IDs and digests), and for
+ * values which are modified in place (e.g. encrypted PDUs).
+ */
+int snmp_asn1_read_octets(pool *p, unsigned char **buf, size_t *buflen,
+    unsigned char *asn1_type, unsigned char **asn1_data,
+    unsigned int *asn1_datalen) {
+  unsigned int objlen;
+  int res;
+
+  res = asn1_read_type(p, buf, buflen, asn1_type, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (*asn1_type != (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING)) {
+    pr_trace_msg(trace_channel, 3,
+      "unable to read OCTET_STRING (received type '%s')",
+      snmp_asn1_get_tagstr(p, *asn1_type));
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = asn1_read_len(p, buf, buflen, &objlen);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (objlen > *buflen) {
+    pr_trace_msg(trace_channel, 3,
+      "failed reading OCTET_STRING object: object length (%u bytes) is greater "
+      "than remaining data (%lu bytes)", objlen, (unsigned long) (*buflen));
+
+    snmp_stacktrace_log();
+    errno = EINVAL;
+    return -1;
+  }
+
+  *asn1_datalen = objlen;
+  *asn1_data = *buf;
+  (*buf) += objlen;
+  (*buflen) -= objlen;
+
+  pr_trace_msg(trace_channel, 18, "read ASN.1 OCTET_STRING (%u bytes)",
+    objlen);
+  return 0;
+}
+
 static int asn1_write_byte(unsigned char **buf, size_t *buflen,
     unsigned char byte) {
 
@@ -1255,3 +1304,120 @@ int snmp_asn1_write_exception(pool *p, unsigned char **buf, size_t *buflen,
   pr_trace_msg(trace_channel, 18, "wrote ASN.1 value %u", asn1_ex);
   return res;
 }
+
+unsigned int snmp_asn1_get_header_len(unsigned int asn1_len, int flags) {
+  /* The type byte, plus the length bytes; see asn1_write_len(). */
+  if (!(flags & SNMP_ASN1_FL_KNOWN_LEN)) {
+    return 4;
+  }
+
+  if (asn1_len < SNMP_ASN1_LEN_LONG) {
+    return 2;
+  }
+
+  if (asn1_len <= 0xff) {
+    return 3;
+  }
+
+  return 4;
+}
+
+unsigned int snmp_asn1_get_int_len(long asn1_int) {
+  unsigned int asn1_intsz;
+  unsigned long bitmask;
+  long objval;
+
+  /* Mirrors the truncation done by snmp_asn1_write_int(). */
+  asn1_intsz = (unsigned int) sizeof(long);
+  objval = asn1_int;
+  bitmask = (unsigned long) 0x1ff << ((8 * (sizeof(long) - 1)) - 1);
+
+  while (((objval & bitmask) == 0 ||
+          (objval & bitmask) == bitmask) &&
+         asn1_intsz > 1) {
+    asn1_intsz--;
+    objval <<= 8;
+  }
+
+  return snmp_asn1_get_header_len(asn1_intsz, SNMP_ASN1_FL_KNOWN_LEN) +
+    asn1_intsz;
+}
+
+unsigned int snmp_asn1_get_uint_len(unsigned long asn1_uint) {
+  unsigned int asn1_uintsz, bitmask;
+
+  /* Mirrors the truncation done by snmp_asn1_write_uint(). */
+  asn1_uintsz = (unsigned int) sizeof(unsigned int);
+
+  bitmask = (unsigned int) 0x80 << (8 * (sizeof(unsigned int) - 1));
+  if ((asn1_uint & bitmask) != 0) {
+    asn1_uintsz++;
+  }
+
+  bitmask = (unsigned int) 0x1ff << ((8 * (sizeof(unsigned int) - 1)) - 1);
+  while ((asn1_uint & bitmask) == 0 &&
+         asn1_uintsz > 1) {
+    asn1_uintsz--;
+    asn1_uint <<= 8;
+  }
+
+  return snmp_asn1_get_header_len(asn1_uintsz, SNMP_ASN1_FL_KNOWN_LEN) +
+    asn1_uintsz;
+}
+
+unsigned int snmp_asn1_get_null_len(void) {
+  return snmp_asn1_get_header_len(0, SNMP_ASN1_FL_KNOWN_LEN);
+}
+
+unsigned int snmp_asn1_get_oid_len(oid_t *asn1_oid, unsigned int asn1_oidlen) {
+  register unsigned int i;
+  unsigned int asn1_len = 0;
+  oid_t sub_id;
+
+  /* Mirrors the sub-identifier encoding done by snmp_asn1_write_oid(),
+   * including the combining of the first two sub-identifiers.
+   */
+  if (asn1_oidlen == 0) {
+    sub_id = 0;
+
+  } else if (asn1_oidlen == 1) {
+    sub_id = (asn1_oid[0] * 40);
+    asn1_oidlen = 2;
+
+  } else {
+    sub_id = ((asn1_oid[0] * 40) + asn1_oid[1]);
+  }
+
+  for (i = 1;;) {
+    if (sub_id < (unsigned int) 0x80) {
+      asn1_len += 1;
+
+    } else if (sub_id < (unsigned int) 0x4000) {
+      asn1_len += 2;
+
+    } else if (sub_id < (unsigned int) 0x200000) {
+      asn1_len += 3;
+
+    } else if (sub_id < (unsigned int) 0x10000000) {
+      asn1_len += 4;
+
+    } else {
+      asn1_len += 5;
+    }
+
+    i++;
+
+    if (i >= asn1_oidlen) {
+      break;
+    }
+
+    sub_id = asn1_oid[i];
+  }
+
+  return snmp_asn1_get_header_len(asn1_len, SNMP_ASN1_FL_KNOWN_LEN) + asn1_len;
+}
+
+unsigned int snmp_asn1_get_string_len(unsigned int asn1_strlen) {
+  return snmp_asn1_get_header_len(asn1_strlen, SNMP_ASN1_FL_KNOWN_LEN) +
+    asn1_strlen;
+}
@@ -88,6 +88,10 @@ int snmp_asn1_read_oid(pool *p, unsigned char **buf, size_t *buflen,
 int snmp_asn1_read_string(pool *p, unsigned char **buf, size_t *buflen,
   unsigned char *asn1_type, char **asn_1str, unsigned int *asn1_strlen);
 
+int snmp_asn1_read_octets(pool *p, unsigned char **buf, size_t *buflen,
+  unsigned char *asn1_type, unsigned char **asn1_data,
+  unsigned int *asn1_datalen);
+
 /* XXX Need an snmp_asn1_read_sequence() function? */
 
 int snmp_asn1_write_header(pool *p, unsigned char **buf, size_t *buflen,
@@ -120,4 +124,16 @@ int snmp_asn1_write_exception(pool *p, unsigned char **buf, size_t *buflen,
 
 /* XXX Need an snmp_asn1_write_sequence() function? */
 
+/* Return the number of bytes which the matching snmp_asn1_write_*() function
+ * would write for the given value, including the type and length bytes.
+ * These do not touch any buffer, and are used for tracking the encoded size
+ * of a message as it is built.
+ */
+unsigned int snmp_asn1_get_header_len(unsigned int asn1_len, int flags);
+unsigned int snmp_asn1_get_int_len(long asn1_int);
+unsigned int snmp_asn1_get_uint_len(unsigned long asn1_uint);
+unsigned int snmp_asn1_get_null_len(void);
+unsigned int snmp_asn1_get_oid_len(oid_t *asn1_oid, unsigned int asn1_oidlen);
+unsigned int snmp_asn1_get_string_len(unsigned int asn1_strlen);
+
 #endif
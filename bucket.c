@@ -0,0 +1,147 @@
+/*
+ * ProFTPD - mod_snmp per-manager rate limiting
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+#include "bucket.h"
+#include "hash.h"
+
+/* Each source address gets its own token bucket, so that one manager which
+ * floods the agent (e.g. walking the whole MIB in a tight loop) only has its
+ * own requests dropped.  The buckets live in a small direct-mapped table; a
+ * source which takes over another source's slot inherits that bucket's
+ * tokens, rather than a full bucket, so that a manager cannot escape its
+ * limit by cycling through source addresses which collide.  Tokens are
+ * counted in millionths, so that the refill can be done in integer
+ * arithmetic, to the microsecond.
+ */
+
+#define SNMP_BUCKET_TOKEN		1000000ULL
+
+struct snmp_bucket {
+  int in_use;
+  struct snmp_addr_key key;
+
+  unsigned long long tokens;
+  struct timeval last_tv;
+};
+
+static struct snmp_bucket bucket_table[SNMP_BUCKET_TABLE_SIZE];
+
+static unsigned int bucket_rate = 0;
+static unsigned long long bucket_max_tokens = 0;
+
+static const char *trace_channel = "snmp.bucket";
+
+int snmp_bucket_set_rate(unsigned int rate, unsigned int burst) {
+  if (rate > 0 &&
+      burst == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  bucket_rate = rate;
+  bucket_max_tokens = burst * SNMP_BUCKET_TOKEN;
+  memset(bucket_table, 0, sizeof(bucket_table));
+
+  return 0;
+}
+
+/* Returns the address key, and its slot in the table. */
+static int bucket_get_slot(const pr_netaddr_t *addr,
+    struct snmp_addr_key *key) {
+  uint32_t h;
+
+  if (snmp_addr_key_init(key, addr, &h) < 0) {
+    return -1;
+  }
+
+  return (int) (h & (SNMP_BUCKET_TABLE_SIZE - 1));
+}
+
+int snmp_bucket_take(const pr_netaddr_t *addr) {
+  struct snmp_bucket *bucket;
+  struct timeval now_tv;
+  struct snmp_addr_key key;
+  int slot;
+
+  if (bucket_rate == 0) {
+    return TRUE;
+  }
+
+  slot = bucket_get_slot(addr, &key);
+  if (slot < 0) {
+    return TRUE;
+  }
+
+  gettimeofday(&now_tv, NULL);
+
+  bucket = &(bucket_table[slot]);
+  if (bucket->in_use == FALSE) {
+    bucket->in_use = TRUE;
+    bucket->key = key;
+    bucket->tokens = bucket_max_tokens;
+
+  } else {
+    if (now_tv.tv_sec > bucket->last_tv.tv_sec ||
+        (now_tv.tv_sec == bucket->last_tv.tv_sec &&
+         now_tv.tv_usec > bucket->last_tv.tv_usec)) {
+      unsigned long long elapsed_usecs;
+
+      /* Cap the elapsed time, so that the refill cannot overflow. */
+      if (now_tv.tv_sec - bucket->last_tv.tv_sec > 86400) {
+        elapsed_usecs = 86400ULL * 1000000ULL;
+
+      } else {
+        elapsed_usecs = ((now_tv.tv_sec - bucket->last_tv.tv_sec) *
+          1000000ULL) + now_tv.tv_usec - bucket->last_tv.tv_usec;
+      }
+
+      bucket->tokens += elapsed_usecs * bucket_rate;
+      if (bucket->tokens > bucket_max_tokens) {
+        bucket->tokens = bucket_max_tokens;
+      }
+    }
+
+    if (snmp_addr_key_match(&(bucket->key), &key) == FALSE) {
+      /* The newcomer inherits the (refilled) tokens left in the bucket. */
+      pr_trace_msg(trace_channel, 17,
+        "replacing rate limit bucket in slot %d", slot);
+      bucket->key = key;
+    }
+  }
+
+  /* If the clock went backwards, the bucket is not refilled. */
+  bucket->last_tv = now_tv;
+
+  if (bucket->tokens < SNMP_BUCKET_TOKEN) {
+    pr_trace_msg(trace_channel, 15,
+      "%s has exceeded its rate of %u requests/sec",
+      pr_netaddr_get_ipstr(addr), bucket_rate);
+    return FALSE;
+  }
+
+  bucket->tokens -= SNMP_BUCKET_TOKEN;
+  return TRUE;
+}
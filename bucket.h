@@ -0,0 +1,45 @@
+/*
+ * ProFTPD - mod_snmp per-manager rate limiting
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_BUCKET_H
+#define MOD_SNMP_BUCKET_H
+
+/* Number of source addresses which are tracked; a power of 2. */
+#define SNMP_BUCKET_TABLE_SIZE		256
+
+/* Sets the rate (requests per second) at which each source address's bucket
+ * refills, and the number of requests it can hold, i.e. the largest burst
+ * allowed.  A rate of zero disables rate limiting.  Discards all buckets.
+ */
+int snmp_bucket_set_rate(unsigned int rate, unsigned int burst);
+
+/* Takes a token from the bucket of the given source address.  Returns TRUE
+ * if the request may be handled, FALSE if the source has exceeded its rate.
+ */
+int snmp_bucket_take(const pr_netaddr_t *addr);
+
+#endif
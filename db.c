@@ -24,6 +24,11 @@
 
 #include "mod_snmp.h"
 #include "db.h"
+#include "gauge.h"
+#include "hash.h"
+#include "mib.h"
+#include "registry.h"
+#include "smi.h"
 #include "uptime.h"
 
 /* On some platforms, this may not be defined.  On AIX, for example, this
@@ -36,6 +41,14 @@
 
 #define SNMP_MAX_LOCK_ATTEMPTS		10
 
+/* Each table starts on its own cache line. */
+#define SNMP_DB_CACHE_LINESZ		64
+#define SNMP_DB_ALIGN(sz) \
+  (((sz) + SNMP_DB_CACHE_LINESZ - 1) & ~((size_t) SNMP_DB_CACHE_LINESZ - 1))
+
+/* The file, in the SNMPTables directory, used for the byte-range locks. */
+#define SNMP_DB_LOCK_FILE		"tables.lck"
+
 /* Note: Not all database IDs are in this list; only those databases which
  * have on-disk tables are here.  Thus the NOTIFY and CONN database IDs are
  * explicitly NOT here, as they are ephemeral/synthetic databases anyway.
@@ -50,6 +63,10 @@ int snmp_table_ids[] = {
   SNMP_DB_ID_SFTP,
   SNMP_DB_ID_SCP,
   SNMP_DB_ID_BAN,
+  SNMP_DB_ID_HIST,
+  SNMP_DB_ID_CMD,
+  SNMP_DB_ID_RATE,
+  SNMP_DB_ID_EXT,
 
   /* XXX Not supported just yet */
 #if 0
@@ -61,7 +78,47 @@ int snmp_table_ids[] = {
   SNMP_DB_ID_UNKNOWN
 };
 
+/* The order of the tables within the shared region.  Counters which are
+ * updated together are kept together: the daemon and ftp tables (updated on
+ * every connection and login) first, then the other protocols' tables, then
+ * the histograms and command statistics (updated on every transfer and
+ * command).  The snmp and rate tables, which only the agent process updates,
+ * come last, so that the agent's writes do not share cache lines with the
+ * sessions' writes.
+ */
+static int snmp_db_layout[] = {
+  SNMP_DB_ID_DAEMON,
+  SNMP_DB_ID_FTP,
+  SNMP_DB_ID_TIMEOUTS,
+  SNMP_DB_ID_TLS,
+  SNMP_DB_ID_SSH,
+  SNMP_DB_ID_SFTP,
+  SNMP_DB_ID_SCP,
+  SNMP_DB_ID_BAN,
+  SNMP_DB_ID_HIST,
+  SNMP_DB_ID_CMD,
+  SNMP_DB_ID_EXT,
+  SNMP_DB_ID_SNMP,
+  SNMP_DB_ID_RATE,
+
+  SNMP_DB_ID_UNKNOWN
+};
+
 static const char *snmp_db_root = NULL;
+static int snmp_db_persistent = FALSE;
+
+/* All of the tables are mapped as a single shared region, and locked using
+ * a single file descriptor, which is all that forked sessions inherit.
+ * Persistent tables are mapped from their own files instead, but are still
+ * locked as if they were in the region.
+ */
+static void *snmp_db_region = NULL;
+static size_t snmp_db_regionsz = 0;
+static int snmp_db_lockfd = -1;
+static unsigned int snmp_db_nopen = 0;
+
+/* Whether values are currently read from the table snapshots. */
+static int snmp_db_use_snapshot = FALSE;
 
 static const char *trace_channel = "snmp.db";
 
@@ -190,6 +247,26 @@ static struct snmp_field_info snmp_fields[] = {
     sizeof(uint32_t), "SNMP_F_PKTS_AUTH_ERR_TOTAL" },
   { SNMP_DB_SNMP_F_PKTS_DROPPED_TOTAL, SNMP_DB_ID_SNMP, 16,
     sizeof(uint32_t), "SNMP_F_PKTS_DROPPED_TOTAL" },
+  { SNMP_DB_SNMP_F_ACL_CACHE_HITS_TOTAL, SNMP_DB_ID_SNMP, 20,
+    sizeof(uint32_t), "SNMP_F_ACL_CACHE_HITS_TOTAL" },
+  { SNMP_DB_SNMP_F_ACL_CACHE_MISSES_TOTAL, SNMP_DB_ID_SNMP, 24,
+    sizeof(uint32_t), "SNMP_F_ACL_CACHE_MISSES_TOTAL" },
+  { SNMP_DB_SNMP_F_PKTS_DROPPED_RATE_LIMIT_TOTAL, SNMP_DB_ID_SNMP, 28,
+    sizeof(uint32_t), "SNMP_F_PKTS_DROPPED_RATE_LIMIT_TOTAL" },
+  { SNMP_DB_SNMP_F_PKTS_DROPPED_VERSION_TOTAL, SNMP_DB_ID_SNMP, 32,
+    sizeof(uint32_t), "SNMP_F_PKTS_DROPPED_VERSION_TOTAL" },
+  { SNMP_DB_SNMP_F_PKTS_DROPPED_SEND_TOTAL, SNMP_DB_ID_SNMP, 36,
+    sizeof(uint32_t), "SNMP_F_PKTS_DROPPED_SEND_TOTAL" },
+  { SNMP_DB_SNMP_F_PKTS_DROPPED_STALE_TOTAL, SNMP_DB_ID_SNMP, 40,
+    sizeof(uint32_t), "SNMP_F_PKTS_DROPPED_STALE_TOTAL" },
+  { SNMP_DB_SNMP_F_RXQ_BYTES, SNMP_DB_ID_SNMP, 44,
+    sizeof(uint32_t), "SNMP_F_RXQ_BYTES" },
+  { SNMP_DB_SNMP_F_RXQ_DROPPED_TOTAL, SNMP_DB_ID_SNMP, 48,
+    sizeof(uint32_t), "SNMP_F_RXQ_DROPPED_TOTAL" },
+  { SNMP_DB_SNMP_F_PKTS_REPLAYED_TOTAL, SNMP_DB_ID_SNMP, 52,
+    sizeof(uint32_t), "SNMP_F_PKTS_REPLAYED_TOTAL" },
+  { SNMP_DB_SNMP_F_PKTS_DROPPED_TOO_BIG_TOTAL, SNMP_DB_ID_SNMP, 56,
+    sizeof(uint32_t), "SNMP_F_PKTS_DROPPED_TOO_BIG_TOTAL" },
 
   /* ftps.tlsSessions fields */
   { SNMP_DB_FTPS_SESS_F_SESS_COUNT, SNMP_DB_ID_TLS, 0,
@@ -362,32 +439,71 @@ static struct snmp_field_info snmp_fields[] = {
     sizeof(uint32_t), "BAN_BANS_F_CLASS_BAN_COUNT" },
   { SNMP_DB_BAN_BANS_F_CLASS_BAN_TOTAL, SNMP_DB_ID_BAN, 44,
     sizeof(uint32_t), "BAN_BANS_F_CLASS_BAN_TOTAL" },
+
+  /* rate fields */
+  { SNMP_DB_RATE_F_CONN_RATE_1MIN, SNMP_DB_ID_RATE, 0,
+    sizeof(uint32_t), "RATE_F_CONN_RATE_1MIN" },
+  { SNMP_DB_RATE_F_CONN_RATE_5MIN, SNMP_DB_ID_RATE, 4,
+    sizeof(uint32_t), "RATE_F_CONN_RATE_5MIN" },
+  { SNMP_DB_RATE_F_CONN_RATE_15MIN, SNMP_DB_ID_RATE, 8,
+    sizeof(uint32_t), "RATE_F_CONN_RATE_15MIN" },
+  { SNMP_DB_RATE_F_FTP_LOGIN_RATE_1MIN, SNMP_DB_ID_RATE, 12,
+    sizeof(uint32_t), "RATE_F_FTP_LOGIN_RATE_1MIN" },
+  { SNMP_DB_RATE_F_FTP_LOGIN_RATE_5MIN, SNMP_DB_ID_RATE, 16,
+    sizeof(uint32_t), "RATE_F_FTP_LOGIN_RATE_5MIN" },
+  { SNMP_DB_RATE_F_FTP_LOGIN_RATE_15MIN, SNMP_DB_ID_RATE, 20,
+    sizeof(uint32_t), "RATE_F_FTP_LOGIN_RATE_15MIN" },
+  { SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_1MIN, SNMP_DB_ID_RATE, 24,
+    sizeof(uint32_t), "RATE_F_FTP_KB_UPLOAD_RATE_1MIN" },
+  { SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_5MIN, SNMP_DB_ID_RATE, 28,
+    sizeof(uint32_t), "RATE_F_FTP_KB_UPLOAD_RATE_5MIN" },
+  { SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_15MIN, SNMP_DB_ID_RATE, 32,
+    sizeof(uint32_t), "RATE_F_FTP_KB_UPLOAD_RATE_15MIN" },
+  { SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_1MIN, SNMP_DB_ID_RATE, 36,
+    sizeof(uint32_t), "RATE_F_FTP_KB_DOWNLOAD_RATE_1MIN" },
+  { SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_5MIN, SNMP_DB_ID_RATE, 40,
+    sizeof(uint32_t), "RATE_F_FTP_KB_DOWNLOAD_RATE_5MIN" },
+  { SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_15MIN, SNMP_DB_ID_RATE, 44,
+    sizeof(uint32_t), "RATE_F_FTP_KB_DOWNLOAD_RATE_15MIN" },
   
   { 0, -1, 0, 0 }
 };
 
 struct snmp_db_info {
   int db_id;
-  int db_fd;
   const char *db_name;
   char *db_path;
   void *db_data;
   size_t db_datasz;
+
+  /* For persistent tables, the size of the header preceding the data in the
+   * mapping (zero otherwise), and whether the data were restored.
+   */
+  size_t db_hdrsz;
+  int db_restored;
+
+  /* A private copy of the data, for reading a consistent snapshot. */
+  void *db_snapshot;
+
+  /* Where the table's data start within the shared region; the field locks
+   * are byte ranges of the lock file, at these same offsets.
+   */
+  off_t db_offset;
 };
 
 static struct snmp_db_info snmp_dbs[] = {
-  { SNMP_DB_ID_UNKNOWN, -1, NULL, NULL, 0 },
+  { SNMP_DB_ID_UNKNOWN, NULL, NULL, 0 },
 
   /* This "table" is synthetic; nothing to be persisted to disk. */
-  { SNMP_DB_ID_NOTIFY, -1, "notify.dat", NULL, NULL, 0 },
+  { SNMP_DB_ID_NOTIFY, "notify.dat", NULL, NULL, 0 },
 
   /* This "table" is comprised purely of values in memory; nothing to be
    * persisted to disk.
    */
-  { SNMP_DB_ID_CONN, -1, "conn.dat", NULL, NULL, 0 },
+  { SNMP_DB_ID_CONN, "conn.dat", NULL, NULL, 0 },
 
   /* Eight numeric fields only in this table: 8 x 4 bytes = 32 bytes */
-  { SNMP_DB_ID_DAEMON, -1, "daemon.dat", NULL, NULL, 32 },
+  { SNMP_DB_ID_DAEMON, "daemon.dat", NULL, NULL, 32 },
 
   /* The size of the timeouts table is calculated as:
    *
@@ -395,7 +511,7 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 16 bytes.
    */
-  { SNMP_DB_ID_TIMEOUTS, -1, "timeouts.dat", NULL, NULL, 16 },
+  { SNMP_DB_ID_TIMEOUTS, "timeouts.dat", NULL, NULL, 16 },
  
   /* The size of the ftp table is calculated as:
    *
@@ -405,13 +521,13 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 84 bytes.
    */
-  { SNMP_DB_ID_FTP, -1, "ftp.dat", NULL, NULL, 84 },
+  { SNMP_DB_ID_FTP, "ftp.dat", NULL, NULL, 84 },
 
   /* The size of the snmp table is calculated as:
    *
-   *  4 fields                x 4 bytes = 20 bytes
+   *  14 fields               x 4 bytes = 56 bytes
    */
-  { SNMP_DB_ID_SNMP, -1, "snmp.dat", NULL, NULL, 20 },
+  { SNMP_DB_ID_SNMP, "snmp.dat", NULL, NULL, 60 },
 
   /* The size of the ftps table is calculated as:
    *
@@ -421,7 +537,7 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 100 bytes.
    */
-  { SNMP_DB_ID_TLS, -1, "tls.dat", NULL, NULL, 100 },
+  { SNMP_DB_ID_TLS, "tls.dat", NULL, NULL, 100 },
 
   /* The size of the ssh table is calculated as:
    *
@@ -430,7 +546,7 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 40 bytes.
    */
-  { SNMP_DB_ID_SSH, -1, "ssh.dat", NULL, NULL, 44 },
+  { SNMP_DB_ID_SSH, "ssh.dat", NULL, NULL, 44 },
 
   /* The size of the sftp table is calculated as:
    *
@@ -439,7 +555,7 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 68 bytes.
    */
-  { SNMP_DB_ID_SFTP, -1, "sftp.dat", NULL, NULL, 68 },
+  { SNMP_DB_ID_SFTP, "sftp.dat", NULL, NULL, 68 },
 
   /* The size of the scp table is calculated as:
    *
@@ -448,7 +564,7 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 40 bytes.
    */
-  { SNMP_DB_ID_SCP, -1, "scp.dat", NULL, NULL, 40 },
+  { SNMP_DB_ID_SCP, "scp.dat", NULL, NULL, 40 },
 
   /* The size of the ban table is calculated as:
    *
@@ -456,17 +572,53 @@ static struct snmp_db_info snmp_dbs[] = {
    *
    * for a total of 48 bytes.
    */
-  { SNMP_DB_ID_BAN, -1, "ban.dat", NULL, NULL, 48 },
+  { SNMP_DB_ID_BAN, "ban.dat", NULL, NULL, 48 },
+
+  /* The size of the histograms table is calculated as:
+   *
+   *  4 protocols x 3 transfer metrics x 50 buckets x 4 bytes = 2400 bytes
+   *
+   * for a total of 2400 bytes.
+   */
+  { SNMP_DB_ID_HIST, "hist.dat", NULL, NULL,
+    SNMP_DB_HIST_NPROTOS * SNMP_DB_HIST_NXFER_METRICS *
+      SNMP_DB_HIST_NBUCKETS * sizeof(uint32_t) },
+
+  /* The size of the command statistics table is calculated as:
+   *
+   *  56 commands x (2 counters + 50 buckets) x 4 bytes = 11648 bytes
+   *
+   * for a total of 11648 bytes.
+   */
+  { SNMP_DB_ID_CMD, "cmd.dat", NULL, NULL,
+    SNMP_DB_CMD_NCMDS * SNMP_DB_CMD_NSLOTS * sizeof(uint32_t) },
+
+  /* The size of the rates table is calculated as:
+   *
+   *  12 gauges x 4 bytes = 48 bytes
+   *
+   * for a total of 48 bytes.
+   */
+  { SNMP_DB_ID_RATE, "rate.dat", NULL, NULL, 48 },
+
+  /* The size of the registered metrics table is calculated as:
+   *
+   *  1024 slots x 4 bytes = 4096 bytes
+   *
+   * for a total of 4096 bytes.
+   */
+  { SNMP_DB_ID_EXT, "ext.dat", NULL, NULL,
+    SNMP_DB_EXT_NSLOTS * sizeof(uint32_t) },
 
 #if 0
-  { SNMP_DB_ID_SQL, -1, "sql.dat", NULL, NULL, 0 },
+  { SNMP_DB_ID_SQL, "sql.dat", NULL, NULL, 0 },
 
-  { SNMP_DB_ID_QUOTA, -1, "quota.dat", NULL, NULL, 0 },
+  { SNMP_DB_ID_QUOTA, "quota.dat", NULL, NULL, 0 },
 
-  { SNMP_DB_ID_GEOIP, -1, "geoip.dat", NULL, NULL, 0 }
+  { SNMP_DB_ID_GEOIP, "geoip.dat", NULL, NULL, 0 }
 #endif
 
-  { -1, -1, NULL, NULL, 0 },
+  { -1, NULL, NULL, 0 },
 };
 
 /* For the given field, provision the corresponding lock start and len
@@ -483,6 +635,49 @@ static int get_field_range(unsigned int field, off_t *field_start,
     return 0;
   }
 
+  /* The histogram bucket fields are not listed in snmp_fields; their
+   * offsets are computed from the field ID.
+   */
+  if (field >= SNMP_DB_HIST_F_XFER_BUCKET_BASE &&
+      field <= SNMP_DB_HIST_F_XFER_BUCKET_MAX) {
+    if (field_start != NULL) {
+      *field_start = (field - SNMP_DB_HIST_F_XFER_BUCKET_BASE) *
+        sizeof(uint32_t);
+    }
+
+    if (field_len != NULL) {
+      *field_len = sizeof(uint32_t);
+    }
+
+    return 0;
+  }
+
+  if (field >= SNMP_DB_CMD_F_BASE &&
+      field <= SNMP_DB_CMD_F_MAX) {
+    if (field_start != NULL) {
+      *field_start = (field - SNMP_DB_CMD_F_BASE) * sizeof(uint32_t);
+    }
+
+    if (field_len != NULL) {
+      *field_len = sizeof(uint32_t);
+    }
+
+    return 0;
+  }
+
+  if (field >= SNMP_DB_EXT_F_BASE &&
+      field <= SNMP_DB_EXT_F_MAX) {
+    if (field_start != NULL) {
+      *field_start = (field - SNMP_DB_EXT_F_BASE) * sizeof(uint32_t);
+    }
+
+    if (field_len != NULL) {
+      *field_len = sizeof(uint32_t);
+    }
+
+    return 0;
+  }
+
   for (i = 0; snmp_fields[i].db_id > 0; i++) {
     if (snmp_fields[i].field == field) {
       field_idx = i;
@@ -533,6 +728,35 @@ int snmp_db_get_field_db_id(unsigned int field) {
   register unsigned int i;
   int db_id = -1;
 
+  if (field >= SNMP_DB_HIST_F_XFER_BUCKET_BASE &&
+      field <= SNMP_DB_HIST_F_XFER_BUCKET_MAX) {
+    return SNMP_DB_ID_HIST;
+  }
+
+  if (field >= SNMP_DB_HIST_F_UPPER_BOUND_BASE &&
+      field <= SNMP_DB_HIST_F_UPPER_BOUND_MAX) {
+    return SNMP_DB_ID_HIST;
+  }
+
+  if ((field >= SNMP_DB_CMD_F_BASE &&
+       field <= SNMP_DB_CMD_F_MAX) ||
+      (field >= SNMP_DB_CMD_F_NAME_BASE &&
+       field <= SNMP_DB_CMD_F_NAME_MAX)) {
+    return SNMP_DB_ID_CMD;
+  }
+
+  if (field >= SNMP_DB_EXT_F_BASE &&
+      field <= SNMP_DB_EXT_F_MAX) {
+    return SNMP_DB_ID_EXT;
+  }
+
+  if (field >= SNMP_DB_COUNTER_F_NAME_BASE &&
+      field <= SNMP_DB_COUNTER_F_MAX) {
+    /* Counter table fields belong to the table of the mirrored field. */
+    return snmp_db_get_field_db_id(
+      (field - SNMP_DB_COUNTER_F_NAME_BASE) % SNMP_DB_COUNTER_NFIELDS);
+  }
+
   for (i = 0; snmp_fields[i].db_id > 0; i++) {
     if (snmp_fields[i].field == field) {
       db_id = snmp_fields[i].db_id;
@@ -553,11 +777,43 @@ const char *snmp_db_get_fieldstr(pool *p, unsigned int field) {
   int db_id = -1;
   const char *db_name = NULL, *field_name = NULL;
 
-  for (i = 0; snmp_fields[i].db_id > 0; i++) {
-    if (snmp_fields[i].field == field) {
-      db_id = snmp_fields[i].db_id;
-      field_name = snmp_fields[i].field_name;
-      break;
+  if (field >= SNMP_DB_HIST_F_XFER_BUCKET_BASE &&
+      field <= SNMP_DB_HIST_F_XFER_BUCKET_MAX) {
+    db_id = SNMP_DB_ID_HIST;
+    field_name = "HIST_F_XFER_BUCKET";
+
+  } else if (field >= SNMP_DB_HIST_F_UPPER_BOUND_BASE &&
+             field <= SNMP_DB_HIST_F_UPPER_BOUND_MAX) {
+    db_id = SNMP_DB_ID_HIST;
+    field_name = "HIST_F_UPPER_BOUND";
+
+  } else if (field >= SNMP_DB_CMD_F_BASE &&
+             field <= SNMP_DB_CMD_F_MAX) {
+    db_id = SNMP_DB_ID_CMD;
+    field_name = "CMD_F_STATS";
+
+  } else if (field >= SNMP_DB_CMD_F_NAME_BASE &&
+             field <= SNMP_DB_CMD_F_NAME_MAX) {
+    db_id = SNMP_DB_ID_CMD;
+    field_name = "CMD_F_NAME";
+
+  } else if (field >= SNMP_DB_COUNTER_F_NAME_BASE &&
+             field <= SNMP_DB_COUNTER_F_MAX) {
+    db_id = snmp_db_get_field_db_id(field);
+    field_name = "COUNTER_F_ROW";
+
+  } else if (field >= SNMP_DB_EXT_F_BASE &&
+             field <= SNMP_DB_EXT_F_MAX) {
+    db_id = SNMP_DB_ID_EXT;
+    field_name = "EXT_F_SLOT";
+
+  } else {
+    for (i = 0; snmp_fields[i].db_id > 0; i++) {
+      if (snmp_fields[i].field == field) {
+        db_id = snmp_fields[i].db_id;
+        field_name = snmp_fields[i].field_name;
+        break;
+      }
     }
   }
 
@@ -587,10 +843,11 @@ int snmp_db_rlock(unsigned int field) {
     return -1;
   }
 
-  db_fd = snmp_dbs[db_id].db_fd;
+  db_fd = snmp_db_lockfd;
   if (get_field_range(field, &(lock.l_start), &field_len) < 0) {
     return -1;
   }
+  lock.l_start += snmp_dbs[db_id].db_offset;
   lock.l_len = (off_t) field_len;
 
   pr_trace_msg(trace_channel, 9,
@@ -607,7 +864,7 @@ int snmp_db_rlock(unsigned int field) {
       continue;
     }
 
-    pr_trace_msg(trace_channel, 3, "read-lock of table fd %d failed: %s",
+    pr_trace_msg(trace_channel, 3, "read-lock of lock fd %d failed: %s",
       db_fd, strerror(xerrno));
     if (xerrno == EACCES) {
       struct flock locker;
@@ -615,7 +872,7 @@ int snmp_db_rlock(unsigned int field) {
       /* Get the PID of the process blocking this lock. */
       if (fcntl(db_fd, F_GETLK, &locker) == 0) {
         pr_trace_msg(trace_channel, 3, "process ID %lu has blocking %s lock on "
-          "table fd %d, start %lu len %lu", (unsigned long) locker.l_pid,
+          "lock fd %d, start %lu len %lu", (unsigned long) locker.l_pid,
           get_lock_type(&locker), db_fd, (unsigned long) lock.l_start,
           (unsigned long) lock.l_len);
       }
@@ -636,12 +893,12 @@ int snmp_db_rlock(unsigned int field) {
 
         errno = 0;
         pr_trace_msg(trace_channel, 9,
-          "attempt #%u to read-lock table fd %d", nattempts, db_fd);
+          "attempt #%u to read-lock lock fd %d", nattempts, db_fd);
         continue;
       }
 
       pr_trace_msg(trace_channel, 3,
-        "unable to acquire read-lock on table fd %d: %s", db_fd,
+        "unable to acquire read-lock on lock fd %d: %s", db_fd,
         strerror(xerrno));
     }
 
@@ -650,7 +907,7 @@ int snmp_db_rlock(unsigned int field) {
   }
 
   pr_trace_msg(trace_channel, 9,
-    "read-lock of field %u table fd %d (start %lu len %lu) successful",
+    "read-lock of field %u lock fd %d (start %lu len %lu) successful",
     field, db_fd, (unsigned long) lock.l_start, (unsigned long) lock.l_len);
   return 0;
 }
@@ -669,10 +926,11 @@ int snmp_db_wlock(unsigned int field) {
     return -1;
   }
 
-  db_fd = snmp_dbs[db_id].db_fd;
+  db_fd = snmp_db_lockfd;
   if (get_field_range(field, &(lock.l_start), &field_len) < 0) {
     return -1;
   }
+  lock.l_start += snmp_dbs[db_id].db_offset;
   lock.l_len = (off_t) field_len;
 
   pr_trace_msg(trace_channel, 9,
@@ -689,7 +947,7 @@ int snmp_db_wlock(unsigned int field) {
       continue;
     }
 
-    pr_trace_msg(trace_channel, 3, "write-lock of table fd %d failed: %s",
+    pr_trace_msg(trace_channel, 3, "write-lock of lock fd %d failed: %s",
       db_fd, strerror(xerrno));
     if (xerrno == EACCES) {
       struct flock locker;
@@ -697,7 +955,7 @@ int snmp_db_wlock(unsigned int field) {
       /* Get the PID of the process blocking this lock. */
       if (fcntl(db_fd, F_GETLK, &locker) == 0) {
         pr_trace_msg(trace_channel, 3, "process ID %lu has blocking %s lock on "
-          "table fd %d, start %lu len %lu", (unsigned long) locker.l_pid,
+          "lock fd %d, start %lu len %lu", (unsigned long) locker.l_pid,
           get_lock_type(&locker), db_fd, (unsigned long) lock.l_start,
           (unsigned long) lock.l_len);
       }
@@ -718,12 +976,12 @@ int snmp_db_wlock(unsigned int field) {
 
         errno = 0;
         pr_trace_msg(trace_channel, 9,
-          "attempt #%u to write-lock table fd %d", nattempts, db_fd);
+          "attempt #%u to write-lock lock fd %d", nattempts, db_fd);
         continue;
       }
 
       pr_trace_msg(trace_channel, 3,
-        "unable to acquire write-lock on table fd %d: %s", db_fd,
+        "unable to acquire write-lock on lock fd %d: %s", db_fd,
         strerror(xerrno));
     }
 
@@ -732,7 +990,7 @@ int snmp_db_wlock(unsigned int field) {
   }
 
   pr_trace_msg(trace_channel, 9,
-    "write-lock of field %u table fd %d (start %lu len %lu) successful",
+    "write-lock of field %u lock fd %d (start %lu len %lu) successful",
     field, db_fd, (unsigned long) lock.l_start, (unsigned long) lock.l_len);
   return 0;
 }
@@ -751,10 +1009,11 @@ int snmp_db_unlock(unsigned int field) {
     return -1;
   }
 
-  db_fd = snmp_dbs[db_id].db_fd;
+  db_fd = snmp_db_lockfd;
   if (get_field_range(field, &(lock.l_start), &field_len) < 0) {
     return -1;
   }
+  lock.l_start += snmp_dbs[db_id].db_offset;
   lock.l_len = (off_t) field_len;
 
   pr_trace_msg(trace_channel, 9,
@@ -770,7 +1029,7 @@ int snmp_db_unlock(unsigned int field) {
       continue;
     }
 
-    pr_trace_msg(trace_channel, 3, "unlock of table fd %d failed: %s",
+    pr_trace_msg(trace_channel, 3, "unlock of lock fd %d failed: %s",
       db_fd, strerror(xerrno));
     if (xerrno == EACCES) {
       struct flock locker;
@@ -778,7 +1037,7 @@ int snmp_db_unlock(unsigned int field) {
       /* Get the PID of the process blocking this lock. */
       if (fcntl(db_fd, F_GETLK, &locker) == 0) {
         pr_trace_msg(trace_channel, 3, "process ID %lu has blocking %s lock on "
-          "table fd %d, start %lu len %lu", (unsigned long) locker.l_pid,
+          "lock fd %d, start %lu len %lu", (unsigned long) locker.l_pid,
           get_lock_type(&locker), db_fd, (unsigned long) lock.l_start,
           (unsigned long) lock.l_len);
       }
@@ -799,12 +1058,12 @@ int snmp_db_unlock(unsigned int field) {
 
         errno = 0;
         pr_trace_msg(trace_channel, 9,
-          "attempt #%u to unlock table fd %d", nattempts, db_fd);
+          "attempt #%u to unlock lock fd %d", nattempts, db_fd);
         continue;
       }
 
       pr_trace_msg(trace_channel, 3,
-        "unable to acquire unlock on table fd %d: %s", db_fd,
+        "unable to acquire unlock on lock fd %d: %s", db_fd,
         strerror(xerrno));
     }
 
@@ -813,189 +1072,768 @@ int snmp_db_unlock(unsigned int field) {
   }
 
   pr_trace_msg(trace_channel, 9,
-    "unlock of field %u table fd %d (start %lu len %lu) successful",
+    "unlock of field %u lock fd %d (start %lu len %lu) successful",
     field, db_fd, (unsigned long) lock.l_start, (unsigned long) lock.l_len);
   return 0;
 }
 
-int snmp_db_open(pool *p, int db_id) {
-  int db_fd, mmap_flags, res, xerrno;
-  char *db_path;
-  size_t db_datasz;
-  void *db_data;
+/* Computes a hash of the layout of the given table, so that we do not
+ * restore a table file written with a different layout.
+ */
+static uint32_t db_get_layout_hash(int db_id) {
+  register unsigned int i;
+  uint32_t hash = SNMP_HASH_INIT, val;
 
-  if (db_id < 0) {
-    errno = EINVAL;
-    return -1;
+  val = db_id;
+  hash = snmp_hash_bytes(hash, &val, sizeof(val));
+  val = snmp_dbs[db_id].db_datasz;
+  hash = snmp_hash_bytes(hash, &val, sizeof(val));
+
+  for (i = 0; snmp_fields[i].db_id > 0; i++) {
+    if (snmp_fields[i].db_id != db_id) {
+      continue;
+    }
+
+    val = snmp_fields[i].field;
+    hash = snmp_hash_bytes(hash, &val, sizeof(val));
+    val = snmp_fields[i].field_start;
+    hash = snmp_hash_bytes(hash, &val, sizeof(val));
+    val = snmp_fields[i].field_len;
+    hash = snmp_hash_bytes(hash, &val, sizeof(val));
   }
 
-  /* First, see if the database is already opened. */
-  if (snmp_dbs[db_id].db_path != NULL) {
-    return 0;
+  /* The histogram and command tables are not described by snmp_fields; their
+   * layout depends on the bucket count, and the list of commands.
+   */
+  if (db_id == SNMP_DB_ID_HIST ||
+      db_id == SNMP_DB_ID_CMD) {
+    val = SNMP_DB_HIST_NBUCKETS;
+    hash = snmp_hash_bytes(hash, &val, sizeof(val));
   }
 
-  pr_trace_msg(trace_channel, 19,
-    "opening db ID %d (db root = %s, db name = %s)", db_id, snmp_db_root,
-    snmp_dbs[db_id].db_name);
+  if (db_id == SNMP_DB_ID_CMD) {
+    for (i = 0; i < SNMP_DB_CMD_NCMDS; i++) {
+      const char *cmd_name;
 
-  db_path = pdircat(p, snmp_db_root, snmp_dbs[db_id].db_name, NULL);
+      cmd_name = snmp_db_cmd_get_name(i);
+      hash = snmp_hash_bytes(hash, cmd_name, strlen(cmd_name) + 1);
+    }
+  }
 
-  PRIVS_ROOT
-  db_fd = open(db_path, O_RDWR|O_CREAT, 0600);
-  xerrno = errno;
-  PRIVS_RELINQUISH
+  /* The registered metrics table depends on what was registered, and in
+   * which order.
+   */
+  if (db_id == SNMP_DB_ID_EXT) {
+    val = SNMP_DB_HIST_NBUCKETS;
+    hash = snmp_hash_bytes(hash, &val, sizeof(val));
+
+    for (i = 0; i < snmp_registry_get_count(); i++) {
+      struct snmp_metric *metric;
+
+      metric = snmp_registry_get(i);
+      val = metric->slot;
+      hash = snmp_hash_bytes(hash, &val, sizeof(val));
+      val = metric->metric_type;
+      hash = snmp_hash_bytes(hash, &val, sizeof(val));
+      hash = snmp_hash_bytes(hash, metric->name, strlen(metric->name) + 1);
+    }
+  }
 
-  if (db_fd < 0) {
-    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "error opening SNMPTable '%s': %s", db_path, strerror(xerrno));
-    errno = xerrno;
-    return -1;
+  return hash;
+}
+
+/* Returns the number of entries in the field directory of the given table:
+ * one per stored field, one per transfer histogram, one per command, and one
+ * per registered metric.
+ */
+static unsigned int db_get_nfields(int db_id) {
+  register unsigned int i;
+  unsigned int nfields = 0;
+
+  for (i = 0; snmp_fields[i].db_id > 0; i++) {
+    if (snmp_fields[i].db_id == db_id &&
+        snmp_fields[i].field_len > 0) {
+      nfields++;
+    }
   }
 
-  /* Make sure the fd isn't one of the big three. */
-  res = pr_fs_get_usable_fd(db_fd);
-  if (res >= 0) {
-    db_fd = res;
+  if (db_id == SNMP_DB_ID_HIST) {
+    nfields += (SNMP_DB_HIST_NPROTOS * SNMP_DB_HIST_NXFER_METRICS);
+
+  } else if (db_id == SNMP_DB_ID_CMD) {
+    nfields += SNMP_DB_CMD_NCMDS;
+
+  } else if (db_id == SNMP_DB_ID_EXT) {
+    nfields += snmp_registry_get_count();
   }
 
-  pr_trace_msg(trace_channel, 19, "opened fd %d for SNMPTable '%s'", db_fd,
-    db_path);
+  return nfields;
+}
 
-  snmp_dbs[db_id].db_fd = db_fd;
-  snmp_dbs[db_id].db_path = db_path;
+/* The header is padded to a whole number of cache lines, so that the data,
+ * which the sessions write, do not share a cache line with the header, which
+ * is only read.
+ */
+static size_t db_get_hdrsz(int db_id) {
+  return SNMP_DB_ALIGN(SNMP_DB_HEADER_SIZE +
+    (db_get_nfields(db_id) * sizeof(struct snmp_db_field_desc)));
+}
 
-  db_datasz = snmp_dbs[db_id].db_datasz;
+static void db_set_field_desc(struct snmp_db_field_desc *desc,
+    unsigned int field, off_t field_start, size_t field_len,
+    unsigned char smi_type, unsigned char kind, const char *name) {
+  memset(desc, 0, sizeof(struct snmp_db_field_desc));
+
+  desc->field = field;
+  desc->offset = (uint32_t) field_start;
+  desc->nelts = (uint32_t) (field_len / sizeof(uint32_t));
+  desc->smi_type = smi_type;
+  desc->kind = kind;
+  sstrncpy(desc->name, name, sizeof(desc->name));
+}
 
-  /* Truncate the table first; any existing data should be deleted. */
-  if (ftruncate(db_fd, 0) < 0) {
-    xerrno = errno;
+/* Writes the field directory, describing where (and what) each value in the
+ * table is, so that other tools can read the table file without needing to
+ * know its layout.  The directory is rewritten on every open, since it
+ * describes this build of the module.
+ */
+static void db_write_field_dir(int db_id, struct snmp_db_header *hdr) {
+  register unsigned int i;
+  struct snmp_db_field_desc *desc;
+  size_t prefix_len;
 
-    pr_trace_msg(trace_channel, 1,
-      "error truncating SNMPTable '%s' to size 0: %s", db_path,
-      strerror(xerrno));
+  hdr->nfields = db_get_nfields(db_id);
+  hdr->fieldsz = sizeof(struct snmp_db_field_desc);
 
-    (void) snmp_db_close(p, db_id);
-    errno = xerrno;
-    return -1;
+  desc = (struct snmp_db_field_desc *) (((char *) hdr) + SNMP_DB_HEADER_SIZE);
+  prefix_len = strlen(SNMP_MIB_NAME_PREFIX);
+
+  for (i = 0; snmp_fields[i].db_id > 0; i++) {
+    struct snmp_mib *mib;
+    const char *name;
+    unsigned char smi_type = 0;
+
+    if (snmp_fields[i].db_id != db_id ||
+        snmp_fields[i].field_len == 0) {
+      continue;
+    }
+
+    /* Prefer the MIB name, e.g. "daemon.connectionTotal", over the field
+     * name, e.g. "DAEMON_F_CONN_TOTAL".
+     */
+    name = snmp_fields[i].field_name;
+
+    mib = snmp_mib_get_by_field(snmp_fields[i].field);
+    if (mib != NULL) {
+      name = mib->mib_name;
+      if (strncmp(name, SNMP_MIB_NAME_PREFIX, prefix_len) == 0) {
+        name += prefix_len;
+      }
+
+      smi_type = mib->smi_type;
+    }
+
+    db_set_field_desc(desc++, snmp_fields[i].field, snmp_fields[i].field_start,
+      snmp_fields[i].field_len, smi_type, SNMP_DB_FIELD_KIND_SCALAR, name);
   }
 
-  /* Seek to the desired table size (actually, one byte less than the desired
-   * size) and write a single byte, so that there's enough allocated backing
-   * store on the filesystem to support the ensuing mmap() call.
-   */
-  if (lseek(db_fd, db_datasz, SEEK_SET) < 0) {
-    xerrno = errno;
+  if (db_id == SNMP_DB_ID_HIST) {
+    static const char *protos[SNMP_DB_HIST_NPROTOS] = {
+      "ftp", "ftps", "sftp", "scp"
+    };
+    static const char *metrics[SNMP_DB_HIST_NXFER_METRICS] = {
+      "duration", "size", "rate"
+    };
+    unsigned int proto, metric;
+
+    for (proto = 0; proto < SNMP_DB_HIST_NPROTOS; proto++) {
+      for (metric = 0; metric < SNMP_DB_HIST_NXFER_METRICS; metric++) {
+        unsigned int field;
+        char name[SNMP_DB_FIELD_NAMESZ];
+        off_t field_start;
+
+        field = SNMP_DB_HIST_F_XFER_BUCKET(proto, metric, 0);
+        (void) get_field_range(field, &field_start, NULL);
+
+        memset(name, '\0', sizeof(name));
+        snprintf(name, sizeof(name)-1, "%s.xferHist.%s", protos[proto],
+          metrics[metric]);
+
+        db_set_field_desc(desc++, field, field_start,
+          SNMP_DB_HIST_NBUCKETS * sizeof(uint32_t), SNMP_SMI_COUNTER32,
+          SNMP_DB_FIELD_KIND_HISTOGRAM, name);
+      }
+    }
 
-    pr_trace_msg(trace_channel, 1,
-      "error seeking to %lu in table '%s': %s",
-      (unsigned long) db_datasz-1, db_path, strerror(xerrno));
+  } else if (db_id == SNMP_DB_ID_CMD) {
+    unsigned int cmd_idx;
 
-    (void) snmp_db_close(p, db_id);
-    errno = xerrno;
-    return -1;
+    for (cmd_idx = 0; cmd_idx < SNMP_DB_CMD_NCMDS; cmd_idx++) {
+      unsigned int field;
+      char name[SNMP_DB_FIELD_NAMESZ];
+      off_t field_start;
+
+      field = SNMP_DB_CMD_F_COUNT(cmd_idx);
+      (void) get_field_range(field, &field_start, NULL);
+
+      memset(name, '\0', sizeof(name));
+      snprintf(name, sizeof(name)-1, "ftp.commands.%s",
+        snmp_db_cmd_get_name(cmd_idx));
+
+      db_set_field_desc(desc++, field, field_start,
+        SNMP_DB_CMD_NSLOTS * sizeof(uint32_t), SNMP_SMI_COUNTER32,
+        SNMP_DB_FIELD_KIND_COMMAND, name);
+    }
+
+  } else if (db_id == SNMP_DB_ID_EXT) {
+    unsigned int idx;
+
+    for (idx = 0; idx < snmp_registry_get_count(); idx++) {
+      struct snmp_metric *metric;
+      char name[SNMP_DB_FIELD_NAMESZ];
+
+      metric = snmp_registry_get(idx);
+
+      memset(name, '\0', sizeof(name));
+      snprintf(name, sizeof(name)-1, "ext.%s", metric->name);
+
+      switch (metric->metric_type) {
+        case SNMP_METRIC_TYPE_HISTOGRAM:
+          db_set_field_desc(desc++, SNMP_DB_EXT_F(metric->slot),
+            metric->slot * sizeof(uint32_t),
+            SNMP_DB_HIST_NBUCKETS * sizeof(uint32_t), SNMP_SMI_COUNTER32,
+            SNMP_DB_FIELD_KIND_HISTOGRAM, name);
+          break;
+
+        default:
+          db_set_field_desc(desc++, SNMP_DB_EXT_F(metric->slot),
+            metric->slot * sizeof(uint32_t), sizeof(uint32_t),
+            metric->metric_type == SNMP_METRIC_TYPE_COUNTER ?
+              SNMP_SMI_COUNTER32 : SNMP_SMI_GAUGE32,
+            SNMP_DB_FIELD_KIND_SCALAR, name);
+          break;
+      }
+    }
   }
+}
 
-  if (write(db_fd, "", 1) != 1) {
-    xerrno = errno;
+/* Maps the table from its file, restoring the existing data if the file's
+ * header matches the current layout, and (re)initializing the file
+ * otherwise.  Restoring is simply a matter of mapping the file; the data are
+ * neither read nor copied.
+ */
+static int db_open_persistent(pool *p, int db_id, int db_fd,
+    const char *db_path) {
+  struct stat st;
+  struct snmp_db_header *hdr;
+  size_t db_datasz, db_hdrsz, db_mapsz;
+  uint32_t layout_hash;
+  void *db_map;
+  int restore = FALSE, xerrno;
 
-    pr_trace_msg(trace_channel, 1,
-      "error writing single byte to table '%s': %s", db_path, strerror(xerrno));
+  db_datasz = snmp_dbs[db_id].db_datasz;
+  db_hdrsz = db_get_hdrsz(db_id);
+  db_mapsz = db_hdrsz + db_datasz;
+  layout_hash = db_get_layout_hash(db_id);
 
-    (void) snmp_db_close(p, db_id);
-    errno = xerrno;
+  if (fstat(db_fd, &st) < 0) {
     return -1;
   }
 
-  mmap_flags = MAP_SHARED;
+  if ((size_t) st.st_size == db_mapsz) {
+    restore = TRUE;
 
-  /* Make sure to set the fd to -1 if MAP_ANON(YMOUS) is used.  By definition,
-   * anonymous mapped memory does not need (or want) a valid file backing
-   * store; some implementations will not do what is expected when anonymous
-   * memory is requested AND a valid fd is passed in.
-   *
-   * However, we want to keep a valid fd open anyway, for later use by
-   * fcntl(2) for byte range locking; we simply don't use the valid fd for
-   * the mmap(2) call.
-   */
+  } else {
+    if (st.st_size > 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "SNMPTable '%s' has unexpected size (%lu bytes, expected %lu), "
+        "reinitializing", db_path, (unsigned long) st.st_size,
+        (unsigned long) db_mapsz);
+    }
 
-#if defined(MAP_ANONYMOUS)
-  /* Linux */
-  mmap_flags |= MAP_ANONYMOUS;
-  db_fd = -1;
+    /* Truncating and then extending the file zero-fills it. */
+    if (ftruncate(db_fd, 0) < 0 ||
+        ftruncate(db_fd, db_mapsz) < 0) {
+      xerrno = errno;
 
-#elif defined(MAP_ANON)
-  /* FreeBSD, MacOSX, Solaris, others? */
-  mmap_flags |= MAP_ANON;
-  db_fd = -1;
+      pr_trace_msg(trace_channel, 1,
+        "error sizing SNMPTable '%s' to %lu bytes: %s", db_path,
+        (unsigned long) db_mapsz, strerror(xerrno));
 
-#else
-  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-    "mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined");
-#endif
+      errno = xerrno;
+      return -1;
+    }
+  }
 
-  db_data = mmap(NULL, db_datasz, PROT_READ|PROT_WRITE, mmap_flags, db_fd, 0);
-  if (db_data == MAP_FAILED) {
+  db_map = mmap(NULL, db_mapsz, PROT_READ|PROT_WRITE, MAP_SHARED, db_fd, 0);
+  if (db_map == MAP_FAILED) {
     xerrno = errno;
 
     pr_trace_msg(trace_channel, 1,
       "error mapping table '%s' fd %d size %lu into memory: %s", db_path,
-      db_fd, (unsigned long) db_datasz, strerror(xerrno));
+      db_fd, (unsigned long) db_mapsz, strerror(xerrno));
 
-    (void) snmp_db_close(p, db_id);
     errno = xerrno;
     return -1;
   }
 
-  snmp_dbs[db_id].db_data = db_data;
+  hdr = db_map;
+
+  if (restore == TRUE) {
+    if (memcmp(hdr->magic, SNMP_DB_HEADER_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != SNMP_DB_HEADER_VERSION ||
+        hdr->db_id != (uint32_t) db_id ||
+        hdr->hdrsz != db_hdrsz ||
+        hdr->datasz != db_datasz ||
+        hdr->layout_hash != layout_hash) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "SNMPTable '%s' has a different version/layout, reinitializing",
+        db_path);
+      restore = FALSE;
+    }
+  }
+
+  if (restore == FALSE) {
+    memset(db_map, 0, db_mapsz);
 
-  /* Make sure the data are zeroed. */
-  memset(db_data, 0, db_datasz);
+    memcpy(hdr->magic, SNMP_DB_HEADER_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNMP_DB_HEADER_VERSION;
+    hdr->db_id = db_id;
+    hdr->layout_hash = layout_hash;
+    hdr->hdrsz = db_hdrsz;
+    hdr->datasz = db_datasz;
+
+  } else {
+    pr_trace_msg(trace_channel, 9, "restored SNMPTable '%s' (%lu bytes)",
+      db_path, (unsigned long) db_datasz);
+  }
+
+  db_write_field_dir(db_id, hdr);
+
+  snmp_dbs[db_id].db_data = ((char *) db_map) + db_hdrsz;
+  snmp_dbs[db_id].db_hdrsz = db_hdrsz;
+  snmp_dbs[db_id].db_restored = restore;
 
   return 0;
 }
 
-int snmp_db_close(pool *p, int db_id) {
-  int db_fd, res;
-  void *db_data;
+/* Assigns each table its cache-line aligned offset within the shared region,
+ * in the order of snmp_db_layout[].
+ */
+static void db_layout_region(void) {
+  register unsigned int i;
+  size_t offset = 0;
 
-  if (db_id < 0) {
-    errno = EINVAL;
+  for (i = 0; snmp_db_layout[i] > 0; i++) {
+    int db_id;
+
+    db_id = snmp_db_layout[i];
+    snmp_dbs[db_id].db_offset = (off_t) offset;
+    offset = SNMP_DB_ALIGN(offset + snmp_dbs[db_id].db_datasz);
+  }
+
+  snmp_db_regionsz = offset;
+}
+
+/* Opens the lock file, and maps the shared region (unless the tables are
+ * persistent), if not already done.
+ */
+static int db_open_region(pool *p) {
+  int lock_fd, res, xerrno;
+  char *lock_path;
+
+  if (snmp_db_lockfd >= 0) {
+    return 0;
+  }
+
+  lock_path = pdircat(p, snmp_db_root, SNMP_DB_LOCK_FILE, NULL);
+
+  PRIVS_ROOT
+  lock_fd = open(lock_path, O_RDWR|O_CREAT, 0600);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (lock_fd < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error opening SNMPTables lock file '%s': %s", lock_path,
+      strerror(xerrno));
+    errno = xerrno;
     return -1;
   }
 
-  db_data = snmp_dbs[db_id].db_data;
+  /* Make sure the fd isn't one of the big three. */
+  res = pr_fs_get_usable_fd(lock_fd);
+  if (res >= 0) {
+    lock_fd = res;
+  }
 
-  if (db_data != NULL) {
-    size_t db_datasz;
+  db_layout_region();
 
-    db_datasz = snmp_dbs[db_id].db_datasz;
+  if (snmp_db_persistent == FALSE) {
+    int mmap_fd = -1, mmap_flags = MAP_SHARED;
+    void *region;
+
+#if defined(MAP_ANONYMOUS)
+    /* Linux */
+    mmap_flags |= MAP_ANONYMOUS;
+
+#elif defined(MAP_ANON)
+    /* FreeBSD, MacOSX, Solaris, others? */
+    mmap_flags |= MAP_ANON;
+
+#else
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined, using '%s'",
+      lock_path);
+
+    /* Fall back to mapping the lock file itself; the locks are unaffected. */
+    if (ftruncate(lock_fd, 0) < 0 ||
+        ftruncate(lock_fd, snmp_db_regionsz) < 0) {
+      xerrno = errno;
+
+      (void) close(lock_fd);
+      errno = xerrno;
+      return -1;
+    }
+
+    mmap_fd = lock_fd;
+#endif
 
-    if (munmap(db_data, db_datasz) < 0) {
-      int xerrno = errno;
+    region = mmap(NULL, snmp_db_regionsz, PROT_READ|PROT_WRITE, mmap_flags,
+      mmap_fd, 0);
+    if (region == MAP_FAILED) {
+      xerrno = errno;
 
       pr_trace_msg(trace_channel, 1,
-        "error unmapping SNMPTable '%s' from memory: %s",
-        pdircat(p, snmp_db_root, snmp_dbs[db_id].db_path, NULL),
-        strerror(xerrno));
+        "error mapping SNMPTables region (%lu bytes) into memory: %s",
+        (unsigned long) snmp_db_regionsz, strerror(xerrno));
 
+      (void) close(lock_fd);
       errno = xerrno;
       return -1;
     }
+
+    snmp_db_region = region;
   }
 
-  snmp_dbs[db_id].db_data = NULL;
+  snmp_db_lockfd = lock_fd;
 
-  db_fd = snmp_dbs[db_id].db_fd;
-  res = close(db_fd);
-  if (res < 0) {
-    return -1;
+  pr_trace_msg(trace_channel, 19,
+    "opened lock fd %d for '%s', region %lu bytes", lock_fd, lock_path,
+    (unsigned long) snmp_db_regionsz);
+  return 0;
+}
+
+static void db_close_region(void) {
+  if (snmp_db_region != NULL) {
+    if (munmap(snmp_db_region, snmp_db_regionsz) < 0) {
+      pr_trace_msg(trace_channel, 1,
+        "error unmapping SNMPTables region from memory: %s", strerror(errno));
+    }
+
+    snmp_db_region = NULL;
   }
 
-  snmp_dbs[db_id].db_fd = -1;
-  return 0;
+  if (snmp_db_lockfd >= 0) {
+    (void) close(snmp_db_lockfd);
+    snmp_db_lockfd = -1;
+  }
 }
 
-int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
+int snmp_db_open(pool *p, int db_id) {
+  int db_fd, res, xerrno;
+  char *db_path;
+
+  if (db_id < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* First, see if the database is already opened. */
+  if (snmp_dbs[db_id].db_path != NULL) {
+    snmp_dbs[db_id].db_restored = FALSE;
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 19,
+    "opening db ID %d (db root = %s, db name = %s)", db_id, snmp_db_root,
+    snmp_dbs[db_id].db_name);
+
+  if (db_open_region(p) < 0) {
+    return -1;
+  }
+
+  db_path = pdircat(p, snmp_db_root, snmp_dbs[db_id].db_name, NULL);
+
+  if (snmp_db_persistent == FALSE) {
+    snmp_dbs[db_id].db_path = db_path;
+    snmp_dbs[db_id].db_data = ((char *) snmp_db_region) +
+      snmp_dbs[db_id].db_offset;
+    snmp_dbs[db_id].db_hdrsz = 0;
+    snmp_dbs[db_id].db_restored = FALSE;
+    snmp_db_nopen++;
+
+    /* Make sure the data are zeroed. */
+    memset(snmp_dbs[db_id].db_data, 0, snmp_dbs[db_id].db_datasz);
+
+    pr_trace_msg(trace_channel, 19,
+      "SNMPTable '%s' at offset %lu of region", snmp_dbs[db_id].db_name,
+      (unsigned long) snmp_dbs[db_id].db_offset);
+    return 0;
+  }
+
+  PRIVS_ROOT
+  db_fd = open(db_path, O_RDWR|O_CREAT, 0600);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (db_fd < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error opening SNMPTable '%s': %s", db_path, strerror(xerrno));
+
+    if (snmp_db_nopen == 0) {
+      db_close_region();
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 19, "opened fd %d for SNMPTable '%s'", db_fd,
+    db_path);
+
+  snmp_dbs[db_id].db_path = db_path;
+  snmp_db_nopen++;
+
+  res = db_open_persistent(p, db_id, db_fd, db_path);
+  xerrno = errno;
+
+  /* The mapping does not need the fd, and the locks use the lock file, so
+   * there is no reason for the sessions to inherit it.
+   */
+  (void) close(db_fd);
+
+  if (res < 0) {
+    (void) snmp_db_close(p, db_id);
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int snmp_db_close(pool *p, int db_id) {
+  void *db_data;
+
+  if (db_id < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (snmp_dbs[db_id].db_path == NULL) {
+    /* Never opened, e.g. skipped because the module was not loaded. */
+    return 0;
+  }
+
+  db_data = snmp_dbs[db_id].db_data;
+
+  if (db_data != NULL &&
+      snmp_dbs[db_id].db_hdrsz > 0) {
+    size_t db_mapsz;
+
+    /* Persistent table; the mapping starts with the header, and should be
+     * flushed to the file before we let go of it.
+     */
+    db_data = ((char *) db_data) - snmp_dbs[db_id].db_hdrsz;
+    db_mapsz = snmp_dbs[db_id].db_hdrsz + snmp_dbs[db_id].db_datasz;
+
+    if (msync(db_data, db_mapsz, MS_SYNC) < 0) {
+      pr_trace_msg(trace_channel, 1,
+        "error syncing SNMPTable '%s': %s", snmp_dbs[db_id].db_path,
+        strerror(errno));
+    }
+
+    if (munmap(db_data, db_mapsz) < 0) {
+      pr_trace_msg(trace_channel, 1,
+        "error unmapping SNMPTable '%s' from memory: %s",
+        snmp_dbs[db_id].db_path, strerror(errno));
+    }
+  }
+
+  snmp_dbs[db_id].db_data = NULL;
+  snmp_dbs[db_id].db_hdrsz = 0;
+  snmp_dbs[db_id].db_path = NULL;
+
+  /* The region, and the lock file, go once the last table is closed. */
+  snmp_db_nopen--;
+  if (snmp_db_nopen == 0) {
+    db_close_region();
+  }
+
+  return 0;
+}
+
+int snmp_db_is_restored(int db_id) {
+  if (db_id < 0) {
+    return FALSE;
+  }
+
+  return snmp_dbs[db_id].db_restored;
+}
+
+int snmp_db_sync(pool *p, int flags) {
+  register unsigned int i;
+  int res = 0, xerrno = 0;
+
+  for (i = 0; snmp_table_ids[i] > 0; i++) {
+    int db_id;
+    void *db_map;
+    size_t db_mapsz;
+
+    db_id = snmp_table_ids[i];
+    if (snmp_dbs[db_id].db_data == NULL ||
+        snmp_dbs[db_id].db_hdrsz == 0) {
+      continue;
+    }
+
+    db_map = ((char *) snmp_dbs[db_id].db_data) - snmp_dbs[db_id].db_hdrsz;
+    db_mapsz = snmp_dbs[db_id].db_hdrsz + snmp_dbs[db_id].db_datasz;
+
+    if (msync(db_map, db_mapsz, flags) < 0) {
+      xerrno = errno;
+
+      pr_trace_msg(trace_channel, 3, "error syncing SNMPTable '%s': %s",
+        snmp_dbs[db_id].db_path, strerror(xerrno));
+      res = -1;
+    }
+  }
+
+  if (res < 0) {
+    errno = xerrno;
+  }
+
+  return res;
+}
+
+/* Read-locks (or unlocks) every table, rather than a single field. */
+static int db_lock_region(short lock_type) {
+  struct flock lock;
+
+  lock.l_type = lock_type;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 0;
+
+  while (fcntl(snmp_db_lockfd, F_SETLKW, &lock) < 0) {
+    if (errno == EINTR) {
+      pr_signals_handle();
+      continue;
+    }
+
+    return -1;
+  }
+
+  return 0;
+}
+
+int snmp_db_snapshot_begin(pool *p) {
+  register unsigned int i;
+
+  if (snmp_db_nopen == 0) {
+    /* Nothing to copy. */
+    snmp_db_use_snapshot = TRUE;
+    return 0;
+  }
+
+  /* One lock covers every table. */
+  if (db_lock_region(F_RDLCK) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3,
+      "error read-locking SNMPTables for snapshot: %s", strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  for (i = 0; snmp_table_ids[i] > 0; i++) {
+    int db_id;
+    size_t db_datasz;
+
+    db_id = snmp_table_ids[i];
+    db_datasz = snmp_dbs[db_id].db_datasz;
+
+    if (snmp_dbs[db_id].db_data == NULL ||
+        db_datasz == 0) {
+      continue;
+    }
+
+    /* The table sizes are fixed, so the copy is allocated once, and reused
+     * for every later snapshot.
+     */
+    if (snmp_dbs[db_id].db_snapshot == NULL) {
+      snmp_dbs[db_id].db_snapshot = palloc(p, db_datasz);
+    }
+
+    memcpy(snmp_dbs[db_id].db_snapshot, snmp_dbs[db_id].db_data, db_datasz);
+  }
+
+  (void) db_lock_region(F_UNLCK);
+
+  snmp_db_use_snapshot = TRUE;
+  return 0;
+}
+
+int snmp_db_snapshot_end(void) {
+  snmp_db_use_snapshot = FALSE;
+  return 0;
+}
+
+/* Reads a counter table field, i.e. the name, type, or value of the scalar
+ * counter or gauge that the table row mirrors.
+ */
+static int db_get_counter_value(pool *p, unsigned int field,
+    int32_t *int_value, char **str_value, size_t *str_valuelen) {
+  unsigned int scalar_field;
+  struct snmp_mib *mib;
+
+  scalar_field = (field - SNMP_DB_COUNTER_F_NAME_BASE) %
+    SNMP_DB_COUNTER_NFIELDS;
+
+  if (field >= SNMP_DB_COUNTER_F_VALUE_BASE) {
+    return snmp_db_get_value(p, scalar_field, int_value, str_value,
+      str_valuelen);
+  }
+
+  mib = snmp_mib_get_by_field(scalar_field);
+  if (mib == NULL) {
+    return -1;
+  }
+
+  if (field >= SNMP_DB_COUNTER_F_TYPE_BASE) {
+    *int_value = (mib->smi_type == SNMP_SMI_COUNTER32) ?
+      SNMP_MIB_COUNTER_TYPE_COUNTER : SNMP_MIB_COUNTER_TYPE_GAUGE;
+
+    pr_trace_msg(trace_channel, 19,
+      "read value %lu for field %s", (unsigned long) *int_value,
+      snmp_db_get_fieldstr(p, field));
+    return 0;
+  }
+
+  *str_value = (char *) mib->mib_name;
+  if (strncmp(*str_value, SNMP_MIB_NAME_PREFIX,
+      strlen(SNMP_MIB_NAME_PREFIX)) == 0) {
+    *str_value += strlen(SNMP_MIB_NAME_PREFIX);
+  }
+  *str_valuelen = strlen(*str_value);
+
+  pr_trace_msg(trace_channel, 19,
+    "read value '%s' for field %s", *str_value,
+    snmp_db_get_fieldstr(p, field));
+  return 0;
+}
+
+int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
     char **str_value, size_t *str_valuelen) {
   void *db_data, *field_data;
   int db_id, res;
@@ -1169,6 +2007,35 @@ int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
       break;
   }
 
+  if (field >= SNMP_DB_HIST_F_UPPER_BOUND_BASE &&
+      field <= SNMP_DB_HIST_F_UPPER_BOUND_MAX) {
+    *int_value = (int32_t) snmp_db_hist_get_upper_bound(
+      field - SNMP_DB_HIST_F_UPPER_BOUND_BASE);
+
+    pr_trace_msg(trace_channel, 19,
+      "read value %lu for field %s", (unsigned long) *int_value,
+      snmp_db_get_fieldstr(p, field));
+    return 0;
+  }
+
+  if (field >= SNMP_DB_CMD_F_NAME_BASE &&
+      field <= SNMP_DB_CMD_F_NAME_MAX) {
+    *str_value = (char *) snmp_db_cmd_get_name(
+      field - SNMP_DB_CMD_F_NAME_BASE);
+    *str_valuelen = strlen(*str_value);
+
+    pr_trace_msg(trace_channel, 19,
+      "read value '%s' for field %s", *str_value,
+      snmp_db_get_fieldstr(p, field));
+    return 0;
+  }
+
+  if (field >= SNMP_DB_COUNTER_F_NAME_BASE &&
+      field <= SNMP_DB_COUNTER_F_MAX) {
+    return db_get_counter_value(p, field, int_value, str_value,
+      str_valuelen);
+  }
+
   db_id = snmp_db_get_field_db_id(field);
   if (db_id < 0) {
     return -1;
@@ -1178,13 +2045,21 @@ int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
     return -1;
   }
 
+  if (snmp_db_use_snapshot == TRUE &&
+      snmp_dbs[db_id].db_snapshot != NULL) {
+    /* The snapshot is private to this process; no locking needed. */
+    field_data = ((char *) snmp_dbs[db_id].db_snapshot) + field_start;
+    memmove(int_value, field_data, field_len);
+    return 0;
+  }
+
   res = snmp_db_rlock(field);
   if (res < 0) {
     return -1;
   }
 
   db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
+  field_data = ((char *) db_data) + field_start;
   memmove(int_value, field_data, field_len);
 
   res = snmp_db_unlock(field);
@@ -1220,7 +2095,7 @@ int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
   }
 
   db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
+  field_data = ((char *) db_data) + field_start;
   memmove(&new_val, field_data, field_len);
   orig_val = new_val;
 
@@ -1241,9 +2116,22 @@ int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
     return 0;
   }
 
-  new_val += incr;
+  if (incr < 0 &&
+      (uint32_t) -((int64_t) incr) > orig_val) {
+    /* Likewise, a decrement larger than the value stops at zero, rather
+     * than wrapping around.
+     */
+    new_val = 0;
+
+  } else {
+    new_val += incr;
+  }
+
   memmove(field_data, &new_val, field_len);
 
+  /* If this is a session gauge, the session's share of it changed. */
+  snmp_gauge_note(field, (int32_t) (new_val - orig_val));
+
 #if 0
   res = msync(field_data, field_len, MS_SYNC);
   if (res < 0) {
@@ -1285,7 +2173,7 @@ int snmp_db_reset_value(pool *p, unsigned int field) {
   }
 
   db_data = snmp_dbs[db_id].db_data;
-  field_data = &(((uint32_t *) db_data)[field_start]);
+  field_data = ((char *) db_data) + field_start;
 
   val = 0;
   memmove(field_data, &val, field_len);
@@ -1300,6 +2188,285 @@ int snmp_db_reset_value(pool *p, unsigned int field) {
   return 0;
 }
 
+int snmp_db_set_value(pool *p, unsigned int field, int32_t value) {
+  int db_id, res;
+  void *db_data, *field_data;
+  off_t field_start;
+  size_t field_len;
+
+  db_id = snmp_db_get_field_db_id(field);
+  if (db_id < 0) {
+    return -1;
+  }
+
+  if (get_field_range(field, &field_start, &field_len) < 0) {
+    return -1;
+  }
+
+  res = snmp_db_wlock(field);
+  if (res < 0) {
+    return -1;
+  }
+
+  db_data = snmp_dbs[db_id].db_data;
+  field_data = ((char *) db_data) + field_start;
+  memmove(field_data, &value, field_len);
+
+  res = snmp_db_unlock(field);
+  if (res < 0) {
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 19,
+    "set value to %ld for field %s", (long) value,
+    snmp_db_get_fieldstr(p, field));
+  return 0;
+}
+
+/* Increments the given counter, without using the fcntl(2) locks where
+ * possible.
+ */
+static int db_incr_lockless(unsigned int field, uint32_t *data) {
+#if defined(__GNUC__)
+  /* Every process shares the same mapping, so an atomic add is all that is
+   * needed; readers see either the old or the new count.
+   */
+  (void) __sync_fetch_and_add(data, 1);
+#else
+  if (snmp_db_wlock(field) < 0) {
+    return -1;
+  }
+
+  (*data)++;
+
+  if (snmp_db_unlock(field) < 0) {
+    return -1;
+  }
+#endif
+
+  return 0;
+}
+
+int snmp_db_ext_incr(unsigned int slot, int32_t incr) {
+  uint32_t *data;
+
+  data = snmp_dbs[SNMP_DB_ID_EXT].db_data;
+  if (data == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (slot >= SNMP_DB_EXT_NSLOTS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  data += slot;
+
+#if defined(__GNUC__)
+  if (incr >= 0) {
+    (void) __sync_fetch_and_add(data, (uint32_t) incr);
+
+  } else {
+    uint32_t orig_val, new_val;
+
+    /* As for snmp_db_incr_value(), values are not decremented below zero. */
+    do {
+      orig_val = *data;
+      if (orig_val == 0) {
+        break;
+      }
+
+      new_val = orig_val > (uint32_t) -incr ? orig_val + incr : 0;
+    } while (__sync_val_compare_and_swap(data, orig_val, new_val) != orig_val);
+  }
+#else
+  return snmp_db_incr_value(snmp_pool, SNMP_DB_EXT_F(slot), incr);
+#endif
+
+  return 0;
+}
+
+int snmp_db_ext_set(unsigned int slot, int32_t value) {
+  uint32_t *data;
+
+  data = snmp_dbs[SNMP_DB_ID_EXT].db_data;
+  if (data == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (slot >= SNMP_DB_EXT_NSLOTS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* An aligned 32-bit store is seen whole by the readers. */
+  data[slot] = (uint32_t) value;
+  return 0;
+}
+
+unsigned int snmp_db_hist_get_bucket(uint64_t value) {
+  unsigned int bucket, nbits = 0;
+  uint64_t v;
+
+  if (value <= 2) {
+    return (value <= 1 ? 0 : 1);
+  }
+
+  /* Find k such that 2^k < value <= 2^(k+1); the lower half of that range
+   * is bucket 2k, the upper half bucket 2k+1.
+   */
+  v = value - 1;
+  while (v >>= 1) {
+    nbits++;
+  }
+
+  bucket = (nbits * 2);
+  if (value > ((uint64_t) 3 << (nbits - 1))) {
+    bucket++;
+  }
+
+  if (bucket >= SNMP_DB_HIST_NBUCKETS) {
+    bucket = SNMP_DB_HIST_NBUCKETS - 1;
+  }
+
+  return bucket;
+}
+
+uint32_t snmp_db_hist_get_upper_bound(unsigned int bucket) {
+  if (bucket >= SNMP_DB_HIST_NBUCKETS - 1) {
+    /* The last bucket has no upper bound. */
+    return (uint32_t) INT_MAX;
+  }
+
+  if (bucket < 2) {
+    return bucket + 1;
+  }
+
+  if (bucket % 2 == 0) {
+    return ((uint32_t) 3 << ((bucket / 2) - 1));
+  }
+
+  return ((uint32_t) 1 << ((bucket + 1) / 2));
+}
+
+int snmp_db_hist_add_xfer(pool *p, int proto, int metric, uint64_t value) {
+  unsigned int bucket, field;
+  uint32_t *bucket_data;
+  void *db_data;
+
+  if (proto < 0 ||
+      proto >= SNMP_DB_HIST_NPROTOS ||
+      metric < 0 ||
+      metric >= SNMP_DB_HIST_NXFER_METRICS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  db_data = snmp_dbs[SNMP_DB_ID_HIST].db_data;
+  if (db_data == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  bucket = snmp_db_hist_get_bucket(value);
+  field = SNMP_DB_HIST_F_XFER_BUCKET(proto, metric, bucket);
+  bucket_data = ((uint32_t *) db_data) +
+    (field - SNMP_DB_HIST_F_XFER_BUCKET_BASE);
+
+  if (db_incr_lockless(field, bucket_data) < 0) {
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 19,
+    "added value %llu to bucket %u for field %s", (unsigned long long) value,
+    bucket, snmp_db_get_fieldstr(p, field));
+  return 0;
+}
+
+/* The tracked commands; this list MUST be kept sorted, and its length in
+ * sync with SNMP_DB_CMD_NCMDS.  The "other" slot is not part of the list.
+ */
+static const char *snmp_db_cmds[] = {
+  "ABOR", "ACCT", "ALLO", "APPE", "AUTH", "CCC", "CDUP", "CLNT", "CWD",
+  "DELE", "EPRT", "EPSV", "FEAT", "HELP", "HOST", "LANG", "LIST", "MDTM",
+  "MFF", "MFMT", "MKD", "MLSD", "MLST", "MODE", "NLST", "NOOP", "OPTS",
+  "PASS", "PASV", "PBSZ", "PORT", "PROT", "PWD", "QUIT", "REIN", "REST",
+  "RETR", "RMD", "RNFR", "RNTO", "SITE", "SIZE", "SMNT", "STAT", "STOR",
+  "STOU", "STRU", "SYST", "TYPE", "USER", "XCUP", "XCWD", "XMKD", "XPWD",
+  "XRMD"
+};
+
+static int db_cmd_cmp(const void *a, const void *b) {
+  return strcasecmp((const char *) a, *((const char **) b));
+}
+
+unsigned int snmp_db_cmd_get_idx(const char *cmd_name) {
+  const char **cmd;
+
+  if (cmd_name == NULL) {
+    return SNMP_DB_CMD_NCMDS - 1;
+  }
+
+  cmd = bsearch(cmd_name, snmp_db_cmds, SNMP_DB_CMD_NCMDS - 1,
+    sizeof(char *), db_cmd_cmp);
+  if (cmd == NULL) {
+    return SNMP_DB_CMD_NCMDS - 1;
+  }
+
+  return cmd - snmp_db_cmds;
+}
+
+const char *snmp_db_cmd_get_name(unsigned int cmd_idx) {
+  if (cmd_idx >= SNMP_DB_CMD_NCMDS - 1) {
+    return "other";
+  }
+
+  return snmp_db_cmds[cmd_idx];
+}
+
+int snmp_db_cmd_add(pool *p, unsigned int cmd_idx, int failed,
+    uint64_t latency_us) {
+  unsigned int bucket, field;
+  uint32_t *cmd_data;
+  void *db_data;
+
+  if (cmd_idx >= SNMP_DB_CMD_NCMDS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  db_data = snmp_dbs[SNMP_DB_ID_CMD].db_data;
+  if (db_data == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  cmd_data = ((uint32_t *) db_data) + (cmd_idx * SNMP_DB_CMD_NSLOTS);
+
+  /* This is called for every command, so we skip the usual trace logging. */
+  field = SNMP_DB_CMD_F_COUNT(cmd_idx);
+  if (db_incr_lockless(field, cmd_data) < 0) {
+    return -1;
+  }
+
+  if (failed) {
+    field = SNMP_DB_CMD_F_ERR_COUNT(cmd_idx);
+    if (db_incr_lockless(field, cmd_data + 1) < 0) {
+      return -1;
+    }
+  }
+
+  bucket = snmp_db_hist_get_bucket(latency_us);
+  field = SNMP_DB_CMD_F_LATENCY_BUCKET(cmd_idx, bucket);
+  if (db_incr_lockless(field, cmd_data + 2 + bucket) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
 int snmp_db_set_root(const char *db_root) {
   if (db_root == NULL) {
     errno = EINVAL;
@@ -1309,3 +2476,14 @@ int snmp_db_set_root(const char *db_root) {
   snmp_db_root = db_root;
   return 0;
 }
+
+int snmp_db_set_persistent(int persistent) {
+  if (persistent != TRUE &&
+      persistent != FALSE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  snmp_db_persistent = persistent;
+  return 0;
+}
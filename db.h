@@ -40,6 +40,10 @@
 #define SNMP_DB_ID_SFTP			9
 #define SNMP_DB_ID_SCP			10
 #define SNMP_DB_ID_BAN			11
+#define SNMP_DB_ID_HIST			12
+#define SNMP_DB_ID_CMD			13
+#define SNMP_DB_ID_RATE			14
+#define SNMP_DB_ID_EXT			15
 
 #if 0
 #define SNMP_DB_ID_SQL			11
@@ -115,6 +119,16 @@ extern int snmp_table_ids[];
 #define SNMP_DB_SNMP_F_TRAPS_SENT_TOTAL				202
 #define SNMP_DB_SNMP_F_PKTS_AUTH_ERR_TOTAL			203
 #define SNMP_DB_SNMP_F_PKTS_DROPPED_TOTAL			204
+#define SNMP_DB_SNMP_F_ACL_CACHE_HITS_TOTAL			205
+#define SNMP_DB_SNMP_F_ACL_CACHE_MISSES_TOTAL			206
+#define SNMP_DB_SNMP_F_PKTS_DROPPED_RATE_LIMIT_TOTAL		207
+#define SNMP_DB_SNMP_F_PKTS_DROPPED_VERSION_TOTAL		208
+#define SNMP_DB_SNMP_F_PKTS_DROPPED_SEND_TOTAL			209
+#define SNMP_DB_SNMP_F_PKTS_DROPPED_STALE_TOTAL			210
+#define SNMP_DB_SNMP_F_RXQ_BYTES				211
+#define SNMP_DB_SNMP_F_RXQ_DROPPED_TOTAL			212
+#define SNMP_DB_SNMP_F_PKTS_REPLAYED_TOTAL			213
+#define SNMP_DB_SNMP_F_PKTS_DROPPED_TOO_BIG_TOTAL		214
 
 /* ftps.tlsSessions database fields */
 #define SNMP_DB_FTPS_SESS_F_SESS_COUNT				310
@@ -213,12 +227,187 @@ extern int snmp_table_ids[];
 #define SNMP_DB_BAN_BANS_F_CLASS_BAN_COUNT			716
 #define SNMP_DB_BAN_BANS_F_CLASS_BAN_TOTAL			717
 
+/* rate database fields.  These are the 1, 5, and 15 minute moving averages
+ * of selected counters, maintained by the agent process.
+ */
+#define SNMP_DB_RATE_F_CONN_RATE_1MIN				800
+#define SNMP_DB_RATE_F_CONN_RATE_5MIN				801
+#define SNMP_DB_RATE_F_CONN_RATE_15MIN				802
+#define SNMP_DB_RATE_F_FTP_LOGIN_RATE_1MIN			803
+#define SNMP_DB_RATE_F_FTP_LOGIN_RATE_5MIN			804
+#define SNMP_DB_RATE_F_FTP_LOGIN_RATE_15MIN			805
+#define SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_1MIN			806
+#define SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_5MIN			807
+#define SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_15MIN			808
+#define SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_1MIN		809
+#define SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_5MIN		810
+#define SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_15MIN		811
+
+/* Histogram protocols, metrics, and buckets.  Each histogram uses the same
+ * log-linear bucket boundaries (two linear sub-buckets per power of two),
+ * with the last bucket catching everything above the highest boundary.
+ */
+#define SNMP_DB_HIST_PROTO_FTP					0
+#define SNMP_DB_HIST_PROTO_FTPS					1
+#define SNMP_DB_HIST_PROTO_SFTP					2
+#define SNMP_DB_HIST_PROTO_SCP					3
+#define SNMP_DB_HIST_NPROTOS					4
+
+/* Transfer duration, in milliseconds */
+#define SNMP_DB_HIST_XFER_DURATION				0
+
+/* Transfer size, in KB */
+#define SNMP_DB_HIST_XFER_SIZE					1
+
+/* Transfer throughput, in KB/sec */
+#define SNMP_DB_HIST_XFER_RATE					2
+#define SNMP_DB_HIST_NXFER_METRICS				3
+
+#define SNMP_DB_HIST_NBUCKETS					50
+
+/* Transfer histogram bucket database fields.  These are not listed
+ * individually; the field ID encodes the protocol, metric, and bucket.
+ */
+#define SNMP_DB_HIST_F_XFER_BUCKET_BASE				1000
+#define SNMP_DB_HIST_F_XFER_BUCKET(proto, metric, bucket) \
+  (SNMP_DB_HIST_F_XFER_BUCKET_BASE + \
+   ((((proto) * SNMP_DB_HIST_NXFER_METRICS) + (metric)) * \
+     SNMP_DB_HIST_NBUCKETS) + (bucket))
+#define SNMP_DB_HIST_F_XFER_BUCKET_MAX \
+  SNMP_DB_HIST_F_XFER_BUCKET(SNMP_DB_HIST_NPROTOS - 1, \
+    SNMP_DB_HIST_NXFER_METRICS - 1, SNMP_DB_HIST_NBUCKETS - 1)
+
+/* Synthetic bucket upper bound fields, one per bucket. */
+#define SNMP_DB_HIST_F_UPPER_BOUND_BASE				1900
+#define SNMP_DB_HIST_F_UPPER_BOUND(bucket) \
+  (SNMP_DB_HIST_F_UPPER_BOUND_BASE + (bucket))
+#define SNMP_DB_HIST_F_UPPER_BOUND_MAX \
+  SNMP_DB_HIST_F_UPPER_BOUND(SNMP_DB_HIST_NBUCKETS - 1)
+
+/* Per-command statistics.  Commands are tracked by their index in a fixed,
+ * sorted list of known command names; any other command is counted in the
+ * last, "other", slot.  Each command has a request count, an error count,
+ * and a latency histogram (in microseconds), using the same buckets as the
+ * transfer histograms.
+ */
+#define SNMP_DB_CMD_NCMDS					56
+#define SNMP_DB_CMD_NSLOTS					(2 + SNMP_DB_HIST_NBUCKETS)
+
+/* Command statistics database fields.  As for the histogram buckets, the
+ * field ID encodes the command index and the counter.
+ */
+#define SNMP_DB_CMD_F_BASE					2000
+#define SNMP_DB_CMD_F_COUNT(cmd_idx) \
+  (SNMP_DB_CMD_F_BASE + ((cmd_idx) * SNMP_DB_CMD_NSLOTS))
+#define SNMP_DB_CMD_F_ERR_COUNT(cmd_idx) \
+  (SNMP_DB_CMD_F_COUNT(cmd_idx) + 1)
+#define SNMP_DB_CMD_F_LATENCY_BUCKET(cmd_idx, bucket) \
+  (SNMP_DB_CMD_F_COUNT(cmd_idx) + 2 + (bucket))
+#define SNMP_DB_CMD_F_MAX \
+  SNMP_DB_CMD_F_LATENCY_BUCKET(SNMP_DB_CMD_NCMDS - 1, \
+    SNMP_DB_HIST_NBUCKETS - 1)
+
+/* Synthetic command name fields, one per tracked command. */
+#define SNMP_DB_CMD_F_NAME_BASE					9000
+#define SNMP_DB_CMD_F_NAME(cmd_idx) \
+  (SNMP_DB_CMD_F_NAME_BASE + (cmd_idx))
+#define SNMP_DB_CMD_F_NAME_MAX \
+  SNMP_DB_CMD_F_NAME(SNMP_DB_CMD_NCMDS - 1)
+
+/* Synthetic counter table fields.  Each row of the counter table mirrors a
+ * scalar counter or gauge, and has a name, type, and value field; the field
+ * ID encodes the column and the scalar's own field, which is always below
+ * SNMP_DB_COUNTER_NFIELDS.
+ */
+#define SNMP_DB_COUNTER_NFIELDS					1000
+#define SNMP_DB_COUNTER_F_NAME_BASE				10000
+#define SNMP_DB_COUNTER_F_NAME(field) \
+  (SNMP_DB_COUNTER_F_NAME_BASE + (field))
+#define SNMP_DB_COUNTER_F_TYPE_BASE				11000
+#define SNMP_DB_COUNTER_F_TYPE(field) \
+  (SNMP_DB_COUNTER_F_TYPE_BASE + (field))
+#define SNMP_DB_COUNTER_F_VALUE_BASE				12000
+#define SNMP_DB_COUNTER_F_VALUE(field) \
+  (SNMP_DB_COUNTER_F_VALUE_BASE + (field))
+#define SNMP_DB_COUNTER_F_MAX \
+  SNMP_DB_COUNTER_F_VALUE(SNMP_DB_COUNTER_NFIELDS - 1)
+
+/* Registered metrics database fields (see snmp_metric_register()).  The
+ * table is a fixed number of slots, handed out in order of registration;
+ * counters and gauges take one slot, and histograms SNMP_DB_HIST_NBUCKETS
+ * slots.  The field ID is simply the base plus the slot.
+ */
+#define SNMP_DB_EXT_NSLOTS					1024
+#define SNMP_DB_EXT_F_BASE					13000
+#define SNMP_DB_EXT_F(slot) \
+  (SNMP_DB_EXT_F_BASE + (slot))
+#define SNMP_DB_EXT_F_MAX \
+  SNMP_DB_EXT_F(SNMP_DB_EXT_NSLOTS - 1)
+
 /* XXX sql database fields */
 
 /* XXX quota database fields */
 
 /* XXX geoip database fields */
 
+/* Persistent tables are mapped from their files under SNMPTables, rather
+ * than from anonymous memory, and start with this header.  A table is only
+ * restored if the magic, version, layout hash, and sizes all match; the
+ * layout hash covers the IDs, offsets, and lengths of the table's fields.
+ *
+ * The header is followed by a directory of nfields entries, each fieldsz
+ * bytes, describing the values in the table; the data follow the directory,
+ * hdrsz bytes from the start of the file.  All values are 32-bit, in host
+ * byte order.
+ */
+#define SNMP_DB_HEADER_MAGIC		"PRSNMPDB"
+#define SNMP_DB_HEADER_VERSION		2
+#define SNMP_DB_HEADER_SIZE		64
+
+struct snmp_db_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t db_id;
+  uint32_t layout_hash;
+  uint32_t hdrsz;
+  uint32_t datasz;
+  uint32_t nfields;
+  uint32_t fieldsz;
+
+  /* Pad the header out to SNMP_DB_HEADER_SIZE bytes. */
+  char reserved[SNMP_DB_HEADER_SIZE - 36];
+};
+
+/* A single value, e.g. a counter or gauge. */
+#define SNMP_DB_FIELD_KIND_SCALAR	0
+
+/* SNMP_DB_HIST_NBUCKETS bucket counts. */
+#define SNMP_DB_FIELD_KIND_HISTOGRAM	1
+
+/* The count and error count of a command, followed by its
+ * SNMP_DB_HIST_NBUCKETS latency bucket counts.
+ */
+#define SNMP_DB_FIELD_KIND_COMMAND	2
+
+#define SNMP_DB_FIELD_NAMESZ		48
+
+struct snmp_db_field_desc {
+  uint32_t field;
+
+  /* Offset of the first value from the start of the data, and the number of
+   * 32-bit values.
+   */
+  uint32_t offset;
+  uint32_t nelts;
+
+  /* The SMI type of the values (e.g. Counter32), and their kind. */
+  unsigned char smi_type;
+  unsigned char kind;
+  unsigned char reserved[2];
+
+  char name[SNMP_DB_FIELD_NAMESZ];
+};
+
 /* For a given field ID, return the database ID. */
 int snmp_db_get_field_db_id(unsigned int field);
 
@@ -230,16 +419,76 @@ int snmp_db_unlock(unsigned int field);
 
 int snmp_db_close(pool *p, int db_id);
 int snmp_db_open(pool *p, int db_id);
+
+/* Returns TRUE if the most recent snmp_db_open() call for the given table
+ * restored its data from the existing table file, FALSE otherwise.
+ */
+int snmp_db_is_restored(int db_id);
+
+/* Flush any persistent tables to their files; the flags are those for
+ * msync(2), i.e. MS_ASYNC or MS_SYNC.
+ */
+int snmp_db_sync(pool *p, int flags);
+/* Copies every open table, under a read lock of the whole table, into a
+ * private snapshot.  Until snmp_db_snapshot_end() is called,
+ * snmp_db_get_value() then reads from that snapshot, so that a series of
+ * reads sees a single, consistent point in time.  The given pool is used
+ * for allocating the snapshot buffers the first time only; they are reused
+ * afterwards.
+ */
+int snmp_db_snapshot_begin(pool *p);
+int snmp_db_snapshot_end(void);
+
 int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
   char **str_value, size_t *str_valuelen);
 int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr);
 
+/* Record the given value in the specified transfer histogram.  The bucket
+ * counter is incremented without taking the fcntl(2) locks used for the other
+ * fields, so that this is cheap enough for every transfer.
+ */
+int snmp_db_hist_add_xfer(pool *p, int proto, int metric, uint64_t value);
+
+/* Returns the bucket index for the given value, and the upper bound (in the
+ * units of the histogram) of the given bucket, respectively.
+ */
+unsigned int snmp_db_hist_get_bucket(uint64_t value);
+uint32_t snmp_db_hist_get_upper_bound(unsigned int bucket);
+
+/* Returns the index for the given command name, and the name for the given
+ * index, respectively.
+ */
+unsigned int snmp_db_cmd_get_idx(const char *cmd_name);
+const char *snmp_db_cmd_get_name(unsigned int cmd_idx);
+
+/* Record a completed command, its outcome, and its latency.  Like the
+ * transfer histograms, this does not use the fcntl(2) locks.
+ */
+int snmp_db_cmd_add(pool *p, unsigned int cmd_idx, int failed,
+  uint64_t latency_us);
+
+/* Adds to, or sets, the value in the given slot of the registered metrics
+ * table.  As these are only used via metric handles, there is no field
+ * lookup, and (where atomic operations are available) no fcntl(2) locking.
+ * Adding a negative value does not take the value below zero.
+ */
+int snmp_db_ext_incr(unsigned int slot, int32_t incr);
+int snmp_db_ext_set(unsigned int slot, int32_t value);
+
 /* Used to reset/clear counters. */
 int snmp_db_reset_value(pool *p, unsigned int field);
 
+/* Used to set gauges which are computed, rather than counted. */
+int snmp_db_set_value(pool *p, unsigned int field, int32_t value);
+
 /* Configure the SNMPTables path to use as the root/parent directory for the
  * various database table files.
  */
 int snmp_db_set_root(const char *path);
 
+/* Configure whether the database tables are persisted to (and restored
+ * from) their files under SNMPTables, or kept only in memory (the default).
+ */
+int snmp_db_set_persistent(int persistent);
+
 #endif
@@ -0,0 +1,422 @@
+/*
+ * ProFTPD - mod_snmp session gauge ownership
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "db.h"
+#include "gauge.h"
+
+/* The session gauges (connectionCount, sessionCount, etc) go up when a
+ * session starts something, and down when it finishes.  A session process
+ * which is killed, or crashes, never takes its part away again.  So each
+ * session records, in its own slot, how much it has added to each gauge and
+ * not yet taken away; when the agent finds a slot whose process has gone,
+ * it takes that amount away on the process's behalf.  A session which ends
+ * normally leaves its slot all zeroes, and gives it up.
+ *
+ * The mapping is the PIDs of the slots' owners, which is all that the agent
+ * scans, followed by each slot's values.  Only the owner writes a slot's
+ * values, and the agent only reads them once the owner has gone.
+ */
+
+#define SNMP_GAUGE_FILE		"gauge.dat"
+
+static unsigned int gauge_fields[] = {
+  SNMP_DB_DAEMON_F_CONN_COUNT,
+
+  SNMP_DB_FTP_SESS_F_SESS_COUNT,
+  SNMP_DB_FTP_LOGINS_F_ANON_COUNT,
+  SNMP_DB_FTP_XFERS_F_DIR_LIST_COUNT,
+  SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_COUNT,
+  SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_COUNT,
+
+  SNMP_DB_FTPS_SESS_F_SESS_COUNT,
+  SNMP_DB_FTPS_XFERS_F_DIR_LIST_COUNT,
+  SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_COUNT,
+  SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_COUNT,
+
+  SNMP_DB_SFTP_SESS_F_SESS_COUNT,
+  SNMP_DB_SFTP_XFERS_F_DIR_LIST_COUNT,
+  SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_COUNT,
+  SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_COUNT,
+
+  SNMP_DB_SCP_SESS_F_SESS_COUNT,
+  SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_COUNT,
+  SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_COUNT,
+
+  0
+};
+
+#define SNMP_GAUGE_NFIELDS \
+  ((sizeof(gauge_fields) / sizeof(unsigned int)) - 1)
+
+/* For each scalar field, its index in gauge_fields plus one, or zero if it
+ * is not a session gauge.
+ */
+static unsigned char gauge_field_idx[SNMP_DB_COUNTER_NFIELDS];
+
+static void *gauge_map = NULL;
+static size_t gauge_mapsz = 0;
+static pid_t *gauge_pids = NULL;
+static int32_t *gauge_values = NULL;
+
+/* The current session's slot, if any. */
+static int gauge_slot = -1;
+
+static time_t gauge_last_reconcile = 0;
+
+static const char *trace_channel = "snmp.gauge";
+
+static void *gauge_mmap(pool *p, const char *tables_dir, size_t mapsz) {
+  int fd = -1, mmap_flags = MAP_SHARED, xerrno;
+  void *map;
+
+#if defined(MAP_ANONYMOUS)
+  /* Linux */
+  mmap_flags |= MAP_ANONYMOUS;
+
+#elif defined(MAP_ANON)
+  /* FreeBSD, MacOSX, Solaris, others? */
+  mmap_flags |= MAP_ANON;
+
+#else
+  char *path;
+
+  /* The slots describe the running sessions only, so the file is simply
+   * emptied; it is never restored.
+   */
+  path = pdircat(p, tables_dir, SNMP_GAUGE_FILE, NULL);
+
+  PRIVS_ROOT
+  fd = open(path, O_RDWR|O_CREAT, 0600);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error opening SNMP gauge file '%s': %s", path, strerror(xerrno));
+    errno = xerrno;
+    return NULL;
+  }
+
+  if (ftruncate(fd, 0) < 0 ||
+      ftruncate(fd, mapsz) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+
+    errno = xerrno;
+    return NULL;
+  }
+#endif
+
+  map = mmap(NULL, mapsz, PROT_READ|PROT_WRITE, mmap_flags, fd, 0);
+  xerrno = errno;
+
+  if (fd >= 0) {
+    (void) close(fd);
+  }
+
+  if (map == MAP_FAILED) {
+    pr_trace_msg(trace_channel, 1,
+      "error mapping %lu bytes of gauge slots: %s", (unsigned long) mapsz,
+      strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  return map;
+}
+
+int snmp_gauge_open(pool *p, const char *tables_dir) {
+  register unsigned int i;
+  size_t pidsz;
+  void *map;
+
+  if (gauge_map != NULL) {
+    return 0;
+  }
+
+  memset(gauge_field_idx, 0, sizeof(gauge_field_idx));
+  for (i = 0; gauge_fields[i] > 0; i++) {
+    gauge_field_idx[gauge_fields[i]] = i + 1;
+  }
+
+  pidsz = SNMP_GAUGE_NSLOTS * sizeof(pid_t);
+  pidsz = ((pidsz + sizeof(int32_t) - 1) / sizeof(int32_t)) *
+    sizeof(int32_t);
+
+  gauge_mapsz = pidsz +
+    (SNMP_GAUGE_NSLOTS * SNMP_GAUGE_NFIELDS * sizeof(int32_t));
+
+  map = gauge_mmap(p, tables_dir, gauge_mapsz);
+  if (map == NULL) {
+    gauge_mapsz = 0;
+    return -1;
+  }
+
+  gauge_map = map;
+  gauge_pids = map;
+  gauge_values = (int32_t *) (((char *) map) + pidsz);
+  gauge_slot = -1;
+
+  pr_trace_msg(trace_channel, 9,
+    "mapped %u gauge slots (%lu bytes) for %u session gauges",
+    SNMP_GAUGE_NSLOTS, (unsigned long) gauge_mapsz,
+    (unsigned int) SNMP_GAUGE_NFIELDS);
+  return 0;
+}
+
+int snmp_gauge_close(pool *p) {
+  if (gauge_map == NULL) {
+    return 0;
+  }
+
+  if (munmap(gauge_map, gauge_mapsz) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 1, "error unmapping gauge slots: %s",
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  gauge_map = NULL;
+  gauge_mapsz = 0;
+  gauge_pids = NULL;
+  gauge_values = NULL;
+  gauge_slot = -1;
+
+  return 0;
+}
+
+/* Takes the given free slot for the given process, returning TRUE if it was
+ * still free.
+ */
+static int gauge_take_slot(unsigned int slot, pid_t pid) {
+#if defined(__GNUC__)
+  return __sync_bool_compare_and_swap(&(gauge_pids[slot]), 0, pid) ?
+    TRUE : FALSE;
+#else
+  int taken = FALSE;
+
+  /* Without atomic operations, the claims are serialized using the lock of
+   * one of the gauges.
+   */
+  if (snmp_db_wlock(SNMP_DB_DAEMON_F_CONN_COUNT) < 0) {
+    return FALSE;
+  }
+
+  if (gauge_pids[slot] == 0) {
+    gauge_pids[slot] = pid;
+    taken = TRUE;
+  }
+
+  (void) snmp_db_unlock(SNMP_DB_DAEMON_F_CONN_COUNT);
+  return taken;
+#endif
+}
+
+int snmp_gauge_claim(void) {
+  register unsigned int i;
+  unsigned int start;
+  pid_t pid;
+
+  if (gauge_map == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (gauge_slot >= 0) {
+    return 0;
+  }
+
+  /* A slot left by an earlier process with this same PID may still be in
+   * use; the agent cannot tell the two apart, and will reconcile both once
+   * this process has gone.
+   */
+  pid = getpid();
+  start = ((unsigned int) pid) % SNMP_GAUGE_NSLOTS;
+
+  for (i = 0; i < SNMP_GAUGE_NSLOTS; i++) {
+    unsigned int slot;
+
+    slot = (start + i) % SNMP_GAUGE_NSLOTS;
+    if (gauge_pids[slot] != 0) {
+      continue;
+    }
+
+    if (gauge_take_slot(slot, pid) == FALSE) {
+      continue;
+    }
+
+    memset(gauge_values + (slot * SNMP_GAUGE_NFIELDS), 0,
+      SNMP_GAUGE_NFIELDS * sizeof(int32_t));
+    gauge_slot = slot;
+
+    pr_trace_msg(trace_channel, 17, "claimed gauge slot %u for PID %lu",
+      slot, (unsigned long) pid);
+    return 0;
+  }
+
+  errno = ENOSPC;
+  return -1;
+}
+
+int snmp_gauge_release(void) {
+  register unsigned int i;
+  int32_t *values;
+
+  if (gauge_slot < 0) {
+    return 0;
+  }
+
+  values = gauge_values + (gauge_slot * SNMP_GAUGE_NFIELDS);
+  for (i = 0; i < SNMP_GAUGE_NFIELDS; i++) {
+    if (values[i] != 0) {
+      /* Keep recording, in case some other exit handler updates this gauge
+       * after us; the agent reconciles whatever is left.
+       */
+      pr_trace_msg(trace_channel, 9,
+        "gauge %u still has %ld from this session, leaving slot %d for "
+        "the agent", gauge_fields[i], (long) values[i], gauge_slot);
+      return 0;
+    }
+  }
+
+  gauge_pids[gauge_slot] = 0;
+  gauge_slot = -1;
+
+  return 0;
+}
+
+void snmp_gauge_note(unsigned int field, int32_t incr) {
+  unsigned int idx;
+
+  if (gauge_slot < 0 ||
+      incr == 0 ||
+      field >= SNMP_DB_COUNTER_NFIELDS) {
+    return;
+  }
+
+  idx = gauge_field_idx[field];
+  if (idx == 0) {
+    return;
+  }
+
+  gauge_values[(gauge_slot * SNMP_GAUGE_NFIELDS) + (idx - 1)] += incr;
+}
+
+/* Takes away whatever the given slot's (gone) owner left in the gauges,
+ * returning the number of gauges changed.  The subtraction stops at zero
+ * (see snmp_db_incr_value()); a net decrement, e.g. of a gauge which the
+ * daemon incremented before forking the session, is not added back.
+ */
+static unsigned int gauge_reconcile_slot(pool *p, unsigned int slot) {
+  register unsigned int i;
+  unsigned int count = 0;
+  int32_t *values;
+
+  values = gauge_values + (slot * SNMP_GAUGE_NFIELDS);
+  for (i = 0; i < SNMP_GAUGE_NFIELDS; i++) {
+    if (values[i] == 0) {
+      continue;
+    }
+
+    if (values[i] < 0) {
+      pr_trace_msg(trace_channel, 9, "not reconciling %s by %ld",
+        snmp_db_get_fieldstr(p, gauge_fields[i]), (long) -values[i]);
+      values[i] = 0;
+      continue;
+    }
+
+    if (snmp_db_incr_value(p, gauge_fields[i], -values[i]) < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error reconciling %s: %s", snmp_db_get_fieldstr(p, gauge_fields[i]),
+        strerror(errno));
+
+    } else {
+      pr_trace_msg(trace_channel, 9, "reconciled %s by %ld",
+        snmp_db_get_fieldstr(p, gauge_fields[i]), (long) -values[i]);
+      count++;
+    }
+
+    values[i] = 0;
+  }
+
+  return count;
+}
+
+int snmp_gauge_reconcile(pool *p) {
+  register unsigned int i;
+  pool *tmp_pool = NULL;
+  time_t now;
+
+  if (gauge_map == NULL) {
+    return 0;
+  }
+
+  now = time(NULL);
+  if (now >= gauge_last_reconcile &&
+      now - gauge_last_reconcile < SNMP_GAUGE_RECONCILE_INTERVAL) {
+    return 0;
+  }
+
+  gauge_last_reconcile = now;
+
+  for (i = 0; i < SNMP_GAUGE_NSLOTS; i++) {
+    pid_t pid;
+    unsigned int count;
+
+    pid = gauge_pids[i];
+    if (pid == 0) {
+      continue;
+    }
+
+    /* EPERM means the process exists, just not as our user. */
+    if (kill(pid, 0) == 0 ||
+        errno != ESRCH) {
+      continue;
+    }
+
+    if (tmp_pool == NULL) {
+      tmp_pool = make_sub_pool(p);
+    }
+
+    count = gauge_reconcile_slot(tmp_pool, i);
+    if (count > 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "session process %lu ended without updating %u %s, reconciled",
+        (unsigned long) pid, count, count != 1 ? "gauges" : "gauge");
+    }
+
+    gauge_pids[i] = 0;
+  }
+
+  if (tmp_pool != NULL) {
+    destroy_pool(tmp_pool);
+  }
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * ProFTPD - mod_snmp session gauge ownership
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_GAUGE_H
+#define MOD_SNMP_GAUGE_H
+
+/* The most session processes whose gauge contributions can be tracked at
+ * once.  Sessions beyond this are not tracked, and so are not reconciled if
+ * they die without cleaning up.
+ */
+#define SNMP_GAUGE_NSLOTS		4096
+
+/* How often, in seconds, the agent looks for dead session processes. */
+#define SNMP_GAUGE_RECONCILE_INTERVAL	5
+
+/* Maps the ownership slots, shared by the daemon, the agent, and the
+ * sessions, if not already mapped.  The slots are kept across restarts,
+ * like the SNMPTables.
+ */
+int snmp_gauge_open(pool *p, const char *tables_dir);
+int snmp_gauge_close(pool *p);
+
+/* Claims a slot for the current session process.  From then on, every
+ * change the session makes to a session gauge (e.g. connectionCount) is
+ * also recorded in its slot.
+ */
+int snmp_gauge_claim(void);
+
+/* Gives up the current session's slot, if its gauge contributions are all
+ * zero.  Otherwise the slot is left for the agent to reconcile, once the
+ * process has gone.
+ */
+int snmp_gauge_release(void);
+
+/* Records a change to the given field in the current session's slot, if
+ * any.  Called by snmp_db_incr_value(), with the change actually made.
+ */
+void snmp_gauge_note(unsigned int field, int32_t incr);
+
+/* Looks for slots whose processes no longer exist, and subtracts their
+ * recorded contributions from the gauges, if at least the reconcile interval
+ * has passed since the last look.  Called periodically by the agent process.
+ */
+int snmp_gauge_reconcile(pool *p);
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * ProFTPD - mod_snmp hashing of cache keys
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "hash.h"
+
+uint32_t snmp_hash_bytes(uint32_t hash, const void *data, size_t datalen) {
+  register unsigned int i;
+  const unsigned char *ptr;
+
+  ptr = data;
+  for (i = 0; i < datalen; i++) {
+    hash ^= ptr[i];
+    hash *= 16777619UL;
+  }
+
+  return hash;
+}
+
+int snmp_addr_key_init(struct snmp_addr_key *key, const pr_netaddr_t *addr,
+    uint32_t *hash) {
+  const void *data;
+  size_t datalen;
+
+  if (key == NULL ||
+      addr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  data = pr_netaddr_get_inaddr(addr);
+  datalen = pr_netaddr_get_inaddr_len(addr);
+
+  if (data == NULL ||
+      datalen == 0 ||
+      datalen > sizeof(key->addr)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(key, 0, sizeof(struct snmp_addr_key));
+  key->family = pr_netaddr_get_family(addr);
+  memcpy(key->addr, data, datalen);
+  key->addrlen = datalen;
+
+  if (hash != NULL) {
+    *hash = snmp_hash_bytes(SNMP_HASH_INIT, key->addr, key->addrlen);
+  }
+
+  return 0;
+}
+
+int snmp_addr_key_match(const struct snmp_addr_key *key1,
+    const struct snmp_addr_key *key2) {
+  if (key1->family != key2->family ||
+      key1->addrlen != key2->addrlen ||
+      memcmp(key1->addr, key2->addr, key1->addrlen) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,56 @@
+/*
+ * ProFTPD - mod_snmp hashing of cache keys
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_HASH_H
+#define MOD_SNMP_HASH_H
+
+/* The FNV-1a hash, as used by the caches and table layouts; start with
+ * SNMP_HASH_INIT, and feed each part of the key in turn.
+ */
+#define SNMP_HASH_INIT			2166136261UL
+
+uint32_t snmp_hash_bytes(uint32_t hash, const void *data, size_t datalen);
+
+/* A source address, as used to key the per-address caches (e.g. the ACL
+ * decisions, the rate limit buckets).  The port is not part of the key.
+ */
+struct snmp_addr_key {
+  int family;
+  unsigned char addr[16];
+  size_t addrlen;
+};
+
+/* Fills in the key for the given address, and its hash.  Returns -1, with
+ * errno set to EINVAL, if the address cannot be used as a key.
+ */
+int snmp_addr_key_init(struct snmp_addr_key *key, const pr_netaddr_t *addr,
+  uint32_t *hash);
+
+/* Returns TRUE if the keys are for the same address, FALSE otherwise. */
+int snmp_addr_key_match(const struct snmp_addr_key *key1,
+  const struct snmp_addr_key *key2);
+
+#endif
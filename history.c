@@ -0,0 +1,599 @@
+/*
+ * ProFTPD - mod_snmp counter history
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "db.h"
+#include "hash.h"
+#include "mib.h"
+#include "smi.h"
+#include "history.h"
+
+/* The rings are mapped by the daemon, so that they outlive any one agent
+ * process, and are only written (and read) by the agent.  The mapping is
+ * a header, followed by the sample times, followed by each counter's ring
+ * of values, in counter table order.  Samples are numbered from 1; sample
+ * N is kept in slot (N - 1) % nsamples of each ring.
+ */
+
+#define SNMP_HISTORY_MAGIC		"PRSNMPH"
+#define SNMP_HISTORY_VERSION		1
+
+#define SNMP_HISTORY_FILE		"history.dat"
+
+struct snmp_history_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t interval;
+  uint32_t nsamples;
+  uint32_t ncounters;
+  uint32_t layout_hash;
+
+  /* The number of the next sample to be taken, and when the last one was. */
+  uint32_t next_sample;
+  uint32_t last_sample_time;
+  uint32_t reserved;
+};
+
+static struct snmp_history_header *history_hdr = NULL;
+static size_t history_mapsz = 0;
+static int history_persistent = FALSE;
+
+static uint32_t *history_times = NULL;
+static uint32_t *history_values = NULL;
+
+static unsigned int history_fields[SNMP_DB_COUNTER_NFIELDS];
+static unsigned int history_nfields = 0;
+
+static const char *trace_channel = "snmp.history";
+
+/* The layout hash covers the counter fields, so that rings restored from a
+ * file are only used if they hold the same counters, in the same order.
+ */
+static uint32_t history_get_layout_hash(unsigned int *fields,
+    unsigned int nfields) {
+  register unsigned int i;
+  uint32_t h = SNMP_HASH_INIT;
+
+  for (i = 0; i < nfields; i++) {
+    register unsigned int j;
+    unsigned char field[4];
+
+    /* Hashed least significant byte first, whatever the byte order. */
+    for (j = 0; j < sizeof(field); j++) {
+      field[j] = (fields[i] >> (j * 8)) & 0xff;
+    }
+
+    h = snmp_hash_bytes(h, field, sizeof(field));
+  }
+
+  return h;
+}
+
+static void *history_map(pool *p, const char *tables_dir, size_t mapsz,
+    int persistent, int *restored) {
+  int fd = -1, mmap_flags = MAP_SHARED, use_file = TRUE, xerrno;
+  void *map;
+
+  *restored = FALSE;
+
+  /* Without anonymous mappings, the rings are always mapped from the file;
+   * it is simply not restored.
+   */
+#if defined(MAP_ANONYMOUS)
+  if (persistent == FALSE) {
+    mmap_flags |= MAP_ANONYMOUS;
+    use_file = FALSE;
+  }
+#elif defined(MAP_ANON)
+  if (persistent == FALSE) {
+    mmap_flags |= MAP_ANON;
+    use_file = FALSE;
+  }
+#endif
+
+  if (use_file == TRUE) {
+    struct stat st;
+    char *path;
+
+    path = pdircat(p, tables_dir, SNMP_HISTORY_FILE, NULL);
+
+    PRIVS_ROOT
+    fd = open(path, O_RDWR|O_CREAT, 0600);
+    xerrno = errno;
+    PRIVS_RELINQUISH
+
+    if (fd < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error opening SNMP history file '%s': %s", path, strerror(xerrno));
+      errno = xerrno;
+      return NULL;
+    }
+
+    if (fstat(fd, &st) < 0) {
+      xerrno = errno;
+      (void) close(fd);
+
+      errno = xerrno;
+      return NULL;
+    }
+
+    if (persistent == TRUE &&
+        (size_t) st.st_size == mapsz) {
+      *restored = TRUE;
+
+    } else {
+      /* Truncating and then extending the file zero-fills it. */
+      if (ftruncate(fd, 0) < 0 ||
+          ftruncate(fd, mapsz) < 0) {
+        xerrno = errno;
+
+        pr_trace_msg(trace_channel, 1,
+          "error sizing SNMP history file '%s' to %lu bytes: %s", path,
+          (unsigned long) mapsz, strerror(xerrno));
+        (void) close(fd);
+
+        errno = xerrno;
+        return NULL;
+      }
+    }
+  }
+
+  map = mmap(NULL, mapsz, PROT_READ|PROT_WRITE, mmap_flags, fd, 0);
+  xerrno = errno;
+
+  /* The mapping does not need the fd; nothing is locked. */
+  if (fd >= 0) {
+    (void) close(fd);
+  }
+
+  if (map == MAP_FAILED) {
+    pr_trace_msg(trace_channel, 1,
+      "error mapping %lu bytes of SNMP history: %s", (unsigned long) mapsz,
+      strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  return map;
+}
+
+int snmp_history_close(pool *p) {
+  if (history_hdr == NULL) {
+    return 0;
+  }
+
+  if (history_persistent == TRUE) {
+    if (msync(history_hdr, history_mapsz, MS_SYNC) < 0) {
+      pr_trace_msg(trace_channel, 1, "error syncing SNMP history: %s",
+        strerror(errno));
+    }
+  }
+
+  if (munmap(history_hdr, history_mapsz) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 1, "error unmapping SNMP history: %s",
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  history_hdr = NULL;
+  history_mapsz = 0;
+  history_times = history_values = NULL;
+  history_nfields = 0;
+
+  return 0;
+}
+
+int snmp_history_open(pool *p, const char *tables_dir, int persistent,
+    unsigned int interval, unsigned int nsamples) {
+  struct snmp_history_header *hdr;
+  unsigned int fields[SNMP_DB_COUNTER_NFIELDS];
+  int nfields, restored = FALSE;
+  uint32_t layout_hash;
+  size_t mapsz;
+
+  if (interval == 0) {
+    return snmp_history_close(p);
+  }
+
+  if (tables_dir == NULL ||
+      nsamples == 0 ||
+      nsamples > SNMP_HISTORY_MAX_SAMPLES) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  nfields = snmp_mib_get_counter_fields(fields, SNMP_DB_COUNTER_NFIELDS);
+  if (nfields < 0) {
+    return -1;
+  }
+
+  layout_hash = history_get_layout_hash(fields, nfields);
+  mapsz = sizeof(struct snmp_history_header) +
+    (nsamples * sizeof(uint32_t)) +
+    (nfields * nsamples * sizeof(uint32_t));
+
+  /* On restart, keep the existing rings if nothing about them changed. */
+  if (history_hdr != NULL) {
+    if (history_persistent == persistent &&
+        history_hdr->interval == interval &&
+        history_hdr->nsamples == nsamples &&
+        history_hdr->ncounters == (uint32_t) nfields &&
+        history_hdr->layout_hash == layout_hash) {
+      return 0;
+    }
+
+    (void) snmp_history_close(p);
+  }
+
+  hdr = history_map(p, tables_dir, mapsz, persistent, &restored);
+  if (hdr == NULL) {
+    return -1;
+  }
+
+  if (restored == TRUE) {
+    if (memcmp(hdr->magic, SNMP_HISTORY_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != SNMP_HISTORY_VERSION ||
+        hdr->interval != interval ||
+        hdr->nsamples != nsamples ||
+        hdr->ncounters != (uint32_t) nfields ||
+        hdr->layout_hash != layout_hash) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "SNMP history file has a different version/layout, reinitializing");
+      restored = FALSE;
+    }
+  }
+
+  if (restored == FALSE) {
+    memset(hdr, 0, mapsz);
+
+    memcpy(hdr->magic, SNMP_HISTORY_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNMP_HISTORY_VERSION;
+    hdr->interval = interval;
+    hdr->nsamples = nsamples;
+    hdr->ncounters = nfields;
+    hdr->layout_hash = layout_hash;
+    hdr->next_sample = 1;
+
+  } else {
+    pr_trace_msg(trace_channel, 9,
+      "restored %lu SNMP history samples", (unsigned long)
+      (hdr->next_sample > nsamples ? nsamples : hdr->next_sample - 1));
+  }
+
+  history_hdr = hdr;
+  history_mapsz = mapsz;
+  history_persistent = persistent;
+
+  history_times = (uint32_t *) (hdr + 1);
+  history_values = history_times + nsamples;
+
+  memcpy(history_fields, fields, nfields * sizeof(unsigned int));
+  history_nfields = nfields;
+
+  pr_trace_msg(trace_channel, 9,
+    "mapped history of %u samples, every %u secs, for %d counters "
+    "(%lu bytes)", nsamples, interval, nfields, (unsigned long) mapsz);
+  return 0;
+}
+
+/* Returns TRUE if the counter's samples should be reported, i.e. if the
+ * counter's module is present, and its rows are in the requester's view.
+ * Views are applied to each counter's rows as a whole.
+ */
+static int history_is_visible(const struct snmp_view *view, oid_t col,
+    unsigned int field) {
+  struct snmp_mib *mib;
+  oid_t oid[] = { SNMP_COUNTER_HISTORY_OID_BASE, 0, 0 };
+  unsigned int oidlen = SNMP_COUNTER_HISTORY_OID_BASELEN + 2;
+
+  mib = snmp_mib_get_by_field(field);
+  if (mib == NULL ||
+      mib->mib_enabled == FALSE) {
+    return FALSE;
+  }
+
+  oid[oidlen-2] = col;
+  oid[oidlen-1] = field;
+
+  return snmp_view_allows_oid(view, oid, oidlen);
+}
+
+int snmp_history_poll(pool *p) {
+  register unsigned int i;
+  pool *tmp_pool;
+  time_t now;
+  uint32_t slot, nsamples, interval;
+
+  if (history_hdr == NULL) {
+    return 0;
+  }
+
+  now = time(NULL);
+  interval = history_hdr->interval;
+  nsamples = history_hdr->nsamples;
+
+  if (history_hdr->last_sample_time != 0 &&
+      (uint32_t) now >= history_hdr->last_sample_time &&
+      (uint32_t) now - history_hdr->last_sample_time < interval) {
+    return 0;
+  }
+
+  tmp_pool = make_sub_pool(p);
+
+  if (snmp_db_snapshot_begin(p) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error taking snapshot of SNMPTables, reading live values: %s",
+      strerror(errno));
+  }
+
+  slot = (history_hdr->next_sample - 1) % nsamples;
+
+  for (i = 0; i < history_nfields; i++) {
+    struct snmp_mib *mib;
+    int32_t int_value = 0;
+    char *str_value = NULL;
+    size_t str_valuelen = 0;
+
+    mib = snmp_mib_get_by_field(history_fields[i]);
+    if (mib != NULL &&
+        mib->mib_enabled == TRUE) {
+      if (snmp_db_get_value(tmp_pool, history_fields[i], &int_value,
+          &str_value, &str_valuelen) < 0) {
+        pr_trace_msg(trace_channel, 3, "error reading value for field %s: %s",
+          snmp_db_get_fieldstr(tmp_pool, history_fields[i]), strerror(errno));
+        int_value = 0;
+      }
+    }
+
+    history_values[(i * nsamples) + slot] = (uint32_t) int_value;
+  }
+
+  (void) snmp_db_snapshot_end();
+  destroy_pool(tmp_pool);
+
+  history_times[slot] = (uint32_t) now;
+  history_hdr->next_sample++;
+
+  /* Keep to the interval's schedule, unless we fell more than an interval
+   * behind, or the clock went backwards.
+   */
+  if (history_hdr->last_sample_time == 0 ||
+      (uint32_t) now < history_hdr->last_sample_time ||
+      (uint32_t) now - history_hdr->last_sample_time >= (2 * interval)) {
+    history_hdr->last_sample_time = (uint32_t) now;
+
+  } else {
+    history_hdr->last_sample_time += interval;
+  }
+
+  pr_trace_msg(trace_channel, 19, "took history sample %lu in slot %lu",
+    (unsigned long) (history_hdr->next_sample - 1), (unsigned long) slot);
+  return 0;
+}
+
+/* Returns the numbers of the oldest and newest samples kept, or -1 if there
+ * are none yet.
+ */
+static int history_get_range(uint32_t *first, uint32_t *last) {
+  if (history_hdr == NULL ||
+      history_hdr->next_sample <= 1) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  *last = history_hdr->next_sample - 1;
+  *first = 1;
+  if (*last > history_hdr->nsamples) {
+    *first = *last - history_hdr->nsamples + 1;
+  }
+
+  return 0;
+}
+
+static void history_get_sample(oid_t col, unsigned int field_idx,
+    uint32_t sample, unsigned char *smi_type, int32_t *int_value) {
+  uint32_t slot;
+
+  slot = (sample - 1) % history_hdr->nsamples;
+
+  *smi_type = SNMP_SMI_GAUGE32;
+  if (col == SNMP_MIB_COUNTER_HISTORY_COL_TIME) {
+    *int_value = (int32_t) history_times[slot];
+
+  } else {
+    *int_value = (int32_t) history_values[
+      (field_idx * history_hdr->nsamples) + slot];
+  }
+}
+
+/* Returns the index of the given field in the rings, or -1. */
+static int history_get_field_idx(oid_t field) {
+  register unsigned int i;
+
+  for (i = 0; i < history_nfields; i++) {
+    if (history_fields[i] == field) {
+      return (int) i;
+    }
+  }
+
+  return -1;
+}
+
+int snmp_history_is_oid(oid_t *oid, unsigned int oidlen) {
+  oid_t base_oid[] = { SNMP_COUNTER_HISTORY_OID_BASE };
+  unsigned int baselen = SNMP_COUNTER_HISTORY_OID_BASELEN;
+
+  if (oid == NULL ||
+      oidlen <= baselen ||
+      memcmp(oid, base_oid, baselen * sizeof(oid_t)) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int snmp_history_get(pool *p, const struct snmp_view *view, oid_t *oid,
+    unsigned int oidlen, unsigned char *smi_type, int32_t *int_value) {
+  unsigned int baselen = SNMP_COUNTER_HISTORY_OID_BASELEN;
+  oid_t col;
+  uint32_t first, last, sample;
+  int field_idx;
+
+  if (oid == NULL ||
+      smi_type == NULL ||
+      int_value == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Column, counter ID, and sample number. */
+  if (oidlen != baselen + 3 ||
+      snmp_history_is_oid(oid, oidlen) == FALSE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  col = oid[baselen];
+  sample = oid[baselen + 2];
+
+  if (col != SNMP_MIB_COUNTER_HISTORY_COL_TIME &&
+      col != SNMP_MIB_COUNTER_HISTORY_COL_VALUE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  field_idx = history_get_field_idx(oid[baselen + 1]);
+  if (field_idx < 0 ||
+      history_get_range(&first, &last) < 0 ||
+      sample < first ||
+      sample > last ||
+      history_is_visible(view, col, history_fields[field_idx]) == FALSE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  history_get_sample(col, field_idx, sample, smi_type, int_value);
+  return 0;
+}
+
+int snmp_history_get_next(pool *p, const struct snmp_view *view, oid_t *oid,
+    unsigned int oidlen, oid_t *next_oid, unsigned int *next_oidlen,
+    unsigned char *smi_type, int32_t *int_value) {
+  register unsigned int i, j;
+  oid_t base_oid[] = { SNMP_COUNTER_HISTORY_OID_BASE };
+  oid_t cols[] = {
+    SNMP_MIB_COUNTER_HISTORY_COL_TIME,
+    SNMP_MIB_COUNTER_HISTORY_COL_VALUE
+  };
+  unsigned int baselen = SNMP_COUNTER_HISTORY_OID_BASELEN, restlen = 0;
+  oid_t *rest = NULL;
+  uint32_t first, last;
+
+  if (oid == NULL ||
+      next_oid == NULL ||
+      next_oidlen == NULL ||
+      smi_type == NULL ||
+      int_value == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (history_get_range(&first, &last) < 0) {
+    return -1;
+  }
+
+  /* Where is the given OID, relative to the table?  If it comes before the
+   * table (or is a prefix of it), the first row is next.
+   */
+  for (i = 0; i < oidlen && i < baselen; i++) {
+    if (oid[i] != base_oid[i]) {
+      break;
+    }
+  }
+
+  if (i < oidlen &&
+      i < baselen) {
+    if (oid[i] > base_oid[i]) {
+      errno = ENOENT;
+      return -1;
+    }
+
+  } else if (oidlen > baselen) {
+    rest = oid + baselen;
+    restlen = oidlen - baselen;
+  }
+
+  for (i = 0; i < sizeof(cols) / sizeof(oid_t); i++) {
+    if (restlen > 0 &&
+        cols[i] < rest[0]) {
+      continue;
+    }
+
+    for (j = 0; j < history_nfields; j++) {
+      uint32_t sample = first;
+
+      if (restlen > 1 &&
+          cols[i] == rest[0]) {
+        if (history_fields[j] < rest[1]) {
+          continue;
+        }
+
+        if (history_fields[j] == rest[1] &&
+            restlen > 2) {
+          /* The given OID is this row's, or within it; the next row's
+           * sample follows.
+           */
+          if (rest[2] >= last) {
+            continue;
+          }
+
+          if (rest[2] + 1 > sample) {
+            sample = rest[2] + 1;
+          }
+        }
+      }
+
+      if (history_is_visible(view, cols[i], history_fields[j]) == FALSE) {
+        continue;
+      }
+
+      memmove(next_oid, base_oid, baselen * sizeof(oid_t));
+      next_oid[baselen] = cols[i];
+      next_oid[baselen + 1] = history_fields[j];
+      next_oid[baselen + 2] = sample;
+      *next_oidlen = baselen + 3;
+
+      history_get_sample(cols[i], j, sample, smi_type, int_value);
+      return 0;
+    }
+  }
+
+  errno = ENOENT;
+  return -1;
+}
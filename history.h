@@ -0,0 +1,69 @@
+/*
+ * ProFTPD - mod_snmp counter history
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "asn1.h"
+#include "view.h"
+
+#ifndef MOD_SNMP_HISTORY_H
+#define MOD_SNMP_HISTORY_H
+
+/* The most samples kept for each counter. */
+#define SNMP_HISTORY_MAX_SAMPLES	100000
+
+/* Maps the history rings, one per counter table row, each holding the
+ * given number of samples taken every interval seconds.  The rings are
+ * kept across restarts if their layout does not change; if persistent is
+ * TRUE, they are kept in a file in the given directory, and restored from
+ * it, like the SNMPTables.  An interval of zero unmaps the rings.
+ */
+int snmp_history_open(pool *p, const char *tables_dir, int persistent,
+  unsigned int interval, unsigned int nsamples);
+int snmp_history_close(pool *p);
+
+/* Samples every counter, if at least the configured interval has passed
+ * since the last sample.  Called periodically by the agent process.
+ */
+int snmp_history_poll(pool *p);
+
+/* Returns TRUE if the given OID is within the history table, FALSE
+ * otherwise.
+ */
+int snmp_history_is_oid(oid_t *oid, unsigned int oidlen);
+
+/* Looks up the value of the given history table OID, returning -1, with
+ * errno set to ENOENT, if there is no such sample.
+ */
+int snmp_history_get(pool *p, const struct snmp_view *view, oid_t *oid,
+  unsigned int oidlen, unsigned char *smi_type, int32_t *int_value);
+
+/* Finds the first history table OID after the given OID, and its value,
+ * returning -1, with errno set to ENOENT, if there is none.  The next OID
+ * must have room for SNMP_MIB_MAX_OIDLEN sub-identifiers.
+ */
+int snmp_history_get_next(pool *p, const struct snmp_view *view, oid_t *oid,
+  unsigned int oidlen, oid_t *next_oid, unsigned int *next_oidlen,
+  unsigned char *smi_type, int32_t *int_value);
+
+#endif
@@ -0,0 +1,821 @@
+/*
+ * ProFTPD - mod_snmp OpenMetrics exporter
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "db.h"
+#include "mib.h"
+#include "registry.h"
+#include "smi.h"
+#include "metrics.h"
+
+/* The initial size of the rendering buffer.  The buffer grows as needed, and
+ * is kept for the next scrape.
+ */
+#define SNMP_METRICS_BUFSZ			(64 * 1024)
+
+/* The largest HTTP request we are willing to read. */
+#define SNMP_METRICS_MAX_REQUEST_SIZE		4096
+
+/* How long, in seconds, a client has, in all, to send its request and read
+ * the response.  The agent handles one request at a time, so this bounds how
+ * long a slow client can delay SNMP requests.
+ */
+#define SNMP_METRICS_IO_TIMEOUT			2
+
+#define SNMP_METRICS_CONTENT_TYPE \
+  "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+static pool *metrics_pool = NULL;
+static char *metrics_buf = NULL;
+static size_t metrics_bufsz = 0, metrics_buflen = 0;
+
+/* The last metric family described, so that each family's metadata is only
+ * rendered once.
+ */
+static char metrics_family[128];
+
+static const char *metrics_hist_protos[SNMP_DB_HIST_NPROTOS] = {
+  "ftp", "ftps", "sftp", "scp"
+};
+
+static const char *metrics_hist_metrics[SNMP_DB_HIST_NXFER_METRICS] = {
+  "transfer_duration_milliseconds",
+  "transfer_size_kilobytes",
+  "transfer_rate_kilobytes_per_second"
+};
+
+/* When the current request must be done, in milliseconds. */
+static uint64_t metrics_deadline_ms = 0;
+
+static const char *trace_channel = "snmp.metrics";
+
+static void metrics_grow(size_t len) {
+  size_t new_bufsz;
+  char *new_buf;
+
+  new_bufsz = metrics_bufsz;
+  while (new_bufsz - metrics_buflen < len) {
+    new_bufsz *= 2;
+  }
+
+  pr_trace_msg(trace_channel, 9, "growing metrics buffer from %lu to %lu bytes",
+    (unsigned long) metrics_bufsz, (unsigned long) new_bufsz);
+
+  new_buf = palloc(metrics_pool, new_bufsz);
+  memcpy(new_buf, metrics_buf, metrics_buflen);
+
+  metrics_buf = new_buf;
+  metrics_bufsz = new_bufsz;
+}
+
+static void metrics_append(const char *fmt, ...) {
+  va_list msg;
+  int len;
+
+  while (TRUE) {
+    size_t avail;
+
+    avail = metrics_bufsz - metrics_buflen;
+
+    va_start(msg, fmt);
+    len = vsnprintf(metrics_buf + metrics_buflen, avail, fmt, msg);
+    va_end(msg);
+
+    if (len < 0) {
+      return;
+    }
+
+    if ((size_t) len < avail) {
+      metrics_buflen += len;
+      return;
+    }
+
+    metrics_grow(len + 1);
+  }
+}
+
+/* Renders the TYPE and HELP metadata for a family, unless that family was the
+ * one most recently described.
+ */
+static void metrics_describe(const char *family, const char *type,
+    const char *help) {
+  if (strcmp(metrics_family, family) == 0) {
+    return;
+  }
+
+  sstrncpy(metrics_family, family, sizeof(metrics_family));
+
+  metrics_append("# TYPE %s %s\n", family, type);
+  if (help != NULL) {
+    metrics_append("# HELP %s %s\n", family, help);
+  }
+}
+
+/* Returns the MIB name, without the common prefix. */
+static const char *metrics_get_help(const char *mib_name) {
+  size_t prefix_len;
+
+  prefix_len = strlen(SNMP_MIB_NAME_PREFIX);
+  if (strncmp(mib_name, SNMP_MIB_NAME_PREFIX, prefix_len) == 0) {
+    return mib_name + prefix_len;
+  }
+
+  return mib_name;
+}
+
+/* Converts a MIB name, e.g. "daemon.connectionCount", into a metric name,
+ * e.g. "proftpd_daemon_connection_count".
+ */
+static char *metrics_get_name(pool *p, const char *mib_name) {
+  const char *ptr;
+  char *name;
+  size_t i = 0;
+
+  mib_name = metrics_get_help(mib_name);
+
+  /* Each character may become two, plus the "proftpd_" prefix. */
+  name = pcalloc(p, (strlen(mib_name) * 2) + 9);
+  sstrncpy(name, "proftpd_", 9);
+  i = 8;
+
+  for (ptr = mib_name; *ptr; ptr++) {
+    if (*ptr == '.') {
+      name[i++] = '_';
+
+    } else if (isupper((int) *ptr)) {
+      if (i > 0 &&
+          name[i-1] != '_') {
+        name[i++] = '_';
+      }
+
+      name[i++] = tolower((int) *ptr);
+
+    } else if (isalnum((int) *ptr)) {
+      name[i++] = *ptr;
+
+    } else {
+      name[i++] = '_';
+    }
+  }
+
+  return name;
+}
+
+static char *metrics_escape(pool *p, const char *str, size_t len) {
+  register unsigned int i;
+  char *escaped;
+  size_t j = 0;
+
+  escaped = pcalloc(p, (len * 2) + 1);
+
+  for (i = 0; i < len; i++) {
+    switch (str[i]) {
+      case '\\':
+      case '"':
+        escaped[j++] = '\\';
+        escaped[j++] = str[i];
+        break;
+
+      case '\n':
+        escaped[j++] = '\\';
+        escaped[j++] = 'n';
+        break;
+
+      default:
+        escaped[j++] = str[i];
+        break;
+    }
+  }
+
+  return escaped;
+}
+
+static uint32_t metrics_get_count(pool *p, unsigned int field) {
+  int32_t int_value = 0;
+  char *str_value = NULL;
+  size_t str_valuelen = 0;
+
+  if (snmp_db_get_value(p, field, &int_value, &str_value,
+      &str_valuelen) < 0) {
+    pr_trace_msg(trace_channel, 5, "error reading value for field %s: %s",
+      snmp_db_get_fieldstr(p, field), strerror(errno));
+    return 0;
+  }
+
+  return (uint32_t) int_value;
+}
+
+/* Renders a histogram from its contiguous bucket fields, starting with the
+ * given field.  The last bucket catches everything above the highest bound,
+ * and so becomes the "+Inf" bucket.
+ */
+static void metrics_render_hist(pool *p, const char *family,
+    const char *labels, unsigned int bucket_field) {
+  register unsigned int i;
+  uint64_t total = 0;
+  const char *sep;
+
+  sep = (*labels != '\0' ? "," : "");
+
+  for (i = 0; i < SNMP_DB_HIST_NBUCKETS; i++) {
+    total += metrics_get_count(p, bucket_field + i);
+
+    if (i == SNMP_DB_HIST_NBUCKETS - 1) {
+      break;
+    }
+
+    metrics_append("%s_bucket{%s%sle=\"%lu.0\"} %llu\n", family, labels, sep,
+      (unsigned long) snmp_db_hist_get_upper_bound(i),
+      (unsigned long long) total);
+  }
+
+  metrics_append("%s_bucket{%s%sle=\"+Inf\"} %llu\n", family, labels, sep,
+    (unsigned long long) total);
+
+  if (*labels != '\0') {
+    metrics_append("%s_count{%s} %llu\n", family, labels,
+      (unsigned long long) total);
+
+  } else {
+    metrics_append("%s_count %llu\n", family, (unsigned long long) total);
+  }
+}
+
+static void metrics_render_xfer_hist(pool *p, struct snmp_mib *mib) {
+  unsigned int idx, bucket, metric, proto;
+  char *family;
+
+  idx = mib->db_field - SNMP_DB_HIST_F_XFER_BUCKET_BASE;
+  bucket = idx % SNMP_DB_HIST_NBUCKETS;
+  metric = (idx / SNMP_DB_HIST_NBUCKETS) % SNMP_DB_HIST_NXFER_METRICS;
+  proto = (idx / SNMP_DB_HIST_NBUCKETS) / SNMP_DB_HIST_NXFER_METRICS;
+
+  /* The whole histogram is rendered when its first bucket is seen. */
+  if (bucket != 0) {
+    return;
+  }
+
+  family = pstrcat(p, "proftpd_", metrics_hist_protos[proto], "_",
+    metrics_hist_metrics[metric], NULL);
+
+  metrics_describe(family, "histogram", metrics_get_help(mib->mib_name));
+  metrics_render_hist(p, family, "", mib->db_field);
+}
+
+static void metrics_render_cmd(pool *p, struct snmp_mib *mib) {
+  unsigned int idx, cmd_idx, slot;
+  uint32_t count;
+  const char *help;
+  char *labels;
+
+  idx = mib->db_field - SNMP_DB_CMD_F_BASE;
+  cmd_idx = idx / SNMP_DB_CMD_NSLOTS;
+  slot = idx % SNMP_DB_CMD_NSLOTS;
+
+  /* Only the first latency bucket is needed, for the whole histogram. */
+  if (slot > 2) {
+    return;
+  }
+
+  /* Commands which have never been seen are omitted, rather than rendering
+   * thousands of zeroes.
+   */
+  count = metrics_get_count(p, SNMP_DB_CMD_F_COUNT(cmd_idx));
+  if (count == 0) {
+    return;
+  }
+
+  help = metrics_get_help(mib->mib_name);
+  labels = pstrcat(p, "command=\"", snmp_db_cmd_get_name(cmd_idx), "\"",
+    NULL);
+
+  switch (slot) {
+    case 0:
+      metrics_describe("proftpd_ftp_command", "counter", help);
+      metrics_append("proftpd_ftp_command_total{%s} %lu\n", labels,
+        (unsigned long) count);
+      break;
+
+    case 1:
+      metrics_describe("proftpd_ftp_command_errors", "counter", help);
+      metrics_append("proftpd_ftp_command_errors_total{%s} %lu\n", labels,
+        (unsigned long) metrics_get_count(p, mib->db_field));
+      break;
+
+    default:
+      metrics_describe("proftpd_ftp_command_latency_microseconds",
+        "histogram", help);
+      metrics_render_hist(p, "proftpd_ftp_command_latency_microseconds",
+        labels, mib->db_field);
+      break;
+  }
+}
+
+static void metrics_render_scalar(pool *p, struct snmp_mib *mib) {
+  int32_t int_value = 0;
+  char *str_value = NULL;
+  size_t str_valuelen = 0;
+  const char *help;
+  char *name;
+
+  switch (snmp_db_get_field_db_id(mib->db_field)) {
+    case SNMP_DB_ID_NOTIFY:
+    case SNMP_DB_ID_CONN:
+      /* These only have meaning within a session, or a notification. */
+      return;
+
+    default:
+      break;
+  }
+
+  if (snmp_db_get_value(p, mib->db_field, &int_value, &str_value,
+      &str_valuelen) < 0) {
+    pr_trace_msg(trace_channel, 5, "error reading value for field %s: %s",
+      snmp_db_get_fieldstr(p, mib->db_field), strerror(errno));
+    return;
+  }
+
+  name = metrics_get_name(p, mib->mib_name);
+  help = metrics_get_help(mib->mib_name);
+
+  switch (mib->smi_type) {
+    case SNMP_SMI_COUNTER32: {
+      size_t namelen;
+
+      /* OpenMetrics adds the "_total" suffix to the counter samples itself. */
+      namelen = strlen(name);
+      if (namelen > 6 &&
+          strcmp(name + namelen - 6, "_total") == 0) {
+        name[namelen - 6] = '\0';
+      }
+
+      metrics_describe(name, "counter", help);
+      metrics_append("%s_total %lu\n", name, (unsigned long) int_value);
+      break;
+    }
+
+    case SNMP_SMI_GAUGE32:
+      metrics_describe(name, "gauge", help);
+
+      if (snmp_db_get_field_db_id(mib->db_field) == SNMP_DB_ID_RATE) {
+        /* The rate gauges are kept in hundredths. */
+        metrics_append("%s %lu.%02lu\n", name,
+          (unsigned long) ((uint32_t) int_value / 100),
+          (unsigned long) ((uint32_t) int_value % 100));
+
+      } else {
+        metrics_append("%s %lu\n", name, (unsigned long) int_value);
+      }
+      break;
+
+    case SNMP_SMI_INTEGER:
+      metrics_describe(name, "gauge", help);
+      metrics_append("%s %ld\n", name, (long) int_value);
+      break;
+
+    case SNMP_SMI_TIMETICKS:
+      /* TimeTicks are hundredths of seconds. */
+      name = pstrcat(p, name, "_seconds", NULL);
+      metrics_describe(name, "gauge", help);
+      metrics_append("%s %lu.%02lu\n", name,
+        (unsigned long) ((uint32_t) int_value / 100),
+        (unsigned long) ((uint32_t) int_value % 100));
+      break;
+
+    case SNMP_SMI_STRING:
+      metrics_describe(name, "info", help);
+      metrics_append("%s_info{value=\"%s\"} 1\n", name,
+        metrics_escape(p, str_value, str_valuelen));
+      break;
+
+    default:
+      pr_trace_msg(trace_channel, 17,
+        "skipping '%s' with unsupported SMI type %s", mib->instance_name,
+        snmp_smi_get_varstr(p, mib->smi_type));
+      break;
+  }
+}
+
+static void metrics_render_ext(pool *p, struct snmp_mib *mib) {
+  struct snmp_metric *metric;
+  char *family, *mib_name;
+
+  metric = snmp_registry_get_by_field(mib->db_field);
+  if (metric == NULL) {
+    return;
+  }
+
+  if (metric->metric_type != SNMP_METRIC_TYPE_HISTOGRAM) {
+    metrics_render_scalar(p, mib);
+    return;
+  }
+
+  /* The whole histogram is rendered when its first bucket is seen. */
+  if (mib->db_field != SNMP_DB_EXT_F(metric->slot)) {
+    return;
+  }
+
+  mib_name = pstrcat(p, SNMP_MIB_NAME_PREFIX, "ext.", metric->name, NULL);
+  family = metrics_get_name(p, mib_name);
+
+  metrics_describe(family, "histogram", metrics_get_help(mib_name));
+  metrics_render_hist(p, family, "", mib->db_field);
+}
+
+static void metrics_render(pool *p) {
+  register int i;
+  int max_idx;
+
+  metrics_buflen = 0;
+  metrics_family[0] = '\0';
+
+  if (snmp_db_snapshot_begin(metrics_pool) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error taking snapshot of SNMPTables, reading live values: %s",
+      strerror(errno));
+  }
+
+  max_idx = snmp_mib_get_max_idx();
+
+  /* The MIBs are sorted by OID, which keeps the rows of each table, and so
+   * the samples of each metric family, together.
+   */
+  for (i = 1; i <= max_idx; i++) {
+    struct snmp_mib *mib;
+    unsigned int field;
+
+    mib = snmp_mib_get_by_idx(i);
+    if (mib == NULL ||
+        mib->mib_enabled == FALSE ||
+        mib->notify_only == TRUE) {
+      continue;
+    }
+
+    field = mib->db_field;
+
+    if (field >= SNMP_DB_HIST_F_XFER_BUCKET_BASE &&
+        field <= SNMP_DB_HIST_F_XFER_BUCKET_MAX) {
+      metrics_render_xfer_hist(p, mib);
+
+    } else if (field >= SNMP_DB_CMD_F_BASE &&
+               field <= SNMP_DB_CMD_F_MAX) {
+      metrics_render_cmd(p, mib);
+
+    } else if ((field >= SNMP_DB_HIST_F_UPPER_BOUND_BASE &&
+                field <= SNMP_DB_HIST_F_UPPER_BOUND_MAX) ||
+               (field >= SNMP_DB_CMD_F_NAME_BASE &&
+                field <= SNMP_DB_CMD_F_NAME_MAX)) {
+      /* These become the bucket bounds and labels of the above. */
+      continue;
+
+    } else if (field >= SNMP_DB_COUNTER_F_NAME_BASE &&
+               field <= SNMP_DB_COUNTER_F_MAX) {
+      /* The counter table only repeats the scalars. */
+      continue;
+
+    } else if (field >= SNMP_DB_EXT_F_BASE &&
+               field <= SNMP_DB_EXT_F_MAX) {
+      metrics_render_ext(p, mib);
+
+    } else {
+      metrics_render_scalar(p, mib);
+    }
+  }
+
+  (void) snmp_db_snapshot_end();
+
+  metrics_append("# EOF\n");
+}
+
+static uint64_t metrics_now_ms(void) {
+  struct timeval tv;
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  /* Prefer a clock which cannot be stepped, so that the deadline for a
+   * request is neither cut short nor stretched by clock changes.
+   */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return ((uint64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+  }
+#endif
+
+  gettimeofday(&tv, NULL);
+  return ((uint64_t) tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+}
+
+/* Waits for the client to be ready for reading (or writing), failing with
+ * ETIMEDOUT once the deadline for the request has passed.  Since this is
+ * checked before every read and write, a client cannot keep the agent busy
+ * past the deadline by trickling its request, or by reading the response
+ * slowly.
+ */
+static int metrics_wait(int fd, int for_write) {
+  while (TRUE) {
+    fd_set fds;
+    struct timeval tv;
+    uint64_t now_ms, remaining_ms;
+    int res;
+
+    now_ms = metrics_now_ms();
+    if (now_ms >= metrics_deadline_ms) {
+      pr_trace_msg(trace_channel, 9,
+        "metrics client did not finish its request within %d secs",
+        SNMP_METRICS_IO_TIMEOUT);
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    remaining_ms = metrics_deadline_ms - now_ms;
+    tv.tv_sec = remaining_ms / 1000;
+    tv.tv_usec = (remaining_ms % 1000) * 1000;
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    res = select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+      NULL, &tv);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res > 0) {
+      return 0;
+    }
+  }
+}
+
+static int metrics_write(int fd, const char *buf, size_t buflen) {
+  while (buflen > 0) {
+    ssize_t res;
+
+    if (metrics_wait(fd, TRUE) < 0) {
+      return -1;
+    }
+
+    res = write(fd, buf, buflen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (errno == EAGAIN ||
+          errno == EWOULDBLOCK) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    buf += res;
+    buflen -= res;
+  }
+
+  return 0;
+}
+
+static int metrics_send_error(int fd, const char *status) {
+  char resp[256];
+
+  memset(resp, '\0', sizeof(resp));
+  snprintf(resp, sizeof(resp)-1,
+    "HTTP/1.0 %s\r\n"
+    "Allow: GET, HEAD\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n", status);
+
+  return metrics_write(fd, resp, strlen(resp));
+}
+
+/* Reads the request head, i.e. everything up to the blank line.  Any body
+ * is ignored.
+ */
+static int metrics_read_request(int fd, char *buf, size_t bufsz) {
+  size_t buflen = 0;
+
+  while (buflen < bufsz - 1) {
+    ssize_t res;
+
+    if (metrics_wait(fd, FALSE) < 0) {
+      return -1;
+    }
+
+    res = read(fd, buf + buflen, bufsz - buflen - 1);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (errno == EAGAIN ||
+          errno == EWOULDBLOCK) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    buflen += res;
+    buf[buflen] = '\0';
+
+    if (strstr(buf, "\r\n\r\n") != NULL ||
+        strstr(buf, "\n\n") != NULL) {
+      return 0;
+    }
+  }
+
+  if (buflen == 0) {
+    errno = ENODATA;
+    return -1;
+  }
+
+  /* An incomplete request head; the request line may still be usable. */
+  return 0;
+}
+
+static int metrics_handle_request(pool *p, int fd) {
+  char req[SNMP_METRICS_MAX_REQUEST_SIZE], *method, *path, *ptr;
+  char hdr[256];
+  int head_only = FALSE;
+
+  memset(req, '\0', sizeof(req));
+  if (metrics_read_request(fd, req, sizeof(req)) < 0) {
+    return -1;
+  }
+
+  method = req;
+  ptr = strchr(method, ' ');
+  if (ptr == NULL) {
+    return metrics_send_error(fd, "400 Bad Request");
+  }
+  *ptr = '\0';
+
+  path = ptr + 1;
+  ptr = strpbrk(path, " \r\n");
+  if (ptr != NULL) {
+    *ptr = '\0';
+  }
+
+  if (strcmp(method, "HEAD") == 0) {
+    head_only = TRUE;
+
+  } else if (strcmp(method, "GET") != 0) {
+    return metrics_send_error(fd, "405 Method Not Allowed");
+  }
+
+  /* Ignore any query string, e.g. as used by some scrapers. */
+  ptr = strchr(path, '?');
+  if (ptr != NULL) {
+    *ptr = '\0';
+  }
+
+  if (strcmp(path, "/metrics") != 0) {
+    return metrics_send_error(fd, "404 Not Found");
+  }
+
+  metrics_render(p);
+
+  memset(hdr, '\0', sizeof(hdr));
+  snprintf(hdr, sizeof(hdr)-1,
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: " SNMP_METRICS_CONTENT_TYPE "\r\n"
+    "Content-Length: %lu\r\n"
+    "Connection: close\r\n"
+    "\r\n", (unsigned long) metrics_buflen);
+
+  if (metrics_write(fd, hdr, strlen(hdr)) < 0) {
+    return -1;
+  }
+
+  if (head_only == TRUE) {
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 17, "sending %lu bytes of metrics",
+    (unsigned long) metrics_buflen);
+  return metrics_write(fd, metrics_buf, metrics_buflen);
+}
+
+int snmp_metrics_handle(pool *p, int listen_fd) {
+  pool *tmp_pool;
+  int fd, flags, res, xerrno;
+
+  fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0) {
+    if (errno == EAGAIN ||
+        errno == EWOULDBLOCK ||
+        errno == EINTR ||
+        errno == ECONNABORTED) {
+      /* The client went away before we got to it. */
+      return 0;
+    }
+
+    return -1;
+  }
+
+  /* Per-call socket timeouts would only bound each read(2) and write(2),
+   * not the request as a whole; so we use non-blocking I/O, and wait, in
+   * metrics_wait(), for no longer than the time left for the request.
+   */
+  flags = fcntl(fd, F_GETFL);
+  if (flags >= 0) {
+    (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+  }
+
+  metrics_deadline_ms = metrics_now_ms() + (SNMP_METRICS_IO_TIMEOUT * 1000);
+
+  tmp_pool = make_sub_pool(p);
+  pr_pool_tag(tmp_pool, "SNMP metrics request pool");
+
+  res = metrics_handle_request(tmp_pool, fd);
+  xerrno = errno;
+
+  destroy_pool(tmp_pool);
+  (void) close(fd);
+
+  errno = xerrno;
+  return res;
+}
+
+int snmp_metrics_listen(pool *p, const pr_netaddr_t *addr) {
+  int fd, flags, on = 1, xerrno;
+
+  fd = socket(pr_netaddr_get_family(addr), SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    return -1;
+  }
+
+  (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (bind(fd, pr_netaddr_get_sockaddr(addr),
+      pr_netaddr_get_sockaddr_len(addr)) < 0) {
+    xerrno = errno;
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to bind metrics socket to %s#%u: %s", pr_netaddr_get_ipstr(addr),
+      ntohs(pr_netaddr_get_port(addr)), strerror(xerrno));
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (listen(fd, 5) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Make sure that accept(2) never blocks the agent, e.g. should the client
+   * go away between select(2) and accept(2).
+   */
+  flags = fcntl(fd, F_GETFL);
+  if (flags >= 0) {
+    (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+  }
+
+  if (metrics_pool == NULL) {
+    metrics_pool = make_sub_pool(p);
+    pr_pool_tag(metrics_pool, "SNMP metrics pool");
+
+    metrics_bufsz = SNMP_METRICS_BUFSZ;
+    metrics_buf = palloc(metrics_pool, metrics_bufsz);
+    metrics_buflen = 0;
+  }
+
+  return fd;
+}
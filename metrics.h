@@ -0,0 +1,41 @@
+/*
+ * ProFTPD - mod_snmp OpenMetrics exporter
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_METRICS_H
+#define MOD_SNMP_METRICS_H
+
+/* Creates the TCP socket on which the agent process serves the metrics, in
+ * OpenMetrics text format, over HTTP.  Returns the listening socket, or -1
+ * (with errno set) on error.
+ */
+int snmp_metrics_listen(pool *p, const pr_netaddr_t *addr);
+
+/* Accepts and handles a single scrape on the given listening socket.  The
+ * response is rendered from one snapshot of the tables.
+ */
+int snmp_metrics_handle(pool *p, int listen_fd);
+
+#endif
@@ -27,6 +27,7 @@
 #include "mib.h"
 #include "smi.h"
 #include "db.h"
+#include "registry.h"
 #include "stacktrace.h"
 
 /* This table maps the OIDs in the PROFTPD-MIB to the database field where
@@ -201,6 +202,27 @@ static struct snmp_mib snmp_mibs[] = {
     SNMP_MIB_NAME_PREFIX "daemon.daemonNotifications.maxInstancesExceeded.0",
     SNMP_SMI_NULL },
 
+  { { SNMP_MIB_DAEMON_OID_CONN_RATE_1MIN, 0 },
+    SNMP_MIB_DAEMON_OIDLEN_CONN_RATE_1MIN + 1,
+    SNMP_DB_RATE_F_CONN_RATE_1MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "daemon.connectionRate1Min",
+    SNMP_MIB_NAME_PREFIX "daemon.connectionRate1Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_DAEMON_OID_CONN_RATE_5MIN, 0 },
+    SNMP_MIB_DAEMON_OIDLEN_CONN_RATE_5MIN + 1,
+    SNMP_DB_RATE_F_CONN_RATE_5MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "daemon.connectionRate5Min",
+    SNMP_MIB_NAME_PREFIX "daemon.connectionRate5Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_DAEMON_OID_CONN_RATE_15MIN, 0 },
+    SNMP_MIB_DAEMON_OIDLEN_CONN_RATE_15MIN + 1,
+    SNMP_DB_RATE_F_CONN_RATE_15MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "daemon.connectionRate15Min",
+    SNMP_MIB_NAME_PREFIX "daemon.connectionRate15Min.0",
+    SNMP_SMI_GAUGE32 },
+
   /* timeouts MIBs */
   { { SNMP_MIB_TIMEOUTS_OID_IDLE_TOTAL, 0 },
     SNMP_MIB_TIMEOUTS_OIDLEN_IDLE_TOTAL + 1,
@@ -302,6 +324,27 @@ static struct snmp_mib snmp_mibs[] = {
     SNMP_MIB_NAME_PREFIX "ftp.logins.anonLoginTotal.0",
     SNMP_SMI_COUNTER32 },
 
+  { { SNMP_MIB_FTP_LOGINS_OID_RATE_1MIN, 0 },
+    SNMP_MIB_FTP_LOGINS_OIDLEN_RATE_1MIN + 1,
+    SNMP_DB_RATE_F_FTP_LOGIN_RATE_1MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.logins.loginRate1Min",
+    SNMP_MIB_NAME_PREFIX "ftp.logins.loginRate1Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_LOGINS_OID_RATE_5MIN, 0 },
+    SNMP_MIB_FTP_LOGINS_OIDLEN_RATE_5MIN + 1,
+    SNMP_DB_RATE_F_FTP_LOGIN_RATE_5MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.logins.loginRate5Min",
+    SNMP_MIB_NAME_PREFIX "ftp.logins.loginRate5Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_LOGINS_OID_RATE_15MIN, 0 },
+    SNMP_MIB_FTP_LOGINS_OIDLEN_RATE_15MIN + 1,
+    SNMP_DB_RATE_F_FTP_LOGIN_RATE_15MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.logins.loginRate15Min",
+    SNMP_MIB_NAME_PREFIX "ftp.logins.loginRate15Min.0",
+    SNMP_SMI_GAUGE32 },
+
   /* ftp.dataTransfers MIBs */
   { { SNMP_MIB_FTP_XFERS_OID_DIR_LIST_COUNT, 0 },
     SNMP_MIB_FTP_XFERS_OIDLEN_DIR_LIST_COUNT + 1,
@@ -380,6 +423,48 @@ static struct snmp_mib snmp_mibs[] = {
     SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadTotal.0",
     SNMP_SMI_COUNTER32 },
 
+  { { SNMP_MIB_FTP_XFERS_OID_KB_UPLOAD_RATE_1MIN, 0 },
+    SNMP_MIB_FTP_XFERS_OIDLEN_KB_UPLOAD_RATE_1MIN + 1,
+    SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_1MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbUploadRate1Min",
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbUploadRate1Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_XFERS_OID_KB_UPLOAD_RATE_5MIN, 0 },
+    SNMP_MIB_FTP_XFERS_OIDLEN_KB_UPLOAD_RATE_5MIN + 1,
+    SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_5MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbUploadRate5Min",
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbUploadRate5Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_XFERS_OID_KB_UPLOAD_RATE_15MIN, 0 },
+    SNMP_MIB_FTP_XFERS_OIDLEN_KB_UPLOAD_RATE_15MIN + 1,
+    SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_15MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbUploadRate15Min",
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbUploadRate15Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_XFERS_OID_KB_DOWNLOAD_RATE_1MIN, 0 },
+    SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_RATE_1MIN + 1,
+    SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_1MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadRate1Min",
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadRate1Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_XFERS_OID_KB_DOWNLOAD_RATE_5MIN, 0 },
+    SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_RATE_5MIN + 1,
+    SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_5MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadRate5Min",
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadRate5Min.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_FTP_XFERS_OID_KB_DOWNLOAD_RATE_15MIN, 0 },
+    SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_RATE_15MIN + 1,
+    SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_15MIN, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadRate15Min",
+    SNMP_MIB_NAME_PREFIX "ftp.dataTransfers.kbDownloadRate15Min.0",
+    SNMP_SMI_GAUGE32 },
+
   /* ftp.ftpNotifications MIBs */
   { { SNMP_MIB_FTP_NOTIFY_OID_LOGIN_BAD_PASSWORD, 0 },
     SNMP_MIB_FTP_NOTIFY_OIDLEN_LOGIN_BAD_PASSWORD + 1,
@@ -431,6 +516,76 @@ static struct snmp_mib snmp_mibs[] = {
     SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedTotal.0",
     SNMP_SMI_COUNTER32 },
 
+  { { SNMP_MIB_SNMP_OID_ACL_CACHE_HITS_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_ACL_CACHE_HITS_TOTAL + 1,
+    SNMP_DB_SNMP_F_ACL_CACHE_HITS_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.aclCacheHitsTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.aclCacheHitsTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_ACL_CACHE_MISSES_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_ACL_CACHE_MISSES_TOTAL + 1,
+    SNMP_DB_SNMP_F_ACL_CACHE_MISSES_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.aclCacheMissesTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.aclCacheMissesTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_PKTS_DROPPED_RATE_LIMIT_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_RATE_LIMIT_TOTAL + 1,
+    SNMP_DB_SNMP_F_PKTS_DROPPED_RATE_LIMIT_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedRateLimitTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedRateLimitTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_PKTS_DROPPED_VERSION_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_VERSION_TOTAL + 1,
+    SNMP_DB_SNMP_F_PKTS_DROPPED_VERSION_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedVersionTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedVersionTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_PKTS_DROPPED_SEND_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_SEND_TOTAL + 1,
+    SNMP_DB_SNMP_F_PKTS_DROPPED_SEND_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedSendTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedSendTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_PKTS_DROPPED_STALE_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_STALE_TOTAL + 1,
+    SNMP_DB_SNMP_F_PKTS_DROPPED_STALE_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedStaleTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedStaleTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_RXQ_BYTES, 0 },
+    SNMP_MIB_SNMP_OIDLEN_RXQ_BYTES + 1,
+    SNMP_DB_SNMP_F_RXQ_BYTES, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.receiveQueueBytes",
+    SNMP_MIB_NAME_PREFIX "snmp.receiveQueueBytes.0",
+    SNMP_SMI_GAUGE32 },
+
+  { { SNMP_MIB_SNMP_OID_RXQ_DROPPED_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_RXQ_DROPPED_TOTAL + 1,
+    SNMP_DB_SNMP_F_RXQ_DROPPED_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.receiveQueueDroppedTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.receiveQueueDroppedTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_PKTS_REPLAYED_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_PKTS_REPLAYED_TOTAL + 1,
+    SNMP_DB_SNMP_F_PKTS_REPLAYED_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.packetsReplayedTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.packetsReplayedTotal.0",
+    SNMP_SMI_COUNTER32 },
+
+  { { SNMP_MIB_SNMP_OID_PKTS_DROPPED_TOO_BIG_TOTAL, 0 },
+    SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_TOO_BIG_TOTAL + 1,
+    SNMP_DB_SNMP_F_PKTS_DROPPED_TOO_BIG_TOTAL, TRUE, FALSE,
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedTooBigTotal",
+    SNMP_MIB_NAME_PREFIX "snmp.packetsDroppedTooBigTotal.0",
+    SNMP_SMI_COUNTER32 },
+
   /* ftps.tlsSessions MIBs */
   { { SNMP_MIB_FTPS_SESS_OID_SESS_COUNT, 0 },
     SNMP_MIB_FTPS_SESS_OIDLEN_SESS_COUNT + 1,
@@ -970,6 +1125,13 @@ static struct snmp_mib snmp_mibs[] = {
   { { }, 0, 0, TRUE, FALSE, NULL, NULL, 0 }
 };
 
+/* The MIBs actually consulted at runtime.  This is the static snmp_mibs
+ * table, plus any generated table rows (e.g. histogram buckets), sorted by
+ * OID; it is (re)built by snmp_mib_init().
+ */
+static struct snmp_mib *snmp_mib_table = snmp_mibs;
+static pool *snmp_mib_pool = NULL;
+
 /* We only need to look this up once. */
 static int snmp_mib_max_idx = -1;
 
@@ -1013,7 +1175,7 @@ int snmp_mib_get_nearest_idx(oid_t *mib_oid, unsigned int mib_oidlen) {
        * we still need to look for partial prefix matches, e.g.
        * 1.3.6.1.4.1.17852.2.2.2, and Do The Right Thing(tm).
        */
-      for (i = SNMP_MIB_FIRST_IDX; snmp_mibs[i].mib_oidlen != 0; i++) {
+      for (i = SNMP_MIB_FIRST_IDX; snmp_mib_table[i].mib_oidlen != 0; i++) {
         register unsigned int j;
         unsigned int nsubids, oidlen;
         int prefix_matched = FALSE;
@@ -1021,26 +1183,26 @@ int snmp_mib_get_nearest_idx(oid_t *mib_oid, unsigned int mib_oidlen) {
         pr_signals_handle();
 
         /* Skip any disabled MIBs. */
-        if (snmp_mibs[i].mib_enabled == FALSE) {
+        if (snmp_mib_table[i].mib_enabled == FALSE) {
           continue;
         }
 
         /* Skip any 'notify only' MIBs, which are only for notifications. */
-        if (snmp_mibs[i].notify_only == TRUE) {
+        if (snmp_mib_table[i].notify_only == TRUE) {
           continue;
         }
 
-        if (mib_oidlen > snmp_mibs[i].mib_oidlen) {
-          nsubids = mib_oidlen - snmp_mibs[i].mib_oidlen;
+        if (mib_oidlen > snmp_mib_table[i].mib_oidlen) {
+          nsubids = mib_oidlen - snmp_mib_table[i].mib_oidlen;
           oidlen = mib_oidlen;
 
         } else {
-          nsubids = snmp_mibs[i].mib_oidlen - mib_oidlen;
-          oidlen = snmp_mibs[i].mib_oidlen;
+          nsubids = snmp_mib_table[i].mib_oidlen - mib_oidlen;
+          oidlen = snmp_mib_table[i].mib_oidlen;
         }
 
         for (j = 0; j <= nsubids; j++) {
-          if (memcmp(snmp_mibs[i].mib_oid, mib_oid,
+          if (memcmp(snmp_mib_table[i].mib_oid, mib_oid,
               (oidlen - j) * sizeof(oid_t)) == 0) {
             mib_idx = i;
             prefix_matched = TRUE;
@@ -1071,16 +1233,16 @@ int snmp_mib_get_idx(oid_t *mib_oid, unsigned int mib_oidlen,
     *lacks_instance_id = FALSE;
   }
 
-  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+  for (i = 1; snmp_mib_table[i].mib_oidlen != 0; i++) {
     pr_signals_handle();
 
     /* Skip any disabled MIBs. */
-    if (snmp_mibs[i].mib_enabled == FALSE) {
+    if (snmp_mib_table[i].mib_enabled == FALSE) {
       continue;
     }
 
-    if (snmp_mibs[i].mib_oidlen == mib_oidlen) {
-      if (memcmp(snmp_mibs[i].mib_oid, mib_oid,
+    if (snmp_mib_table[i].mib_oidlen == mib_oidlen) {
+      if (memcmp(snmp_mib_table[i].mib_oid, mib_oid,
           mib_oidlen * sizeof(oid_t)) == 0) {
         mib_idx = i;
         break;
@@ -1094,8 +1256,8 @@ int snmp_mib_get_idx(oid_t *mib_oid, unsigned int mib_oidlen,
      */
 
     if (lacks_instance_id != NULL) {
-      if (snmp_mibs[i].mib_oidlen == (mib_oidlen + 1)) {
-        if (memcmp(snmp_mibs[i].mib_oid, mib_oid,
+      if (snmp_mib_table[i].mib_oidlen == (mib_oidlen + 1)) {
+        if (memcmp(snmp_mib_table[i].mib_oid, mib_oid,
             mib_oidlen * sizeof(oid_t)) == 0) {
           *lacks_instance_id = TRUE;
           break;
@@ -1118,9 +1280,9 @@ int snmp_mib_get_max_idx(void) {
     return snmp_mib_max_idx;
   }
 
-  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+  for (i = 1; snmp_mib_table[i].mib_oidlen != 0; i++) {
     /* Skip any disabled MIBs. */
-    if (snmp_mibs[i].mib_enabled == FALSE) {
+    if (snmp_mib_table[i].mib_enabled == FALSE) {
       continue;
     }
   }
@@ -1139,7 +1301,25 @@ struct snmp_mib *snmp_mib_get_by_idx(unsigned int mib_idx) {
     return NULL;
   }
 
-  return &snmp_mibs[mib_idx];
+  return &(snmp_mib_table[mib_idx]);
+}
+
+struct snmp_mib *snmp_mib_get_by_field(unsigned int db_field) {
+  register unsigned int i;
+
+  /* Search the static MIBs, since the tables are opened (and described)
+   * before the runtime MIB table is built.  The notification-only MIBs share
+   * fields with the regular MIBs, and are skipped.
+   */
+  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+    if (snmp_mibs[i].db_field == db_field &&
+        snmp_mibs[i].notify_only == FALSE) {
+      return &(snmp_mibs[i]);
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
 }
 
 struct snmp_mib *snmp_mib_get_by_oid(oid_t *mib_oid, unsigned int mib_oidlen,
@@ -1157,32 +1337,468 @@ struct snmp_mib *snmp_mib_get_by_oid(oid_t *mib_oid, unsigned int mib_oidlen,
 int snmp_mib_reset_counters(void) {
   register unsigned int i;
 
-  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+  for (i = 1; snmp_mib_table[i].mib_oidlen != 0; i++) {
     pr_signals_handle();
 
     /* Explicitly skip the restart counter; that's the one counter that is
      * preserved.
      */
-    if (snmp_mibs[i].mib_oidlen == SNMP_MIB_DAEMON_OIDLEN_RESTART_COUNT) {
+    if (snmp_mib_table[i].mib_oidlen == SNMP_MIB_DAEMON_OIDLEN_RESTART_COUNT) {
       oid_t restart_oid[] = { SNMP_MIB_DAEMON_OID_RESTART_COUNT };
 
-      if (memcmp(snmp_mibs[i].mib_oid, restart_oid,
+      if (memcmp(snmp_mib_table[i].mib_oid, restart_oid,
           SNMP_MIB_DAEMON_OIDLEN_RESTART_COUNT * sizeof(oid_t)) == 0) {
         continue;
       }
     }
 
-    if (snmp_mibs[i].smi_type == SNMP_SMI_COUNTER32 ||
-        snmp_mibs[i].smi_type == SNMP_SMI_COUNTER64) {
+    if (snmp_mib_table[i].smi_type == SNMP_SMI_COUNTER32 ||
+        snmp_mib_table[i].smi_type == SNMP_SMI_COUNTER64) {
       pr_trace_msg(trace_channel, 17, "resetting '%s' counter",
-        snmp_mibs[i].instance_name);
-      (void) snmp_db_reset_value(snmp_pool, snmp_mibs[i].db_field);
+        snmp_mib_table[i].instance_name);
+      (void) snmp_db_reset_value(snmp_pool, snmp_mib_table[i].db_field);
+    }
+  }
+
+  return 0;
+}
+
+int snmp_mib_reset_gauges(void) {
+  register unsigned int i;
+
+  for (i = 1; snmp_mib_table[i].mib_oidlen != 0; i++) {
+    pr_signals_handle();
+
+    if (snmp_mib_table[i].mib_enabled == FALSE ||
+        snmp_mib_table[i].smi_type != SNMP_SMI_GAUGE32) {
+      continue;
+    }
+
+    /* Some gauges (e.g. histogram bucket bounds) are synthetic, and have
+     * nothing stored to reset; ignore those.
+     */
+    if (snmp_db_reset_value(snmp_pool, snmp_mib_table[i].db_field) == 0) {
+      pr_trace_msg(trace_channel, 17, "reset '%s' gauge",
+        snmp_mib_table[i].instance_name);
+    }
+  }
+
+  return 0;
+}
+
+static int mib_oid_cmp(const void *a, const void *b) {
+  const struct snmp_mib *mib1, *mib2;
+  register unsigned int i;
+
+  mib1 = a;
+  mib2 = b;
+
+  for (i = 0; i < mib1->mib_oidlen && i < mib2->mib_oidlen; i++) {
+    if (mib1->mib_oid[i] < mib2->mib_oid[i]) {
+      return -1;
     }
+
+    if (mib1->mib_oid[i] > mib2->mib_oid[i]) {
+      return 1;
+    }
+  }
+
+  if (mib1->mib_oidlen < mib2->mib_oidlen) {
+    return -1;
+  }
+
+  if (mib1->mib_oidlen > mib2->mib_oidlen) {
+    return 1;
   }
 
   return 0;
 }
 
+/* Adds a generated table row, i.e. the given column OID with the given
+ * row instance identifier appended.
+ */
+static void mib_add_row(array_header *rows, oid_t *col_oid,
+    unsigned int col_oidlen, oid_t *row_oid, unsigned int row_oidlen,
+    unsigned int db_field, int mib_enabled, const char *mib_name,
+    unsigned char smi_type) {
+  register unsigned int i;
+  struct snmp_mib *mib;
+  char *instance_name;
+
+  mib = push_array(rows);
+  memset(mib, 0, sizeof(struct snmp_mib));
+
+  memmove(mib->mib_oid, col_oid, col_oidlen * sizeof(oid_t));
+  memmove(mib->mib_oid + col_oidlen, row_oid, row_oidlen * sizeof(oid_t));
+  mib->mib_oidlen = col_oidlen + row_oidlen;
+
+  instance_name = pstrdup(snmp_mib_pool, mib_name);
+  for (i = 0; i < row_oidlen; i++) {
+    char buf[32];
+
+    memset(buf, '\0', sizeof(buf));
+    snprintf(buf, sizeof(buf)-1, ".%lu", (unsigned long) row_oid[i]);
+    instance_name = pstrcat(snmp_mib_pool, instance_name, buf, NULL);
+  }
+
+  mib->db_field = db_field;
+  mib->mib_enabled = mib_enabled;
+  mib->notify_only = FALSE;
+  mib->mib_name = mib_name;
+  mib->instance_name = instance_name;
+  mib->smi_type = smi_type;
+}
+
+/* Generates the rows of a transfer histogram table, indexed by metric and
+ * bucket, for the given protocol.
+ */
+static void mib_add_xfer_hist_rows(array_header *rows, int proto,
+    oid_t *table_oid, unsigned int table_oidlen, const char *table_name,
+    int mib_enabled) {
+  register unsigned int col;
+  oid_t col_oid[SNMP_MIB_MAX_OIDLEN];
+
+  memmove(col_oid, table_oid, table_oidlen * sizeof(oid_t));
+
+  for (col = SNMP_MIB_XFER_HIST_COL_UPPER_BOUND;
+       col <= SNMP_MIB_XFER_HIST_COL_COUNT; col++) {
+    register unsigned int metric;
+
+    col_oid[table_oidlen] = col;
+
+    for (metric = 0; metric < SNMP_DB_HIST_NXFER_METRICS; metric++) {
+      register unsigned int bucket;
+
+      for (bucket = 0; bucket < SNMP_DB_HIST_NBUCKETS; bucket++) {
+        oid_t row_oid[2];
+
+        /* Row indices start at 1, not 0. */
+        row_oid[0] = metric + 1;
+        row_oid[1] = bucket + 1;
+
+        if (col == SNMP_MIB_XFER_HIST_COL_UPPER_BOUND) {
+          mib_add_row(rows, col_oid, table_oidlen + 1, row_oid, 2,
+            SNMP_DB_HIST_F_UPPER_BOUND(bucket), mib_enabled,
+            pstrcat(snmp_mib_pool, SNMP_MIB_NAME_PREFIX, table_name,
+              "UpperBound", NULL), SNMP_SMI_GAUGE32);
+
+        } else {
+          mib_add_row(rows, col_oid, table_oidlen + 1, row_oid, 2,
+            SNMP_DB_HIST_F_XFER_BUCKET(proto, metric, bucket), mib_enabled,
+            pstrcat(snmp_mib_pool, SNMP_MIB_NAME_PREFIX, table_name,
+              "Count", NULL), SNMP_SMI_COUNTER32);
+        }
+      }
+    }
+  }
+}
+
+/* Generates the rows of the command statistics and command latency tables. */
+static void mib_add_cmd_rows(array_header *rows) {
+  register unsigned int cmd_idx;
+  oid_t cmd_oid[] = { SNMP_FTP_CMD_TABLE_OID_BASE, 0 };
+  oid_t latency_oid[] = { SNMP_FTP_CMD_LATENCY_OID_BASE, 0 };
+  unsigned int cmd_oidlen = SNMP_FTP_CMD_TABLE_OID_BASELEN + 1;
+  unsigned int latency_oidlen = SNMP_FTP_CMD_LATENCY_OID_BASELEN + 1;
+
+  for (cmd_idx = 0; cmd_idx < SNMP_DB_CMD_NCMDS; cmd_idx++) {
+    register unsigned int bucket;
+    oid_t row_oid[2];
+
+    /* Row indices start at 1, not 0. */
+    row_oid[0] = cmd_idx + 1;
+
+    cmd_oid[cmd_oidlen-1] = SNMP_MIB_FTP_CMD_COL_NAME;
+    mib_add_row(rows, cmd_oid, cmd_oidlen, row_oid, 1,
+      SNMP_DB_CMD_F_NAME(cmd_idx), TRUE,
+      SNMP_MIB_NAME_PREFIX "ftp.commands.cmdName", SNMP_SMI_STRING);
+
+    cmd_oid[cmd_oidlen-1] = SNMP_MIB_FTP_CMD_COL_COUNT;
+    mib_add_row(rows, cmd_oid, cmd_oidlen, row_oid, 1,
+      SNMP_DB_CMD_F_COUNT(cmd_idx), TRUE,
+      SNMP_MIB_NAME_PREFIX "ftp.commands.cmdCount", SNMP_SMI_COUNTER32);
+
+    cmd_oid[cmd_oidlen-1] = SNMP_MIB_FTP_CMD_COL_ERR_COUNT;
+    mib_add_row(rows, cmd_oid, cmd_oidlen, row_oid, 1,
+      SNMP_DB_CMD_F_ERR_COUNT(cmd_idx), TRUE,
+      SNMP_MIB_NAME_PREFIX "ftp.commands.cmdErrorCount", SNMP_SMI_COUNTER32);
+
+    for (bucket = 0; bucket < SNMP_DB_HIST_NBUCKETS; bucket++) {
+      row_oid[1] = bucket + 1;
+
+      latency_oid[latency_oidlen-1] =
+        SNMP_MIB_FTP_CMD_LATENCY_COL_UPPER_BOUND;
+      mib_add_row(rows, latency_oid, latency_oidlen, row_oid, 2,
+        SNMP_DB_HIST_F_UPPER_BOUND(bucket), TRUE,
+        SNMP_MIB_NAME_PREFIX "ftp.commands.cmdLatencyUpperBound",
+        SNMP_SMI_GAUGE32);
+
+      latency_oid[latency_oidlen-1] = SNMP_MIB_FTP_CMD_LATENCY_COL_COUNT;
+      mib_add_row(rows, latency_oid, latency_oidlen, row_oid, 2,
+        SNMP_DB_CMD_F_LATENCY_BUCKET(cmd_idx, bucket), TRUE,
+        SNMP_MIB_NAME_PREFIX "ftp.commands.cmdLatencyCount",
+        SNMP_SMI_COUNTER32);
+    }
+  }
+}
+
+/* Returns TRUE if the given static MIB is a counter or gauge scalar, and so
+ * has a row in the counter table.
+ */
+static int mib_is_counter(struct snmp_mib *mib) {
+  switch (mib->smi_type) {
+    case SNMP_SMI_COUNTER32:
+    case SNMP_SMI_GAUGE32:
+    case SNMP_SMI_INTEGER:
+      break;
+
+    default:
+      return FALSE;
+  }
+
+  /* Skip the per-connection and notification-only values, and any MIB
+   * sharing its field with an earlier MIB.
+   */
+  if (mib->db_field >= SNMP_DB_COUNTER_NFIELDS ||
+      snmp_mib_get_by_field(mib->db_field) != mib) {
+    return FALSE;
+  }
+
+  switch (snmp_db_get_field_db_id(mib->db_field)) {
+    case SNMP_DB_ID_CONN:
+    case SNMP_DB_ID_NOTIFY:
+      return FALSE;
+
+    default:
+      break;
+  }
+
+  return TRUE;
+}
+
+static int mib_field_cmp(const void *a, const void *b) {
+  unsigned int field1, field2;
+
+  field1 = *((const unsigned int *) a);
+  field2 = *((const unsigned int *) b);
+
+  if (field1 < field2) {
+    return -1;
+  }
+
+  return field1 > field2 ? 1 : 0;
+}
+
+int snmp_mib_get_counter_fields(unsigned int *fields,
+    unsigned int max_fields) {
+  register unsigned int i;
+  unsigned int nfields = 0;
+
+  if (fields == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+    if (mib_is_counter(&(snmp_mibs[i])) == FALSE) {
+      continue;
+    }
+
+    if (nfields == max_fields) {
+      errno = ENOSPC;
+      return -1;
+    }
+
+    fields[nfields++] = snmp_mibs[i].db_field;
+  }
+
+  qsort(fields, nfields, sizeof(unsigned int), mib_field_cmp);
+  return (int) nfields;
+}
+
+/* Generates the rows of the counter table, one for each scalar counter or
+ * gauge, indexed by the scalar's database field.
+ */
+static void mib_add_counter_rows(array_header *rows) {
+  register unsigned int i;
+  oid_t col_oid[] = { SNMP_COUNTER_TABLE_OID_BASE, 0 };
+  unsigned int col_oidlen = SNMP_COUNTER_TABLE_OID_BASELEN + 1;
+
+  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+    struct snmp_mib *mib;
+    oid_t row_oid[1];
+
+    mib = &(snmp_mibs[i]);
+    if (mib_is_counter(mib) == FALSE) {
+      continue;
+    }
+
+    row_oid[0] = mib->db_field;
+
+    col_oid[col_oidlen-1] = SNMP_MIB_COUNTER_COL_NAME;
+    mib_add_row(rows, col_oid, col_oidlen, row_oid, 1,
+      SNMP_DB_COUNTER_F_NAME(mib->db_field), mib->mib_enabled,
+      SNMP_MIB_NAME_PREFIX "counters.proftpdCounterName", SNMP_SMI_STRING);
+
+    col_oid[col_oidlen-1] = SNMP_MIB_COUNTER_COL_TYPE;
+    mib_add_row(rows, col_oid, col_oidlen, row_oid, 1,
+      SNMP_DB_COUNTER_F_TYPE(mib->db_field), mib->mib_enabled,
+      SNMP_MIB_NAME_PREFIX "counters.proftpdCounterType", SNMP_SMI_INTEGER);
+
+    col_oid[col_oidlen-1] = SNMP_MIB_COUNTER_COL_VALUE;
+    mib_add_row(rows, col_oid, col_oidlen, row_oid, 1,
+      SNMP_DB_COUNTER_F_VALUE(mib->db_field), mib->mib_enabled,
+      SNMP_MIB_NAME_PREFIX "counters.proftpdCounterValue", SNMP_SMI_GAUGE32);
+  }
+}
+
+/* Generates the objects of the metrics registered by other modules: a
+ * scalar for each counter or gauge, and a table of bucket bounds and counts
+ * for each histogram.
+ */
+static void mib_add_ext_rows(array_header *rows) {
+  register unsigned int i;
+  oid_t col_oid[] = { SNMP_EXT_OID_BASE, 0, 0, 1, 1, 0 };
+  unsigned int col_oidlen = SNMP_EXT_OID_BASELEN + 5;
+
+  for (i = 0; i < snmp_registry_get_count(); i++) {
+    register unsigned int bucket;
+    struct snmp_metric *metric;
+    const char *mib_name;
+    oid_t row_oid[1];
+
+    metric = snmp_registry_get(i);
+    col_oid[SNMP_EXT_OID_BASELEN] = metric->subtree;
+    col_oid[SNMP_EXT_OID_BASELEN + 1] = metric->item;
+
+    mib_name = pstrcat(snmp_mib_pool, SNMP_MIB_NAME_PREFIX, "ext.",
+      metric->name, NULL);
+
+    if (metric->metric_type != SNMP_METRIC_TYPE_HISTOGRAM) {
+      row_oid[0] = 0;
+      mib_add_row(rows, col_oid, SNMP_EXT_OID_BASELEN + 2, row_oid, 1,
+        SNMP_DB_EXT_F(metric->slot), TRUE, mib_name,
+        metric->metric_type == SNMP_METRIC_TYPE_COUNTER ?
+          SNMP_SMI_COUNTER32 : SNMP_SMI_GAUGE32);
+      continue;
+    }
+
+    for (bucket = 0; bucket < SNMP_DB_HIST_NBUCKETS; bucket++) {
+      /* Row indices start at 1, not 0. */
+      row_oid[0] = bucket + 1;
+
+      col_oid[col_oidlen-1] = SNMP_MIB_XFER_HIST_COL_UPPER_BOUND;
+      mib_add_row(rows, col_oid, col_oidlen, row_oid, 1,
+        SNMP_DB_HIST_F_UPPER_BOUND(bucket), TRUE,
+        pstrcat(snmp_mib_pool, mib_name, "UpperBound", NULL),
+        SNMP_SMI_GAUGE32);
+
+      col_oid[col_oidlen-1] = SNMP_MIB_XFER_HIST_COL_COUNT;
+      mib_add_row(rows, col_oid, col_oidlen, row_oid, 1,
+        SNMP_DB_EXT_F(metric->slot + bucket), TRUE,
+        pstrcat(snmp_mib_pool, mib_name, "Count", NULL), SNMP_SMI_COUNTER32);
+    }
+  }
+}
+
+static int mib_encode_oid(struct snmp_mib *mib) {
+  unsigned char asn1_type, *buf;
+  size_t buflen;
+
+  buflen = snmp_asn1_get_oid_len(mib->mib_oid, mib->mib_oidlen);
+  mib->ber_oid = buf = palloc(snmp_mib_pool, buflen);
+  mib->ber_oidlen = (unsigned int) buflen;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OID);
+  return snmp_asn1_write_oid(snmp_mib_pool, &buf, &buflen, asn1_type,
+    mib->mib_oid, mib->mib_oidlen);
+}
+
+/* Builds the runtime MIB table from the static MIBs and the generated table
+ * rows, keeping the entries sorted by OID so that GetNext/GetBulk requests
+ * can simply move to the next index.
+ */
+static int mib_build_table(void) {
+  register unsigned int i;
+  unsigned int nmibs = 0;
+  int sftp_loaded, tls_loaded;
+  array_header *rows;
+  struct snmp_mib *mib_table;
+  oid_t ftp_hist_oid[] = { SNMP_FTP_XFER_HIST_OID_BASE };
+  oid_t ftps_hist_oid[] = { SNMP_FTPS_XFER_HIST_OID_BASE };
+  oid_t sftp_hist_oid[] = { SNMP_SFTP_XFER_HIST_OID_BASE };
+  oid_t scp_hist_oid[] = { SNMP_SCP_XFER_HIST_OID_BASE };
+
+  if (snmp_mib_pool != NULL) {
+    destroy_pool(snmp_mib_pool);
+  }
+
+  snmp_mib_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(snmp_mib_pool, MOD_SNMP_VERSION ": MIB table pool");
+
+  /* Count the static MIBs, not including the trailing sentinel. */
+  for (i = 1; snmp_mibs[i].mib_oidlen != 0; i++) {
+    nmibs = i + 1;
+  }
+
+  rows = make_array(snmp_mib_pool, 1, sizeof(struct snmp_mib));
+
+  tls_loaded = pr_module_exists("mod_tls.c");
+  sftp_loaded = pr_module_exists("mod_sftp.c");
+
+  mib_add_xfer_hist_rows(rows, SNMP_DB_HIST_PROTO_FTP, ftp_hist_oid,
+    SNMP_FTP_XFER_HIST_OID_BASELEN, "ftp.dataTransfers.xferHist", TRUE);
+  mib_add_xfer_hist_rows(rows, SNMP_DB_HIST_PROTO_FTPS, ftps_hist_oid,
+    SNMP_FTPS_XFER_HIST_OID_BASELEN, "ftps.tlsDataTransfers.xferHist",
+    tls_loaded);
+  mib_add_xfer_hist_rows(rows, SNMP_DB_HIST_PROTO_SFTP, sftp_hist_oid,
+    SNMP_SFTP_XFER_HIST_OID_BASELEN, "sftp.sftpDataTransfers.xferHist",
+    sftp_loaded);
+  mib_add_xfer_hist_rows(rows, SNMP_DB_HIST_PROTO_SCP, scp_hist_oid,
+    SNMP_SCP_XFER_HIST_OID_BASELEN, "scp.scpDataTransfers.xferHist",
+    sftp_loaded);
+
+  mib_add_cmd_rows(rows);
+  mib_add_counter_rows(rows);
+  mib_add_ext_rows(rows);
+
+  /* Allocate room for the trailing sentinel entry as well. */
+  mib_table = pcalloc(snmp_mib_pool,
+    (nmibs + rows->nelts + 1) * sizeof(struct snmp_mib));
+  memmove(mib_table, snmp_mibs, nmibs * sizeof(struct snmp_mib));
+  memmove(&(mib_table[nmibs]), rows->elts,
+    rows->nelts * sizeof(struct snmp_mib));
+  mib_table[nmibs + rows->nelts].mib_enabled = TRUE;
+
+  qsort(&(mib_table[SNMP_MIB_FIRST_IDX]),
+    nmibs + rows->nelts - SNMP_MIB_FIRST_IDX, sizeof(struct snmp_mib),
+    mib_oid_cmp);
+
+  for (i = 1; i < nmibs + rows->nelts; i++) {
+    if (mib_table[i].mib_oidlen == 0) {
+      continue;
+    }
+
+    if (mib_encode_oid(&(mib_table[i])) < 0) {
+      int xerrno = errno;
+
+      pr_trace_msg(trace_channel, 1, "error encoding OID for %s: %s",
+        mib_table[i].mib_name, strerror(xerrno));
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 17,
+    "built MIB table of %u static and %d generated MIBs", nmibs - 1,
+    rows->nelts);
+
+  snmp_mib_table = mib_table;
+  snmp_mib_max_idx = -1;
+
+  return 0;
+}
+
 int snmp_mib_init(void) {
   /* Iterate through all of the MIBs, deactivating some of them
    * if the related module is not loaded.
@@ -1232,5 +1848,5 @@ int snmp_mib_init(void) {
     }
   }
 
-  return 0;
+  return mib_build_table();
 }
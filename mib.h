@@ -96,6 +96,13 @@
 #define SNMP_BAN_OID_BASE		SNMP_OID_BASE, 9
 #define SNMP_BAN_OID_BASELEN		SNMP_OID_BASELEN + 1
 
+/* Metrics registered by other modules (see snmp_metric_register()). */
+#define SNMP_EXT_OID_BASE		SNMP_OID_BASE, 11
+#define SNMP_EXT_OID_BASELEN		SNMP_OID_BASELEN + 1
+
+#define SNMP_COUNTERS_OID_BASE		SNMP_OID_BASE, 13
+#define SNMP_COUNTERS_OID_BASELEN	SNMP_OID_BASELEN + 1
+
 #if 0
 #define SNMP_SQL_OID_BASE		SNMP_OID_BASE, 9
 #define SNMP_SQL_OID_BASELEN		SNMP_OID_BASELEN + 1
@@ -168,6 +175,21 @@
 #define SNMP_MIB_DAEMON_OID_MAXINST_CONF	SNMP_DAEMON_OID_BASE, 12
 #define SNMP_MIB_DAEMON_OIDLEN_MAXINST_CONF	SNMP_DAEMON_OID_BASELEN + 1
 
+#define SNMP_MIB_DAEMON_OID_CONN_RATE_1MIN \
+  SNMP_DAEMON_OID_BASE, 14
+#define SNMP_MIB_DAEMON_OIDLEN_CONN_RATE_1MIN \
+  SNMP_DAEMON_OID_BASELEN + 1
+
+#define SNMP_MIB_DAEMON_OID_CONN_RATE_5MIN \
+  SNMP_DAEMON_OID_BASE, 15
+#define SNMP_MIB_DAEMON_OIDLEN_CONN_RATE_5MIN \
+  SNMP_DAEMON_OID_BASELEN + 1
+
+#define SNMP_MIB_DAEMON_OID_CONN_RATE_15MIN \
+  SNMP_DAEMON_OID_BASE, 16
+#define SNMP_MIB_DAEMON_OIDLEN_CONN_RATE_15MIN \
+  SNMP_DAEMON_OID_BASELEN + 1
+
 /* daemon.daemonNotifications MIBs */
 #define SNMP_DAEMON_NOTIFY_OID_BASE		SNMP_DAEMON_OID_BASE, 13
 #define SNMP_DAEMON_NOTIFY_OID_BASELEN		SNMP_DAEMON_OID_BASELEN + 1
@@ -236,6 +258,21 @@
 #define SNMP_MIB_FTP_LOGINS_OID_ANON_TOTAL	SNMP_FTP_LOGINS_OID_BASE, 7
 #define SNMP_MIB_FTP_LOGINS_OIDLEN_ANON_TOTAL 	SNMP_FTP_LOGINS_OID_BASELEN + 1
 
+#define SNMP_MIB_FTP_LOGINS_OID_RATE_1MIN \
+  SNMP_FTP_LOGINS_OID_BASE, 8
+#define SNMP_MIB_FTP_LOGINS_OIDLEN_RATE_1MIN \
+  SNMP_FTP_LOGINS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_LOGINS_OID_RATE_5MIN \
+  SNMP_FTP_LOGINS_OID_BASE, 9
+#define SNMP_MIB_FTP_LOGINS_OIDLEN_RATE_5MIN \
+  SNMP_FTP_LOGINS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_LOGINS_OID_RATE_15MIN \
+  SNMP_FTP_LOGINS_OID_BASE, 10
+#define SNMP_MIB_FTP_LOGINS_OIDLEN_RATE_15MIN \
+  SNMP_FTP_LOGINS_OID_BASELEN + 1
+
 /* ftp.dataTransfers MIBs */
 #define SNMP_FTP_XFERS_OID_BASE			SNMP_FTP_OID_BASE, 3
 #define SNMP_FTP_XFERS_OID_BASELEN		SNMP_FTP_OID_BASELEN + 1
@@ -295,6 +332,36 @@
 #define SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_TOTAL \
   SNMP_FTP_XFERS_OID_BASELEN + 1
 
+#define SNMP_MIB_FTP_XFERS_OID_KB_UPLOAD_RATE_1MIN \
+  SNMP_FTP_XFERS_OID_BASE, 12
+#define SNMP_MIB_FTP_XFERS_OIDLEN_KB_UPLOAD_RATE_1MIN \
+  SNMP_FTP_XFERS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_XFERS_OID_KB_UPLOAD_RATE_5MIN \
+  SNMP_FTP_XFERS_OID_BASE, 13
+#define SNMP_MIB_FTP_XFERS_OIDLEN_KB_UPLOAD_RATE_5MIN \
+  SNMP_FTP_XFERS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_XFERS_OID_KB_UPLOAD_RATE_15MIN \
+  SNMP_FTP_XFERS_OID_BASE, 14
+#define SNMP_MIB_FTP_XFERS_OIDLEN_KB_UPLOAD_RATE_15MIN \
+  SNMP_FTP_XFERS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_XFERS_OID_KB_DOWNLOAD_RATE_1MIN \
+  SNMP_FTP_XFERS_OID_BASE, 15
+#define SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_RATE_1MIN \
+  SNMP_FTP_XFERS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_XFERS_OID_KB_DOWNLOAD_RATE_5MIN \
+  SNMP_FTP_XFERS_OID_BASE, 16
+#define SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_RATE_5MIN \
+  SNMP_FTP_XFERS_OID_BASELEN + 1
+
+#define SNMP_MIB_FTP_XFERS_OID_KB_DOWNLOAD_RATE_15MIN \
+  SNMP_FTP_XFERS_OID_BASE, 17
+#define SNMP_MIB_FTP_XFERS_OIDLEN_KB_DOWNLOAD_RATE_15MIN \
+  SNMP_FTP_XFERS_OID_BASELEN + 1
+
 /* ftp.notifications MIBs */
 #define SNMP_FTP_NOTIFY_OID_BASE		SNMP_FTP_OID_BASE, 5
 #define SNMP_FTP_NOTIFY_OID_BASELEN		SNMP_FTP_OID_BASELEN + 1
@@ -329,6 +396,56 @@
 #define SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_TOTAL \
   SNMP_SNMP_OID_BASELEN + 1
 
+#define SNMP_MIB_SNMP_OID_ACL_CACHE_HITS_TOTAL \
+  SNMP_SNMP_OID_BASE, 6
+#define SNMP_MIB_SNMP_OIDLEN_ACL_CACHE_HITS_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_ACL_CACHE_MISSES_TOTAL \
+  SNMP_SNMP_OID_BASE, 7
+#define SNMP_MIB_SNMP_OIDLEN_ACL_CACHE_MISSES_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_PKTS_DROPPED_RATE_LIMIT_TOTAL \
+  SNMP_SNMP_OID_BASE, 8
+#define SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_RATE_LIMIT_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_PKTS_DROPPED_VERSION_TOTAL \
+  SNMP_SNMP_OID_BASE, 9
+#define SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_VERSION_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_PKTS_DROPPED_SEND_TOTAL \
+  SNMP_SNMP_OID_BASE, 10
+#define SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_SEND_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_PKTS_DROPPED_STALE_TOTAL \
+  SNMP_SNMP_OID_BASE, 11
+#define SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_STALE_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_RXQ_BYTES \
+  SNMP_SNMP_OID_BASE, 12
+#define SNMP_MIB_SNMP_OIDLEN_RXQ_BYTES \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_RXQ_DROPPED_TOTAL \
+  SNMP_SNMP_OID_BASE, 13
+#define SNMP_MIB_SNMP_OIDLEN_RXQ_DROPPED_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_PKTS_REPLAYED_TOTAL \
+  SNMP_SNMP_OID_BASE, 14
+#define SNMP_MIB_SNMP_OIDLEN_PKTS_REPLAYED_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
+#define SNMP_MIB_SNMP_OID_PKTS_DROPPED_TOO_BIG_TOTAL \
+  SNMP_SNMP_OID_BASE, 15
+#define SNMP_MIB_SNMP_OIDLEN_PKTS_DROPPED_TOO_BIG_TOTAL \
+  SNMP_SNMP_OID_BASELEN + 1
+
 /* ftps.tlsSessions MIBs */
 #define SNMP_FTPS_SESS_OID_BASE			SNMP_TLS_OID_BASE, 1
 #define SNMP_FTPS_SESS_OID_BASELEN		SNMP_TLS_OID_BASELEN + 1
@@ -712,14 +829,86 @@
 #define SNMP_MIB_BAN_BANS_OIDLEN_CLASS_BAN_TOTAL \
   SNMP_BAN_BANS_OID_BASELEN + 1
 
+/* Transfer histogram MIBs
+ *
+ * Each protocol's data transfers arc has a histogram table, indexed by
+ * metric and bucket.  These are tables, rather than scalars; the OIDs defined
+ * here are for the columns.  The instance identifier for each row is
+ * appended to the column OID when the MIB is initialized.
+ */
+#define SNMP_MIB_XFER_HIST_COL_UPPER_BOUND	3
+#define SNMP_MIB_XFER_HIST_COL_COUNT		4
+
+#define SNMP_FTP_XFER_HIST_OID_BASE		SNMP_FTP_XFERS_OID_BASE, 20, 1
+#define SNMP_FTP_XFER_HIST_OID_BASELEN		SNMP_FTP_XFERS_OID_BASELEN + 2
+
+#define SNMP_FTPS_XFER_HIST_OID_BASE		SNMP_FTPS_XFERS_OID_BASE, 20, 1
+#define SNMP_FTPS_XFER_HIST_OID_BASELEN		SNMP_FTPS_XFERS_OID_BASELEN + 2
+
+#define SNMP_SFTP_XFER_HIST_OID_BASE		SNMP_SFTP_XFERS_OID_BASE, 20, 1
+#define SNMP_SFTP_XFER_HIST_OID_BASELEN		SNMP_SFTP_XFERS_OID_BASELEN + 2
+
+#define SNMP_SCP_XFER_HIST_OID_BASE		SNMP_SCP_XFERS_OID_BASE, 20, 1
+#define SNMP_SCP_XFER_HIST_OID_BASELEN		SNMP_SCP_XFERS_OID_BASELEN + 2
+
+/* ftp.commands MIBs
+ *
+ * The command statistics table is indexed by command; the command latency
+ * table is indexed by command and bucket.
+ */
+#define SNMP_FTP_CMDS_OID_BASE			SNMP_FTP_OID_BASE, 6
+#define SNMP_FTP_CMDS_OID_BASELEN		SNMP_FTP_OID_BASELEN + 1
+
+#define SNMP_FTP_CMD_TABLE_OID_BASE		SNMP_FTP_CMDS_OID_BASE, 1, 1
+#define SNMP_FTP_CMD_TABLE_OID_BASELEN		SNMP_FTP_CMDS_OID_BASELEN + 2
+
+#define SNMP_MIB_FTP_CMD_COL_NAME		2
+#define SNMP_MIB_FTP_CMD_COL_COUNT		3
+#define SNMP_MIB_FTP_CMD_COL_ERR_COUNT		4
+
+#define SNMP_FTP_CMD_LATENCY_OID_BASE		SNMP_FTP_CMDS_OID_BASE, 2, 1
+#define SNMP_FTP_CMD_LATENCY_OID_BASELEN	SNMP_FTP_CMDS_OID_BASELEN + 2
+
+#define SNMP_MIB_FTP_CMD_LATENCY_COL_UPPER_BOUND	3
+#define SNMP_MIB_FTP_CMD_LATENCY_COL_COUNT	4
+
+/* counters MIBs
+ *
+ * The counter table has a row for every counter and gauge scalar, indexed
+ * by its database field ID, so that a manager can collect all of them by
+ * walking a single column.
+ */
+#define SNMP_COUNTER_TABLE_OID_BASE		SNMP_COUNTERS_OID_BASE, 1, 1
+#define SNMP_COUNTER_TABLE_OID_BASELEN		SNMP_COUNTERS_OID_BASELEN + 2
+
+#define SNMP_MIB_COUNTER_COL_NAME		2
+#define SNMP_MIB_COUNTER_COL_TYPE		3
+#define SNMP_MIB_COUNTER_COL_VALUE		4
+
+/* The counter history table is indexed by counter ID and sample number.
+ * Its rows are not in the MIB table; they are looked up in the history
+ * rings (see history.h) instead.
+ */
+#define SNMP_COUNTER_HISTORY_OID_BASE		SNMP_COUNTERS_OID_BASE, 2, 1
+#define SNMP_COUNTER_HISTORY_OID_BASELEN	SNMP_COUNTERS_OID_BASELEN + 2
+
+#define SNMP_MIB_COUNTER_HISTORY_COL_TIME	3
+#define SNMP_MIB_COUNTER_HISTORY_COL_VALUE	4
+
+/* Values of the counter table's type column. */
+#define SNMP_MIB_COUNTER_TYPE_COUNTER		1
+#define SNMP_MIB_COUNTER_TYPE_GAUGE		2
+
 /* XXX sqlStats MIBs */
 
 /* XXX quotaStats MIBs */
 
 /* XXX geoipStats MIBs */
 
-/* The longest MIB that we support/define. */
-#define SNMP_MIB_MAX_OIDLEN		14
+/* The longest MIB that we support/define, including the instance identifiers
+ * of table rows.
+ */
+#define SNMP_MIB_MAX_OIDLEN		24
 
 /* The index at which the sysUpTime OID appears in our MIBs array. */
 #define SNMP_MIB_SYS_UPTIME_IDX		1
@@ -736,15 +925,32 @@ struct snmp_mib {
   const char *mib_name;
   const char *instance_name;
   unsigned char smi_type;
+
+  /* The OID as encoded in a variable binding (type, length, and value);
+   * set when the MIB table is built, so that responses need only copy it.
+   */
+  unsigned char *ber_oid;
+  unsigned int ber_oidlen;
 };
 
 struct snmp_mib *snmp_mib_get_by_idx(unsigned int mib_idx);
+
+/* Returns the MIB for the given database field, if any.  Unlike the other
+ * lookups, this may be used before snmp_mib_init() has been called.
+ */
+struct snmp_mib *snmp_mib_get_by_field(unsigned int db_field);
 struct snmp_mib *snmp_mib_get_by_oid(oid_t *mib_oid, unsigned int mib_oidlen,
   int *lacks_instance_id);
 int snmp_mib_get_idx(oid_t *mib_oid, unsigned int mib_oidlen,
   int *lacks_instance_id);
 int snmp_mib_get_nearest_idx(oid_t *mib_oid, unsigned int mib_oidlen);
 
+/* Fills in the database fields of the counter table's rows, in ascending
+ * order, returning how many there are.  Like snmp_mib_get_by_field(), this
+ * may be used before snmp_mib_init() has been called.
+ */
+int snmp_mib_get_counter_fields(unsigned int *fields, unsigned int max_fields);
+
 /* Returns the highest valid MIB index.  Why is this a runtime function,
  * rather than a compile-time constant?  Because of the conditional nature
  * of some of the MIBs e.g. pertaining to mod_tls or mod_sftp; those modules
@@ -755,6 +961,11 @@ int snmp_mib_get_max_idx(void);
 /* Resets the counter values in the database, as per RFC recommendation. */
 int snmp_mib_reset_counters(void);
 
+/* Used to reset the gauges (e.g. current session counts), which are not
+ * meaningful once restored from a previous run.
+ */
+int snmp_mib_reset_gauges(void);
+
 /* Initialize the MIB. */
 int snmp_mib_init(void);
 
@@ -26,13 +26,25 @@
  */
 
 #include "mod_snmp.h"
+#include "acl.h"
 #include "asn1.h"
+#include "bucket.h"
 #include "db.h"
+#include "gauge.h"
+#include "history.h"
 #include "mib.h"
 #include "packet.h"
 #include "pdu.h"
 #include "msg.h"
 #include "notify.h"
+#include "rate.h"
+#include "registry.h"
+#include "replay.h"
+#include "metrics.h"
+#include "stream.h"
+#include "template.h"
+#include "usm.h"
+#include "view.h"
 
 /* Defaults */
 #define SNMP_DEFAULT_AGENT_PORT		161
@@ -42,6 +54,13 @@
 #define SNMP_AGENT_TYPE_MASTER		1
 #define SNMP_AGENT_TYPE_AGENTX		2
 
+/* Agent transports */
+#define SNMP_AGENT_TRANSPORT_UDP	0x01
+#define SNMP_AGENT_TRANSPORT_TCP	0x02
+
+/* Maximum number of waiting UDP requests read, and scheduled, at once */
+#define SNMP_AGENT_BATCH_SIZE		16
+
 extern xaset_t *server_list;
 
 module snmp_module;
@@ -51,9 +70,15 @@ pool *snmp_pool = NULL;
 conn_t *snmp_conn = NULL;
 struct timeval snmp_start_tv;
 int snmp_proto_udp = IPPROTO_UDP;
+int snmp_proto_tcp = IPPROTO_TCP;
 
 /* mod_snmp option flags */
 #define SNMP_OPT_RESTART_CLEARS_COUNTERS		0x0001
+#define SNMP_OPT_COMMAND_STATS				0x0002
+#define SNMP_OPT_PERSISTENT_TABLES			0x0004
+
+/* How often, in seconds, the agent checkpoints persistent tables. */
+#define SNMP_DB_SYNC_INTERVAL				60
 
 static pid_t snmp_agent_pid = 0;
 static int snmp_enabled = TRUE;
@@ -63,6 +88,18 @@ static unsigned long snmp_opts = 0UL;
 
 static const char *snmp_community = NULL;
 
+/* The communities, and SNMPv3 users, which may make requests, and the MIB
+ * views to which they are limited.
+ */
+struct snmp_principal {
+  const char *name;
+  size_t namelen;
+  const struct snmp_view *view;
+};
+
+static array_header *snmp_communities = NULL;
+static array_header *snmp_users = NULL;
+
 /* The list of SNMPNotify receivers/managers to which to send notifications. */
 static array_header *snmp_notifys = NULL;
 
@@ -72,6 +109,23 @@ static array_header *snmp_notifys = NULL;
  */
 static unsigned int snmp_max_variables = SNMP_PDU_MAX_BINDINGS;
 
+/* UDP requests which have waited longer than this many millisecs to be
+ * handled, e.g. because the agent is backlogged, have most likely been
+ * given up on (and retransmitted) by the manager, and are dropped.  Zero
+ * means no deadline.
+ */
+static unsigned int snmp_request_deadline = 0;
+
+/* The kernel's count of datagrams dropped from the agent's full UDP receive
+ * queue, as last reported, and when the queue length was last sampled.
+ */
+static uint32_t snmp_agent_rxq_drops = 0;
+static time_t snmp_agent_rxq_sampled = 0;
+
+/* Unix domain socket for local clients, and the UIDs allowed to use it. */
+static const char *snmp_socket_path = NULL;
+static array_header *snmp_socket_uids = NULL;
+
 /* Number of seconds to wait for the SNMP agent process to stop before
  * we terminate it with extreme prejudice.
  *
@@ -82,6 +136,27 @@ static time_t snmp_agent_timeout = 1;
 
 static off_t snmp_retr_bytes = 0, snmp_stor_bytes = 0;
 
+/* For SNMPTransferUpdates: how often (and after how many bytes) the bytes
+ * of a transfer in progress are added to its KB total, rather than all at
+ * once when it ends.  While a transfer is in progress, a timer checks the
+ * number of bytes transferred every second; the shared tables are only
+ * updated when either limit is reached.
+ */
+static unsigned int snmp_xfer_update_interval = 0;
+static off_t snmp_xfer_update_bytes = 0;
+
+static int snmp_xfer_timerno = -1;
+static unsigned int snmp_xfer_kb_field = 0;
+static off_t *snmp_xfer_bucket = NULL;
+static off_t snmp_xfer_added_bytes = 0;
+static struct timeval snmp_xfer_pre_tv, snmp_xfer_start_tv;
+static time_t snmp_xfer_updated = 0;
+
+/* For SNMPOptions CommandStats: the command currently being timed. */
+static cmd_rec *snmp_cmd = NULL;
+static unsigned int snmp_cmd_idx = 0;
+static struct timeval snmp_cmd_start_tv;
+
 static const char *trace_channel = "snmp";
 
 static int snmp_check_class_access(xaset_t *set, const char *name,
@@ -379,16 +454,39 @@ static int snmp_limits_allow(xaset_t *set, struct snmp_packet *pkt) {
   return ok;
 }
 
+static struct snmp_principal *snmp_find_principal(array_header *principals,
+    const char *name, unsigned int namelen) {
+  register unsigned int i;
+  struct snmp_principal *elts;
+
+  if (principals == NULL) {
+    return NULL;
+  }
+
+  elts = principals->elts;
+  for (i = 0; i < principals->nelts; i++) {
+    if (elts[i].namelen == namelen &&
+        memcmp(elts[i].name, name, namelen) == 0) {
+      return &(elts[i]);
+    }
+  }
+
+  return NULL;
+}
+
 static int snmp_security_check(struct snmp_packet *pkt) {
+  struct snmp_principal *principal;
   int res = 0;
 
   switch (pkt->snmp_version) {
     case SNMP_PROTOCOL_VERSION_1:
     case SNMP_PROTOCOL_VERSION_2:
-      /* Check the community string against the configured SNMPCommunity. */
-      if (strncmp(snmp_community, pkt->community, pkt->community_len) != 0) {
+      /* Check the community string against the configured SNMPCommunities. */
+      principal = snmp_find_principal(snmp_communities, pkt->community,
+        pkt->community_len);
+      if (principal == NULL) {
         (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "%s message community '%s' does not match configured community, "
+          "%s message community '%s' does not match any configured community, "
           "ignoring message", snmp_msg_get_versionstr(pkt->snmp_version),
           pkt->community);
 
@@ -405,12 +503,32 @@ static int snmp_security_check(struct snmp_packet *pkt) {
         errno = EACCES;
         return -1;
       }
+
+      pkt->view = principal->view;
       break;
 
     case SNMP_PROTOCOL_VERSION_3:
-      /* XXX Not supported yet */
-      errno = ENOSYS;
-      return -1;
+      /* The USM has already authenticated the message, as it was read.  A
+       * user whose view could not be found is not allowed any access.
+       */
+      principal = snmp_find_principal(snmp_users, pkt->community,
+        pkt->community_len);
+      if (pkt->usm.user == NULL ||
+          principal == NULL) {
+        res = snmp_db_incr_value(pkt->pool,
+          SNMP_DB_SNMP_F_PKTS_AUTH_ERR_TOTAL, 1);
+        if (res < 0) {
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "error incrementing snmp.packetsAuthFailedTotal: %s",
+            strerror(errno));
+        }
+
+        errno = EACCES;
+        return -1;
+      }
+
+      pkt->view = principal->view;
+      break;
   }
 
   return res;
@@ -572,10 +690,259 @@ static void snmp_daemonize(const char *daemon_dir) {
   pr_fsio_chdir(daemon_dir, 0);
 }
 
+/* Returns the index of the next MIB after the given index, skipping any
+ * disabled or notification-only arcs, and any MIBs not in the requester's
+ * view, or -1 if the end of the MIB view has been reached.
+ */
+static int snmp_agent_get_next_idx(struct snmp_packet *pkt, int mib_idx,
+    int max_idx) {
+  int next_idx;
+
+  for (next_idx = mib_idx + 1; next_idx <= max_idx; next_idx++) {
+    struct snmp_mib *mib;
+
+    if (snmp_view_allows(pkt->view, next_idx) == FALSE) {
+      continue;
+    }
+
+    mib = snmp_mib_get_by_idx(next_idx);
+    if (mib != NULL &&
+        mib->mib_enabled == TRUE &&
+        mib->notify_only == FALSE) {
+      return next_idx;
+    }
+  }
+
+  return -1;
+}
+
+/* The variable bindings of GET, GETNEXT, and GETBULK responses are encoded
+ * directly into the response buffer, at the offset where the message and
+ * PDU headers will end, as each value is read from the database; no list of
+ * struct snmp_var is built.  The list is only used for error responses
+ * (e.g. SNMPv1 errors, which echo the request bindings), and for traps.
+ */
+struct snmp_agent_vars {
+  unsigned char *data;
+  unsigned char *buf;
+  size_t buflen;
+  unsigned int count;
+};
+
+/* Must be called once the response PDU's request ID and error fields are
+ * set, as those determine the length of the headers.
+ */
+static int snmp_agent_vars_init(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars) {
+  unsigned int hdrlen;
+
+  hdrlen = snmp_msg_get_hdrlen(pkt->community_len, pkt->snmp_version,
+    pkt->resp_pdu, &(pkt->usm));
+  if ((size_t) hdrlen >= pkt->resp_datalen) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  vars->data = vars->buf = pkt->resp_data + hdrlen;
+  vars->buflen = pkt->resp_datalen - hdrlen;
+  vars->count = 0;
+
+  return 0;
+}
+
+/* Returns -1, with errno set to ENOSPC, if the variable would not fit in the
+ * response, or would exceed SNMPMaxVariables.
+ */
+static int snmp_agent_vars_add(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars, const unsigned char *ber_name,
+    unsigned int ber_namelen, unsigned char smi_type, int32_t int_value,
+    char *str_value, size_t str_valuelen) {
+  unsigned char *buf;
+  size_t buflen;
+  unsigned int var_len;
+  int res;
+
+  var_len = snmp_smi_get_value_len(ber_namelen, smi_type, int_value,
+    str_valuelen);
+  if (vars->count >= snmp_max_variables ||
+      var_len > vars->buflen) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  buf = vars->buf;
+  buflen = vars->buflen;
+
+  res = snmp_smi_write_value(pkt->pool, &buf, &buflen, ber_name, ber_namelen,
+    smi_type, int_value, str_value, str_valuelen, pkt->snmp_version);
+  if (res < 0) {
+    return -1;
+  }
+
+  vars->buf = buf;
+  vars->buflen = buflen;
+  vars->count++;
+
+  return 0;
+}
+
+static int snmp_agent_vars_add_mib(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars, struct snmp_mib *mib) {
+  int32_t mib_int = -1;
+  char *mib_str = NULL;
+  size_t mib_strlen = 0;
+  int res;
+
+  res = snmp_db_get_value(pkt->pool, mib->db_field, &mib_int, &mib_str,
+    &mib_strlen);
+
+  /* XXX Response with genErr instead? */
+  if (res < 0) {
+    int xerrno = errno;
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error retrieving database value for field %s: %s",
+      snmp_db_get_fieldstr(pkt->pool, mib->db_field), strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  return snmp_agent_vars_add(pkt, vars, mib->ber_oid, mib->ber_oidlen,
+    mib->smi_type, mib_int, mib_str, mib_strlen);
+}
+
+/* Variables which are not in the MIB table (exceptions, which use the OID
+ * from the request, and counter history rows) have their OIDs encoded here.
+ */
+static int snmp_agent_vars_add_oid(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars, oid_t *name, unsigned int namelen,
+    unsigned char smi_type, int32_t int_value) {
+  unsigned char asn1_type, *ber_name, *buf;
+  size_t buflen;
+  unsigned int ber_namelen;
+  int res;
+
+  ber_namelen = snmp_asn1_get_oid_len(name, namelen);
+  ber_name = buf = palloc(pkt->pool, ber_namelen);
+  buflen = ber_namelen;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OID);
+  res = snmp_asn1_write_oid(pkt->pool, &buf, &buflen, asn1_type, name,
+    namelen);
+  if (res < 0) {
+    return -1;
+  }
+
+  return snmp_agent_vars_add(pkt, vars, ber_name, ber_namelen, smi_type,
+    int_value, NULL, 0);
+}
+
+static int snmp_agent_vars_add_exception(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars, oid_t *name, unsigned int namelen,
+    unsigned char smi_type) {
+  return snmp_agent_vars_add_oid(pkt, vars, name, namelen, smi_type, 0);
+}
+
+/* The counter history rows are not in the MIB table, and sort after all of
+ * its rows; they are only looked for once the MIB table is exhausted.
+ */
+static int snmp_agent_get_next_history(struct snmp_packet *pkt, oid_t *name,
+    unsigned int namelen, oid_t **next_name, unsigned int *next_namelen,
+    unsigned char *smi_type, int32_t *int_value) {
+  oid_t *oid;
+  unsigned int oidlen = 0;
+
+  oid = palloc(pkt->pool, SNMP_MIB_MAX_OIDLEN * sizeof(oid_t));
+  if (snmp_history_get_next(pkt->pool, pkt->view, name, namelen, oid,
+      &oidlen, smi_type, int_value) < 0) {
+    return -1;
+  }
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "%s %s of OID %s (counter history)",
+    snmp_msg_get_versionstr(pkt->snmp_version),
+    snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
+    snmp_asn1_get_oidstr(pkt->pool, oid, oidlen));
+
+  *next_name = oid;
+  *next_namelen = oidlen;
+  return 0;
+}
+
+static void snmp_agent_vars_finish(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars) {
+  pkt->resp_pdu->varlist = NULL;
+  pkt->resp_pdu->varlistlen = vars->count;
+  pkt->resp_pdu->vars_data = vars->data;
+  pkt->resp_pdu->vars_datalen = vars->buf - vars->data;
+}
+
+/* RFC 3416, Section 4.2.1: if the response would be too large, the response
+ * has an error-status of tooBig, and an empty variable-bindings field.
+ */
+static void snmp_agent_set_too_big(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars) {
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "%s %s response too large (more than %u variables, or %lu bytes)",
+    snmp_msg_get_versionstr(pkt->snmp_version),
+    snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type), vars->count,
+    (unsigned long) pkt->resp_datalen);
+
+  pkt->resp_pdu->err_code = SNMP_ERR_TOO_BIG;
+  pkt->resp_pdu->err_idx = 0;
+  pkt->resp_pdu->varlist = NULL;
+  pkt->resp_pdu->varlistlen = 0;
+  pkt->resp_pdu->vars_data = NULL;
+  pkt->resp_pdu->vars_datalen = 0;
+}
+
+/* Answers a GET of a variable list seen before, whose OIDs have already
+ * been resolved to MIBs (or exceptions).
+ */
+static int snmp_agent_handle_get_template(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars, struct snmp_template *tmpl) {
+  register unsigned int i;
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "%s %s of %u %s (using template)",
+    snmp_msg_get_versionstr(pkt->snmp_version),
+    snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type), tmpl->nslots,
+    tmpl->nslots != 1 ? "OIDs" : "OID");
+
+  for (i = 0; i < tmpl->nslots; i++) {
+    struct snmp_template_slot *slot;
+    int res;
+
+    slot = &(tmpl->slots[i]);
+    if (slot->mib != NULL) {
+      res = snmp_agent_vars_add_mib(pkt, vars, slot->mib);
+
+    } else {
+      res = snmp_agent_vars_add(pkt, vars, slot->ber_name, slot->ber_namelen,
+        slot->smi_type, 0, NULL, 0);
+    }
+
+    if (res < 0) {
+      if (errno == ENOSPC) {
+        snmp_agent_set_too_big(pkt, vars);
+        return 0;
+      }
+
+      return -1;
+    }
+  }
+
+  snmp_agent_vars_finish(pkt, vars);
+  return 0;
+}
+
 static int snmp_agent_handle_get(struct snmp_packet *pkt) {
-  struct snmp_var *iter_var = NULL, *head_var = NULL, *tail_var = NULL;
+  struct snmp_var *iter_var = NULL;
+  struct snmp_agent_vars vars;
+  struct snmp_template *tmpl;
+  struct snmp_template_slot *slots;
   unsigned int var_count = 0;
-  int res;
+  int cacheable = TRUE, res;
 
   if (pkt->req_pdu->varlist == NULL) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
@@ -600,19 +967,59 @@ static int snmp_agent_handle_get(struct snmp_packet *pkt) {
     return 0;
   }
 
+  if (snmp_agent_vars_init(pkt, &vars) < 0) {
+    return -1;
+  }
+
+  tmpl = snmp_template_get(pkt->snmp_version, pkt->view,
+    pkt->req_pdu->varlist, pkt->req_pdu->varlistlen);
+  if (tmpl != NULL) {
+    return snmp_agent_handle_get_template(pkt, &vars, tmpl);
+  }
+
+  /* Note how each OID was resolved, for answering the same GET next time. */
+  slots = pcalloc(pkt->pool,
+    pkt->req_pdu->varlistlen * sizeof(struct snmp_template_slot));
+
   for (iter_var = pkt->req_pdu->varlist; iter_var; iter_var = iter_var->next) { 
     struct snmp_mib *mib = NULL;
-    struct snmp_var *resp_var = NULL;
-    int32_t mib_int = -1;
-    char *mib_str = NULL;
-    size_t mib_strlen = 0;
-    int lacks_instance_id = FALSE;
+    unsigned char exception_type = 0, hist_type = 0;
+    int32_t hist_value = 0;
+    int mib_idx, lacks_instance_id = FALSE, in_history = FALSE;
 
     pr_signals_handle();
 
-    mib = snmp_mib_get_by_oid(iter_var->name, iter_var->namelen,
+    mib_idx = snmp_mib_get_idx(iter_var->name, iter_var->namelen,
       &lacks_instance_id);
-    if (mib == NULL) {
+    if (mib_idx >= 0) {
+      /* RFC 3415, Section 3.2: variables outside of the requester's view
+       * are reported as if they did not exist.
+       */
+      if (snmp_view_allows(pkt->view, mib_idx) == TRUE) {
+        mib = snmp_mib_get_by_idx(mib_idx);
+
+      } else {
+        pr_trace_msg(trace_channel, 9, "OID %s is not in view for '%.*s'",
+          snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
+            iter_var->namelen), (int) pkt->community_len, pkt->community);
+      }
+    }
+
+    if (mib == NULL &&
+        snmp_history_is_oid(iter_var->name, iter_var->namelen) == TRUE) {
+      /* Counter history samples come and go, so a GET of them is never
+       * answered from a template.
+       */
+      cacheable = FALSE;
+
+      if (snmp_history_get(pkt->pool, pkt->view, iter_var->name,
+          iter_var->namelen, &hist_type, &hist_value) == 0) {
+        in_history = TRUE;
+      }
+    }
+
+    if (mib == NULL &&
+        in_history == FALSE) {
       (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
         "%s %s of unknown OID %s (lacks instance ID = %s)",
         snmp_msg_get_versionstr(pkt->snmp_version),
@@ -639,13 +1046,12 @@ static int snmp_agent_handle_get(struct snmp_packet *pkt) {
 
         case SNMP_PROTOCOL_VERSION_2:
         case SNMP_PROTOCOL_VERSION_3:
-          resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
-            iter_var->namelen, lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
-              SNMP_SMI_NO_SUCH_OBJECT);
+          exception_type = lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
+            SNMP_SMI_NO_SUCH_OBJECT;
           break;
       }
 
-      if (resp_var == NULL) {
+      if (exception_type == 0) {
         return 0;
       }
     }
@@ -654,41 +1060,52 @@ static int snmp_agent_handle_get(struct snmp_packet *pkt) {
       "%s %s of OID %s (%s)", snmp_msg_get_versionstr(pkt->snmp_version),
       snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
       snmp_asn1_get_oidstr(iter_var->pool, iter_var->name, iter_var->namelen),
-      mib ? mib->instance_name : "unknown");
+      mib ? mib->instance_name : in_history ? "counter history" : "unknown");
 
-    /* A response variable may be have generated above, e.g. when the MIB
-     * not known/supported.
-     */
-    if (resp_var == NULL) { 
-      res = snmp_db_get_value(pkt->pool, mib->db_field, &mib_int, &mib_str,
-        &mib_strlen);
+    if (var_count < pkt->req_pdu->varlistlen) {
+      slots[var_count].mib = mib;
+      slots[var_count].smi_type = exception_type;
+    }
 
-      /* XXX Response with genErr instead? */
-      if (res < 0) {
-        int xerrno = errno;
+    if (exception_type != 0) {
+      res = snmp_agent_vars_add_exception(pkt, &vars, iter_var->name,
+        iter_var->namelen, exception_type);
 
-        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "error retrieving database value for field %s: %s",
-          snmp_db_get_fieldstr(pkt->pool, mib->db_field), strerror(xerrno));
-        errno = xerrno;
-        return -1;
+    } else if (in_history) {
+      res = snmp_agent_vars_add_oid(pkt, &vars, iter_var->name,
+        iter_var->namelen, hist_type, hist_value);
+
+    } else {
+      res = snmp_agent_vars_add_mib(pkt, &vars, mib);
+    }
+
+    if (res < 0) {
+      if (errno == ENOSPC) {
+        snmp_agent_set_too_big(pkt, &vars);
+        return 0;
       }
 
-      resp_var = snmp_smi_create_var(pkt->pool, mib->mib_oid, mib->mib_oidlen,
-        mib->smi_type, mib_int, mib_str, mib_strlen);
+      return -1;
     }
 
-    var_count = snmp_smi_util_add_list_var(&head_var, &tail_var, resp_var);
+    var_count = vars.count;
   }
 
-  pkt->resp_pdu->varlist = head_var;
-  pkt->resp_pdu->varlistlen = var_count;
+  snmp_agent_vars_finish(pkt, &vars);
+
+  if (cacheable == TRUE &&
+      snmp_template_add(pkt->snmp_version, pkt->view, pkt->req_pdu->varlist,
+      pkt->req_pdu->varlistlen, slots) < 0) {
+    pr_trace_msg(trace_channel, 9, "error adding GET template: %s",
+      strerror(errno));
+  }
 
   return 0;
 }
 
 static int snmp_agent_handle_getnext(struct snmp_packet *pkt) {
-  struct snmp_var *iter_var = NULL, *head_var = NULL, *tail_var = NULL;
+  struct snmp_var *iter_var = NULL;
+  struct snmp_agent_vars vars;
   unsigned int var_count = 0;
   int max_idx, res;
 
@@ -715,15 +1132,19 @@ static int snmp_agent_handle_getnext(struct snmp_packet *pkt) {
     return 0;
   }
 
+  if (snmp_agent_vars_init(pkt, &vars) < 0) {
+    return -1;
+  }
+
   max_idx = snmp_mib_get_max_idx();
 
   for (iter_var = pkt->req_pdu->varlist; iter_var; iter_var = iter_var->next) { 
     struct snmp_mib *mib = NULL;
-    struct snmp_var *resp_var = NULL;
+    unsigned char exception_type = 0, hist_type = 0;
+    oid_t *hist_name = NULL;
+    unsigned int hist_namelen = 0;
+    int32_t hist_value = 0;
     int mib_idx = -1, next_idx = -1, lacks_instance_id = FALSE;
-    int32_t mib_int = -1;
-    char *mib_str = NULL;
-    size_t mib_strlen = 0;
 
     pr_signals_handle();
 
@@ -772,7 +1193,9 @@ static int snmp_agent_handle_getnext(struct snmp_packet *pkt) {
         }
       }
 
-      if (unknown_oid) {
+      if (unknown_oid &&
+          snmp_agent_get_next_history(pkt, iter_var->name, iter_var->namelen,
+            &hist_name, &hist_namelen, &hist_type, &hist_value) < 0) {
         /* If SNMPv1, then set the err_code/err_idx values, and duplicate the
          * varlist.
          *
@@ -792,13 +1215,12 @@ static int snmp_agent_handle_getnext(struct snmp_packet *pkt) {
 
           case SNMP_PROTOCOL_VERSION_2:
           case SNMP_PROTOCOL_VERSION_3:
-            resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
-              iter_var->namelen, lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
-                SNMP_SMI_NO_SUCH_OBJECT);
+            exception_type = lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
+              SNMP_SMI_NO_SUCH_OBJECT;
             break;
         }
 
-        if (resp_var == NULL) {
+        if (exception_type == 0) {
           return 0;
         }
       }
@@ -811,64 +1233,60 @@ static int snmp_agent_handle_getnext(struct snmp_packet *pkt) {
       snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
         iter_var->namelen), mib_idx, max_idx);
 
-    next_idx = mib_idx + 1;
-
-    if (next_idx < max_idx) {
+    if (exception_type == 0 &&
+        hist_name == NULL) {
       /* Get the next MIB in the list.  Note that we may need to continue
-       * looking for a short while, as some arcs are for notifications only.
+       * looking for a short while, as some arcs are for notifications only,
+       * and some MIBs may not be in the requester's view.
        */
-      mib = snmp_mib_get_by_idx(next_idx);
-      while (mib != NULL &&
-             (mib->mib_enabled == FALSE ||
-              mib->notify_only == TRUE)) {
-        pr_signals_handle();
+      next_idx = snmp_agent_get_next_idx(pkt, mib_idx, max_idx);
+      if (next_idx < 0 &&
+          snmp_agent_get_next_history(pkt, iter_var->name, iter_var->namelen,
+            &hist_name, &hist_namelen, &hist_type, &hist_value) < 0) {
+        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+          "%s %s of last OID %s",
+          snmp_msg_get_versionstr(pkt->snmp_version),
+          snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
+          snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
+            iter_var->namelen));
 
-        if (next_idx > max_idx) {
-          break;
+        /* If SNMPv1, then set the err_code/err_idx values, and duplicate the
+         * varlist.
+         *
+         * If SNMPv2/SNMPv3, then leave err_code/err_idex values set to zero,
+         * but create a var of value 'endOfMibView'.
+         */
+
+        switch (pkt->snmp_version) {
+          case SNMP_PROTOCOL_VERSION_1:
+            pkt->resp_pdu->err_code = SNMP_ERR_NO_SUCH_NAME;
+            pkt->resp_pdu->err_idx = var_count + 1;
+            pkt->resp_pdu->varlist = snmp_smi_dup_var(pkt->pool,
+              pkt->req_pdu->varlist);
+            pkt->resp_pdu->varlistlen = pkt->req_pdu->varlistlen;
+            break;
+
+          case SNMP_PROTOCOL_VERSION_2:
+          case SNMP_PROTOCOL_VERSION_3:
+            exception_type = SNMP_SMI_END_OF_MIB_VIEW;
+            break;
         }
 
-        mib = snmp_mib_get_by_idx(++next_idx);
+        if (exception_type == 0) {
+          return 0;
+        }
       }
     }
 
-    if (mib_idx >= max_idx ||
-        next_idx > max_idx) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "%s %s of last OID %s",
-        snmp_msg_get_versionstr(pkt->snmp_version),
-        snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-        snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-          iter_var->namelen));
-
-      /* If SNMPv1, then set the err_code/err_idx values, and duplicate the
-       * varlist.
-       *
-       * If SNMPv2/SNMPv3, then leave err_code/err_idex values set to zero, but
-       * create a var of value 'endOfMibView'.
-       */
-
-      switch (pkt->snmp_version) {
-        case SNMP_PROTOCOL_VERSION_1:
-          pkt->resp_pdu->err_code = SNMP_ERR_NO_SUCH_NAME;
-          pkt->resp_pdu->err_idx = var_count + 1;
-          pkt->resp_pdu->varlist = snmp_smi_dup_var(pkt->pool,
-            pkt->req_pdu->varlist);
-          pkt->resp_pdu->varlistlen = pkt->req_pdu->varlistlen;
-          break;
-
-        case SNMP_PROTOCOL_VERSION_2:
-        case SNMP_PROTOCOL_VERSION_3:
-          resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
-            iter_var->namelen, SNMP_SMI_END_OF_MIB_VIEW);
-          break;
-      }
+    if (exception_type != 0) {
+      res = snmp_agent_vars_add_exception(pkt, &vars, iter_var->name,
+        iter_var->namelen, exception_type);
 
-      if (resp_var == NULL) {
-        return 0;
-      }
-    }
+    } else if (hist_name != NULL) {
+      res = snmp_agent_vars_add_oid(pkt, &vars, hist_name, hist_namelen,
+        hist_type, hist_value);
 
-    if (resp_var == NULL) {
+    } else {
       /* Get the next MIB in the list. */
       mib = snmp_mib_get_by_idx(next_idx);
 
@@ -877,47 +1295,120 @@ static int snmp_agent_handle_getnext(struct snmp_packet *pkt) {
         snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
         snmp_asn1_get_oidstr(iter_var->pool, mib->mib_oid, mib->mib_oidlen),
         mib->mib_name);
- 
-      res = snmp_db_get_value(pkt->pool, mib->db_field, &mib_int, &mib_str,
-        &mib_strlen);
 
-      /* XXX Response with genErr instead? */
-      if (res < 0) {
-        int xerrno = errno;
+      res = snmp_agent_vars_add_mib(pkt, &vars, mib);
+    }
 
-        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "error retrieving database value for field %s: %s",
-          snmp_db_get_fieldstr(pkt->pool, mib->db_field), strerror(xerrno));
-        errno = xerrno;
-        return -1;
+    if (res < 0) {
+      if (errno == ENOSPC) {
+        snmp_agent_set_too_big(pkt, &vars);
+        return 0;
       }
 
-      resp_var = snmp_smi_create_var(pkt->pool, mib->mib_oid, mib->mib_oidlen,
-        mib->smi_type, mib_int, mib_str, mib_strlen);
+      return -1;
     }
 
-    var_count = snmp_smi_util_add_list_var(&head_var, &tail_var, resp_var);
+    var_count = vars.count;
   }
 
-  pkt->resp_pdu->varlist = head_var;
-  pkt->resp_pdu->varlistlen = var_count;
-
+  snmp_agent_vars_finish(pkt, &vars);
   return 0;
 }
 
-static int snmp_agent_handle_getbulk(struct snmp_packet *pkt) {
-  register unsigned int i = 0;
-  struct snmp_var *iter_var = NULL, *head_var = NULL, *tail_var = NULL;
-  unsigned int var_count = 0;
-  int max_idx, res;
+/* Find the MIB index from which a GetBulkRequest-PDU variable's lexicographic
+ * successor is found, i.e. the index of the variable's MIB, or the index just
+ * before its nearest successor.  Returns -1 if there is no such MIB.
+ */
+static int snmp_agent_get_bulk_idx(struct snmp_packet *pkt,
+    struct snmp_var *var, int *lacks_instance_id) {
+  int mib_idx;
 
-  /* SNMPv1 does not support GetBulkRequest PDUs. */
-  if (pkt->snmp_version == SNMP_PROTOCOL_VERSION_1) {
-    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "GetBulkRequest-PDU not supported for %s packets, rejecting "
-      "invalid request", snmp_msg_get_versionstr(pkt->snmp_version));
-    errno = EINVAL;
-    return -1;
+  mib_idx = snmp_mib_get_idx(var->name, var->namelen, lacks_instance_id);
+  if (mib_idx >= 0) {
+    return mib_idx;
+  }
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "%s %s of unknown OID %s (lacks instance ID = %s)",
+    snmp_msg_get_versionstr(pkt->snmp_version),
+    snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
+    snmp_asn1_get_oidstr(pkt->req_pdu->pool, var->name, var->namelen),
+    *lacks_instance_id ? "true" : "false");
+
+  if (*lacks_instance_id) {
+    oid_t *oid;
+    unsigned int oidlen;
+
+    /* For GetBulkRequest-PDUs, a request for "A", without instance
+     * identifier, gets the response of "A.0", since "A" comes before
+     * "A.0".  (This does not hold true for GetRequest-PDUs.)
+     */
+
+    oidlen = var->namelen + 1;
+    oid = pcalloc(pkt->pool, oidlen * sizeof(oid_t));
+    memmove(oid, var->name, var->namelen * sizeof(oid_t));
+
+    mib_idx = snmp_mib_get_idx(oid, oidlen, NULL);
+    if (mib_idx < 0) {
+      *lacks_instance_id = FALSE;
+      return -1;
+    }
+
+    return mib_idx - 1;
+  }
+
+  /* Try to find the "nearest" OID. */
+  mib_idx = snmp_mib_get_nearest_idx(var->name, var->namelen);
+  if (mib_idx < 0) {
+    return -1;
+  }
+
+  return mib_idx - 1;
+}
+
+static int snmp_agent_add_bulk_var(struct snmp_packet *pkt,
+    struct snmp_agent_vars *vars, int mib_idx) {
+  struct snmp_mib *mib;
+
+  mib = snmp_mib_get_by_idx(mib_idx);
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "%s %s of OID %s (%s)", snmp_msg_get_versionstr(pkt->snmp_version),
+    snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
+    snmp_asn1_get_oidstr(pkt->pool, mib->mib_oid, mib->mib_oidlen),
+    mib->mib_name);
+
+  return snmp_agent_vars_add_mib(pkt, vars, mib);
+}
+
+/* RFC 3416, Section 4.2.3: the GetBulkRequest-PDU response contains the
+ * N non-repeaters, followed by up to M repetitions of the R repeaters, in
+ * that order.  If the message encapsulating all of these would be larger
+ * than the maximum message size (or would have more than the configured
+ * maximum number of variables), the response is truncated, dropping the
+ * variable bindings at the end.  Since the bindings are encoded into the
+ * response buffer as we go, we stop at the first variable which would not
+ * fit.
+ */
+static int snmp_agent_handle_getbulk(struct snmp_packet *pkt) {
+  register unsigned int i = 0;
+  struct snmp_var *iter_var = NULL;
+  struct snmp_agent_vars vars;
+  oid_t **rep_names = NULL;
+  unsigned int *rep_namelens = NULL, nrepeaters = 0;
+  unsigned char *rep_types = NULL, hist_type = 0;
+  int32_t hist_value = 0;
+  long max_repetitions;
+  int *rep_idxs = NULL, *rep_in_history = NULL, max_idx, res,
+    truncated = FALSE;
+
+  /* SNMPv1 does not support GetBulkRequest PDUs. */
+  if (pkt->snmp_version == SNMP_PROTOCOL_VERSION_1) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "GetBulkRequest-PDU not supported for %s packets, rejecting "
+      "invalid request", snmp_msg_get_versionstr(pkt->snmp_version));
+    errno = EINVAL;
+    return -1;
   }
 
   if (pkt->req_pdu->varlist == NULL) {
@@ -937,319 +1428,243 @@ static int snmp_agent_handle_getbulk(struct snmp_packet *pkt) {
 
   pkt->resp_pdu = snmp_pdu_dup(pkt->pool, pkt->req_pdu);
   pkt->resp_pdu->request_type = SNMP_PDU_RESPONSE;
+  pkt->resp_pdu->err_code = 0;
+  pkt->resp_pdu->err_idx = 0;
 
-  if (pkt->req_pdu->varlistlen > snmp_max_variables) {
-    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "%s %s of too many OIDs (%u, max %u)",
-      snmp_msg_get_versionstr(pkt->snmp_version),
-      snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-      pkt->req_pdu->varlistlen, snmp_max_variables);
-
-    pkt->resp_pdu->err_code = SNMP_ERR_TOO_BIG;
-    pkt->resp_pdu->err_idx = 0;
+  max_idx = snmp_mib_get_max_idx();
 
-    return 0;
+  /* Unlike the other requests, a GetBulkRequest-PDU is never answered with
+   * tooBig; the response is truncated as needed instead.
+   */
+  if (snmp_agent_vars_init(pkt, &vars) < 0) {
+    return -1;
   }
 
-  max_idx = snmp_mib_get_max_idx();
-
   /* First, deal with the non_repeaters count.  This part is just like handling
    * any other GetNextRequest PDU.
    */
   for (i = 0, iter_var = pkt->req_pdu->varlist;
        i < pkt->req_pdu->non_repeaters && iter_var != NULL;
-       i++, iter_var = iter_var->next) { 
-    struct snmp_mib *mib = NULL;
-    struct snmp_var *resp_var = NULL;
-    int mib_idx = -1, lacks_instance_id = FALSE;
-    int32_t mib_int = -1;
-    char *mib_str = NULL;
-    size_t mib_strlen = 0;
+       i++, iter_var = iter_var->next) {
+    oid_t *hist_name = NULL;
+    unsigned int hist_namelen = 0;
+    int mib_idx, next_idx = -1, lacks_instance_id = FALSE;
 
     pr_signals_handle();
 
-    mib_idx = snmp_mib_get_idx(iter_var->name, iter_var->namelen,
-      &lacks_instance_id);
+    mib_idx = snmp_agent_get_bulk_idx(pkt, iter_var, &lacks_instance_id);
     if (mib_idx < 0) {
-      int unknown_oid = FALSE;
-
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "%s %s of unknown OID %s (lacks instance ID = %s)",
-        snmp_msg_get_versionstr(pkt->snmp_version),
-        snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-        snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-          iter_var->namelen), lacks_instance_id ? "true" : "false");
-
-      if (lacks_instance_id) {
-        oid_t *oid;
-        unsigned int oidlen;
-
-        /* For GetBulkRequest-PDUs, a request for "A", without instance
-         * identifier, gets the response of "A.0", since "A" comes before
-         * "A.0".  (This does not hold true for GetRequest-PDUs.)
-         */
-
-        oidlen = iter_var->namelen + 1;
-        oid = pcalloc(pkt->pool, oidlen * sizeof(oid_t));
-        memmove(oid, iter_var->name, iter_var->namelen * sizeof(oid_t));
-
-        mib_idx = snmp_mib_get_idx(oid, oidlen, NULL);
-        if (mib_idx < 0) {
-          lacks_instance_id = FALSE;
-          unknown_oid = TRUE;
-
-        } else {
-          mib_idx--;
-        }
+      if (snmp_agent_get_next_history(pkt, iter_var->name, iter_var->namelen,
+          &hist_name, &hist_namelen, &hist_type, &hist_value) == 0) {
+        res = snmp_agent_vars_add_oid(pkt, &vars, hist_name, hist_namelen,
+          hist_type, hist_value);
 
       } else {
-        /* Try to find the "nearest" OID. */
-        mib_idx = snmp_mib_get_nearest_idx(iter_var->name, iter_var->namelen);
-        if (mib_idx < 0) {
-          unknown_oid = TRUE;
-
-        } else {
-          mib_idx--;
-        }
-      }
-
-      if (unknown_oid) {
-        resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
+        res = snmp_agent_vars_add_exception(pkt, &vars, iter_var->name,
           iter_var->namelen, lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
             SNMP_SMI_NO_SUCH_OBJECT);
       }
-    }
-
-    pr_trace_msg(trace_channel, 19,
-      "%s %s for OID %s at MIB index %d (max index %d)",
-      snmp_msg_get_versionstr(pkt->snmp_version),
-      snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-      snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-        iter_var->namelen), mib_idx, max_idx);
 
-    if (mib_idx >= max_idx) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "%s %s of last OID %s",
+    } else {
+      pr_trace_msg(trace_channel, 19,
+        "%s %s for OID %s at MIB index %d (max index %d)",
         snmp_msg_get_versionstr(pkt->snmp_version),
         snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
         snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-          iter_var->namelen));
+          iter_var->namelen), mib_idx, max_idx);
 
-      resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
-        iter_var->namelen, SNMP_SMI_END_OF_MIB_VIEW);
-    }
+      next_idx = snmp_agent_get_next_idx(pkt, mib_idx, max_idx);
+      if (next_idx < 0 &&
+          snmp_agent_get_next_history(pkt, iter_var->name, iter_var->namelen,
+            &hist_name, &hist_namelen, &hist_type, &hist_value) == 0) {
+        res = snmp_agent_vars_add_oid(pkt, &vars, hist_name, hist_namelen,
+          hist_type, hist_value);
 
-    if (resp_var == NULL) {
-      /* Get the next MIB in the list. */
-      mib = snmp_mib_get_by_idx(mib_idx + 1);
+      } else if (next_idx < 0) {
+        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+          "%s %s of last OID %s",
+          snmp_msg_get_versionstr(pkt->snmp_version),
+          snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
+          snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
+            iter_var->namelen));
 
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "%s %s of OID %s (%s)", snmp_msg_get_versionstr(pkt->snmp_version),
-        snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-        snmp_asn1_get_oidstr(iter_var->pool, mib->mib_oid, mib->mib_oidlen),
-        mib->mib_name);
- 
-      res = snmp_db_get_value(pkt->pool, mib->db_field, &mib_int, &mib_str,
-        &mib_strlen);
+        res = snmp_agent_vars_add_exception(pkt, &vars, iter_var->name,
+          iter_var->namelen, SNMP_SMI_END_OF_MIB_VIEW);
 
-      /* XXX Response with genErr instead? */
-      if (res < 0) {
-        int xerrno = errno;
+      } else {
+        res = snmp_agent_add_bulk_var(pkt, &vars, next_idx);
+      }
+    }
 
-        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "error retrieving database value for field %s: %s",
-          snmp_db_get_fieldstr(pkt->pool, mib->db_field), strerror(xerrno));
-        errno = xerrno;
+    if (res < 0) {
+      if (errno != ENOSPC) {
         return -1;
       }
 
-      resp_var = snmp_smi_create_var(pkt->pool, mib->mib_oid, mib->mib_oidlen,
-        mib->smi_type, mib_int, mib_str, mib_strlen);
+      truncated = TRUE;
+      break;
     }
-
-    var_count = snmp_smi_util_add_list_var(&head_var, &tail_var, resp_var);
   }
 
-  /* Now, deal with the max_repetitions count.  Keep in mind the max_variables
-   * limits.
+  /* Now, deal with the max_repetitions count.  Per RFC 3416, the repetitions
+   * are interleaved: the first repetition of every repeater, then the
+   * second repetition of every repeater, and so on.  Each repeater thus
+   * tracks the MIB index and OID of its last value; once a repeater reaches
+   * the end of the MIB table, it continues into the counter history rows, and
+   * once it reaches the end of the MIB view, it keeps returning its exception
+   * for that OID.
    *
    * The iter_var variable should (after the above non_repeaters loop) be
    * pointing at the starting variable for us to process in the max_repetitions
    * loop.
    */
-  for (; iter_var; iter_var = iter_var->next) {
-    register unsigned int j;
-    struct snmp_mib *mib = NULL;
-    struct snmp_var *resp_var = NULL;
-    int mib_idx = -1, lacks_instance_id = FALSE;
-    int32_t mib_int = -1;
-    char *mib_str = NULL;
-    size_t mib_strlen = 0;
-
-    mib_idx = snmp_mib_get_idx(iter_var->name, iter_var->namelen,
-      &lacks_instance_id);
-    if (mib_idx < 0) {
-      int unknown_oid = FALSE;
-
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "%s %s of unknown OID %s (lacks instance ID = %s)",
-        snmp_msg_get_versionstr(pkt->snmp_version),
-        snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-        snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-          iter_var->namelen), lacks_instance_id ? "true" : "false");
-
-      if (lacks_instance_id) {
-        oid_t *oid;
-        unsigned int oidlen;
-
-        /* For GetBulkRequest-PDUs, a request for "A", without instance
-         * identifier, gets the response of "A.0", since "A" comes before
-         * "A.0".  (This does not hold true for GetRequest-PDUs.)
-         */
-
-        oidlen = iter_var->namelen + 1;
-        oid = pcalloc(pkt->pool, oidlen * sizeof(oid_t));
-        memmove(oid, iter_var->name, iter_var->namelen * sizeof(oid_t));
+  if (truncated == FALSE) {
+    struct snmp_var *rep_var;
 
-        mib_idx = snmp_mib_get_idx(oid, oidlen, NULL);
-        if (mib_idx < 0) {
-          lacks_instance_id = FALSE;
-          unknown_oid = TRUE;
+    for (rep_var = iter_var; rep_var; rep_var = rep_var->next) {
+      nrepeaters++;
+    }
 
-        } else {
-          mib_idx--;
-        }
+    if (nrepeaters > 0) {
+      rep_idxs = pcalloc(pkt->pool, nrepeaters * sizeof(int));
+      rep_names = pcalloc(pkt->pool, nrepeaters * sizeof(oid_t *));
+      rep_namelens = pcalloc(pkt->pool, nrepeaters * sizeof(unsigned int));
+      rep_types = pcalloc(pkt->pool, nrepeaters * sizeof(unsigned char));
+      rep_in_history = pcalloc(pkt->pool, nrepeaters * sizeof(int));
+    }
 
-      } else {
-        /* Try to find the "nearest" OID. */
-        mib_idx = snmp_mib_get_nearest_idx(iter_var->name, iter_var->namelen);
-        if (mib_idx < 0) {
-          unknown_oid = TRUE;
+    for (i = 0; i < nrepeaters; i++, iter_var = iter_var->next) {
+      int lacks_instance_id = FALSE;
 
-        } else {
-          mib_idx--;
-        }
-      }
+      pr_signals_handle();
 
-      if (unknown_oid) {
-        resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
-          iter_var->namelen, lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
-            SNMP_SMI_NO_SUCH_OBJECT);
-      }
-    }
+      rep_names[i] = iter_var->name;
+      rep_namelens[i] = iter_var->namelen;
+      rep_idxs[i] = snmp_agent_get_bulk_idx(pkt, iter_var,
+        &lacks_instance_id);
 
-    if (resp_var == NULL) {
       pr_trace_msg(trace_channel, 19,
         "%s %s for OID %s at MIB index %d (max index %d)",
         snmp_msg_get_versionstr(pkt->snmp_version),
         snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
         snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-          iter_var->namelen), mib_idx, max_idx);
+          iter_var->namelen), rep_idxs[i], max_idx);
 
-      if (mib_idx >= max_idx) {
-        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "%s %s of last OID %s",
-          snmp_msg_get_versionstr(pkt->snmp_version),
-          snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-          snmp_asn1_get_oidstr(pkt->req_pdu->pool, iter_var->name,
-            iter_var->namelen));
+      if (rep_idxs[i] < 0) {
+        oid_t *hist_name = NULL;
+        unsigned int hist_namelen = 0;
 
-        resp_var = snmp_smi_create_exception(pkt->pool, iter_var->name,
-          iter_var->namelen, SNMP_SMI_END_OF_MIB_VIEW);
+        if (snmp_agent_get_next_history(pkt, iter_var->name,
+            iter_var->namelen, &hist_name, &hist_namelen, &hist_type,
+            &hist_value) == 0) {
+          /* This repeater starts in the counter history rows. */
+          rep_in_history[i] = TRUE;
+
+        } else {
+          /* Note that this repeater is done, and that its (only) response
+           * is the exception.
+           */
+          rep_types[i] = lacks_instance_id ? SNMP_SMI_NO_SUCH_INSTANCE :
+            SNMP_SMI_NO_SUCH_OBJECT;
+        }
       }
+    }
+  }
 
-      if (resp_var == NULL) {
-        struct snmp_mib *prev_mib = NULL;
+  max_repetitions = pkt->req_pdu->max_repetitions;
+  if (max_repetitions < 0) {
+    max_repetitions = 0;
+  }
 
-        for (j = 1; j <= pkt->req_pdu->max_repetitions; j++) {
-          int next_idx;
+  while (truncated == FALSE &&
+         nrepeaters > 0 &&
+         max_repetitions-- > 0) {
+    int in_view = FALSE;
 
-          pr_signals_handle();
+    for (i = 0; i < nrepeaters; i++) {
+      pr_signals_handle();
 
-          /* Get the next MIB in the list. */
-          next_idx = mib_idx + j;
-          if (next_idx < max_idx) {
-            mib = snmp_mib_get_by_idx(next_idx);
-            while (mib != NULL &&
-                   (mib->mib_enabled == FALSE ||
-                    mib->notify_only == TRUE)) {
-              pr_signals_handle();
+      if (rep_types[i] == 0) {
+        int next_idx = -1;
 
-              if (next_idx > max_idx) {
-                break;
-              }
+        if (rep_in_history[i] == FALSE) {
+          next_idx = snmp_agent_get_next_idx(pkt, rep_idxs[i], max_idx);
+        }
 
-              mib = snmp_mib_get_by_idx(++next_idx);
-            }
-          }
+        if (next_idx >= 0) {
+          struct snmp_mib *mib;
 
           mib = snmp_mib_get_by_idx(next_idx);
-          if (mib != NULL) {
-            (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-              "%s %s of OID %s (%s)",
-              snmp_msg_get_versionstr(pkt->snmp_version),
-              snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
-              snmp_asn1_get_oidstr(iter_var->pool, mib->mib_oid,
-                mib->mib_oidlen), mib->mib_name);
-
-            res = snmp_db_get_value(pkt->pool, mib->db_field, &mib_int,
-              &mib_str, &mib_strlen);
-
-            /* XXX Response with genErr instead? */
-            if (res < 0) {
-              int xerrno = errno;
-
-              (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-                "error retrieving database value for field %s: %s",
-                snmp_db_get_fieldstr(pkt->pool, mib->db_field),
-                strerror(xerrno));
-              errno = xerrno;
-              return -1;
-            }
-
-            resp_var = snmp_smi_create_var(pkt->pool, mib->mib_oid,
-              mib->mib_oidlen, mib->smi_type, mib_int, mib_str, mib_strlen);
-            prev_mib = mib;
-
-          } else {
-            oid_t *end_oid;
-            unsigned int end_oidlen;
-
-            /* We want to use the OID of the last MIB we processed, or the
-             * last OID in the request, whichever is present.
-             */
-            if (prev_mib != NULL) {
-              end_oid = prev_mib->mib_oid;
-              end_oidlen = prev_mib->mib_oidlen;
-
-            } else {
-              end_oid = iter_var->name;
-              end_oidlen = iter_var->namelen;
-            }
-
-            resp_var = snmp_smi_create_exception(pkt->pool, end_oid,
-              end_oidlen, SNMP_SMI_END_OF_MIB_VIEW);
-            var_count = snmp_smi_util_add_list_var(&head_var, &tail_var,
-              resp_var);
-            break;
-          }
+          rep_names[i] = mib->mib_oid;
+          rep_namelens[i] = mib->mib_oidlen;
+          rep_idxs[i] = next_idx;
+          in_view = TRUE;
+
+        } else if (snmp_agent_get_next_history(pkt, rep_names[i],
+            rep_namelens[i], &(rep_names[i]), &(rep_namelens[i]), &hist_type,
+            &hist_value) == 0) {
+          rep_in_history[i] = TRUE;
+          in_view = TRUE;
 
-          var_count = snmp_smi_util_add_list_var(&head_var, &tail_var,
-            resp_var);
+        } else {
+          /* We want to use the OID of the last MIB we processed, or the
+           * last OID in the request, whichever is present.
+           */
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "%s %s of last OID %s",
+            snmp_msg_get_versionstr(pkt->snmp_version),
+            snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type),
+            snmp_asn1_get_oidstr(pkt->req_pdu->pool, rep_names[i],
+              rep_namelens[i]));
+
+          rep_types[i] = SNMP_SMI_END_OF_MIB_VIEW;
+          rep_idxs[i] = -1;
         }
+      }
+
+      if (rep_types[i] == 0 &&
+          rep_in_history[i] == TRUE) {
+        res = snmp_agent_vars_add_oid(pkt, &vars, rep_names[i],
+          rep_namelens[i], hist_type, hist_value);
+
+      } else if (rep_types[i] == 0) {
+        res = snmp_agent_add_bulk_var(pkt, &vars, rep_idxs[i]);
 
       } else {
-        var_count = snmp_smi_util_add_list_var(&head_var, &tail_var, resp_var);
+        /* This repeater has left the MIB view; repeat its exception. */
+        res = snmp_agent_vars_add_exception(pkt, &vars, rep_names[i],
+          rep_namelens[i], rep_types[i]);
       }
 
-    } else {
-      var_count = snmp_smi_util_add_list_var(&head_var, &tail_var, resp_var);
+      if (res < 0) {
+        if (errno != ENOSPC) {
+          return -1;
+        }
+
+        truncated = TRUE;
+        break;
+      }
+    }
+
+    /* Once every repeater has left the MIB view, any further repetitions
+     * would only repeat the same exceptions; we can stop here.
+     */
+    if (in_view == FALSE) {
+      break;
     }
   }
 
-  pkt->resp_pdu->varlist = head_var;
-  pkt->resp_pdu->varlistlen = var_count;
+  if (truncated) {
+    pr_trace_msg(trace_channel, 12,
+      "%s %s response truncated to %u %s (%lu bytes, max %lu bytes)",
+      snmp_msg_get_versionstr(pkt->snmp_version),
+      snmp_pdu_get_request_type_desc(pkt->req_pdu->request_type), vars.count,
+      vars.count != 1 ? "variables" : "variable",
+      (unsigned long) (vars.buf - pkt->resp_data),
+      (unsigned long) pkt->resp_datalen);
+  }
 
+  snmp_agent_vars_finish(pkt, &vars);
   return 0;
 }
 
@@ -1319,96 +1734,292 @@ static int snmp_agent_handle_request(struct snmp_packet *pkt) {
   return res;
 }
 
-static int snmp_agent_handle_packet(int sockfd, pr_netaddr_t *agent_addr) {
-  int nbytes, res;
-  struct sockaddr_in from_sockaddr;
-  socklen_t from_sockaddrlen;
-  pr_netaddr_t from_addr;
-  struct snmp_packet *pkt = NULL;
-  
-  pkt = snmp_packet_create(snmp_pool);
+#ifdef PR_USE_OPENSSL
+/* Sends the SNMPv3 Report PDU for a message rejected by the USM (RFC 3412,
+ * Section 7.2).  The PDU and its variable are built on the stack, rather
+ * than allocated, as these are sent for every discovery request.
+ */
+static int snmp_agent_send_report(int sockfd, struct snmp_packet *pkt) {
+  struct snmp_pdu pdu;
+  struct snmp_var var;
+  unsigned long value;
+  int res;
 
-  from_sockaddrlen = sizeof(struct sockaddr_in);
-  nbytes = recvfrom(sockfd, pkt->req_data, pkt->req_datalen, 0,
-    (struct sockaddr *) &from_sockaddr, &from_sockaddrlen);
-  if (nbytes < 0) {
-    int xerrno = errno;
+  memset(&var, 0, sizeof(var));
+  res = snmp_usm_get_stat(pkt->usm.report_stat, &(var.name), &(var.namelen),
+    &value);
+  if (res < 0) {
+    return -1;
+  }
 
-    pr_trace_msg(trace_channel, 3,
-      "error receiving data from socket %d: %s", sockfd, strerror(xerrno));
+  var.smi_type = SNMP_SMI_COUNTER32;
+  var.value.integer = (long *) &value;
+  var.valuelen = sizeof(value);
 
-    destroy_pool(pkt->pool);
-    errno = xerrno;
+  memset(&pdu, 0, sizeof(pdu));
+  pdu.request_type = SNMP_PDU_REPORT;
+  pdu.request_id = (pkt->req_pdu != NULL ? pkt->req_pdu->request_id : 0);
+  pdu.varlist = &var;
+  pdu.varlistlen = 1;
+
+  pr_trace_msg(trace_channel, 9, "sending SNMPv3 Report for %s",
+    snmp_asn1_get_oidstr(pkt->pool, var.name, var.namelen));
+
+  res = snmp_msg_write(pkt->pool, &(pkt->resp_data), &(pkt->resp_datalen),
+    NULL, 0, SNMP_PROTOCOL_VERSION_3, &pdu, &(pkt->usm));
+  if (res < 0) {
     return -1;
   }
 
-  pkt->req_datalen = nbytes;
-
-  /* XXX Support UDP/IPv6 in the future */
+  return snmp_packet_write(snmp_pool, sockfd, pkt);
+}
+#endif /* PR_USE_OPENSSL */
 
-  pr_netaddr_clear(&from_addr);
-  pr_netaddr_set_family(&from_addr, AF_INET);
-  pr_netaddr_set_sockaddr(&from_addr, (struct sockaddr *) &from_sockaddr);
+/* Checks a request from a network client against the Class and <Limit SNMP>
+ * rules.  Unix socket clients have no address to match; their peer
+ * credentials were checked when their connection was accepted.
+ */
+static int snmp_agent_check_addr(struct snmp_packet *pkt,
+    pr_netaddr_t *agent_addr, const char *transport) {
+  int allowed = -1, res;
 
-  pkt->remote_addr = &from_addr;
+  /* The Class and <Limit SNMP> decision depend only on the address; most
+   * packets come from a few managers, whose decisions will be cached.
+   */
+  if (snmp_acl_cache_get(pkt->remote_addr, &allowed,
+      &(pkt->remote_class)) == 0) {
+    res = snmp_db_incr_value(pkt->pool, SNMP_DB_SNMP_F_ACL_CACHE_HITS_TOTAL,
+      1);
+    if (res < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error incrementing snmp.aclCacheHitsTotal: %s", strerror(errno));
+    }
 
-  pr_trace_msg(trace_channel, 3,
-    "read %d UDP bytes from %s#%u", nbytes,
-    pr_netaddr_get_ipstr(pkt->remote_addr),
-    ntohs(pr_netaddr_get_port(pkt->remote_addr))); 
+  } else {
+    res = snmp_db_incr_value(pkt->pool,
+      SNMP_DB_SNMP_F_ACL_CACHE_MISSES_TOTAL, 1);
+    if (res < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error incrementing snmp.aclCacheMissesTotal: %s", strerror(errno));
+    }
 
-  res = snmp_db_incr_value(pkt->pool, SNMP_DB_SNMP_F_PKTS_RECVD_TOTAL, 1);
-  if (res < 0) {
-    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "error incrementing SNMP database for "
-      "snmp.packetsReceivedTotal: %s", strerror(errno));
+    pkt->remote_class = pr_class_match_addr(pkt->remote_addr);
   }
 
-  pkt->remote_class = pr_class_match_addr(&from_addr);
   if (pkt->remote_class != NULL) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "received %d UDP bytes from client in '%s' class", nbytes,
+      "received %lu %s bytes from client in '%s' class",
+      (unsigned long) pkt->req_datalen, transport,
       pkt->remote_class->cls_name);
 
   } else {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "received %d UDP bytes from client in unknown class", nbytes);
+      "received %lu %s bytes from client in unknown class",
+      (unsigned long) pkt->req_datalen, transport);
   }
 
   /* Check for malicious packets, which forge the from address/port to be
    * the same as our listening address/port, trying to induce us to talk
-   * to ourselves.
+   * to ourselves.  (TCP connections cannot be forged this way.)
    */
-  if (pr_netaddr_cmp(&from_addr, agent_addr) == 0) {
+  if (pkt->transport == SNMP_PACKET_TRANSPORT_UDP &&
+      pr_netaddr_cmp(pkt->remote_addr, agent_addr) == 0) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
       "rejecting forged UDP packet from %s#%u (appears to be from "
       "SNMPAgent %s#%u)",
-      pr_netaddr_get_ipstr(&from_addr), ntohs(pr_netaddr_get_port(&from_addr)),
+      pr_netaddr_get_ipstr(pkt->remote_addr),
+      ntohs(pr_netaddr_get_port(pkt->remote_addr)),
       pr_netaddr_get_ipstr(agent_addr), ntohs(pr_netaddr_get_port(agent_addr)));
 
-    destroy_pool(pkt->pool);
     errno = EACCES;
     return -1;
   }
 
   /* Note: mod_ifsession does NOT affect mod_snmp ACLs; use <Limit SNMP> */
 
-  if (snmp_limits_allow(main_server->conf, pkt) == FALSE) {
+  if (allowed < 0) {
+    allowed = snmp_limits_allow(main_server->conf, pkt);
+    (void) snmp_acl_cache_add(pkt->remote_addr, allowed, pkt->remote_class);
+  }
+
+  if (allowed == FALSE) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "UDP packet from %s#%u denied by <Limit SNMP> rules",
-      pr_netaddr_get_ipstr(&from_addr), ntohs(pr_netaddr_get_port(&from_addr)));
+      "%s packet from %s#%u denied by <Limit SNMP> rules", transport,
+      pr_netaddr_get_ipstr(pkt->remote_addr),
+      ntohs(pr_netaddr_get_port(pkt->remote_addr)));
 
-    destroy_pool(pkt->pool);
     errno = EACCES;
     return -1;
   }
 
-  res = snmp_msg_read(pkt->pool, &(pkt->req_data), &(pkt->req_datalen),
-    &(pkt->community), &(pkt->community_len), &(pkt->snmp_version),
-    &(pkt->req_pdu));
+  return 0;
+}
+
+/* Returns TRUE if the request has waited past the SNMPRequestDeadline. */
+static int snmp_agent_is_stale(struct snmp_packet *pkt) {
+  struct timeval now_tv;
+  long age_ms;
+
+  if (snmp_request_deadline == 0 ||
+      pkt->recv_tv.tv_sec == 0) {
+    return FALSE;
+  }
+
+  gettimeofday(&now_tv, NULL);
+  age_ms = ((now_tv.tv_sec - pkt->recv_tv.tv_sec) * 1000L) +
+    ((now_tv.tv_usec - pkt->recv_tv.tv_usec) / 1000L);
+
+  if (age_ms <= (long) snmp_request_deadline) {
+    return FALSE;
+  }
+
+  pr_trace_msg(trace_channel, 5,
+    "dropping request from %s#%u received %ld ms ago (SNMPRequestDeadline "
+    "%u ms)", pr_netaddr_get_ipstr(pkt->remote_addr),
+    ntohs(pr_netaddr_get_port(pkt->remote_addr)), age_ms,
+    snmp_request_deadline);
+  return TRUE;
+}
+
+/* Answers a retransmitted UDP request with the response already sent for
+ * the original request, if still cached.  Returns -1, with errno set to
+ * ENOENT, if the request is not a known retransmission.
+ */
+static int snmp_agent_replay_packet(int sockfd, struct snmp_packet *pkt) {
+  const unsigned char *resp_data;
+  size_t resp_datalen;
+
+  if (snmp_replay_get(pkt->remote_addr, pkt->req_data, pkt->req_datalen,
+      &resp_data, &resp_datalen) < 0) {
+    return -1;
+  }
+
+  if (resp_datalen > pkt->resp_datalen) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "replaying %lu-byte response for retransmitted request from %s#%u",
+    (unsigned long) resp_datalen, pr_netaddr_get_ipstr(pkt->remote_addr),
+    ntohs(pr_netaddr_get_port(pkt->remote_addr)));
+
+  memcpy(pkt->resp_data, resp_data, resp_datalen);
+  pkt->resp_datalen = resp_datalen;
+
+  if (snmp_db_incr_value(pkt->pool, SNMP_DB_SNMP_F_PKTS_REPLAYED_TOTAL,
+      1) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error incrementing snmp.packetsReplayedTotal: %s", strerror(errno));
+  }
+
+  (void) snmp_packet_write(snmp_pool, sockfd, pkt);
+  return 0;
+}
+
+/* Handles a single request message, received on either transport, and sends
+ * the response.  The packet is destroyed here.
+ */
+static int snmp_agent_process_packet(int sockfd, struct snmp_packet *pkt,
+    pr_netaddr_t *agent_addr) {
+  const char *transport;
+  unsigned char *req_data = NULL;
+  size_t req_datalen = 0;
+  int is_stream, res, xerrno;
+
+  switch (pkt->transport) {
+    case SNMP_PACKET_TRANSPORT_TCP:
+      transport = "TCP";
+      break;
+
+    case SNMP_PACKET_TRANSPORT_UNIX:
+      transport = "Unix socket";
+      break;
+
+    default:
+      transport = "UDP";
+      break;
+  }
+
+  res = snmp_db_incr_value(pkt->pool, SNMP_DB_SNMP_F_PKTS_RECVD_TOTAL, 1);
+  if (res < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error incrementing SNMP database for "
+      "snmp.packetsReceivedTotal: %s", strerror(errno));
+  }
+
+  if (snmp_agent_is_stale(pkt) == TRUE) {
+    (void) snmp_packet_incr_dropped(pkt->pool,
+      SNMP_DB_SNMP_F_PKTS_DROPPED_STALE_TOTAL);
+    destroy_pool(pkt->pool);
+    return 0;
+  }
+
+  /* A manager flooding us with requests only has its own requests dropped;
+   * this is checked before any decoding, to keep the cost of doing so low.
+   */
+  if (pkt->remote_addr != NULL &&
+      snmp_bucket_take(pkt->remote_addr) == FALSE) {
+    pr_trace_msg(trace_channel, 5,
+      "dropping %s packet from %s#%u: SNMPRateLimit exceeded", transport,
+      pr_netaddr_get_ipstr(pkt->remote_addr),
+      ntohs(pr_netaddr_get_port(pkt->remote_addr)));
+
+    (void) snmp_packet_incr_dropped(pkt->pool,
+      SNMP_DB_SNMP_F_PKTS_DROPPED_RATE_LIMIT_TOTAL);
+    destroy_pool(pkt->pool);
+    return 0;
+  }
+
+  if (pkt->transport == SNMP_PACKET_TRANSPORT_UNIX) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "received %lu %s bytes from %s", (unsigned long) pkt->req_datalen,
+      transport, pkt->remote_name);
+
+  } else if (snmp_agent_check_addr(pkt, agent_addr, transport) < 0) {
+    xerrno = errno;
+
+    destroy_pool(pkt->pool);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (pkt->transport == SNMP_PACKET_TRANSPORT_UDP) {
+    if (snmp_agent_replay_packet(sockfd, pkt) == 0) {
+      destroy_pool(pkt->pool);
+      return 0;
+    }
+
+    /* Decoding the message modifies it (e.g. decrypting SNMPv3 messages in
+     * place), so keep a copy of the request as received, for caching the
+     * response.
+     */
+    req_datalen = pkt->req_datalen;
+    req_data = palloc(pkt->pool, req_datalen);
+    memcpy(req_data, pkt->req_data, req_datalen);
+  }
+
+  res = snmp_msg_read(pkt->pool, &(pkt->req_data), &(pkt->req_datalen),
+    &(pkt->community), &(pkt->community_len), &(pkt->snmp_version),
+    &(pkt->req_pdu), &(pkt->usm));
   if (res < 0) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "error reading SNMP message from UDP packet: %s", strerror(errno));
+      "error reading SNMP message from %s packet: %s", transport,
+      strerror(errno));
+
+#ifdef PR_USE_OPENSSL
+    /* Tell SNMPv3 clients why, e.g. so that they can discover our engine
+     * ID, if they asked.
+     */
+    if (pkt->snmp_version == SNMP_PROTOCOL_VERSION_3 &&
+        pkt->usm.report_stat != 0 &&
+        (pkt->usm.msg_flags & SNMP_USM_FL_REPORTABLE)) {
+      if (snmp_agent_send_report(sockfd, pkt) < 0) {
+        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+          "error sending SNMPv3 Report: %s", strerror(errno));
+      }
+    }
+#endif /* PR_USE_OPENSSL */
 
     destroy_pool(pkt->pool);
     errno = EINVAL;
@@ -1427,6 +2038,12 @@ static int snmp_agent_handle_packet(int sockfd, pr_netaddr_t *agent_addr) {
     return -1;
   }
 
+  /* Never send SNMPv3 clients more than they say they can accept. */
+  if (pkt->snmp_version == SNMP_PROTOCOL_VERSION_3 &&
+      (size_t) pkt->usm.msg_max_size < pkt->resp_datalen) {
+    pkt->resp_datalen = pkt->usm.msg_max_size;
+  }
+
   (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
     "read SNMP message for %s, community = '%s', request ID %ld, "
     "request type '%s'", snmp_msg_get_versionstr(pkt->snmp_version),
@@ -1455,204 +2072,702 @@ static int snmp_agent_handle_packet(int sockfd, pr_netaddr_t *agent_addr) {
     snmp_pdu_get_request_type_desc(pkt->resp_pdu->request_type));
 
   res = snmp_msg_write(pkt->pool, &(pkt->resp_data), &(pkt->resp_datalen),
-    pkt->community, pkt->community_len, pkt->snmp_version, pkt->resp_pdu);
+    pkt->community, pkt->community_len, pkt->snmp_version, pkt->resp_pdu,
+    &(pkt->usm));
   if (res < 0) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "error writing SNMP message to UDP packet: %s", strerror(errno));
+      "error writing SNMP message to %s packet: %s", transport,
+      strerror(errno));
 
     destroy_pool(pkt->pool);
     errno = EINVAL;
     return -1;
   }
 
-  snmp_packet_write(snmp_pool, sockfd, pkt);
+  if (req_data != NULL) {
+    (void) snmp_replay_add(pkt->remote_addr, req_data, req_datalen,
+      pkt->resp_data, pkt->resp_datalen);
+  }
+
+  res = snmp_packet_write(snmp_pool, sockfd, pkt);
+  xerrno = errno;
+  is_stream = (pkt->transport != SNMP_PACKET_TRANSPORT_UDP);
 
   destroy_pool(pkt->pool);
+
+  /* A failed write on a connection means the connection is unusable. */
+  if (res < 0 &&
+      is_stream) {
+    errno = xerrno;
+    return -1;
+  }
+
   return 0;
 }
 
-static int snmp_agent_listen(pr_netaddr_t *agent_addr) {
-  int res, sockfd;
 
-  /* XXX Support IPv6? */
+/* Notes the kernel's count of datagrams dropped because the UDP receive
+ * queue was full, as reported with a received datagram.
+ */
+static void snmp_agent_set_rxq_drops(pool *p, uint32_t drops) {
+  uint32_t incr;
 
-  sockfd = socket(AF_INET, SOCK_DGRAM, snmp_proto_udp);
-  if (sockfd < 0) {
-    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "unable to create UDP socket: %s", strerror(errno));
-    exit(1);
+  if (drops == snmp_agent_rxq_drops) {
+    return;
   }
 
-  res = bind(sockfd, pr_netaddr_get_sockaddr(agent_addr),
-    pr_netaddr_get_sockaddr_len(agent_addr));
-  if (res < 0) {
+  incr = drops - snmp_agent_rxq_drops;
+  snmp_agent_rxq_drops = drops;
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "UDP receive queue full, %lu %s dropped by the kernel",
+    (unsigned long) incr, incr != 1 ? "requests" : "request");
+
+  if (snmp_db_incr_value(p, SNMP_DB_SNMP_F_RXQ_DROPPED_TOTAL,
+      (int32_t) incr) < 0) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "unable to bind UDP socket to %s#%u: %s",
-      pr_netaddr_get_ipstr(agent_addr),
-      ntohs(pr_netaddr_get_port(agent_addr)), strerror(errno));
-    exit(1);
+      "error incrementing snmp.receiveQueueDroppedTotal: %s",
+      strerror(errno));
   }
-
-  return 0;
 }
 
-static void snmp_agent_loop(int sockfd, pr_netaddr_t *agent_addr) {
-  fd_set listenfds;
-  struct timeval tv;
-  int res;
-
-  while (TRUE) {
-    /* XXX Is it necessary to even have a timeout?  We could simply block
-     * in select(2) indefinitely, until either an event arrives or we are
-     * interrupted by a signal.
-     *
-     * Yes, we DO need a timeout here, specifically to poll the trap table
-     * for any trap-generating state.  Rather than using a timer and using
-     * SIGALRM handling, we can reuse this event loop.
-     */
-    tv.tv_sec = 60;
-    tv.tv_usec = 0L;
+/* Handles the ancillary data received with a datagram: its receive
+ * timestamp, and the kernel's drop count.
+ */
+static void snmp_agent_read_cmsgs(struct msghdr *msg,
+    struct snmp_packet *pkt) {
+  struct cmsghdr *cmsg;
 
-    /* To implement notification criteria/thresholds, we poll for the
-     * necessary conditions here.
-     */
-    snmp_notify_poll_cond();
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET) {
+      continue;
+    }
 
-    FD_ZERO(&listenfds);
-    FD_SET(sockfd, &listenfds);
+#if defined(SO_TIMESTAMPNS)
+    if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      struct timespec ts;
 
-    res = select(sockfd + 1, &listenfds, NULL, NULL, &tv);
-    if (res == 0) {
-      /* Select timeout reached.  Just try again. */
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      pkt->recv_tv.tv_sec = ts.tv_sec;
+      pkt->recv_tv.tv_usec = ts.tv_nsec / 1000;
+      continue;
+    }
+#elif defined(SO_TIMESTAMP)
+    if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+      memcpy(&(pkt->recv_tv), CMSG_DATA(cmsg), sizeof(struct timeval));
       continue;
     }
+#endif
 
-    if (res < 0) {
-      if (errno == EINTR) {
-        pr_signals_handle();
-        continue;
-      }
+#if defined(SO_RXQ_OVFL)
+    if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+      uint32_t drops;
 
-    } else {
-      if (FD_ISSET(sockfd, &listenfds)) {
-        res = snmp_agent_handle_packet(sockfd, agent_addr);
-        if (res < 0) {
-          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-            "error handling SNMP packet: %s", strerror(errno));
-        } 
-      }
+      memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+      snmp_agent_set_rxq_drops(pkt->pool, drops);
     }
+#endif
   }
 }
 
-static pid_t snmp_agent_start(const char *tables_dir, int agent_type,
-    pr_netaddr_t *agent_addr) {
-  int agent_fd;
-  pid_t agent_pid;
-  char *agent_chroot = NULL;
+/* Reads a single UDP request from the socket.  Returns NULL, with errno set
+ * to EAGAIN, if no more requests are waiting, or to EMSGSIZE, if the request
+ * was too large, and so was dropped.
+ */
+static struct snmp_packet *snmp_agent_read_packet(int sockfd, int flags) {
+  int nbytes;
+  struct sockaddr_in from_sockaddr;
+  struct msghdr msg;
+  struct iovec iov;
+  union {
+    struct cmsghdr align;
+    unsigned char buf[CMSG_SPACE(sizeof(struct timespec)) +
+      CMSG_SPACE(sizeof(uint32_t))];
+  } ctrl;
+  struct snmp_packet *pkt = NULL;
 
-  agent_pid = fork();
-  switch (agent_pid) {
-    case -1:
-      pr_log_pri(PR_LOG_ERR, MOD_SNMP_VERSION ": unable to fork: %s",
-        strerror(errno));
-      return 0;
+  pkt = snmp_packet_create(snmp_pool);
 
-    case 0:
-      /* We're the child. */
-      break;
+  iov.iov_base = pkt->req_data;
+  iov.iov_len = pkt->req_datalen;
 
-    default:
-      /* We're the parent. */
-      return agent_pid;
-  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &from_sockaddr;
+  msg.msg_namelen = sizeof(struct sockaddr_in);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl.buf;
+  msg.msg_controllen = sizeof(ctrl.buf);
 
-  /* Reset the cached PID, so that it is correctly reflected in the logs. */
-  session.pid = getpid();
+  nbytes = recvmsg(sockfd, &msg, flags);
+  if (nbytes < 0) {
+    int xerrno = errno;
 
-  pr_trace_msg("snmp", 3, "forked SNMP agent PID %lu",
-    (unsigned long) session.pid);
+    if (xerrno != EAGAIN &&
+        xerrno != EWOULDBLOCK) {
+      pr_trace_msg(trace_channel, 3,
+        "error receiving data from socket %d: %s", sockfd, strerror(xerrno));
 
-  snmp_daemonize(tables_dir);
+    } else {
+      xerrno = EAGAIN;
+    }
 
-  /* Install our own signal handlers (mostly to ignore signals) */
-  (void) signal(SIGALRM, SIG_IGN);
-  (void) signal(SIGHUP, SIG_IGN);
-  (void) signal(SIGUSR1, SIG_IGN);
-  (void) signal(SIGUSR2, SIG_IGN);
+    destroy_pool(pkt->pool);
+    errno = xerrno;
+    return NULL;
+  }
 
-  /* Remove our event listeners. */
-  pr_event_unregister(&snmp_module, NULL, NULL);
+  pkt->req_datalen = nbytes;
 
-  /* XXX Check the agent_type variable, to see if we are a master agent or
-   * an AgentX sub-agent.
-   */
+  snmp_agent_read_cmsgs(&msg, pkt);
+  if (pkt->recv_tv.tv_sec == 0) {
+    /* No kernel timestamp; the time of reading will have to do. */
+    gettimeofday(&(pkt->recv_tv), NULL);
+  }
+
+  /* XXX Support UDP/IPv6 in the future */
+
+  pkt->remote_addr = pr_netaddr_alloc(pkt->pool);
+  pr_netaddr_set_family(pkt->remote_addr, AF_INET);
+  pr_netaddr_set_sockaddr(pkt->remote_addr,
+    (struct sockaddr *) &from_sockaddr);
 
-  agent_fd = snmp_agent_listen(agent_addr);
-  if (agent_fd < 0) {
+  if (msg.msg_flags & MSG_TRUNC) {
+    /* The datagram did not fit in the buffer; rather than failing to decode
+     * what was read of it, say why it is dropped.
+     */
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "unable to create listening socket for SNMP agent process: %s",
-      strerror(errno));
-    exit(0);
-  }
+      "dropping UDP packet from %s#%u: larger than SNMPMaxMessageSize "
+      "(%lu bytes)", pr_netaddr_get_ipstr(pkt->remote_addr),
+      ntohs(pr_netaddr_get_port(pkt->remote_addr)),
+      (unsigned long) snmp_packet_get_max_len());
 
-  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-    "SNMP agent process listening on UDP %s#%u",
-    pr_netaddr_get_ipstr(agent_addr), ntohs(pr_netaddr_get_port(agent_addr)));
+    (void) snmp_packet_incr_dropped(pkt->pool,
+      SNMP_DB_SNMP_F_PKTS_DROPPED_TOO_BIG_TOTAL);
 
-  PRIVS_ROOT
+    destroy_pool(pkt->pool);
+    errno = EMSGSIZE;
+    return NULL;
+  }
 
-  if (getuid() == PR_ROOT_UID) {
-    int res;
+  pr_trace_msg(trace_channel, 3,
+    "read %d UDP bytes from %s#%u", nbytes,
+    pr_netaddr_get_ipstr(pkt->remote_addr),
+    ntohs(pr_netaddr_get_port(pkt->remote_addr)));
 
-    /* Chroot to the SNMPTables/empty/ directory before dropping root privs. */
+  return pkt;
+}
 
-    agent_chroot = pdircat(snmp_pool, tables_dir, "empty", NULL);
-    res = chroot(agent_chroot);
-    if (res < 0) {
-      int xerrno = errno;
+/* Samples the number of bytes waiting in the UDP socket's receive queue,
+ * at most once a second.
+ */
+static void snmp_agent_sample_rxq(int sockfd) {
+  time_t now;
+  int32_t queued = -1;
 
-      PRIVS_RELINQUISH
- 
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "unable to chroot to SNMPTables/empty/ directory '%s': %s",
-        agent_chroot, strerror(xerrno));
-      exit(0);
-    }
+  now = time(NULL);
+  if (now == snmp_agent_rxq_sampled) {
+    return;
+  }
 
-    if (chdir("/") < 0) {
-      int xerrno = errno;
+  snmp_agent_rxq_sampled = now;
 
-      PRIVS_RELINQUISH
+#if defined(SO_MEMINFO)
+  {
+    /* The first of the socket memory counters (SK_MEMINFO_RMEM_ALLOC) is
+     * the memory used by the receive queue.  On Linux, FIONREAD only gives
+     * the size of the next datagram.
+     */
+    uint32_t meminfo[16];
+    socklen_t meminfolen = sizeof(meminfo);
 
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "unable to chdir to root directory within chroot: %s",
-        strerror(xerrno));
-      exit(0);
+    if (getsockopt(sockfd, SOL_SOCKET, SO_MEMINFO, meminfo,
+        &meminfolen) == 0 &&
+        meminfolen >= sizeof(uint32_t)) {
+      queued = (int32_t) meminfo[0];
     }
   }
+#else
+  {
+    int len = 0;
 
-  pr_proctitle_set("(listening for SNMP packets)");
-
-  /* Make the SNMP process have the identity of the configured daemon
-   * User/Group.
-   */
-  session.uid = geteuid();
-  session.gid = getegid();
-  PRIVS_REVOKE
+    if (ioctl(sockfd, FIONREAD, &len) == 0) {
+      queued = len;
+    }
+  }
+#endif
 
-  if (agent_chroot != NULL) {
-    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "SNMP agent process running with UID %lu, GID %lu, restricted to '%s'",
-      (unsigned long) getuid(), (unsigned long) getgid(), agent_chroot);
+  if (queued < 0) {
+    pr_trace_msg(trace_channel, 9,
+      "unable to get UDP receive queue length: %s", strerror(errno));
+    return;
+  }
 
-  } else {
+  if (snmp_db_set_value(snmp_pool, SNMP_DB_SNMP_F_RXQ_BYTES, queued) < 0) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-      "SNMP agent process running with UID %lu, GID %lu, located in '%s'",
-      (unsigned long) getuid(), (unsigned long) getgid(), getcwd(NULL, 0));
+      "error setting snmp.receiveQueueBytes: %s", strerror(errno));
   }
+}
 
-  snmp_agent_loop(agent_fd, agent_addr);
+/* Reads the waiting UDP requests, up to SNMP_AGENT_BATCH_SIZE of them, and
+ * handles them round-robin across their source addresses: one request from
+ * each source, then the next request from each, and so on.  Thus a manager
+ * with many requests queued up does not delay the requests from the others
+ * until all of its own have been handled.
+ */
+static int snmp_agent_handle_packet(int sockfd, pr_netaddr_t *agent_addr) {
+  struct snmp_packet *pkts[SNMP_AGENT_BATCH_SIZE];
+  unsigned int srcs[SNMP_AGENT_BATCH_SIZE], passes[SNMP_AGENT_BATCH_SIZE];
+  register unsigned int i;
+  unsigned int npkts = 0, nhandled = 0, pass = 0;
+
+  /* The socket is readable, so the first read will not block. */
+  pkts[0] = snmp_agent_read_packet(sockfd, 0);
+  if (pkts[0] == NULL) {
+    if (errno == EMSGSIZE) {
+      /* Already logged, and counted, as dropped. */
+      return 0;
+    }
+
+    return -1;
+  }
+  npkts++;
+
+  while (npkts < SNMP_AGENT_BATCH_SIZE) {
+    pkts[npkts] = snmp_agent_read_packet(sockfd, MSG_DONTWAIT);
+    if (pkts[npkts] == NULL) {
+      if (errno == EMSGSIZE) {
+        continue;
+      }
+
+      break;
+    }
+    npkts++;
+  }
+
+  if (npkts > 1) {
+    pr_trace_msg(trace_channel, 9, "read batch of %u UDP requests", npkts);
+  }
+
+  /* Identify each request's source by the first request from that source;
+   * the packets (and their addresses) are destroyed as they are handled.
+   */
+  for (i = 0; i < npkts; i++) {
+    register unsigned int j;
+
+    srcs[i] = i;
+    passes[i] = 0;
+
+    for (j = 0; j < i; j++) {
+      if (pr_netaddr_cmp(pkts[j]->remote_addr, pkts[i]->remote_addr) == 0) {
+        srcs[i] = srcs[j];
+        break;
+      }
+    }
+  }
+
+  while (nhandled < npkts) {
+    pass++;
+
+    /* Each pass handles the earliest pending request of each source. */
+    for (i = 0; i < npkts; i++) {
+      int res;
+
+      if (pkts[i] == NULL ||
+          passes[srcs[i]] == pass) {
+        continue;
+      }
+
+      passes[srcs[i]] = pass;
+
+      res = snmp_agent_process_packet(sockfd, pkts[i], agent_addr);
+      if (res < 0) {
+        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+          "error handling SNMP packet: %s", strerror(errno));
+      }
+
+      pkts[i] = NULL;
+      nhandled++;
+    }
+  }
+
+  return 0;
+}
+
+/* Handles a request message read from an SNMP over TCP connection. */
+static int snmp_agent_handle_stream_msg(int sockfd, struct snmp_packet *pkt) {
+  return snmp_agent_process_packet(sockfd, pkt, NULL);
+}
+
+/* Asks the kernel to timestamp each datagram as it is received, for the
+ * SNMPRequestDeadline, and to report how many datagrams it has dropped
+ * because the receive queue was full.
+ */
+static void snmp_agent_set_sockopts(int sockfd) {
+  int on = 1;
+
+#if defined(SO_TIMESTAMPNS)
+  if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error setting SO_TIMESTAMPNS on UDP socket: %s", strerror(errno));
+  }
+#elif defined(SO_TIMESTAMP)
+  if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error setting SO_TIMESTAMP on UDP socket: %s", strerror(errno));
+  }
+#endif
+
+#if defined(SO_RXQ_OVFL)
+  if (setsockopt(sockfd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error setting SO_RXQ_OVFL on UDP socket: %s", strerror(errno));
+  }
+#endif
+}
+
+static int snmp_agent_listen(pr_netaddr_t *agent_addr) {
+  int res, sockfd;
+
+  /* XXX Support IPv6? */
+
+  sockfd = socket(AF_INET, SOCK_DGRAM, snmp_proto_udp);
+  if (sockfd < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to create UDP socket: %s", strerror(errno));
+    exit(1);
+  }
+
+  res = bind(sockfd, pr_netaddr_get_sockaddr(agent_addr),
+    pr_netaddr_get_sockaddr_len(agent_addr));
+  if (res < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to bind UDP socket to %s#%u: %s",
+      pr_netaddr_get_ipstr(agent_addr),
+      ntohs(pr_netaddr_get_port(agent_addr)), strerror(errno));
+    exit(1);
+  }
+
+  snmp_agent_set_sockopts(sockfd);
+  return sockfd;
+}
+
+static void snmp_agent_loop(int sockfd, pr_netaddr_t *agent_addr,
+    int stream_fd, int unix_fd, int metrics_fd) {
+  fd_set listenfds, writefds;
+  struct timeval tv;
+  time_t last_sync;
+  int maxfd, res;
+
+  last_sync = time(NULL);
+
+  while (TRUE) {
+    /* XXX Is it necessary to even have a timeout?  We could simply block
+     * in select(2) indefinitely, until either an event arrives or we are
+     * interrupted by a signal.
+     *
+     * Yes, we DO need a timeout here, specifically to poll the trap table
+     * for any trap-generating state.  Rather than using a timer and using
+     * SIGALRM handling, we can reuse this event loop.  The same goes for
+     * sampling the counters for the rate gauges, and for the history.
+     */
+    tv.tv_sec = SNMP_RATE_INTERVAL;
+    tv.tv_usec = 0L;
+
+    /* To implement notification criteria/thresholds, we poll for the
+     * necessary conditions here.
+     */
+    snmp_notify_poll_cond();
+
+    if (snmp_rate_poll(snmp_pool) < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error updating rate gauges: %s", strerror(errno));
+    }
+
+    if (snmp_history_poll(snmp_pool) < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error sampling counter history: %s", strerror(errno));
+    }
+
+    /* Correct the gauges for any sessions which died without doing so. */
+    if (snmp_gauge_reconcile(snmp_pool) < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error reconciling session gauges: %s", strerror(errno));
+    }
+
+    /* Checkpoint any persistent tables.  The kernel will eventually write
+     * the dirty pages back on its own; this bounds how much could be lost
+     * if the host itself goes down.
+     */
+    if (snmp_opts & SNMP_OPT_PERSISTENT_TABLES) {
+      time_t now;
+
+      now = time(NULL);
+      if (now - last_sync >= SNMP_DB_SYNC_INTERVAL ||
+          now < last_sync) {
+        if (snmp_db_sync(snmp_pool, MS_ASYNC) < 0) {
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "error checkpointing SNMPTables: %s", strerror(errno));
+        }
+
+        last_sync = now;
+      }
+    }
+
+    /* Close any idle TCP/Unix socket connections. */
+    snmp_stream_expire();
+
+    if (sockfd >= 0) {
+      snmp_agent_sample_rxq(sockfd);
+    }
+
+    FD_ZERO(&listenfds);
+    FD_ZERO(&writefds);
+    maxfd = -1;
+
+    if (sockfd >= 0) {
+      FD_SET(sockfd, &listenfds);
+      maxfd = sockfd;
+    }
+
+    if (stream_fd >= 0) {
+      FD_SET(stream_fd, &listenfds);
+      if (stream_fd > maxfd) {
+        maxfd = stream_fd;
+      }
+
+    }
+
+    if (unix_fd >= 0) {
+      FD_SET(unix_fd, &listenfds);
+      if (unix_fd > maxfd) {
+        maxfd = unix_fd;
+      }
+    }
+
+    maxfd = snmp_stream_set_fds(&listenfds, &writefds, maxfd);
+
+    if (metrics_fd >= 0) {
+      FD_SET(metrics_fd, &listenfds);
+      if (metrics_fd > maxfd) {
+        maxfd = metrics_fd;
+      }
+    }
+
+    res = select(maxfd + 1, &listenfds, &writefds, NULL, &tv);
+    if (res == 0) {
+      /* Select timeout reached.  Just try again. */
+      continue;
+    }
+
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+    } else {
+      if (sockfd >= 0 &&
+          FD_ISSET(sockfd, &listenfds)) {
+        res = snmp_agent_handle_packet(sockfd, agent_addr);
+        if (res < 0) {
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "error handling SNMP packet: %s", strerror(errno));
+        } 
+      }
+
+      /* Service the existing connections before accepting any new ones,
+       * so that the new connections are not in the fd_sets.
+       */
+      (void) snmp_stream_handle(snmp_pool, &listenfds, &writefds,
+        snmp_agent_handle_stream_msg);
+
+      if (stream_fd >= 0 &&
+          FD_ISSET(stream_fd, &listenfds)) {
+        res = snmp_stream_accept(snmp_pool, stream_fd);
+        if (res < 0) {
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "error accepting TCP connection: %s", strerror(errno));
+        }
+      }
+
+      if (unix_fd >= 0 &&
+          FD_ISSET(unix_fd, &listenfds)) {
+        res = snmp_stream_accept(snmp_pool, unix_fd);
+        if (res < 0) {
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "error accepting Unix socket connection: %s", strerror(errno));
+        }
+      }
+
+      if (metrics_fd >= 0 &&
+          FD_ISSET(metrics_fd, &listenfds)) {
+        res = snmp_metrics_handle(snmp_pool, metrics_fd);
+        if (res < 0) {
+          (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+            "error handling metrics request: %s", strerror(errno));
+        }
+      }
+    }
+  }
+}
+
+static pid_t snmp_agent_start(const char *tables_dir, int agent_type,
+    pr_netaddr_t *agent_addr, int agent_transports,
+    pr_netaddr_t *metrics_addr) {
+  int agent_fd = -1, stream_fd = -1, unix_fd = -1, metrics_fd = -1;
+  pid_t agent_pid;
+  char *agent_chroot = NULL;
+
+  agent_pid = fork();
+  switch (agent_pid) {
+    case -1:
+      pr_log_pri(PR_LOG_ERR, MOD_SNMP_VERSION ": unable to fork: %s",
+        strerror(errno));
+      return 0;
+
+    case 0:
+      /* We're the child. */
+      break;
+
+    default:
+      /* We're the parent. */
+      return agent_pid;
+  }
+
+  /* Reset the cached PID, so that it is correctly reflected in the logs. */
+  session.pid = getpid();
+
+  pr_trace_msg("snmp", 3, "forked SNMP agent PID %lu",
+    (unsigned long) session.pid);
+
+  snmp_daemonize(tables_dir);
+
+  /* Install our own signal handlers (mostly to ignore signals) */
+  (void) signal(SIGALRM, SIG_IGN);
+  (void) signal(SIGHUP, SIG_IGN);
+  (void) signal(SIGUSR1, SIG_IGN);
+  (void) signal(SIGUSR2, SIG_IGN);
+
+  /* Remove our event listeners. */
+  pr_event_unregister(&snmp_module, NULL, NULL);
+
+  /* XXX Check the agent_type variable, to see if we are a master agent or
+   * an AgentX sub-agent.
+   */
+
+  if (agent_transports & SNMP_AGENT_TRANSPORT_UDP) {
+    agent_fd = snmp_agent_listen(agent_addr);
+    if (agent_fd < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to create listening socket for SNMP agent process: %s",
+        strerror(errno));
+      exit(0);
+    }
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "SNMP agent process listening on UDP %s#%u",
+      pr_netaddr_get_ipstr(agent_addr),
+      ntohs(pr_netaddr_get_port(agent_addr)));
+  }
+
+  if (agent_transports & SNMP_AGENT_TRANSPORT_TCP) {
+    stream_fd = snmp_stream_listen(snmp_pool, agent_addr);
+    if (stream_fd < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to create TCP listening socket for SNMP agent process: %s",
+        strerror(errno));
+      exit(0);
+    }
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "SNMP agent process listening on TCP %s#%u",
+      pr_netaddr_get_ipstr(agent_addr),
+      ntohs(pr_netaddr_get_port(agent_addr)));
+  }
+
+  if (snmp_socket_path != NULL) {
+    unix_fd = snmp_stream_listen_unix(snmp_pool, snmp_socket_path,
+      snmp_socket_uids);
+    if (unix_fd < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to create Unix listening socket '%s' for SNMP agent "
+        "process: %s", snmp_socket_path, strerror(errno));
+
+    } else {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "SNMP agent process listening on Unix socket '%s'", snmp_socket_path);
+    }
+  }
+
+  if (metrics_addr != NULL) {
+    metrics_fd = snmp_metrics_listen(snmp_pool, metrics_addr);
+    if (metrics_fd < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to create listening socket for metrics: %s", strerror(errno));
+
+    } else {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "SNMP agent process serving metrics on TCP %s#%u",
+        pr_netaddr_get_ipstr(metrics_addr),
+        ntohs(pr_netaddr_get_port(metrics_addr)));
+    }
+  }
+
+  PRIVS_ROOT
+
+  if (getuid() == PR_ROOT_UID) {
+    int res;
+
+    /* Chroot to the SNMPTables/empty/ directory before dropping root privs. */
+
+    agent_chroot = pdircat(snmp_pool, tables_dir, "empty", NULL);
+    res = chroot(agent_chroot);
+    if (res < 0) {
+      int xerrno = errno;
+
+      PRIVS_RELINQUISH
+ 
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to chroot to SNMPTables/empty/ directory '%s': %s",
+        agent_chroot, strerror(xerrno));
+      exit(0);
+    }
+
+    if (chdir("/") < 0) {
+      int xerrno = errno;
+
+      PRIVS_RELINQUISH
+
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to chdir to root directory within chroot: %s",
+        strerror(xerrno));
+      exit(0);
+    }
+  }
+
+  pr_proctitle_set("(listening for SNMP packets)");
+
+  /* Make the SNMP process have the identity of the configured daemon
+   * User/Group.
+   */
+  session.uid = geteuid();
+  session.gid = getegid();
+  PRIVS_REVOKE
+
+  if (agent_chroot != NULL) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "SNMP agent process running with UID %lu, GID %lu, restricted to '%s'",
+      (unsigned long) getuid(), (unsigned long) getgid(), agent_chroot);
+
+  } else {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "SNMP agent process running with UID %lu, GID %lu, located in '%s'",
+      (unsigned long) getuid(), (unsigned long) getgid(), getcwd(NULL, 0));
+  }
+
+  snmp_agent_loop(agent_fd, agent_addr, stream_fd, unix_fd, metrics_fd);
 
   /* When we are done, we simply exit. */;
   pr_trace_msg("snmp", 3, "SNMP agent PID %lu exiting",
@@ -1760,6 +2875,14 @@ static void snmp_agent_stop(pid_t agent_pid) {
   }
 
   snmp_agent_pid = 0;
+
+  if (snmp_socket_path != NULL) {
+    /* The agent process, chrooted, cannot remove its own socket. */
+    PRIVS_ROOT
+    (void) unlink(snmp_socket_path);
+    PRIVS_RELINQUISH
+  }
+
   return;
 }
 
@@ -1768,13 +2891,17 @@ static void snmp_agent_stop(pid_t agent_pid) {
 
 /* usage: SNMPAgent "master"|"agentx" address[:port] */
 MODRET set_snmpagent(cmd_rec *cmd) {
+  register unsigned int i;
   config_rec *c;
-  int agent_type;
+  int agent_type, agent_transports = 0;
   pr_netaddr_t *agent_addr;
   int agent_port = SNMP_DEFAULT_AGENT_PORT;
   char *ptr;
 
-  CHECK_ARGS(cmd, 2);
+  if (cmd->argc < 3) {
+    CONF_ERROR(cmd, "missing parameters");
+  }
+
   CHECK_CONF(cmd, CONF_ROOT);
 
   if (strncasecmp(cmd->argv[1], "master", 7) == 0) {
@@ -1813,20 +2940,50 @@ MODRET set_snmpagent(cmd_rec *cmd) {
 
   pr_netaddr_set_port(agent_addr, htons(agent_port));
 
-  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  for (i = 3; i < cmd->argc; i++) {
+    if (strcasecmp(cmd->argv[i], "udp") == 0) {
+      agent_transports |= SNMP_AGENT_TRANSPORT_UDP;
+
+    } else if (strcasecmp(cmd->argv[i], "tcp") == 0) {
+      agent_transports |= SNMP_AGENT_TRANSPORT_TCP;
+
+    } else {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unsupported transport '",
+        cmd->argv[i], "'", NULL));
+    }
+  }
+
+  if (agent_transports == 0) {
+    agent_transports = SNMP_AGENT_TRANSPORT_UDP;
+  }
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
   c->argv[0] = palloc(c->pool, sizeof(int));
   *((int *) c->argv[0]) = agent_type;
   c->argv[1] = agent_addr;
+  c->argv[2] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[2]) = agent_transports;
  
   return PR_HANDLED(cmd);
 }
 
-/* usage: SNMPCommunity community */
+/* usage: SNMPCommunity community [view] */
 MODRET set_snmpcommunity(cmd_rec *cmd) {
-  CHECK_ARGS(cmd, 1);
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
   CHECK_CONF(cmd, CONF_ROOT);
 
-  (void) add_config_param_str(cmd->argv[0], 1, cmd->argv[1]);
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  if (cmd->argc == 3) {
+    c->argv[1] = pstrdup(c->pool, cmd->argv[2]);
+  }
+
   return PR_HANDLED(cmd);
 }
 
@@ -1869,6 +3026,41 @@ MODRET set_snmpengine(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: SNMPHistory interval samples */
+MODRET set_snmphistory(cmd_rec *cmd) {
+  int interval, nsamples;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 2);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  interval = atoi(cmd->argv[1]);
+  if (interval < SNMP_RATE_INTERVAL) {
+    char intervalstr[32];
+
+    memset(intervalstr, '\0', sizeof(intervalstr));
+    snprintf(intervalstr, sizeof(intervalstr)-1, "%d", SNMP_RATE_INTERVAL);
+
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "interval '", cmd->argv[1],
+      "' must be at least ", intervalstr, " seconds", NULL));
+  }
+
+  nsamples = atoi(cmd->argv[2]);
+  if (nsamples < 1 ||
+      nsamples > SNMP_HISTORY_MAX_SAMPLES) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "samples '", cmd->argv[2],
+      "' must be between 1 and 100000", NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = interval;
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = nsamples;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: SNMPLog path|"none" */
 MODRET set_snmplog(cmd_rec *cmd) {
   CHECK_ARGS(cmd, 1);
@@ -1878,23 +3070,92 @@ MODRET set_snmplog(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: SNMPMaxMessageSize size */
+MODRET set_snmpmaxmessagesize(cmd_rec *cmd) {
+  long size;
+  char *ptr = NULL;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  size = strtol(cmd->argv[1], &ptr, 10);
+  if (ptr == NULL ||
+      *ptr != '\0' ||
+      size < SNMP_PACKET_MIN_LEN ||
+      size > SNMP_PACKET_MAX_LEN) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "size '", cmd->argv[1],
+      "' must be between 484 and 65507", NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = (unsigned int) size;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: SNMPMaxVariables count */
 MODRET set_snmpmaxvariables(cmd_rec *cmd) {
   int count = 0;
   config_rec *c;
 
-  CHECK_ARGS(cmd, 1);
-  CHECK_CONF(cmd, CONF_ROOT);
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  count = atoi(cmd->argv[1]);
+  if (count < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "count '", cmd->argv[1],
+      "' must be greater than zero", NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = count;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: SNMPMetrics [address:]port */
+MODRET set_snmpmetrics(cmd_rec *cmd) {
+  config_rec *c;
+  pr_netaddr_t *metrics_addr;
+  const char *addr = "127.0.0.1";
+  int metrics_port;
+  char *ptr;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  /* Separate the port out from the address, if present.  Without an address,
+   * the metrics are only served on the loopback interface.
+   */
+  ptr = strrchr(cmd->argv[1], ':');
+  if (ptr != NULL) {
+    *ptr = '\0';
+
+    addr = cmd->argv[1];
+    metrics_port = atoi(ptr + 1);
+
+  } else {
+    metrics_port = atoi(cmd->argv[1]);
+  }
+
+  if (metrics_port < 1 ||
+      metrics_port > 65535) {
+    CONF_ERROR(cmd, "port must be between 1-65535");
+  }
 
-  count = atoi(cmd->argv[1]);
-  if (count < 0) {
-    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "count '", cmd->argv[1],
-      "' must be greater than zero", NULL));
+  metrics_addr = pr_netaddr_get_addr(snmp_pool, addr, NULL);
+  if (metrics_addr == NULL) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to resolve \"", addr, "\"",
+      NULL));
   }
 
+  pr_netaddr_set_port(metrics_addr, htons(metrics_port));
+
   c = add_config_param(cmd->argv[0], 1, NULL);
-  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
-  *((unsigned int *) c->argv[0]) = count;
+  c->argv[0] = metrics_addr;
 
   return PR_HANDLED(cmd);
 }
@@ -1978,6 +3239,12 @@ MODRET set_snmpoptions(cmd_rec *cmd) {
     if (strcmp(cmd->argv[i], "RestartClearsCounters") == 0) {
       opts |= SNMP_OPT_RESTART_CLEARS_COUNTERS;
 
+    } else if (strcmp(cmd->argv[i], "CommandStats") == 0) {
+      opts |= SNMP_OPT_COMMAND_STATS;
+
+    } else if (strcmp(cmd->argv[i], "PersistentTables") == 0) {
+      opts |= SNMP_OPT_PERSISTENT_TABLES;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown SNMPOption '",
         cmd->argv[i], "'", NULL));
@@ -1990,6 +3257,243 @@ MODRET set_snmpoptions(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: SNMPRateLimit rate [burst] */
+MODRET set_snmpratelimit(cmd_rec *cmd) {
+  int rate, burst;
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  rate = atoi(cmd->argv[1]);
+  if (rate < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "rate '", cmd->argv[1],
+      "' must be zero or greater", NULL));
+  }
+
+  /* By default, allow a burst of one second's worth of requests. */
+  burst = rate;
+
+  if (cmd->argc == 3) {
+    burst = atoi(cmd->argv[2]);
+    if (burst < 1) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "burst '", cmd->argv[2],
+        "' must be greater than zero", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = rate;
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = burst;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: SNMPRequestDeadline millisecs */
+MODRET set_snmprequestdeadline(cmd_rec *cmd) {
+  int deadline;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  deadline = atoi(cmd->argv[1]);
+  if (deadline < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "deadline '", cmd->argv[1],
+      "' must be zero or greater", NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = deadline;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: SNMPTransferUpdates interval [megabytes] */
+MODRET set_snmptransferupdates(cmd_rec *cmd) {
+  int interval, megabytes = 0;
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  interval = atoi(cmd->argv[1]);
+  if (interval < 1) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "interval '", cmd->argv[1],
+      "' must be at least 1 second", NULL));
+  }
+
+  if (cmd->argc == 3) {
+    megabytes = atoi(cmd->argv[2]);
+    if (megabytes < 1) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "megabytes '", cmd->argv[2],
+        "' must be at least 1", NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[0]) = interval;
+  c->argv[1] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[1]) = megabytes;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: SNMPUser name "SHA" auth-passwd ["AES" priv-passwd] [view] */
+MODRET set_snmpuser(cmd_rec *cmd) {
+#ifdef PR_USE_OPENSSL
+  config_rec *c;
+  int priv_proto = SNMP_USM_PRIV_PROTO_NONE;
+  char *view_name = NULL;
+
+  if (cmd->argc < 4 ||
+      cmd->argc > 7) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (strlen(cmd->argv[1]) > SNMP_USM_MAX_USER_NAME_LEN) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "user name too long: '",
+      cmd->argv[1], "'", NULL));
+  }
+
+  if (strcasecmp(cmd->argv[2], "SHA") != 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+      "unsupported authentication protocol '", cmd->argv[2], "'", NULL));
+  }
+
+  /* RFC 3414, Section 11.2: passwords must be at least 8 characters. */
+  if (strlen(cmd->argv[3]) < 8) {
+    CONF_ERROR(cmd, "authentication password must be at least 8 characters");
+  }
+
+  /* An odd number of parameters after the user name means that the last
+   * one names the user's view.
+   */
+  if (cmd->argc == 5 ||
+      cmd->argc == 7) {
+    view_name = cmd->argv[cmd->argc-1];
+  }
+
+  if (cmd->argc >= 6) {
+    if (strcasecmp(cmd->argv[4], "AES") != 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unsupported privacy protocol '",
+        cmd->argv[4], "'", NULL));
+    }
+
+    if (strlen(cmd->argv[5]) < 8) {
+      CONF_ERROR(cmd, "privacy password must be at least 8 characters");
+    }
+
+    priv_proto = SNMP_USM_PRIV_PROTO_AES;
+  }
+
+  c = add_config_param(cmd->argv[0], 5, NULL, NULL, NULL, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = pstrdup(c->pool, cmd->argv[3]);
+  c->argv[2] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[2]) = priv_proto;
+  if (cmd->argc >= 6) {
+    c->argv[3] = pstrdup(c->pool, cmd->argv[5]);
+  }
+
+  if (view_name != NULL) {
+    c->argv[4] = pstrdup(c->pool, view_name);
+  }
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd, "requires OpenSSL support");
+#endif /* PR_USE_OPENSSL */
+}
+
+/* usage: SNMPView name "included"|"excluded" oid */
+MODRET set_snmpview(cmd_rec *cmd) {
+  config_rec *c;
+  int included;
+  oid_t subtree[SNMP_MIB_MAX_OIDLEN];
+  unsigned int subtreelen = 0;
+
+  CHECK_ARGS(cmd, 3);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (strcasecmp(cmd->argv[2], "included") == 0) {
+    included = TRUE;
+
+  } else if (strcasecmp(cmd->argv[2], "excluded") == 0) {
+    included = FALSE;
+
+  } else {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "expected 'included' or "
+      "'excluded', got '", cmd->argv[2], "'", NULL));
+  }
+
+  if (snmp_view_parse_oid(cmd->argv[3], subtree, &subtreelen) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "badly formatted OID '",
+      cmd->argv[3], "'", NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+  c->argv[1] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = included;
+  c->argv[2] = pcalloc(c->pool, subtreelen * sizeof(oid_t));
+  memmove(c->argv[2], subtree, subtreelen * sizeof(oid_t));
+  c->argv[3] = pcalloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[3]) = subtreelen;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: SNMPSocket path [user ...] */
+MODRET set_snmpsocket(cmd_rec *cmd) {
+  register unsigned int i;
+  config_rec *c;
+  array_header *users;
+  struct sockaddr_un sock;
+
+  if (cmd->argc < 2) {
+    CONF_ERROR(cmd, "missing parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (*cmd->argv[1] != '/') {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "must be a full path: '",
+      cmd->argv[1], "'", NULL));
+  }
+
+  if (strlen(cmd->argv[1]) >= sizeof(sock.sun_path)) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "path too long: '",
+      cmd->argv[1], "'", NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pstrdup(c->pool, cmd->argv[1]);
+
+  /* The users are resolved to UIDs later, once the Auth modules are ready. */
+  users = make_array(c->pool, 0, sizeof(char *));
+  for (i = 2; i < cmd->argc; i++) {
+    *((char **) push_array(users)) = pstrdup(c->pool, cmd->argv[i]);
+  }
+  c->argv[1] = users;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: SNMPTables path */
 MODRET set_snmptables(cmd_rec *cmd) {
   int res;
@@ -2079,925 +3583,670 @@ MODRET set_snmptables(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
-/* Command handlers
+/* Records the duration, size, and throughput of the just-completed transfer
+ * in the histograms for the given protocol.
  */
+static void snmp_xfer_hist_add(pool *p, int hist_proto) {
+  struct timeval now_tv;
+  uint64_t xfer_ms, xfer_kb, xfer_rate;
 
-MODRET snmp_pre_list(cmd_rec *cmd) {
-  const char *proto;
-  int res;
-
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
-  }
-
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_XFERS_F_DIR_LIST_COUNT,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_XFERS_F_DIR_LIST_COUNT,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_SFTP_XFERS_F_DIR_LIST_COUNT,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.dirListCount: %s", strerror(errno));
-    }
-  }
-
-  return PR_DECLINED(cmd);
-}
-
-MODRET snmp_log_list(cmd_rec *cmd) {
-  const char *proto;
-  int res;
-
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
-  }
-
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_XFERS_F_DIR_LIST_COUNT,
-      -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftp.dataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_XFERS_F_DIR_LIST_TOTAL,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.dirListTotal: %s", strerror(errno));
-    }
-
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_XFERS_F_DIR_LIST_COUNT,
-      -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftps.tlsDataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_XFERS_F_DIR_LIST_TOTAL,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.dirListTotal: %s", strerror(errno));
-    }
-
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_SFTP_XFERS_F_DIR_LIST_COUNT,
-      -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "sftp.sftpDataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_SFTP_XFERS_F_DIR_LIST_TOTAL,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.dirListTotal: %s", strerror(errno));
-    }
-  }
-
-  return PR_DECLINED(cmd);
-}
-
-MODRET snmp_err_list(cmd_rec *cmd) {
-  const char *proto;
-  int res;
-
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
-  }
-
-  proto = pr_session_get_protocol(0);
-
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_XFERS_F_DIR_LIST_COUNT,
-      -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftp.dataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_DIR_LIST_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTranfers.dirListFailedTotal: %s", strerror(errno));
-    }
-
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_XFERS_F_DIR_LIST_COUNT,
-      -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftps.tlsDataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_DIR_LIST_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTranfers.dirListFailedTotal: %s", strerror(errno));
-    }
-
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_SFTP_XFERS_F_DIR_LIST_COUNT,
-      -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "sftp.sftpDataTransfers.dirListCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_DIR_LIST_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTranfers.dirListFailedTotal: %s", strerror(errno));
-    }
-  }
-
-  return PR_DECLINED(cmd);
-}
-
-MODRET snmp_log_pass(cmd_rec *cmd) {
-  const char *proto; 
-  int res;
-
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
-  }
-
-  proto = pr_session_get_protocol(0);
-
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_SESS_F_SESS_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for ftp.sessions.sessionCount: %s",
-        strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_SESS_F_SESS_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for ftp.sessions.sessionTotal: %s",
-        strerror(errno));
-    }
+  if (session.xfer.start_time.tv_sec == 0) {
+    /* No transfer start time recorded; nothing to measure. */
+    return;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_LOGINS_F_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for ftp.logins.loginsTotal: %s",
-        strerror(errno));
-    }
+  gettimeofday(&now_tv, NULL);
 
-    if (session.anon_config != NULL) {
-      res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_LOGINS_F_ANON_COUNT,
-        1);
-      if (res < 0) {
-        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "error incrementing SNMP database for ftp.logins.anonLoginCount: %s",
-          strerror(errno));
-      }
+  xfer_ms = ((uint64_t) (now_tv.tv_sec - session.xfer.start_time.tv_sec) *
+    1000) + ((now_tv.tv_usec - session.xfer.start_time.tv_usec) / 1000);
+  if ((int64_t) xfer_ms < 0) {
+    xfer_ms = 0;
+  }
 
-      res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_LOGINS_F_ANON_TOTAL,
-        1);
-      if (res < 0) {
-        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-          "error incrementing SNMP database for ftp.logins.anonLoginTotal: %s",
-          strerror(errno));
-      }
-    }
+  /* Round up, so that a transfer of a few bytes is not recorded as zero KB. */
+  xfer_kb = ((uint64_t) session.xfer.total_bytes + 1023) / 1024;
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_LOGINS_F_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for ftps.tlsLogins.loginsTotal: %s",
-        strerror(errno));
-    }
+  if (xfer_ms > 0) {
+    xfer_rate = ((uint64_t) session.xfer.total_bytes * 1000) /
+      (xfer_ms * 1024);
 
   } else {
-    /* SSH2 password logins are handled elsewhere. */
+    /* Too fast to measure; treat it as taking a millisecond. */
+    xfer_rate = ((uint64_t) session.xfer.total_bytes * 1000) / 1024;
   }
 
-  return PR_DECLINED(cmd);
+  if (snmp_db_hist_add_xfer(p, hist_proto, SNMP_DB_HIST_XFER_DURATION,
+      xfer_ms) < 0 ||
+      snmp_db_hist_add_xfer(p, hist_proto, SNMP_DB_HIST_XFER_SIZE,
+      xfer_kb) < 0 ||
+      snmp_db_hist_add_xfer(p, hist_proto, SNMP_DB_HIST_XFER_RATE,
+      xfer_rate) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error adding transfer to SNMP histograms: %s", strerror(errno));
+  }
 }
 
-MODRET snmp_err_pass(cmd_rec *cmd) {
-  const char *proto;
+/* Adds the bytes of the transfer in progress which have not yet been
+ * added to its KB total, using the same holding bucket as for whole
+ * transfers, so that no bytes are lost to rounding.
+ */
+static void snmp_xfer_update(void) {
+  pool *tmp_pool;
+  off_t xfer_kb;
   int res;
 
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
+  if (session.xfer.total_bytes <= snmp_xfer_added_bytes) {
+    return;
   }
 
-  proto = pr_session_get_protocol(0);
+  *snmp_xfer_bucket += (session.xfer.total_bytes - snmp_xfer_added_bytes);
+  snmp_xfer_added_bytes = session.xfer.total_bytes;
+  snmp_xfer_updated = time(NULL);
 
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTP_LOGINS_F_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for ftp.logins.loginFailedTotal: %s",
-        strerror(errno));
-    }
+  xfer_kb = (*snmp_xfer_bucket / 1024);
+  if (xfer_kb == 0) {
+    return;
+  }
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_LOGINS_F_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsLogins.loginFailedTotal: %s", strerror(errno));
-    }
+  *snmp_xfer_bucket %= 1024;
 
-  } else {
-    /* SSH2 password logins are handled elsewhere. */
+  tmp_pool = make_sub_pool(session.pool);
+  res = snmp_db_incr_value(tmp_pool, snmp_xfer_kb_field, (int32_t) xfer_kb);
+  if (res < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error incrementing SNMP database for %s: %s",
+      snmp_db_get_fieldstr(tmp_pool, snmp_xfer_kb_field), strerror(errno));
   }
 
-  return PR_DECLINED(cmd);
+  pr_trace_msg(trace_channel, 19,
+    "added %lu KB of transfer in progress (%llu bytes so far)",
+    (unsigned long) xfer_kb, (unsigned long long) session.xfer.total_bytes);
+  destroy_pool(tmp_pool);
 }
 
-MODRET snmp_pre_retr(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+static int snmp_xfer_timer_cb(CALLBACK_FRAME) {
+  if (snmp_xfer_kb_field == 0) {
+    snmp_xfer_timerno = -1;
+    return 0;
+  }
 
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
+  /* Wait for the transfer to actually start; until then, session.xfer may
+   * still describe the previous transfer.
+   */
+  if (session.xfer.start_time.tv_sec == 0 ||
+      session.xfer.start_time.tv_sec < snmp_xfer_pre_tv.tv_sec ||
+      (session.xfer.start_time.tv_sec == snmp_xfer_pre_tv.tv_sec &&
+       session.xfer.start_time.tv_usec < snmp_xfer_pre_tv.tv_usec)) {
+    return 1;
   }
 
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  if (session.xfer.start_time.tv_sec != snmp_xfer_start_tv.tv_sec ||
+      session.xfer.start_time.tv_usec != snmp_xfer_start_tv.tv_usec) {
+    snmp_xfer_start_tv = session.xfer.start_time;
+    snmp_xfer_added_bytes = 0;
+    snmp_xfer_updated = time(NULL);
+  }
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  if ((snmp_xfer_update_bytes > 0 &&
+       session.xfer.total_bytes - snmp_xfer_added_bytes >=
+         snmp_xfer_update_bytes) ||
+      time(NULL) - snmp_xfer_updated >=
+        (time_t) snmp_xfer_update_interval) {
+    snmp_xfer_update();
+  }
 
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  return 1;
+}
 
-  } else if (strncmp(proto, "scp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+/* Starts tracking a transfer, if SNMPTransferUpdates is configured. */
+static void snmp_xfer_begin(unsigned int kb_field, off_t *bucket) {
+  if (snmp_xfer_update_interval == 0 ||
+      kb_field == 0) {
+    return;
   }
 
-  return PR_DECLINED(cmd);
+  snmp_xfer_kb_field = kb_field;
+  snmp_xfer_bucket = bucket;
+  snmp_xfer_added_bytes = 0;
+  gettimeofday(&snmp_xfer_pre_tv, NULL);
+  memset(&snmp_xfer_start_tv, 0, sizeof(snmp_xfer_start_tv));
+
+  if (snmp_xfer_timerno < 0) {
+    snmp_xfer_timerno = pr_timer_add(1, -1, &snmp_module, snmp_xfer_timer_cb,
+      "SNMP transfer updates");
+  }
 }
 
-MODRET snmp_log_retr(cmd_rec *cmd) {
-  const char *proto;
-  uint32_t retr_kb;
-  off_t rem_bytes;
-  int res;
+/* Stops tracking the transfer, returning the number of its bytes which have
+ * not yet been added to its KB total.
+ */
+static off_t snmp_xfer_end(void) {
+  off_t xfer_bytes;
 
-  if (snmp_engine == FALSE) {
-    return PR_DECLINED(cmd);
+  if (snmp_xfer_timerno >= 0) {
+    (void) pr_timer_remove(snmp_xfer_timerno, &snmp_module);
+    snmp_xfer_timerno = -1;
   }
 
-  proto = pr_session_get_protocol(0);
+  xfer_bytes = session.xfer.total_bytes;
 
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftp.dataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  if (snmp_xfer_kb_field != 0 &&
+      snmp_xfer_start_tv.tv_sec != 0) {
+    xfer_bytes -= snmp_xfer_added_bytes;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.fileDownloadTotal: %s", strerror(errno));
-    }
+  snmp_xfer_kb_field = 0;
+  snmp_xfer_bucket = NULL;
+  snmp_xfer_added_bytes = 0;
 
-    /* We also need to increment the KB download count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be downloaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_retr_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_retr_bytes += session.xfer.total_bytes;
+  return xfer_bytes;
+}
 
-    retr_kb = (snmp_retr_bytes / 1024);
-    rem_bytes = (snmp_retr_bytes % 1024);
+/* Per-session protocol bindings
+ */
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_KB_DOWNLOAD_TOTAL, retr_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.kbDownloadTotal: %s", strerror(errno));
-    }
+/* The counters for each protocol's events.  The hooks use the binding for
+ * the session's current protocol, rather than comparing the protocol name
+ * each time; a field of zero means the protocol has no such counter.
+ */
+struct snmp_proto_binding {
+  const char *proto;
+  int hist_proto;
 
-    snmp_retr_bytes = rem_bytes;
+  /* TRUE if the session is counted when the user logs in, rather than when
+   * the protocol starts (e.g. on AUTH TLS, or when an SFTP channel opens).
+   */
+  int sess_at_login;
+
+  unsigned int sess_count;
+  unsigned int sess_total;
+  unsigned int login_total;
+  unsigned int login_err_total;
+  unsigned int anon_count;
+  unsigned int anon_total;
+
+  unsigned int dir_list_count;
+  unsigned int dir_list_total;
+  unsigned int dir_list_err_total;
+
+  unsigned int upload_count;
+  unsigned int upload_total;
+  unsigned int upload_err_total;
+  unsigned int kb_upload_total;
+
+  unsigned int download_count;
+  unsigned int download_total;
+  unsigned int download_err_total;
+  unsigned int kb_download_total;
+
+  unsigned int ccc_total;
+  unsigned int ccc_err_total;
+
+  /* The number of this protocol's sessions which this process has added to
+   * its sessionCount, and not yet taken away.
+   */
+  int sess_open;
+};
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+#define SNMP_PROTO_FTP		0
+#define SNMP_PROTO_FTPS		1
+#define SNMP_PROTO_SFTP		2
+#define SNMP_PROTO_SCP		3
+#define SNMP_PROTO_OTHER	4
+
+static struct snmp_proto_binding snmp_proto_bindings[] = {
+  { "ftp", SNMP_DB_HIST_PROTO_FTP, TRUE,
+    SNMP_DB_FTP_SESS_F_SESS_COUNT, SNMP_DB_FTP_SESS_F_SESS_TOTAL,
+    SNMP_DB_FTP_LOGINS_F_TOTAL, SNMP_DB_FTP_LOGINS_F_ERR_TOTAL,
+    SNMP_DB_FTP_LOGINS_F_ANON_COUNT, SNMP_DB_FTP_LOGINS_F_ANON_TOTAL,
+    SNMP_DB_FTP_XFERS_F_DIR_LIST_COUNT, SNMP_DB_FTP_XFERS_F_DIR_LIST_TOTAL,
+    SNMP_DB_FTP_XFERS_F_DIR_LIST_ERR_TOTAL,
+    SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_COUNT,
+    SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_TOTAL,
+    SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_ERR_TOTAL,
+    SNMP_DB_FTP_XFERS_F_KB_UPLOAD_TOTAL,
+    SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_COUNT,
+    SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_TOTAL,
+    SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL,
+    SNMP_DB_FTP_XFERS_F_KB_DOWNLOAD_TOTAL,
+    0, 0, 0 },
+
+  { "ftps", SNMP_DB_HIST_PROTO_FTPS, FALSE,
+    SNMP_DB_FTPS_SESS_F_SESS_COUNT, SNMP_DB_FTPS_SESS_F_SESS_TOTAL,
+    SNMP_DB_FTPS_LOGINS_F_TOTAL, SNMP_DB_FTPS_LOGINS_F_ERR_TOTAL,
+    0, 0,
+    SNMP_DB_FTPS_XFERS_F_DIR_LIST_COUNT, SNMP_DB_FTPS_XFERS_F_DIR_LIST_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_DIR_LIST_ERR_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_COUNT,
+    SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_ERR_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_KB_UPLOAD_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_COUNT,
+    SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL,
+    SNMP_DB_FTPS_XFERS_F_KB_DOWNLOAD_TOTAL,
+    SNMP_DB_FTPS_SESS_F_CCC_TOTAL, SNMP_DB_FTPS_SESS_F_CCC_ERR_TOTAL, 0 },
+
+  /* SSH2 logins are counted by the mod_sftp event listeners. */
+  { "sftp", SNMP_DB_HIST_PROTO_SFTP, FALSE,
+    SNMP_DB_SFTP_SESS_F_SESS_COUNT, SNMP_DB_SFTP_SESS_F_SESS_TOTAL,
+    0, 0,
+    0, 0,
+    SNMP_DB_SFTP_XFERS_F_DIR_LIST_COUNT, SNMP_DB_SFTP_XFERS_F_DIR_LIST_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_DIR_LIST_ERR_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_COUNT,
+    SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_ERR_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_KB_UPLOAD_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_COUNT,
+    SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL,
+    SNMP_DB_SFTP_XFERS_F_KB_DOWNLOAD_TOTAL,
+    0, 0, 0 },
+
+  { "scp", SNMP_DB_HIST_PROTO_SCP, FALSE,
+    SNMP_DB_SCP_SESS_F_SESS_COUNT, SNMP_DB_SCP_SESS_F_SESS_TOTAL,
+    0, 0,
+    0, 0,
+    0, 0, 0,
+    SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_COUNT,
+    SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_TOTAL,
+    SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_ERR_TOTAL,
+    SNMP_DB_SCP_XFERS_F_KB_UPLOAD_TOTAL,
+    SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_COUNT,
+    SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_TOTAL,
+    SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL,
+    SNMP_DB_SCP_XFERS_F_KB_DOWNLOAD_TOTAL,
+    0, 0, 0 },
+
+  /* Any other protocol (e.g. "ssh2", before a channel is opened) has no
+   * counters of its own.
+   */
+  { NULL, -1, FALSE,
+    0, 0, 0, 0, 0, 0,
+    0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0, 0,
+    0, 0, 0 }
+};
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileDownloadTotal: %s", strerror(errno));
-    }
+/* The session's current protocol, as last seen, and its binding. */
+static const char *snmp_proto_name = NULL;
+static struct snmp_proto_binding *snmp_proto_binding = NULL;
 
-    /* We also need to increment the KB download count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be downloaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_retr_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_retr_bytes += session.xfer.total_bytes;
+/* TRUE if this session has added to the anonLoginCount. */
+static int snmp_anon_counted = FALSE;
 
-    retr_kb = (snmp_retr_bytes / 1024);
-    rem_bytes = (snmp_retr_bytes % 1024);
+/* Returns the binding for the session's current protocol.  The protocol
+ * only changes at a few points (e.g. AUTH TLS, or when an SSH2 channel is
+ * opened), and each change stores a new string, so the binding is only
+ * looked up again when the protocol string itself changes.
+ */
+static struct snmp_proto_binding *snmp_get_proto_binding(void) {
+  register unsigned int i;
+  const char *proto;
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_KB_DOWNLOAD_TOTAL, retr_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.kbDownloadTotal: %s", strerror(errno));
-    }
+  proto = pr_session_get_protocol(0);
+  if (proto == snmp_proto_name &&
+      snmp_proto_binding != NULL) {
+    return snmp_proto_binding;
+  }
 
-    snmp_retr_bytes = rem_bytes;
+  snmp_proto_name = proto;
+  snmp_proto_binding = &(snmp_proto_bindings[SNMP_PROTO_OTHER]);
 
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileDownloadCount: %s", strerror(errno));
+  for (i = 0; snmp_proto_bindings[i].proto != NULL; i++) {
+    if (strcmp(proto, snmp_proto_bindings[i].proto) == 0) {
+      snmp_proto_binding = &(snmp_proto_bindings[i]);
+      break;
     }
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileDownloadTotal: %s", strerror(errno));
-    }
+  pr_trace_msg(trace_channel, 17, "bound counters for protocol '%s'%s", proto,
+    snmp_proto_binding->proto == NULL ? " (none)" : "");
+  return snmp_proto_binding;
+}
 
-    /* We also need to increment the KB download count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be downloaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_retr_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_retr_bytes += session.xfer.total_bytes;
+/* Adds to the given field; a field of zero is ignored. */
+static void snmp_proto_incr(pool *p, unsigned int field, int32_t incr) {
+  struct snmp_mib *mib;
+  int xerrno;
 
-    retr_kb = (snmp_retr_bytes / 1024);
-    rem_bytes = (snmp_retr_bytes % 1024);
+  if (field == 0) {
+    return;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_KB_DOWNLOAD_TOTAL, retr_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.kbDownloadTotal: %s", strerror(errno));
-    }
+  if (snmp_db_incr_value(p, field, incr) == 0) {
+    return;
+  }
 
-    snmp_retr_bytes = rem_bytes;
+  xerrno = errno;
 
-  } else if (strncmp(proto, "scp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "scp.scpDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  /* Failures are rare; only then is the name of the field looked up. */
+  mib = snmp_mib_get_by_field(field);
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.fileDownloadTotal: %s", strerror(errno));
-    }
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "error %s SNMP database for %s: %s",
+    incr < 0 ? "decrementing" : "incrementing",
+    mib != NULL ? mib->mib_name + strlen(SNMP_MIB_NAME_PREFIX) :
+      snmp_db_get_fieldstr(p, field), strerror(xerrno));
+}
 
-    /* We also need to increment the KB download count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be downloaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_retr_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_retr_bytes += session.xfer.total_bytes;
+/* Counts a new session of the given protocol. */
+static void snmp_proto_sess_open(pool *p, struct snmp_proto_binding *binding) {
+  if (binding->sess_count == 0) {
+    return;
+  }
+
+  snmp_proto_incr(p, binding->sess_count, 1);
+  snmp_proto_incr(p, binding->sess_total, 1);
+  binding->sess_open++;
+}
 
-    retr_kb = (snmp_retr_bytes / 1024);
-    rem_bytes = (snmp_retr_bytes % 1024);
+/* Takes away a session of the given protocol, if this process counted one;
+ * otherwise, it would be taking away some other session's.
+ */
+static void snmp_proto_sess_close(pool *p,
+    struct snmp_proto_binding *binding) {
+  if (binding->sess_open <= 0) {
+    return;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_KB_DOWNLOAD_TOTAL, retr_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.kbDownloadTotal: %s", strerror(errno));
-    }
+  snmp_proto_incr(p, binding->sess_count, -1);
+  binding->sess_open--;
+}
 
-    snmp_retr_bytes = rem_bytes;
+/* Adds the given bytes to the holding bucket, then any whole KB in the
+ * bucket to the given KB total.
+ *
+ * We know the number of bytes transferred as an off_t, but we only store the
+ * number of KB in the mod_snmp db tables.  We could just increment by
+ * xfer_bytes / 1024, but that would mean that several small files of say 999
+ * bytes could be transferred, and the KB count would not be incremented.
+ * Hence the "holding bucket" of bytes (snmp_retr_bytes or snmp_stor_bytes),
+ * from which we get the KB to add to the db tables.
+ */
+static void snmp_xfer_add_kb(pool *p, unsigned int kb_field, off_t *bucket,
+    off_t xfer_bytes) {
+  uint32_t xfer_kb;
+
+  if (kb_field == 0) {
+    return;
   }
 
-  return PR_DECLINED(cmd);
+  *bucket += xfer_bytes;
+
+  xfer_kb = (*bucket / 1024);
+  *bucket %= 1024;
+
+  if (xfer_kb > 0) {
+    snmp_proto_incr(p, kb_field, xfer_kb);
+  }
 }
 
-MODRET snmp_err_retr(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+/* Command handlers
+ */
 
-  if (snmp_engine == FALSE) {
+MODRET snmp_pre_any(cmd_rec *cmd) {
+  if (snmp_engine == FALSE ||
+      !(snmp_opts & SNMP_OPT_COMMAND_STATS)) {
     return PR_DECLINED(cmd);
   }
 
-  proto = pr_session_get_protocol(0);
+  snmp_cmd = cmd;
+  snmp_cmd_idx = snmp_db_cmd_get_idx(cmd->argv[0]);
+  gettimeofday(&snmp_cmd_start_tv, NULL);
 
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftp.dataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  return PR_DECLINED(cmd);
+}
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.fileDownloadFailedTotal: %s", strerror(errno));
-    }
+static void snmp_cmd_stats_add(cmd_rec *cmd, int failed) {
+  struct timeval now_tv;
+  int64_t latency_us;
+  int res;
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  /* If our PRE_CMD handler did not see this command (e.g. another module
+   * rejected it first), there is no start time for it.
+   */
+  if (cmd != snmp_cmd) {
+    return;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileDownloadFailedTotal: %s", strerror(errno));
-    }
+  snmp_cmd = NULL;
 
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+  gettimeofday(&now_tv, NULL);
+  latency_us = (((int64_t) now_tv.tv_sec - snmp_cmd_start_tv.tv_sec) *
+    1000000) + (now_tv.tv_usec - snmp_cmd_start_tv.tv_usec);
+  if (latency_us < 0) {
+    /* The clock went backwards; ignore this one. */
+    return;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileDownloadFailedTotal: %s", strerror(errno));
-    }
+  res = snmp_db_cmd_add(cmd->tmp_pool, snmp_cmd_idx, failed, latency_us);
+  if (res < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error recording statistics for %s command: %s", cmd->argv[0],
+      strerror(errno));
+  }
+}
 
-  } else if (strncmp(proto, "scp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "scp.scpDataTransfers.fileDownloadCount: %s", strerror(errno));
-    }
+MODRET snmp_log_any(cmd_rec *cmd) {
+  if (snmp_engine == FALSE ||
+      !(snmp_opts & SNMP_OPT_COMMAND_STATS)) {
+    return PR_DECLINED(cmd);
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.fileDownloadFailedTotal: %s", strerror(errno));
-    }
+  snmp_cmd_stats_add(cmd, FALSE);
+  return PR_DECLINED(cmd);
+}
+
+MODRET snmp_err_any(cmd_rec *cmd) {
+  if (snmp_engine == FALSE ||
+      !(snmp_opts & SNMP_OPT_COMMAND_STATS)) {
+    return PR_DECLINED(cmd);
   }
 
+  snmp_cmd_stats_add(cmd, TRUE);
   return PR_DECLINED(cmd);
 }
 
-MODRET snmp_pre_stor(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+MODRET snmp_pre_list(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
   if (snmp_engine == FALSE) {
     return PR_DECLINED(cmd);
   }
 
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->dir_list_count, 1);
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  return PR_DECLINED(cmd);
+}
 
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+MODRET snmp_log_list(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
-  } else if (strncmp(proto, "scp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_COUNT, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
   }
 
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->dir_list_count, -1);
+  snmp_proto_incr(cmd->tmp_pool, binding->dir_list_total, 1);
+
   return PR_DECLINED(cmd);
 }
 
-MODRET snmp_log_stor(cmd_rec *cmd) {
-  const char *proto;
-  uint32_t stor_kb;
-  off_t rem_bytes;
-  int res;
+MODRET snmp_err_list(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
   if (snmp_engine == FALSE) {
     return PR_DECLINED(cmd);
   }
 
-  proto = pr_session_get_protocol(0);
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->dir_list_count, -1);
+  snmp_proto_incr(cmd->tmp_pool, binding->dir_list_err_total, 1);
 
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftp.dataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  return PR_DECLINED(cmd);
+}
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.fileUploadTotal: %s", strerror(errno));
-    }
+MODRET snmp_log_pass(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
-    /* We also need to increment the KB upload count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be uploaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_stor_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_stor_bytes += session.xfer.total_bytes;
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
+  }
 
-    stor_kb = (snmp_stor_bytes / 1024);
-    rem_bytes = (snmp_stor_bytes % 1024);
+  /* SSH2 password logins are handled elsewhere. */
+  binding = snmp_get_proto_binding();
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_KB_UPLOAD_TOTAL, stor_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.kbUploadTotal: %s", strerror(errno));
-    }
+  if (binding->sess_at_login == TRUE) {
+    snmp_proto_sess_open(cmd->tmp_pool, binding);
+  }
 
-    snmp_stor_bytes = rem_bytes;
+  snmp_proto_incr(cmd->tmp_pool, binding->login_total, 1);
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  if (session.anon_config != NULL &&
+      binding->anon_count != 0) {
+    snmp_proto_incr(cmd->tmp_pool, binding->anon_count, 1);
+    snmp_proto_incr(cmd->tmp_pool, binding->anon_total, 1);
+    snmp_anon_counted = TRUE;
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileUploadTotal: %s", strerror(errno));
-    }
+  return PR_DECLINED(cmd);
+}
 
-    /* We also need to increment the KB upload count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be uploaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_stor_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_stor_bytes += session.xfer.total_bytes;
+MODRET snmp_err_pass(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
-    stor_kb = (snmp_stor_bytes / 1024);
-    rem_bytes = (snmp_stor_bytes % 1024);
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_KB_UPLOAD_TOTAL, stor_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.kbUploadTotal: %s", strerror(errno));
-    }
+  /* SSH2 password logins are handled elsewhere. */
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->login_err_total, 1);
 
-    snmp_stor_bytes = rem_bytes;
+  return PR_DECLINED(cmd);
+}
 
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+MODRET snmp_pre_retr(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileUploadTotal: %s", strerror(errno));
-    }
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
+  }
 
-    /* We also need to increment the KB upload count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be uploaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_stor_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_stor_bytes += session.xfer.total_bytes;
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->download_count, 1);
+  snmp_xfer_begin(binding->kb_download_total, &snmp_retr_bytes);
 
-    stor_kb = (snmp_stor_bytes / 1024);
-    rem_bytes = (snmp_stor_bytes % 1024);
+  return PR_DECLINED(cmd);
+}
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_KB_UPLOAD_TOTAL, stor_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.kbUploadTotal: %s", strerror(errno));
-    }
+MODRET snmp_log_retr(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
+  off_t xfer_bytes;
 
-    snmp_stor_bytes = rem_bytes;
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
+  }
 
-  } else if (strncmp(proto, "scp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "scp.scpDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  /* Any bytes already added while the transfer was in progress are not
+   * added again.
+   */
+  xfer_bytes = snmp_xfer_end();
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.fileUploadTotal: %s", strerror(errno));
-    }
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->download_count, -1);
+  snmp_proto_incr(cmd->tmp_pool, binding->download_total, 1);
+  snmp_xfer_add_kb(cmd->tmp_pool, binding->kb_download_total,
+    &snmp_retr_bytes, xfer_bytes);
 
-    /* We also need to increment the KB upload count.  We know the number
-     * of bytes downloaded as an off_t here, but we only store the number of KB
-     * in the mod_snmp db tables.
-     * 
-     * We could just increment by xfer_bytes / 1024, but that would mean that
-     * several small files of say 999 bytes could be uploaded, and the KB
-     * count would not be incremented.
-     *
-     * To deal with this situation, we use the snmp_stor_bytes static variable
-     * as a "holding bucket" of bytes, from which we get the KB to add to the
-     * db tables.
-     */
-    snmp_stor_bytes += session.xfer.total_bytes;
+  if (binding->hist_proto >= 0) {
+    snmp_xfer_hist_add(cmd->tmp_pool, binding->hist_proto);
+  }
 
-    stor_kb = (snmp_stor_bytes / 1024);
-    rem_bytes = (snmp_stor_bytes % 1024);
+  return PR_DECLINED(cmd);
+}
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_KB_UPLOAD_TOTAL, stor_kb);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.kbUploadTotal: %s", strerror(errno));
-    }
+MODRET snmp_err_retr(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
-    snmp_stor_bytes = rem_bytes;
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
   }
 
+  /* Bytes already added while the transfer was in progress stay added. */
+  (void) snmp_xfer_end();
+
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->download_count, -1);
+  snmp_proto_incr(cmd->tmp_pool, binding->download_err_total, 1);
+
   return PR_DECLINED(cmd);
 }
 
-MODRET snmp_err_stor(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+MODRET snmp_pre_stor(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
 
   if (snmp_engine == FALSE) {
     return PR_DECLINED(cmd);
   }
 
-  proto = pr_session_get_protocol(0);
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->upload_count, 1);
+  snmp_xfer_begin(binding->kb_upload_total, &snmp_stor_bytes);
 
-  if (strncmp(proto, "ftp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftp.dataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  return PR_DECLINED(cmd);
+}
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftp.dataTransfers.fileUploadFailedTotal: %s", strerror(errno));
-    }
+MODRET snmp_log_stor(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
+  off_t xfer_bytes;
 
-  } else if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
+  }
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsDataTransfers.fileUploadFailedTotal: %s", strerror(errno));
-    }
+  /* Any bytes already added while the transfer was in progress are not
+   * added again.
+   */
+  xfer_bytes = snmp_xfer_end();
 
-  } else if (strncmp(proto, "sftp", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->upload_count, -1);
+  snmp_proto_incr(cmd->tmp_pool, binding->upload_total, 1);
+  snmp_xfer_add_kb(cmd->tmp_pool, binding->kb_upload_total, &snmp_stor_bytes,
+    xfer_bytes);
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "sftp.sftpDataTransfers.fileUploadFailedTotal: %s", strerror(errno));
-    }
+  if (binding->hist_proto >= 0) {
+    snmp_xfer_hist_add(cmd->tmp_pool, binding->hist_proto);
+  }
 
-  } else if (strncmp(proto, "scp", 4) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_COUNT, -1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error decrementing SNMP database for "
-        "scp.scpDataTransfers.fileUploadCount: %s", strerror(errno));
-    }
+  return PR_DECLINED(cmd);
+}
 
-    res = snmp_db_incr_value(cmd->tmp_pool,
-      SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_ERR_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "scp.scpDataTransfers.fileUploadFailedTotal: %s", strerror(errno));
-    }
+MODRET snmp_err_stor(cmd_rec *cmd) {
+  struct snmp_proto_binding *binding;
+
+  if (snmp_engine == FALSE) {
+    return PR_DECLINED(cmd);
   }
 
+  /* Bytes already added while the transfer was in progress stay added. */
+  (void) snmp_xfer_end();
+
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->upload_count, -1);
+  snmp_proto_incr(cmd->tmp_pool, binding->upload_err_total, 1);
+
   return PR_DECLINED(cmd);
 }
 
 MODRET snmp_log_auth(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+  struct snmp_proto_binding *binding;
 
   if (snmp_engine == FALSE) {
     return PR_DECLINED(cmd);
@@ -3014,23 +4263,10 @@ MODRET snmp_log_auth(cmd_rec *cmd) {
    * increment those counts for implicit FTPS connections.
    */
 
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_SESS_F_SESS_COUNT,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsSessions.sessionCount: %s", strerror(errno));
-    }
-
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_SESS_F_SESS_TOTAL,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsSessions.sessionTotal: %s", strerror(errno));
-    }
+  /* A successful AUTH changes the protocol, and thus the binding. */
+  binding = snmp_get_proto_binding();
+  if (binding == &(snmp_proto_bindings[SNMP_PROTO_FTPS])) {
+    snmp_proto_sess_open(cmd->tmp_pool, binding);
 
   } else {
     /* XXX Some other RFC2228 mechanism (e.g. mod_gss) */
@@ -3040,44 +4276,27 @@ MODRET snmp_log_auth(cmd_rec *cmd) {
 }
 
 MODRET snmp_log_ccc(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+  struct snmp_proto_binding *binding;
 
   if (snmp_engine == FALSE) {
     return PR_DECLINED(cmd);
   }
 
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_SESS_F_CCC_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsSessions.clearCommandChannelTotal: %s", strerror(errno));
-    }
-  }
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->ccc_total, 1);
 
   return PR_DECLINED(cmd);
 }
 
 MODRET snmp_err_ccc(cmd_rec *cmd) {
-  const char *proto;
-  int res;
+  struct snmp_proto_binding *binding;
 
   if (snmp_engine == FALSE) {
     return PR_DECLINED(cmd);
   }
 
-  proto = pr_session_get_protocol(0);
-  if (strncmp(proto, "ftps", 5) == 0) {
-    res = snmp_db_incr_value(cmd->tmp_pool, SNMP_DB_FTPS_SESS_F_CCC_ERR_TOTAL,
-      1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing SNMP database for "
-        "ftps.tlsSessions.clearCommandChannelFailedTotal: %s", strerror(errno));
-    }
-  }
+  binding = snmp_get_proto_binding();
+  snmp_proto_incr(cmd->tmp_pool, binding->ccc_err_total, 1);
 
   return PR_DECLINED(cmd);
 }
@@ -3106,7 +4325,7 @@ static void ev_incr_value(unsigned int field_id, const char *field_str,
 static void snmp_auth_code_ev(const void *event_data, void *user_data) {
   int auth_code, res;
   unsigned int field_id, is_ftps = FALSE, notify_id = 0;
-  const char *notify_str = NULL, *proto;
+  const char *notify_str = NULL;
 
   if (snmp_engine == FALSE) {
     return;
@@ -3115,9 +4334,7 @@ static void snmp_auth_code_ev(const void *event_data, void *user_data) {
   auth_code = *((int *) event_data);
 
   /* Any notifications we generate here may depend on the protocol in use. */
-  proto = pr_session_get_protocol(0);
-
-  if (strncmp(proto, "ftps", 5) == 0) {
+  if (snmp_get_proto_binding() == &(snmp_proto_bindings[SNMP_PROTO_FTPS])) {
     is_ftps = TRUE;
   }
 
@@ -3213,28 +4430,27 @@ static void snmp_exit_ev(const void *event_data, void *user_data) {
       "daemon.connectionRefusedTotal", 1);
 
   } else {
-    const char *proto;
-
-    proto = pr_session_get_protocol(0);
-
-    if (strncmp(proto, "ftp", 4) == 0) {
-      ev_incr_value(SNMP_DB_FTP_SESS_F_SESS_COUNT,
-        "ftp.sessions.sessionCount", -1);
+    register unsigned int i;
 
-      if (session.anon_config != NULL) {
-        ev_incr_value(SNMP_DB_FTP_LOGINS_F_ANON_COUNT,
-          "ftp.logins.anonLoginCount", -1);
+    /* Take away every session this process counted, whatever protocol it
+     * was counted under (e.g. an FTP login followed by AUTH TLS, or SFTP
+     * and SCP channels whose close events never came).
+     */
+    for (i = 0; i <= SNMP_PROTO_OTHER; i++) {
+      while (snmp_proto_bindings[i].sess_open > 0) {
+        snmp_proto_sess_close(session.pool, &(snmp_proto_bindings[i]));
       }
+    }
 
-    } else if (strncmp(proto, "ftps", 5) == 0) {
-      ev_incr_value(SNMP_DB_FTPS_SESS_F_SESS_COUNT,
-        "ftps.tlsSessions.sessionCount", -1);
-
-    } else {
-      /* XXX ssh2/sftp/scp session end */
+    if (snmp_anon_counted == TRUE) {
+      ev_incr_value(SNMP_DB_FTP_LOGINS_F_ANON_COUNT,
+        "ftp.logins.anonLoginCount", -1);
+      snmp_anon_counted = FALSE;
     }
   }
 
+  (void) snmp_gauge_release();
+
   if (snmp_logfd >= 0) {
     (void) close(snmp_logfd);
     snmp_logfd = -1;
@@ -3281,6 +4497,9 @@ static void snmp_mod_unload_ev(const void *event_data, void *user_data) {
       snmp_db_close(snmp_pool, snmp_table_ids[i]);
     }
 
+    (void) snmp_history_close(snmp_pool);
+    (void) snmp_gauge_close(snmp_pool);
+
     destroy_pool(snmp_pool);
     snmp_pool = NULL;
 
@@ -3290,14 +4509,39 @@ static void snmp_mod_unload_ev(const void *event_data, void *user_data) {
 }
 #endif
 
+/* Adds a community, or user, to the given list, with its view if any.  If
+ * the named view does not exist, the community/user is not added, and so
+ * has no access at all.
+ */
+static void snmp_add_principal(array_header *principals,
+    const char *directive, const char *name, const char *view_name) {
+  struct snmp_principal *principal;
+  const struct snmp_view *view = NULL;
+
+  if (view_name != NULL) {
+    view = snmp_view_get(view_name);
+    if (view == NULL) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "%s '%s' uses unknown SNMPView '%s', ignoring", directive, name,
+        view_name);
+      return;
+    }
+  }
+
+  principal = push_array(principals);
+  principal->name = name;
+  principal->namelen = strlen(name);
+  principal->view = view;
+}
+
 static void snmp_postparse_ev(const void *event_data, void *user_data) {
   register unsigned int i;
   config_rec *c;
   server_rec *s;
   unsigned int nvhosts = 0;
   const char *tables_dir;
-  int agent_type, res;
-  pr_netaddr_t *agent_addr;
+  int agent_type, agent_transports, res, restored = FALSE;
+  pr_netaddr_t *agent_addr, *metrics_addr = NULL;
   unsigned char ban_loaded = FALSE, sftp_loaded = FALSE, tls_loaded = FALSE;
 
   c = find_config(main_server->conf, CONF_PARAM, "SNMPEngine", FALSE);
@@ -3337,11 +4581,67 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
 
   snmp_community = c->argv[0];
 
+  /* Any cached ACL decisions refer to the previous configuration. */
+  snmp_acl_cache_clear();
+
   c = find_config(main_server->conf, CONF_PARAM, "SNMPMaxVariables", FALSE);
   if (c != NULL) {
     snmp_max_variables = *((unsigned int *) c->argv[0]);
   }
 
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPRateLimit", FALSE);
+  if (c != NULL) {
+    (void) snmp_bucket_set_rate(*((unsigned int *) c->argv[0]),
+      *((unsigned int *) c->argv[1]));
+
+  } else {
+    (void) snmp_bucket_set_rate(0, 0);
+  }
+
+  snmp_request_deadline = 0;
+
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPRequestDeadline",
+    FALSE);
+  if (c != NULL) {
+    snmp_request_deadline = *((unsigned int *) c->argv[0]);
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPMaxMessageSize", FALSE);
+  if (c != NULL) {
+    (void) snmp_packet_set_max_len(*((unsigned int *) c->argv[0]));
+
+  } else {
+    (void) snmp_packet_set_max_len(SNMP_PACKET_DEFAULT_LEN);
+  }
+
+  snmp_socket_path = NULL;
+  snmp_socket_uids = NULL;
+
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPSocket", FALSE);
+  if (c != NULL) {
+    array_header *users;
+    char **names;
+
+    snmp_socket_path = c->argv[0];
+    users = c->argv[1];
+
+    snmp_socket_uids = make_array(snmp_pool, users->nelts, sizeof(uid_t));
+    names = users->elts;
+
+    for (i = 0; i < users->nelts; i++) {
+      uid_t uid;
+
+      uid = pr_auth_name2uid(snmp_pool, names[i]);
+      if (uid == (uid_t) -1) {
+        (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+          "unable to resolve SNMPSocket user '%s', ignoring", names[i]);
+        continue;
+      }
+
+      *((uid_t *) push_array(snmp_socket_uids)) = uid;
+    }
+  }
+
   c = find_config(main_server->conf, CONF_PARAM, "SNMPTables", FALSE);
   if (c == NULL) {
     /* No SNMPTables configured, mod_snmp cannot run. */
@@ -3361,6 +4661,9 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
     return;
   }
 
+  (void) snmp_db_set_persistent(snmp_opts & SNMP_OPT_PERSISTENT_TABLES ?
+    TRUE : FALSE);
+
   /* Create the variable database table files, based on the configured
    * SNMPTables path.
    */
@@ -3368,6 +4671,11 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
   sftp_loaded = pr_module_exists("mod_sftp.c");
   ban_loaded = pr_module_exists("mod_ban.c");
 
+  /* The layout of the registered metrics table, and the MIB table, depend on
+   * the registered metrics, so no more can be registered from here on.
+   */
+  snmp_registry_lock(TRUE);
+
   for (i = 0; snmp_table_ids[i] > 0; i++) {
     int skip_table = FALSE;
 
@@ -3392,6 +4700,12 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
         }
         break;
 
+      case SNMP_DB_ID_EXT:
+        if (snmp_registry_get_count() == 0) {
+          skip_table = TRUE;
+        }
+        break;
+
       default:
         break;
     }
@@ -3415,10 +4729,77 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
       snmp_engine = FALSE;
       return;
     }
+
+    if (snmp_db_is_restored(snmp_table_ids[i]) == TRUE) {
+      restored = TRUE;
+    }
   }
 
-  /* Initial the MIBs. */
+  /* Initial the MIBs.  Any GET templates refer to the previous MIB table
+   * and views.
+   */
   snmp_mib_init();
+  snmp_template_clear();
+
+  if (restored == TRUE) {
+    /* The totals carry over from the previous run, but the gauges describing
+     * the state of that run (e.g. current session counts) do not.
+     */
+    pr_trace_msg(trace_channel, 9,
+      "restored SNMPTables from '%s', resetting gauges", tables_dir);
+    (void) snmp_mib_reset_gauges();
+  }
+
+  if (snmp_gauge_open(snmp_pool, tables_dir) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error mapping session gauge slots: %s", strerror(errno));
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPHistory", FALSE);
+  if (c != NULL) {
+    res = snmp_history_open(snmp_pool, tables_dir,
+      snmp_opts & SNMP_OPT_PERSISTENT_TABLES ? TRUE : FALSE,
+      *((unsigned int *) c->argv[0]), *((unsigned int *) c->argv[1]));
+    if (res < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error mapping SNMPHistory samples: %s", strerror(errno));
+    }
+
+  } else {
+    (void) snmp_history_open(snmp_pool, tables_dir, FALSE, 0, 0);
+  }
+
+  /* Compile the views into bitmaps over the MIB table just built, then bind
+   * them to the communities (and, below, the users).
+   */
+  (void) snmp_view_init(snmp_pool);
+
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPView", FALSE);
+  while (c != NULL) {
+    pr_signals_handle();
+
+    (void) snmp_view_add_subtree(c->argv[0], *((int *) c->argv[1]),
+      c->argv[2], *((unsigned int *) c->argv[3]));
+
+    c = find_config_next(c, c->next, CONF_PARAM, "SNMPView", FALSE);
+  }
+
+  if (snmp_view_compile() < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error compiling SNMPViews: %s", strerror(errno));
+  }
+
+  snmp_communities = make_array(snmp_pool, 1, sizeof(struct snmp_principal));
+  snmp_users = make_array(snmp_pool, 1, sizeof(struct snmp_principal));
+
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPCommunity", FALSE);
+  while (c != NULL) {
+    pr_signals_handle();
+
+    snmp_add_principal(snmp_communities, "SNMPCommunity", c->argv[0],
+      c->argv[1]);
+    c = find_config_next(c, c->next, CONF_PARAM, "SNMPCommunity", FALSE);
+  }
 
   /* Iterate through the server_list, and count up the number of vhosts. */
   for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
@@ -3427,6 +4808,36 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
 
   ev_incr_value(SNMP_DB_DAEMON_F_VHOST_COUNT, "daemon.vhostCount", nvhosts);
 
+#ifdef PR_USE_OPENSSL
+  /* Localize the SNMPv3 users' keys now, once, rather than per message.  If
+   * the USM cannot be used, then neither can any SNMPUser.
+   */
+  c = NULL;
+  if (snmp_usm_init(snmp_pool, tables_dir) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error initializing SNMPv3 USM, disabling SNMPv3: %s", strerror(errno));
+
+  } else {
+    c = find_config(main_server->conf, CONF_PARAM, "SNMPUser", FALSE);
+  }
+
+  while (c != NULL) {
+    pr_signals_handle();
+
+    if (snmp_usm_add_user(c->argv[0], SNMP_USM_AUTH_PROTO_SHA, c->argv[1],
+        *((int *) c->argv[2]), c->argv[3]) < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error adding SNMPUser '%s': %s", (char *) c->argv[0],
+        strerror(errno));
+
+    } else {
+      snmp_add_principal(snmp_users, "SNMPUser", c->argv[0], c->argv[4]);
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "SNMPUser", FALSE);
+  }
+#endif /* PR_USE_OPENSSL */
+
   c = find_config(main_server->conf, CONF_PARAM, "SNMPAgent", FALSE);
   if (c == NULL) {
     snmp_engine = FALSE;
@@ -3443,8 +4854,15 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
 
   agent_type = *((int *) c->argv[0]);
   agent_addr = c->argv[1];
+  agent_transports = *((int *) c->argv[2]);
 
-  snmp_agent_pid = snmp_agent_start(tables_dir, agent_type, agent_addr);
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPMetrics", FALSE);
+  if (c != NULL) {
+    metrics_addr = c->argv[0];
+  }
+
+  snmp_agent_pid = snmp_agent_start(tables_dir, agent_type, agent_addr,
+    agent_transports, metrics_addr);
   if (snmp_agent_pid == 0) {
     snmp_engine = FALSE;
     pr_log_debug(DEBUG0, MOD_SNMP_VERSION
@@ -3480,6 +4898,9 @@ static void snmp_restart_ev(const void *event_data, void *user_data) {
 
   snmp_agent_stop(snmp_agent_pid);
 
+  /* Modules may register more metrics when re-reading their configuration. */
+  snmp_registry_lock(FALSE);
+
   /* Close the SNMPLog file descriptor; it will be reopened in the
    * postparse event listener.
    */
@@ -3496,6 +4917,9 @@ static void snmp_shutdown_ev(const void *event_data, void *user_data) {
     snmp_db_close(snmp_pool, snmp_table_ids[i]);
   }
 
+  (void) snmp_history_close(snmp_pool);
+  (void) snmp_gauge_close(snmp_pool);
+
   destroy_pool(snmp_pool);
   snmp_pool = NULL;
 
@@ -3756,10 +5180,8 @@ static void snmp_ssh2_sftp_sess_opened_ev(const void *event_data,
     return;
   }
 
-  ev_incr_value(SNMP_DB_SFTP_SESS_F_SESS_COUNT,
-    "sftp.sftpSessions.sessionCount", 1);
-  ev_incr_value(SNMP_DB_SFTP_SESS_F_SESS_TOTAL,
-    "sftp.sftpSessions.sessionTotal", 1);
+  snmp_proto_sess_open(session.pool,
+    &(snmp_proto_bindings[SNMP_PROTO_SFTP]));
 }
 
 static void snmp_ssh2_sftp_sess_closed_ev(const void *event_data,
@@ -3768,8 +5190,8 @@ static void snmp_ssh2_sftp_sess_closed_ev(const void *event_data,
     return;
   }
 
-  ev_incr_value(SNMP_DB_SFTP_SESS_F_SESS_COUNT,
-    "sftp.sftpSessions.sessionCount", -1);
+  snmp_proto_sess_close(session.pool,
+    &(snmp_proto_bindings[SNMP_PROTO_SFTP]));
 }
 
 static void snmp_ssh2_scp_sess_opened_ev(const void *event_data,
@@ -3778,10 +5200,7 @@ static void snmp_ssh2_scp_sess_opened_ev(const void *event_data,
     return;
   }
 
-  ev_incr_value(SNMP_DB_SCP_SESS_F_SESS_COUNT,
-    "scp.scpSessions.sessionCount", 1);
-  ev_incr_value(SNMP_DB_SCP_SESS_F_SESS_TOTAL,
-    "scp.scpSessions.sessionTotal", 1);
+  snmp_proto_sess_open(session.pool, &(snmp_proto_bindings[SNMP_PROTO_SCP]));
 }
 
 static void snmp_ssh2_scp_sess_closed_ev(const void *event_data,
@@ -3790,8 +5209,8 @@ static void snmp_ssh2_scp_sess_closed_ev(const void *event_data,
     return;
   }
 
-  ev_incr_value(SNMP_DB_SCP_SESS_F_SESS_COUNT,
-    "scp.scpSessions.sessionCount", -1);
+  snmp_proto_sess_close(session.pool,
+    &(snmp_proto_bindings[SNMP_PROTO_SCP]));
 }
 
 /* mod_ban-generated events */
@@ -3938,6 +5357,11 @@ static int snmp_init(void) {
     snmp_proto_udp = pre->p_proto;
   }
 
+  pre = getprotobyname("tcp");
+  if (pre != NULL) {
+    snmp_proto_tcp = pre->p_proto;
+  }
+
 #ifdef HAVE_ENDPROTOENT
   endprotoent();
 #endif
@@ -4069,6 +5493,14 @@ static int snmp_sess_init(void) {
       snmp_ban_client_disconn_ev, NULL);
   }
 
+  /* Claim our slot before touching any gauges, so that the agent can take
+   * our part of them away again, should this process die without doing so.
+   */
+  if (snmp_gauge_claim() < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to track session gauges: %s", strerror(errno));
+  }
+
   res = snmp_db_incr_value(session.pool, SNMP_DB_DAEMON_F_CONN_COUNT, 1);
   if (res < 0) {
     (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
@@ -4088,6 +5520,13 @@ static int snmp_sess_init(void) {
   srandom((unsigned int) (time(NULL) * getpid())); 
 #endif /* HAVE_RANDOM */
 
+  c = find_config(main_server->conf, CONF_PARAM, "SNMPTransferUpdates", FALSE);
+  if (c != NULL) {
+    snmp_xfer_update_interval = *((unsigned int *) c->argv[0]);
+    snmp_xfer_update_bytes = (off_t) *((unsigned int *) c->argv[1]) *
+      1024 * 1024;
+  }
+
   c = find_config(main_server->conf, CONF_PARAM, "SNMPNotify", FALSE);
   while (c != NULL) {
     pr_signals_handle();
@@ -4112,11 +5551,20 @@ static conftable snmp_conftab[] = {
   { "SNMPCommunity",	set_snmpcommunity,	NULL },
   { "SNMPEnable",	set_snmpenable,		NULL },
   { "SNMPEngine",	set_snmpengine,		NULL },
+  { "SNMPHistory",	set_snmphistory,	NULL },
   { "SNMPLog",		set_snmplog,		NULL },
+  { "SNMPMaxMessageSize",	set_snmpmaxmessagesize,	NULL },
   { "SNMPMaxVariables",	set_snmpmaxvariables,	NULL },
+  { "SNMPMetrics",	set_snmpmetrics,	NULL },
   { "SNMPNotify",	set_snmpnotify,		NULL },
   { "SNMPOptions",	set_snmpoptions,	NULL },
+  { "SNMPRateLimit",	set_snmpratelimit,	NULL },
+  { "SNMPRequestDeadline",	set_snmprequestdeadline,	NULL },
+  { "SNMPSocket",	set_snmpsocket,		NULL },
   { "SNMPTables",	set_snmptables,		NULL },
+  { "SNMPTransferUpdates",	set_snmptransferupdates,	NULL },
+  { "SNMPUser",		set_snmpuser,		NULL },
+  { "SNMPView",		set_snmpview,		NULL },
   { NULL }
 };
 
@@ -4149,6 +5597,11 @@ static cmdtable snmp_cmdtab[] = {
   { LOG_CMD,		C_CCC,	G_NONE,	snmp_log_ccc,	FALSE,	FALSE },
   { LOG_CMD_ERR,	C_CCC,	G_NONE,	snmp_err_ccc,	FALSE,	FALSE },
 
+  /* For SNMPOptions CommandStats */
+  { PRE_CMD,		C_ANY,	G_NONE,	snmp_pre_any,	FALSE,	FALSE },
+  { LOG_CMD,		C_ANY,	G_NONE,	snmp_log_any,	FALSE,	FALSE },
+  { LOG_CMD_ERR,	C_ANY,	G_NONE,	snmp_err_any,	FALSE,	FALSE },
+
   { 0, NULL }
 };
 
@@ -31,6 +31,7 @@
 #include "asn1.h"
 #include "packet.h"
 #include "db.h"
+#include "usm.h"
 #include "stacktrace.h"
 
 static const char *trace_channel = "snmp.msg";
@@ -74,18 +75,399 @@ const char *snmp_msg_get_versionstr(long snmp_version) {
  *    }
  */
 
+#ifdef PR_USE_OPENSSL
+/* RFC 3412, Section 6:
+ *
+ *  ScopedPDU ::=
+ *    SEQUENCE {
+ *      contextEngineID  OCTET STRING,
+ *      contextName      OCTET STRING,
+ *      data             ANY
+ *    }
+ */
+static int msg_read_scoped_pdu(pool *p, unsigned char **buf, size_t *buflen,
+    struct snmp_pdu **pdu) {
+  unsigned char asn1_type, *context;
+  unsigned int asn1_len, contextlen;
+  int res;
+
+  res = snmp_asn1_read_header(p, buf, buflen, &asn1_type, &asn1_len, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (asn1_type != (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT)) {
+    pr_trace_msg(trace_channel, 3,
+      "unable to read scopedPDU (tag '%s')",
+      snmp_asn1_get_tagstr(p, asn1_type));
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* We only have the default context; the contextEngineID and contextName
+   * are not checked.
+   */
+  res = snmp_asn1_read_octets(p, buf, buflen, &asn1_type, &context,
+    &contextlen);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_octets(p, buf, buflen, &asn1_type, &context,
+    &contextlen);
+  if (res < 0) {
+    return -1;
+  }
+
+  return snmp_pdu_read(p, buf, buflen, pdu, SNMP_PROTOCOL_VERSION_3);
+}
+
+/* RFC 3412, Section 6:
+ *
+ *  SNMPv3Message ::=
+ *    SEQUENCE {
+ *      msgVersion            INTEGER
+ *      msgGlobalData         HeaderData
+ *      msgSecurityParameters OCTET STRING
+ *      msgData               ScopedPduData
+ *    }
+ *
+ *  HeaderData ::=
+ *    SEQUENCE {
+ *      msgID                 INTEGER
+ *      msgMaxSize            INTEGER
+ *      msgFlags              OCTET STRING (SIZE(1))
+ *      msgSecurityModel      INTEGER
+ *    }
+ *
+ * The msgData is either a plaintext ScopedPDU, or an OCTET STRING holding
+ * the encrypted ScopedPDU.  The whole message is needed, for checking its
+ * digest.
+ */
+static int msg_read_v3(pool *p, unsigned char *msg_data, size_t msg_datalen,
+    unsigned char **buf, size_t *buflen, struct snmp_pdu **pdu,
+    struct snmp_usm_msg *usm) {
+  unsigned char asn1_type, *flags, *params, *scoped_pdu;
+  unsigned int asn1_len, flagslen, paramslen, scoped_pdulen = 0;
+  size_t scoped_pdu_len;
+  long security_model;
+  int res;
+
+  memset(usm, 0, sizeof(struct snmp_usm_msg));
+
+  res = snmp_asn1_read_header(p, buf, buflen, &asn1_type, &asn1_len, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (asn1_type != (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT)) {
+    pr_trace_msg(trace_channel, 3,
+      "unable to read SNMPv3 msgGlobalData (tag '%s')",
+      snmp_asn1_get_tagstr(p, asn1_type));
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = snmp_asn1_read_int(p, buf, buflen, &asn1_type, &(usm->msg_id), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_int(p, buf, buflen, &asn1_type, &(usm->msg_max_size),
+    0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_octets(p, buf, buflen, &asn1_type, &flags, &flagslen);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (flagslen != 1) {
+    pr_trace_msg(trace_channel, 3,
+      "invalid SNMPv3 msgFlags length (%u bytes)", flagslen);
+    errno = EINVAL;
+    return -1;
+  }
+
+  usm->msg_flags = flags[0];
+
+  res = snmp_asn1_read_int(p, buf, buflen, &asn1_type, &security_model, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (security_model != SNMP_USM_SECURITY_MODEL) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unsupported SNMPv3 security model %ld, dropping packet",
+      security_model);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* RFC 3412, Section 7.2, step 3: the message is invalid if privacy is
+   * requested without authentication.
+   */
+  if (usm->msg_max_size < SNMP_PACKET_MIN_LEN ||
+      ((usm->msg_flags & SNMP_USM_FL_PRIV) &&
+       !(usm->msg_flags & SNMP_USM_FL_AUTH))) {
+    pr_trace_msg(trace_channel, 3,
+      "invalid SNMPv3 msgGlobalData (msgMaxSize %ld, msgFlags 0x%02x)",
+      usm->msg_max_size, usm->msg_flags);
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = snmp_asn1_read_octets(p, buf, buflen, &asn1_type, &params,
+    &paramslen);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_usm_read_params(p, params, paramslen, usm);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (usm->msg_flags & SNMP_USM_FL_PRIV) {
+    res = snmp_asn1_read_octets(p, buf, buflen, &asn1_type, &scoped_pdu,
+      &scoped_pdulen);
+    if (res < 0) {
+      return -1;
+    }
+  }
+
+  res = snmp_usm_process_msg(p, usm, msg_data, msg_datalen);
+  if (res < 0) {
+    int xerrno = errno;
+
+    /* Reports echo the request ID, when we can read it. */
+    if (!(usm->msg_flags & SNMP_USM_FL_PRIV)) {
+      (void) msg_read_scoped_pdu(p, buf, buflen, pdu);
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (usm->msg_flags & SNMP_USM_FL_PRIV) {
+    res = snmp_usm_decrypt(usm, scoped_pdu, scoped_pdulen);
+    if (res < 0) {
+      return -1;
+    }
+
+    scoped_pdu_len = scoped_pdulen;
+    res = msg_read_scoped_pdu(p, &scoped_pdu, &scoped_pdu_len, pdu);
+    if (res < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "unable to decrypt SNMPv3 scopedPDU for user '%s'", usm->user_name);
+
+      /* A scopedPDU that cannot be parsed could not be decrypted. */
+      usm->report_stat = SNMP_USM_STAT_DECRYPTION_ERRORS;
+      errno = EACCES;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  return msg_read_scoped_pdu(p, buf, buflen, pdu);
+}
+
+/* Writes the SNMPv3 message for the given PDU; see msg_read_v3(). */
+static int msg_write_v3(pool *p, unsigned char **buf, size_t *buflen,
+    struct snmp_pdu *pdu, struct snmp_usm_msg *usm) {
+  unsigned char asn1_type, *msg_ptr, *msg_hdr_start, *msg_hdr_end;
+  unsigned char *hdr_start, *hdr_end, *enc_hdr_start = NULL;
+  unsigned char *enc_data = NULL, *auth_params = NULL, flags;
+  const unsigned char *engine_id;
+  unsigned int engine_idlen;
+  size_t msg_hdr_startlen, hdr_startlen, enc_hdr_startlen = 0, msg_len;
+  int res;
+
+  msg_ptr = msg_hdr_start = *buf;
+  msg_hdr_startlen = *buflen;
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  msg_hdr_end = *buf;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_INTEGER);
+  res = snmp_asn1_write_int(p, buf, buflen, asn1_type,
+    SNMP_PROTOCOL_VERSION_3, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  /* msgGlobalData */
+  hdr_start = *buf;
+  hdr_startlen = *buflen;
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  hdr_end = *buf;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_INTEGER);
+  res = snmp_asn1_write_int(p, buf, buflen, asn1_type, usm->msg_id, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_write_int(p, buf, buflen, asn1_type,
+    (long) snmp_packet_get_max_len(), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  flags = usm->resp_flags;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+  res = snmp_asn1_write_string(p, buf, buflen, asn1_type, (char *) &flags, 1);
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_INTEGER);
+  res = snmp_asn1_write_int(p, buf, buflen, asn1_type, SNMP_USM_SECURITY_MODEL,
+    0);
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, &hdr_start, &hdr_startlen, asn1_type,
+    (*buf - hdr_end), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  /* msgSecurityParameters */
+  res = snmp_usm_write_params(p, buf, buflen, usm, &auth_params);
+  if (res < 0) {
+    return -1;
+  }
+
+  /* msgData: the ScopedPDU is encrypted in place, once written. */
+  if (flags & SNMP_USM_FL_PRIV) {
+    enc_hdr_start = *buf;
+    enc_hdr_startlen = *buflen;
+
+    asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+    res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+    if (res < 0) {
+      return -1;
+    }
+
+    enc_data = *buf;
+  }
+
+  hdr_start = *buf;
+  hdr_startlen = *buflen;
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  hdr_end = *buf;
+
+  engine_id = snmp_usm_get_engine_id(&engine_idlen);
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+  res = snmp_asn1_write_string(p, buf, buflen, asn1_type,
+    (const char *) engine_id, engine_idlen);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_write_string(p, buf, buflen, asn1_type, "", 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_pdu_write(p, buf, buflen, pdu, SNMP_PROTOCOL_VERSION_3);
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, &hdr_start, &hdr_startlen, asn1_type,
+    (*buf - hdr_end), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (flags & SNMP_USM_FL_PRIV) {
+    res = snmp_usm_encrypt(usm, enc_data, (*buf - enc_data));
+    if (res < 0) {
+      return -1;
+    }
+
+    asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+    res = snmp_asn1_write_header(p, &enc_hdr_start, &enc_hdr_startlen,
+      asn1_type, (*buf - enc_data), 0);
+    if (res < 0) {
+      return -1;
+    }
+  }
+
+  msg_len = (*buf - msg_hdr_start);
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, &msg_hdr_start, &msg_hdr_startlen,
+    asn1_type, (*buf - msg_hdr_end), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  /* Now that the whole message is written, it can be signed. */
+  if (flags & SNMP_USM_FL_AUTH) {
+    res = snmp_usm_sign(usm, msg_ptr, msg_len, auth_params);
+    if (res < 0) {
+      return -1;
+    }
+  }
+
+  *buflen = msg_len;
+  *buf = msg_ptr;
+
+  return 0;
+}
+#endif /* PR_USE_OPENSSL */
+
 int snmp_msg_read(pool *p, unsigned char **buf, size_t *buflen,
     char **community, unsigned int *community_len, long *snmp_version,
-    struct snmp_pdu **pdu) {
+    struct snmp_pdu **pdu, struct snmp_usm_msg *usm) {
   unsigned char asn1_type;
   unsigned int asn1_len;
   int res;
+#ifdef PR_USE_OPENSSL
+  unsigned char *msg_data;
+  size_t msg_datalen;
+
+  msg_data = *buf;
+#endif /* PR_USE_OPENSSL */
 
   res = snmp_asn1_read_header(p, buf, buflen, &asn1_type, &asn1_len, 0);
   if (res < 0) {
     return -1;
   }
 
+#ifdef PR_USE_OPENSSL
+  /* The length of the whole message, including this header. */
+  msg_datalen = (*buf - msg_data) + asn1_len;
+#endif /* PR_USE_OPENSSL */
+
   if (asn1_type != (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT)) {
     pr_trace_msg(trace_channel, 3,
       "unable to read SNMP message (tag '%s')",
@@ -103,7 +485,29 @@ int snmp_msg_read(pool *p, unsigned char **buf, size_t *buflen,
   pr_trace_msg(trace_channel, 17,
     "read SNMP message for %s", snmp_msg_get_versionstr(*snmp_version));
 
-  /* XXX Don't support SNMPv3 yet. */
+#ifdef PR_USE_OPENSSL
+  if (*snmp_version == SNMP_PROTOCOL_VERSION_3 &&
+      usm != NULL) {
+    if (msg_datalen > (size_t) (*buf - msg_data) + *buflen) {
+      pr_trace_msg(trace_channel, 3,
+        "SNMPv3 message length (%lu bytes) exceeds packet length",
+        (unsigned long) msg_datalen);
+      errno = EINVAL;
+      return -1;
+    }
+
+    res = msg_read_v3(p, msg_data, msg_datalen, buf, buflen, pdu, usm);
+    if (res < 0) {
+      return -1;
+    }
+
+    /* The user name stands in for the community, e.g. for logging. */
+    *community = usm->user_name;
+    *community_len = usm->user_namelen;
+
+    return 0;
+  }
+#endif /* PR_USE_OPENSSL */
 
   if (*snmp_version != SNMP_PROTOCOL_VERSION_1 &&
       *snmp_version != SNMP_PROTOCOL_VERSION_2) {
@@ -111,11 +515,8 @@ int snmp_msg_read(pool *p, unsigned char **buf, size_t *buflen,
       "%s messages not currently supported, dropping packet",
       snmp_msg_get_versionstr(*snmp_version));
 
-    res = snmp_db_incr_value(p, SNMP_DB_SNMP_F_PKTS_DROPPED_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing snmp.packetsDroppedTotal: %s", strerror(errno));
-    }
+    (void) snmp_packet_incr_dropped(p,
+      SNMP_DB_SNMP_F_PKTS_DROPPED_VERSION_TOTAL);
 
     errno = ENOSYS;
     return -1;
@@ -150,7 +551,7 @@ int snmp_msg_read(pool *p, unsigned char **buf, size_t *buflen,
 
 int snmp_msg_write(pool *p, unsigned char **buf, size_t *buflen,
     char *community, unsigned int community_len, long snmp_version,
-    struct snmp_pdu *pdu) {
+    struct snmp_pdu *pdu, struct snmp_usm_msg *usm) {
   unsigned char asn1_type;
   unsigned int asn1_len;
   unsigned char *msg_ptr, *msg_hdr_start, *msg_hdr_end;
@@ -160,12 +561,27 @@ int snmp_msg_write(pool *p, unsigned char **buf, size_t *buflen,
   if (p == NULL ||
       buf == NULL ||
       buflen == NULL ||
-      community == NULL ||
       pdu == NULL) {
     errno = EINVAL;
     return -1;
   }
 
+  if (snmp_version == SNMP_PROTOCOL_VERSION_3) {
+#ifdef PR_USE_OPENSSL
+    if (usm != NULL) {
+      return msg_write_v3(p, buf, buflen, pdu, usm);
+    }
+#endif /* PR_USE_OPENSSL */
+
+    errno = ENOSYS;
+    return -1;
+  }
+
+  if (community == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
   msg_ptr = msg_hdr_start = *buf;
   msg_hdr_startlen = *buflen;
 
@@ -233,3 +649,53 @@ int snmp_msg_write(pool *p, unsigned char **buf, size_t *buflen,
 
   return 0;
 }
+
+unsigned int snmp_msg_get_hdrlen(unsigned int community_len,
+    long snmp_version, struct snmp_pdu *pdu, struct snmp_usm_msg *usm) {
+  unsigned int hdrlen;
+
+  /* The message, PDU, and variable bindings list headers are all written
+   * before their lengths are known.
+   */
+  hdrlen = (3 * snmp_asn1_get_header_len(0, 0));
+
+  hdrlen += snmp_asn1_get_int_len(snmp_version);
+
+#ifdef PR_USE_OPENSSL
+  if (snmp_version == SNMP_PROTOCOL_VERSION_3 &&
+      usm != NULL) {
+    unsigned int engine_idlen;
+
+    /* msgGlobalData */
+    hdrlen += snmp_asn1_get_header_len(0, 0);
+    hdrlen += snmp_asn1_get_int_len(usm->msg_id);
+    hdrlen += snmp_asn1_get_int_len((long) snmp_packet_get_max_len());
+    hdrlen += snmp_asn1_get_string_len(1);
+    hdrlen += snmp_asn1_get_int_len(SNMP_USM_SECURITY_MODEL);
+
+    hdrlen += snmp_usm_get_params_len(usm);
+
+    /* The encrypted ScopedPDU is the same length as the plaintext. */
+    if (usm->resp_flags & SNMP_USM_FL_PRIV) {
+      hdrlen += snmp_asn1_get_header_len(0, 0);
+    }
+
+    (void) snmp_usm_get_engine_id(&engine_idlen);
+
+    hdrlen += snmp_asn1_get_header_len(0, 0);
+    hdrlen += snmp_asn1_get_string_len(engine_idlen);
+    hdrlen += snmp_asn1_get_string_len(0);
+
+  } else {
+    hdrlen += snmp_asn1_get_string_len(community_len);
+  }
+#else
+  hdrlen += snmp_asn1_get_string_len(community_len);
+#endif /* PR_USE_OPENSSL */
+
+  hdrlen += snmp_asn1_get_int_len(pdu->request_id);
+  hdrlen += snmp_asn1_get_int_len(pdu->err_code);
+  hdrlen += snmp_asn1_get_int_len(pdu->err_idx);
+
+  return hdrlen;
+}
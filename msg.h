@@ -26,6 +26,7 @@
 
 #include "mod_snmp.h"
 #include "pdu.h"
+#include "usm.h"
 
 #ifndef MOD_SNMP_MSG_H
 #define MOD_SNMP_MSG_H
@@ -34,9 +35,15 @@ const char *snmp_msg_get_versionstr(long snmp_version);
 
 int snmp_msg_read(pool *p, unsigned char **buf, size_t *buflen,
   char **community, unsigned int *community_len, long *snmp_version,
-  struct snmp_pdu **pdu);
+  struct snmp_pdu **pdu, struct snmp_usm_msg *usm);
 int snmp_msg_write(pool *p, unsigned char **buf, size_t *buflen,
   char *community, unsigned int community_len, long snmp_version,
-  struct snmp_pdu *pdu);
+  struct snmp_pdu *pdu, struct snmp_usm_msg *usm);
+
+/* Returns the number of bytes which snmp_msg_write() would write for the
+ * given response PDU, not counting its variable bindings.
+ */
+unsigned int snmp_msg_get_hdrlen(unsigned int community_len,
+  long snmp_version, struct snmp_pdu *pdu, struct snmp_usm_msg *usm);
 
 #endif
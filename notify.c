@@ -386,7 +386,8 @@ int snmp_notify_generate(pool *p, int sockfd, const char *community,
     snmp_pdu_get_request_type_desc(pkt->resp_pdu->request_type));
 
   res = snmp_msg_write(pkt->pool, &(pkt->resp_data), &(pkt->resp_datalen),
-    pkt->community, pkt->community_len, pkt->snmp_version, pkt->resp_pdu);
+    pkt->community, pkt->community_len, pkt->snmp_version, pkt->resp_pdu,
+    NULL);
   if (res < 0) {
     int xerrno = errno;
 
@@ -26,10 +26,69 @@
 
 #include "mod_snmp.h"
 #include "packet.h"
+#include "stream.h"
 #include "db.h"
 
 static const char *trace_channel = "snmp";
 
+/* The request/response buffers can be as large as 64KB, so rather than
+ * allocating a fresh pair for every packet, we keep the buffers of destroyed
+ * packets on a free list, and hand them out again.  Only as many buffers are
+ * ever allocated as there are packets in use at once (usually one, or a
+ * batch of UDP requests being scheduled).
+ */
+struct snmp_packet_buf {
+  struct snmp_packet_buf *next;
+  unsigned char *data;
+};
+
+static size_t packet_max_len = SNMP_PACKET_DEFAULT_LEN;
+static pool *packet_buf_pool = NULL;
+static struct snmp_packet_buf *packet_free_bufs = NULL;
+
+static struct snmp_packet_buf *packet_get_buf(void) {
+  struct snmp_packet_buf *buf;
+
+  if (packet_free_bufs != NULL) {
+    buf = packet_free_bufs;
+    packet_free_bufs = buf->next;
+    buf->next = NULL;
+
+    return buf;
+  }
+
+  if (packet_buf_pool == NULL) {
+    packet_buf_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(packet_buf_pool, "SNMP packet buffer pool");
+  }
+
+  pr_trace_msg(trace_channel, 17,
+    "allocating new %lu-byte packet buffer", (unsigned long) packet_max_len);
+
+  buf = pcalloc(packet_buf_pool, sizeof(struct snmp_packet_buf));
+  buf->data = palloc(packet_buf_pool, packet_max_len);
+
+  return buf;
+}
+
+static void packet_put_bufs(void *data) {
+  struct snmp_packet *pkt;
+
+  pkt = data;
+
+  if (pkt->req_buf != NULL) {
+    pkt->req_buf->next = packet_free_bufs;
+    packet_free_bufs = pkt->req_buf;
+    pkt->req_buf = NULL;
+  }
+
+  if (pkt->resp_buf != NULL) {
+    pkt->resp_buf->next = packet_free_bufs;
+    packet_free_bufs = pkt->resp_buf;
+    pkt->resp_buf = NULL;
+  }
+}
+
 struct snmp_packet *snmp_packet_create(pool *p) {
   struct snmp_packet *pkt;
   pool *sub_pool;
@@ -39,20 +98,51 @@ struct snmp_packet *snmp_packet_create(pool *p) {
 
   pkt = pcalloc(sub_pool, sizeof(struct snmp_packet));
   pkt->pool = sub_pool;
+  pkt->transport = SNMP_PACKET_TRANSPORT_UDP;
 
-  /* Allocate the request data buffer for now; leave the response data
-   * buffer to be allocated later.
-   */
+  pkt->req_buf = packet_get_buf();
+  pkt->req_datalen = packet_max_len;
+  pkt->req_data = pkt->req_buf->data;
 
-  pkt->req_datalen = SNMP_PACKET_MAX_LEN;
-  pkt->req_data = palloc(sub_pool, pkt->req_datalen);
+  pkt->resp_buf = packet_get_buf();
+  pkt->resp_datalen = packet_max_len;
+  pkt->resp_data = pkt->resp_buf->data;
 
-  pkt->resp_datalen = SNMP_PACKET_MAX_LEN;
-  pkt->resp_data = palloc(sub_pool, pkt->resp_datalen);
+  /* Return the buffers to the free list when the packet is destroyed. */
+  register_cleanup(sub_pool, pkt, packet_put_bufs, packet_put_bufs);
 
   return pkt;
 }
 
+int snmp_packet_set_max_len(size_t max_len) {
+  if (max_len < SNMP_PACKET_MIN_LEN ||
+      max_len > SNMP_PACKET_MAX_LEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (max_len == packet_max_len) {
+    return 0;
+  }
+
+  /* Discard the cached buffers, as they are now the wrong size.  This is
+   * only done when (re)reading the configuration, when no packets are in use.
+   */
+  if (packet_buf_pool != NULL) {
+    destroy_pool(packet_buf_pool);
+    packet_buf_pool = NULL;
+  }
+
+  packet_free_bufs = NULL;
+  packet_max_len = max_len;
+
+  return 0;
+}
+
+size_t snmp_packet_get_max_len(void) {
+  return packet_max_len;
+}
+
 int snmp_packet_write(pool *p, int sockfd, struct snmp_packet *pkt) {
   int res;
   fd_set writefds;
@@ -63,6 +153,10 @@ int snmp_packet_write(pool *p, int sockfd, struct snmp_packet *pkt) {
     return -1; 
   }
 
+  if (pkt->transport != SNMP_PACKET_TRANSPORT_UDP) {
+    return snmp_stream_write(sockfd, pkt);
+  }
+
   FD_ZERO(&writefds);
   FD_SET(sockfd, &writefds);
 
@@ -128,12 +222,31 @@ int snmp_packet_write(pool *p, int sockfd, struct snmp_packet *pkt) {
         "dropping response due to select(2) failure: %s", strerror(errno));
     }
 
-    res = snmp_db_incr_value(pkt->pool, SNMP_DB_SNMP_F_PKTS_DROPPED_TOTAL, 1);
-    if (res < 0) {
-      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
-        "error incrementing snmp.packetsDroppedTotal: %s", strerror(errno));
-    }
+    (void) snmp_packet_incr_dropped(pkt->pool,
+      SNMP_DB_SNMP_F_PKTS_DROPPED_SEND_TOTAL);
+  }
+
+  return res;
+}
+
+int snmp_packet_incr_dropped(pool *p, int reason_field) {
+  int res, xerrno = 0;
+
+  res = snmp_db_incr_value(p, SNMP_DB_SNMP_F_PKTS_DROPPED_TOTAL, 1);
+  if (res < 0) {
+    xerrno = errno;
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error incrementing snmp.packetsDroppedTotal: %s", strerror(xerrno));
+  }
+
+  if (snmp_db_incr_value(p, reason_field, 1) < 0) {
+    xerrno = errno;
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error incrementing %s: %s", snmp_db_get_fieldstr(p, reason_field),
+      strerror(xerrno));
+    res = -1;
   }
 
+  errno = xerrno;
   return res;
 }
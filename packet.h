@@ -26,23 +26,48 @@
 
 #include "mod_snmp.h"
 #include "pdu.h"
+#include "usm.h"
+#include "view.h"
 
 #ifndef MOD_SNMP_PACKET_H
 #define MOD_SNMP_PACKET_H
 
-/* SNMP packets shouldn't be larger than 4K, right? */
-#define SNMP_PACKET_MAX_LEN		4096
+/* By default, SNMP packets shouldn't be larger than 4K.  Larger messages
+ * can be configured via SNMPMaxMessageSize, up to the largest UDP payload;
+ * the smallest message size which every SNMP entity must accept is 484
+ * bytes (RFC 3417).
+ */
+#define SNMP_PACKET_DEFAULT_LEN		4096
+#define SNMP_PACKET_MIN_LEN		484
+#define SNMP_PACKET_MAX_LEN		65507
+
+/* Transports */
+#define SNMP_PACKET_TRANSPORT_UDP	1
+#define SNMP_PACKET_TRANSPORT_TCP	2
+#define SNMP_PACKET_TRANSPORT_UNIX	3
 
 struct snmp_packet {
   pool *pool;
 
+  /* Transport on which the request was received, and the response is sent */
+  int transport;
+
+  /* Unix domain socket clients have no remote address. */
   pr_netaddr_t *remote_addr;
   pr_class_t *remote_class;
 
+  /* Describes the client on a connected transport, for logging. */
+  const char *remote_name;
+
   /* Request packet data */
   unsigned char *req_data;
   size_t req_datalen;
 
+  /* When the request was received; for UDP, as timestamped by the kernel
+   * where supported.
+   */
+  struct timeval recv_tv;
+
   /* SNMP protocol version */
   long snmp_version;
 
@@ -50,6 +75,14 @@ struct snmp_packet {
   char *community;
   unsigned int community_len;
 
+  /* SNMPv3 message header and USM security parameters */
+  struct snmp_usm_msg usm;
+
+  /* The MIB view of the community/user, once authenticated; NULL if the
+   * whole MIB is accessible.
+   */
+  const struct snmp_view *view;
+
   struct snmp_pdu *req_pdu;
 
   /* Response packet data */
@@ -57,9 +90,28 @@ struct snmp_packet {
   size_t resp_datalen;
 
   struct snmp_pdu *resp_pdu;
+
+  /* The cached buffers backing req_data/resp_data, returned for reuse when
+   * the packet pool is destroyed.
+   */
+  struct snmp_packet_buf *req_buf;
+  struct snmp_packet_buf *resp_buf;
 };
 
 struct snmp_packet *snmp_packet_create(pool *p);
+
+/* Sets/gets the size of the request/response buffers of the packets created
+ * by snmp_packet_create(), i.e. the maximum message size.  Changing the size
+ * discards any cached buffers.
+ */
+int snmp_packet_set_max_len(size_t max_len);
+size_t snmp_packet_get_max_len(void);
 int snmp_packet_write(pool *p, int sockfd, struct snmp_packet *pkt);
 
+/* Counts a dropped packet in snmp.packetsDroppedTotal, and in the counter
+ * (one of the SNMP_DB_SNMP_F_PKTS_DROPPED_*_TOTAL fields) for the reason it
+ * was dropped.
+ */
+int snmp_packet_incr_dropped(pool *p, int reason_field);
+
 #endif
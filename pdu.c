@@ -123,6 +123,50 @@ struct snmp_pdu *snmp_pdu_dup(pool *p, struct snmp_pdu *src_pdu) {
   return dst_pdu;
 }
 
+/* Writes the header of the variable bindings list, ahead of bindings which
+ * were already encoded in place.  The bindings should start exactly where
+ * the header ends (see snmp_msg_get_hdrlen()); if they start later, they
+ * are moved down.
+ */
+static int pdu_write_vars_data(pool *p, unsigned char **buf, size_t *buflen,
+    struct snmp_pdu *pdu) {
+  unsigned char asn1_type, *list_hdr_start;
+  size_t list_hdr_startlen;
+  int res;
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+
+  list_hdr_start = *buf;
+  list_hdr_startlen = *buflen;
+
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (*buf > pdu->vars_data ||
+      *buflen < pdu->vars_datalen) {
+    pr_trace_msg(trace_channel, 1,
+      "unable to write encoded variable bindings (%lu bytes): headers "
+      "overlap bindings", (unsigned long) pdu->vars_datalen);
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (*buf != pdu->vars_data) {
+    memmove(*buf, pdu->vars_data, pdu->vars_datalen);
+  }
+
+  (*buf) += pdu->vars_datalen;
+  (*buflen) -= pdu->vars_datalen;
+
+  pr_trace_msg(trace_channel, 18,
+    "updating variable bindings list header to have length %lu",
+    (unsigned long) pdu->vars_datalen);
+  return snmp_asn1_write_header(p, &list_hdr_start, &list_hdr_startlen,
+    asn1_type, (unsigned int) pdu->vars_datalen, 0);
+}
+
 /* Write this PDU into a buffer.
  *
  * RFC 1157: A Simple Network Management Protocol (SNMP)
@@ -387,7 +431,13 @@ int snmp_pdu_write(pool *p, unsigned char **buf, size_t *buflen,
       pr_trace_msg(trace_channel, 19,
         "writing PDU variable binding list: (%u %s)", pdu->varlistlen,
         pdu->varlistlen != 1 ? "variables" : "variable");
-      res = snmp_smi_write_vars(p, buf, buflen, pdu->varlist, snmp_version);
+      if (pdu->vars_data != NULL) {
+        res = pdu_write_vars_data(p, buf, buflen, pdu);
+
+      } else {
+        res = snmp_smi_write_vars(p, buf, buflen, pdu->varlist, snmp_version);
+      }
+
       if (res < 0) {
         return -1;
       }
@@ -98,6 +98,13 @@ struct snmp_pdu {
   struct snmp_var *varlist;
   unsigned int varlistlen;
 
+  /* For responses whose variable bindings were encoded directly into the
+   * message buffer, where the bindings list will be written; if set, this
+   * is used instead of the varlist.
+   */
+  unsigned char *vars_data;
+  size_t vars_datalen;
+
   /* For traps. */
   oid_t *trap_oid;
   unsigned int trap_oidlen;
@@ -0,0 +1,195 @@
+/*
+ * ProFTPD - mod_snmp rate gauges
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "db.h"
+#include "rate.h"
+
+/* The decay factors for the 1, 5, and 15 minute averages, i.e.
+ * exp(-SNMP_RATE_INTERVAL/60), exp(-SNMP_RATE_INTERVAL/300), and
+ * exp(-SNMP_RATE_INTERVAL/900), for an interval of 5 seconds.  These are
+ * precomputed, in the manner of the kernel's load averages, to avoid needing
+ * libm.
+ */
+#define SNMP_RATE_DECAY_1MIN		0.920044414629323
+#define SNMP_RATE_DECAY_5MIN		0.983471453821617
+#define SNMP_RATE_DECAY_15MIN		0.994459848001779
+
+struct snmp_rate {
+  /* The counter being sampled. */
+  unsigned int counter_field;
+
+  /* The 1, 5, and 15 minute gauges. */
+  unsigned int rate_fields[3];
+
+  uint32_t prev_count;
+  double avgs[3];
+};
+
+static struct snmp_rate snmp_rates[] = {
+  { SNMP_DB_DAEMON_F_CONN_TOTAL,
+    { SNMP_DB_RATE_F_CONN_RATE_1MIN, SNMP_DB_RATE_F_CONN_RATE_5MIN,
+      SNMP_DB_RATE_F_CONN_RATE_15MIN }, 0, { 0.0, 0.0, 0.0 } },
+
+  { SNMP_DB_FTP_LOGINS_F_TOTAL,
+    { SNMP_DB_RATE_F_FTP_LOGIN_RATE_1MIN, SNMP_DB_RATE_F_FTP_LOGIN_RATE_5MIN,
+      SNMP_DB_RATE_F_FTP_LOGIN_RATE_15MIN }, 0, { 0.0, 0.0, 0.0 } },
+
+  { SNMP_DB_FTP_XFERS_F_KB_UPLOAD_TOTAL,
+    { SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_1MIN,
+      SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_5MIN,
+      SNMP_DB_RATE_F_FTP_KB_UPLOAD_RATE_15MIN }, 0, { 0.0, 0.0, 0.0 } },
+
+  { SNMP_DB_FTP_XFERS_F_KB_DOWNLOAD_TOTAL,
+    { SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_1MIN,
+      SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_5MIN,
+      SNMP_DB_RATE_F_FTP_KB_DOWNLOAD_RATE_15MIN }, 0, { 0.0, 0.0, 0.0 } },
+
+  { 0, { 0, 0, 0 }, 0, { 0.0, 0.0, 0.0 } }
+};
+
+static const double snmp_rate_decays[3] = {
+  SNMP_RATE_DECAY_1MIN,
+  SNMP_RATE_DECAY_5MIN,
+  SNMP_RATE_DECAY_15MIN
+};
+
+static time_t snmp_rate_last_sample = 0;
+
+static const char *trace_channel = "snmp.rate";
+
+static int rate_get_count(pool *p, unsigned int field, uint32_t *count) {
+  int32_t int_value = 0;
+  char *str_value = NULL;
+  size_t str_valuelen = 0;
+
+  if (snmp_db_get_value(p, field, &int_value, &str_value,
+      &str_valuelen) < 0) {
+    return -1;
+  }
+
+  *count = (uint32_t) int_value;
+  return 0;
+}
+
+int snmp_rate_poll(pool *p) {
+  register unsigned int i;
+  pool *tmp_pool;
+  time_t now;
+  unsigned int nticks;
+
+  now = time(NULL);
+
+  if (snmp_rate_last_sample == 0) {
+    /* First sample; there is nothing to compare against yet. */
+    tmp_pool = make_sub_pool(p);
+
+    for (i = 0; snmp_rates[i].counter_field != 0; i++) {
+      if (rate_get_count(tmp_pool, snmp_rates[i].counter_field,
+          &(snmp_rates[i].prev_count)) < 0) {
+        pr_trace_msg(trace_channel, 3,
+          "error reading initial value for field %s: %s",
+          snmp_db_get_fieldstr(tmp_pool, snmp_rates[i].counter_field),
+          strerror(errno));
+      }
+    }
+
+    destroy_pool(tmp_pool);
+
+    snmp_rate_last_sample = now;
+    return 0;
+  }
+
+  if (now < snmp_rate_last_sample) {
+    /* The clock went backwards; start over from here. */
+    snmp_rate_last_sample = now;
+    return 0;
+  }
+
+  if (now - snmp_rate_last_sample < SNMP_RATE_INTERVAL) {
+    return 0;
+  }
+
+  /* If we were busy, more than one interval may have passed; the counter
+   * deltas are spread evenly across them.
+   */
+  nticks = (now - snmp_rate_last_sample) / SNMP_RATE_INTERVAL;
+  snmp_rate_last_sample += (nticks * SNMP_RATE_INTERVAL);
+
+  tmp_pool = make_sub_pool(p);
+
+  for (i = 0; snmp_rates[i].counter_field != 0; i++) {
+    register unsigned int j;
+    uint32_t count, delta;
+    double rate;
+
+    pr_signals_handle();
+
+    if (rate_get_count(tmp_pool, snmp_rates[i].counter_field, &count) < 0) {
+      pr_trace_msg(trace_channel, 3, "error reading value for field %s: %s",
+        snmp_db_get_fieldstr(tmp_pool, snmp_rates[i].counter_field),
+        strerror(errno));
+      continue;
+    }
+
+    if (count >= snmp_rates[i].prev_count) {
+      delta = count - snmp_rates[i].prev_count;
+
+    } else {
+      /* The counter was reset (e.g. SNMPOptions RestartClearsCounters). */
+      delta = count;
+    }
+
+    snmp_rates[i].prev_count = count;
+    rate = (double) delta / (double) (nticks * SNMP_RATE_INTERVAL);
+
+    for (j = 0; j < 3; j++) {
+      register unsigned int k;
+      double gauge;
+
+      for (k = 0; k < nticks; k++) {
+        snmp_rates[i].avgs[j] = (snmp_rates[i].avgs[j] * snmp_rate_decays[j]) +
+          (rate * (1.0 - snmp_rate_decays[j]));
+      }
+
+      /* The gauges are in hundredths of a unit per second, so that low
+       * rates (e.g. one login every few seconds) do not round to zero.
+       */
+      gauge = (snmp_rates[i].avgs[j] * 100.0) + 0.5;
+      if (gauge > (double) INT_MAX) {
+        gauge = (double) INT_MAX;
+      }
+
+      if (snmp_db_set_value(tmp_pool, snmp_rates[i].rate_fields[j],
+          (int32_t) gauge) < 0) {
+        pr_trace_msg(trace_channel, 3, "error setting value for field %s: %s",
+          snmp_db_get_fieldstr(tmp_pool, snmp_rates[i].rate_fields[j]),
+          strerror(errno));
+      }
+    }
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
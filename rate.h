@@ -0,0 +1,42 @@
+/*
+ * ProFTPD - mod_snmp rate gauges
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_RATE_H
+#define MOD_SNMP_RATE_H
+
+/* How often, in seconds, the sampled counters are folded into the moving
+ * averages.  This is also the longest the agent will block waiting for
+ * requests.
+ */
+#define SNMP_RATE_INTERVAL		5
+
+/* Sample the counters, and update the 1, 5, and 15 minute rate gauges, if
+ * at least SNMP_RATE_INTERVAL seconds have passed since the last sample.
+ * Called periodically by the agent process.
+ */
+int snmp_rate_poll(pool *p);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * ProFTPD - mod_snmp metric registry
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+#include "registry.h"
+
+/* Metrics registered by other modules are kept in a fixed array, and their
+ * values in the registered metrics table, one slot per counter or gauge, and
+ * one slot per bucket for histograms.  Slots are handed out in order of
+ * registration; since modules register their metrics in their init
+ * callbacks, that order is the same for every daemon started with the same
+ * modules, and so the values persist across restarts as the other tables'
+ * values do.
+ */
+
+static struct snmp_metric registry_metrics[SNMP_REGISTRY_MAX_METRICS];
+static unsigned int registry_nmetrics = 0;
+static unsigned int registry_nslots = 0;
+static int registry_locked = FALSE;
+
+static const char *trace_channel = "snmp.registry";
+
+struct snmp_metric *snmp_metric_register(unsigned int subtree,
+    unsigned int item, int metric_type, const char *name) {
+  register unsigned int i;
+  struct snmp_metric *metric;
+  unsigned int nslots;
+
+  if (subtree == 0 ||
+      item == 0 ||
+      name == NULL ||
+      *name == '\0' ||
+      strlen(name) >= SNMP_REGISTRY_NAMESZ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  switch (metric_type) {
+    case SNMP_METRIC_TYPE_COUNTER:
+    case SNMP_METRIC_TYPE_GAUGE:
+      nslots = 1;
+      break;
+
+    case SNMP_METRIC_TYPE_HISTOGRAM:
+      nslots = SNMP_DB_HIST_NBUCKETS;
+      break;
+
+    default:
+      errno = EINVAL;
+      return NULL;
+  }
+
+  for (i = 0; i < registry_nmetrics; i++) {
+    metric = &(registry_metrics[i]);
+
+    if (metric->subtree == subtree &&
+        metric->item == item) {
+      /* Modules are re-initialized on restart, so registering the same
+       * metric again simply returns the existing handle.
+       */
+      if (metric->metric_type != metric_type) {
+        pr_trace_msg(trace_channel, 3,
+          "metric %u.%u already registered as '%s', with a different type",
+          subtree, item, metric->name);
+        errno = EEXIST;
+        return NULL;
+      }
+
+      return metric;
+    }
+  }
+
+  if (registry_locked == TRUE) {
+    pr_trace_msg(trace_channel, 3,
+      "unable to register metric %u.%u ('%s') after startup", subtree, item,
+      name);
+    errno = EPERM;
+    return NULL;
+  }
+
+  if (registry_nmetrics == SNMP_REGISTRY_MAX_METRICS ||
+      registry_nslots + nslots > SNMP_DB_EXT_NSLOTS) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to register metric %u.%u ('%s'): too many metrics", subtree,
+      item, name);
+    errno = ENOSPC;
+    return NULL;
+  }
+
+  metric = &(registry_metrics[registry_nmetrics++]);
+  metric->subtree = subtree;
+  metric->item = item;
+  metric->metric_type = metric_type;
+  sstrncpy(metric->name, name, sizeof(metric->name));
+  metric->slot = registry_nslots;
+
+  registry_nslots += nslots;
+
+  pr_trace_msg(trace_channel, 9,
+    "registered metric %u.%u ('%s') using slots %u-%u", subtree, item, name,
+    metric->slot, registry_nslots - 1);
+  return metric;
+}
+
+int snmp_metric_incr(struct snmp_metric *metric, int32_t incr) {
+  if (metric == NULL ||
+      metric->metric_type == SNMP_METRIC_TYPE_HISTOGRAM) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Counters only go up. */
+  if (metric->metric_type == SNMP_METRIC_TYPE_COUNTER &&
+      incr < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return snmp_db_ext_incr(metric->slot, incr);
+}
+
+int snmp_metric_set(struct snmp_metric *metric, int32_t value) {
+  if (metric == NULL ||
+      metric->metric_type != SNMP_METRIC_TYPE_GAUGE ||
+      value < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return snmp_db_ext_set(metric->slot, value);
+}
+
+int snmp_metric_observe(struct snmp_metric *metric, uint64_t value) {
+  if (metric == NULL ||
+      metric->metric_type != SNMP_METRIC_TYPE_HISTOGRAM) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return snmp_db_ext_incr(metric->slot + snmp_db_hist_get_bucket(value), 1);
+}
+
+unsigned int snmp_registry_get_count(void) {
+  return registry_nmetrics;
+}
+
+struct snmp_metric *snmp_registry_get(unsigned int idx) {
+  if (idx >= registry_nmetrics) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return &(registry_metrics[idx]);
+}
+
+struct snmp_metric *snmp_registry_get_by_field(unsigned int field) {
+  register unsigned int i;
+  unsigned int slot;
+
+  if (field < SNMP_DB_EXT_F_BASE ||
+      field > SNMP_DB_EXT_F_MAX) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  slot = field - SNMP_DB_EXT_F_BASE;
+
+  for (i = 0; i < registry_nmetrics; i++) {
+    struct snmp_metric *metric;
+    unsigned int nslots;
+
+    metric = &(registry_metrics[i]);
+    nslots = (metric->metric_type == SNMP_METRIC_TYPE_HISTOGRAM ?
+      SNMP_DB_HIST_NBUCKETS : 1);
+
+    if (slot >= metric->slot &&
+        slot < metric->slot + nslots) {
+      return metric;
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+void snmp_registry_lock(int locked) {
+  registry_locked = locked;
+}
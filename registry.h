@@ -0,0 +1,69 @@
+/*
+ * ProFTPD - mod_snmp metric registry
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+#include "db.h"
+
+#ifndef MOD_SNMP_REGISTRY_H
+#define MOD_SNMP_REGISTRY_H
+
+/* The most metrics which can be registered, across all modules. */
+#define SNMP_REGISTRY_MAX_METRICS	256
+
+/* The longest metric name, including the terminating NUL, leaving room for
+ * the "ext." prefix in the table field directory.
+ */
+#define SNMP_REGISTRY_NAMESZ		32
+
+struct snmp_metric {
+  unsigned int subtree;
+  unsigned int item;
+  int metric_type;
+  char name[SNMP_REGISTRY_NAMESZ];
+
+  /* The first of the metric's slots in the registered metrics table. */
+  unsigned int slot;
+};
+
+/* Returns the number of registered metrics. */
+unsigned int snmp_registry_get_count(void);
+
+/* Returns the registered metric at the given index, in order of
+ * registration, or NULL if there is no such metric.
+ */
+struct snmp_metric *snmp_registry_get(unsigned int idx);
+
+/* Returns the registered metric using the given registered metrics table
+ * field, or NULL, with errno set to ENOENT, if no metric uses that field.
+ */
+struct snmp_metric *snmp_registry_get_by_field(unsigned int field);
+
+/* Once locked, no more metrics can be registered; the MIB table and the
+ * shared tables are built from the registered metrics, and so cannot change
+ * until the next restart.
+ */
+void snmp_registry_lock(int locked);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * ProFTPD - mod_snmp response replay cache
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+#include "replay.h"
+#include "hash.h"
+
+/* When a response is slow, the manager retransmits the request, with the
+ * same request ID.  Rather than doing all of the work again, the agent
+ * sends the response it already made.  The recent responses are kept in a
+ * small ring, keyed by a hash of the source address/port and the request
+ * bytes; the request bytes (which include the community and request ID)
+ * are compared in full on a hash match.
+ */
+
+struct snmp_replay_entry {
+  pool *pool;
+  uint32_t hash;
+  time_t added;
+
+  const pr_netaddr_t *addr;
+
+  unsigned char *req_data;
+  size_t req_datalen;
+
+  unsigned char *resp_data;
+  size_t resp_datalen;
+};
+
+static pool *replay_pool = NULL;
+static struct snmp_replay_entry replay_cache[SNMP_REPLAY_CACHE_SIZE];
+static unsigned int replay_next = 0;
+
+static const char *trace_channel = "snmp.replay";
+
+/* Hashes the address, port, and request bytes. */
+static uint32_t replay_hash(const pr_netaddr_t *addr,
+    const unsigned char *req_data, size_t req_datalen) {
+  struct snmp_addr_key key;
+  unsigned char port[2];
+  unsigned int port_val;
+  uint32_t h = SNMP_HASH_INIT;
+
+  /* An address without usable bytes leaves the hash as it was. */
+  (void) snmp_addr_key_init(&key, addr, &h);
+
+  port_val = pr_netaddr_get_port(addr);
+  port[0] = port_val & 0xff;
+  port[1] = (port_val >> 8) & 0xff;
+  h = snmp_hash_bytes(h, port, sizeof(port));
+
+  return snmp_hash_bytes(h, req_data, req_datalen);
+}
+
+int snmp_replay_get(const pr_netaddr_t *addr, const unsigned char *req_data,
+    size_t req_datalen, const unsigned char **resp_data,
+    size_t *resp_datalen) {
+  register unsigned int i;
+  uint32_t h;
+  time_t now;
+
+  if (addr == NULL ||
+      req_data == NULL ||
+      resp_data == NULL ||
+      resp_datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  h = replay_hash(addr, req_data, req_datalen);
+  now = time(NULL);
+
+  for (i = 0; i < SNMP_REPLAY_CACHE_SIZE; i++) {
+    struct snmp_replay_entry *entry;
+
+    entry = &(replay_cache[i]);
+    if (entry->pool == NULL ||
+        entry->hash != h ||
+        entry->req_datalen != req_datalen) {
+      continue;
+    }
+
+    if (now - entry->added > SNMP_REPLAY_CACHE_TTL ||
+        now < entry->added) {
+      continue;
+    }
+
+    if (memcmp(entry->req_data, req_data, req_datalen) != 0 ||
+        pr_netaddr_cmp(entry->addr, addr) != 0 ||
+        pr_netaddr_get_port(entry->addr) != pr_netaddr_get_port(addr)) {
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 15,
+      "found %lu-byte response for retransmitted request from %s#%u",
+      (unsigned long) entry->resp_datalen, pr_netaddr_get_ipstr(addr),
+      ntohs(pr_netaddr_get_port(addr)));
+
+    *resp_data = entry->resp_data;
+    *resp_datalen = entry->resp_datalen;
+    return 0;
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+int snmp_replay_add(const pr_netaddr_t *addr, const unsigned char *req_data,
+    size_t req_datalen, const unsigned char *resp_data, size_t resp_datalen) {
+  struct snmp_replay_entry *entry;
+
+  if (addr == NULL ||
+      req_data == NULL ||
+      resp_data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (replay_pool == NULL) {
+    replay_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(replay_pool, MOD_SNMP_VERSION ": Replay Pool");
+  }
+
+  entry = &(replay_cache[replay_next]);
+  replay_next = (replay_next + 1) % SNMP_REPLAY_CACHE_SIZE;
+
+  if (entry->pool != NULL) {
+    destroy_pool(entry->pool);
+  }
+
+  entry->pool = make_sub_pool(replay_pool);
+  pr_pool_tag(entry->pool, MOD_SNMP_VERSION ": Replay Entry Pool");
+
+  entry->hash = replay_hash(addr, req_data, req_datalen);
+  entry->added = time(NULL);
+  entry->addr = pr_netaddr_dup(entry->pool, addr);
+
+  entry->req_data = palloc(entry->pool, req_datalen);
+  memcpy(entry->req_data, req_data, req_datalen);
+  entry->req_datalen = req_datalen;
+
+  entry->resp_data = palloc(entry->pool, resp_datalen);
+  memcpy(entry->resp_data, resp_data, resp_datalen);
+  entry->resp_datalen = resp_datalen;
+
+  return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * ProFTPD - mod_snmp response replay cache
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+
+#ifndef MOD_SNMP_REPLAY_H
+#define MOD_SNMP_REPLAY_H
+
+/* Number of recent responses kept */
+#define SNMP_REPLAY_CACHE_SIZE		32
+
+/* How long, in seconds, a response may be replayed.  Managers retransmit
+ * within a few seconds; a later request with the same bytes is more likely
+ * a new request from a manager which reuses its request IDs.
+ */
+#define SNMP_REPLAY_CACHE_TTL		5
+
+/* Looks up the response sent for an identical request (i.e. with the same
+ * community/user, request ID, and variables) from the same address and
+ * port, within the last SNMP_REPLAY_CACHE_TTL seconds.  Returns -1, with
+ * errno set to ENOENT, if there is none.
+ */
+int snmp_replay_get(const pr_netaddr_t *addr, const unsigned char *req_data,
+  size_t req_datalen, const unsigned char **resp_data, size_t *resp_datalen);
+
+/* Keeps a copy of the response to the given request, replacing the oldest
+ * kept response.
+ */
+int snmp_replay_add(const pr_netaddr_t *addr, const unsigned char *req_data,
+  size_t req_datalen, const unsigned char *resp_data, size_t resp_datalen);
+
+#endif
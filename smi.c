@@ -687,6 +687,180 @@ int snmp_smi_write_vars(pool *p, unsigned char **buf, size_t *buflen,
   return 0;
 }
 
+unsigned int snmp_smi_get_var_len(struct snmp_var *var, int snmp_version) {
+  unsigned int var_len;
+
+  /* The variable header is written before its length is known. */
+  var_len = snmp_asn1_get_header_len(0, 0);
+  var_len += snmp_asn1_get_oid_len(var->name, var->namelen);
+
+  switch (var->smi_type) {
+    case SNMP_SMI_INTEGER:
+      var_len += snmp_asn1_get_int_len(*((long *) var->value.integer));
+      break;
+
+    case SNMP_SMI_COUNTER32:
+    case SNMP_SMI_GAUGE32:
+    case SNMP_SMI_TIMETICKS:
+      var_len += snmp_asn1_get_uint_len(
+        *((unsigned long *) var->value.integer));
+      break;
+
+    case SNMP_SMI_STRING:
+    case SNMP_SMI_IPADDR:
+    case SNMP_SMI_OPAQUE:
+      var_len += snmp_asn1_get_string_len(var->valuelen);
+      break;
+
+    case SNMP_SMI_OID:
+      var_len += snmp_asn1_get_oid_len(var->value.oid, var->valuelen);
+      break;
+
+    case SNMP_SMI_NO_SUCH_OBJECT:
+    case SNMP_SMI_NO_SUCH_INSTANCE:
+    case SNMP_SMI_END_OF_MIB_VIEW:
+    case SNMP_SMI_NULL:
+      /* Exceptions are encoded as NULLs for SNMPv1, and as empty tags
+       * otherwise; both take the same number of bytes.
+       */
+      var_len += snmp_asn1_get_null_len();
+      break;
+
+    default:
+      return 0;
+  }
+
+  return var_len;
+}
+
+int snmp_smi_write_value(pool *p, unsigned char **buf, size_t *buflen,
+    const unsigned char *ber_name, unsigned int ber_namelen,
+    unsigned char smi_type, int32_t int_value, char *str_value,
+    size_t str_valuelen, int snmp_version) {
+  unsigned char asn1_type, *var_hdr_start, *var_hdr_end;
+  size_t var_hdr_startlen;
+  int res;
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+
+  var_hdr_start = *buf;
+  var_hdr_startlen = *buflen;
+
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  var_hdr_end = *buf;
+
+  if (*buflen < ber_namelen) {
+    pr_trace_msg(trace_channel, 3,
+      "unable to write OID (%u bytes): buffer too small (%lu bytes)",
+      ber_namelen, (unsigned long) *buflen);
+    errno = EINVAL;
+    return -1;
+  }
+
+  memmove(*buf, ber_name, ber_namelen);
+  (*buf) += ber_namelen;
+  (*buflen) -= ber_namelen;
+
+  /* Integer values are widened as snmp_smi_create_int() would store them. */
+  switch (smi_type) {
+    case SNMP_SMI_INTEGER:
+      res = snmp_asn1_write_int(p, buf, buflen, smi_type, (long) int_value, 0);
+      break;
+
+    case SNMP_SMI_COUNTER32:
+    case SNMP_SMI_GAUGE32:
+    case SNMP_SMI_TIMETICKS:
+      res = snmp_asn1_write_uint(p, buf, buflen, smi_type,
+        (unsigned long) ((long) int_value));
+      break;
+
+    case SNMP_SMI_STRING:
+    case SNMP_SMI_IPADDR:
+    case SNMP_SMI_OPAQUE:
+      if (str_value == NULL) {
+        errno = EINVAL;
+        return -1;
+      }
+
+      res = snmp_asn1_write_string(p, buf, buflen, smi_type, str_value,
+        str_valuelen);
+      break;
+
+    case SNMP_SMI_NO_SUCH_OBJECT:
+    case SNMP_SMI_NO_SUCH_INSTANCE:
+    case SNMP_SMI_END_OF_MIB_VIEW:
+      if (snmp_version == SNMP_PROTOCOL_VERSION_1) {
+        /* SNMPv1 does not support the other error codes. */
+        res = snmp_asn1_write_null(p, buf, buflen, SNMP_SMI_NO_SUCH_OBJECT);
+
+      } else {
+        res = snmp_asn1_write_exception(p, buf, buflen, smi_type, 0);
+      }
+
+      break;
+
+    case SNMP_SMI_NULL:
+      res = snmp_asn1_write_null(p, buf, buflen, smi_type);
+      break;
+
+    default:
+      pr_trace_msg(trace_channel, 1,
+        "unable to encode unsupported SMI variable type %s",
+        snmp_smi_get_varstr(p, smi_type));
+      errno = ENOSYS;
+      return -1;
+  }
+
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  return snmp_asn1_write_header(p, &var_hdr_start, &var_hdr_startlen,
+    asn1_type, (unsigned int) (*buf - var_hdr_end), 0);
+}
+
+unsigned int snmp_smi_get_value_len(unsigned int ber_namelen,
+    unsigned char smi_type, int32_t int_value, size_t str_valuelen) {
+  unsigned int var_len;
+
+  var_len = snmp_asn1_get_header_len(0, 0) + ber_namelen;
+
+  switch (smi_type) {
+    case SNMP_SMI_INTEGER:
+      var_len += snmp_asn1_get_int_len((long) int_value);
+      break;
+
+    case SNMP_SMI_COUNTER32:
+    case SNMP_SMI_GAUGE32:
+    case SNMP_SMI_TIMETICKS:
+      var_len += snmp_asn1_get_uint_len((unsigned long) ((long) int_value));
+      break;
+
+    case SNMP_SMI_STRING:
+    case SNMP_SMI_IPADDR:
+    case SNMP_SMI_OPAQUE:
+      var_len += snmp_asn1_get_string_len((unsigned int) str_valuelen);
+      break;
+
+    case SNMP_SMI_NO_SUCH_OBJECT:
+    case SNMP_SMI_NO_SUCH_INSTANCE:
+    case SNMP_SMI_END_OF_MIB_VIEW:
+    case SNMP_SMI_NULL:
+      var_len += snmp_asn1_get_null_len();
+      break;
+
+    default:
+      return 0;
+  }
+
+  return var_len;
+}
+
 unsigned int snmp_smi_util_add_list_var(struct snmp_var **head,
     struct snmp_var **tail, struct snmp_var *var) {
   unsigned int count = 0;
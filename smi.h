@@ -109,6 +109,27 @@ int snmp_smi_read_vars(pool *p, unsigned char **buf, size_t *buflen,
 int snmp_smi_write_vars(pool *p, unsigned char **buf, size_t *buflen,
     struct snmp_var *varlist, int snmp_version);
 
+/* Returns the number of bytes which snmp_smi_write_vars() would write for
+ * the given variable binding (not including the list header), or zero if
+ * the variable cannot be encoded.
+ */
+unsigned int snmp_smi_get_var_len(struct snmp_var *var, int snmp_version);
+
+/* Writes a single variable binding, for the given pre-encoded OID (e.g. a
+ * MIB's ber_oid) and value, without allocating a struct snmp_var.  The
+ * binding is encoded exactly as snmp_smi_write_vars() would encode it.
+ */
+int snmp_smi_write_value(pool *p, unsigned char **buf, size_t *buflen,
+    const unsigned char *ber_name, unsigned int ber_namelen,
+    unsigned char smi_type, int32_t int_value, char *str_value,
+    size_t str_valuelen, int snmp_version);
+
+/* Returns the number of bytes which snmp_smi_write_value() would write for
+ * the given binding, or zero if the type cannot be encoded.
+ */
+unsigned int snmp_smi_get_value_len(unsigned int ber_namelen,
+  unsigned char smi_type, int32_t int_value, size_t str_valuelen);
+
 unsigned int snmp_smi_util_add_list_var(struct snmp_var **head,
   struct snmp_var **tail, struct snmp_var *var);
 
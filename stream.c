@@ -0,0 +1,806 @@
+/*
+ * ProFTPD - mod_snmp stream transports
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "asn1.h"
+#include "db.h"
+#include "packet.h"
+#include "stream.h"
+
+/* RFC 3430 carries SNMP messages over TCP without any additional framing;
+ * each message is a single BER-encoded SEQUENCE, whose length is given in
+ * its header.  Each connection thus buffers the data read until it holds a
+ * complete message, which is then handed off to the agent.
+ *
+ * Local clients may also connect over a Unix domain SOCK_SEQPACKET socket.
+ * Those messages are framed the same way, so both kinds of connections
+ * share the code below; the only difference is how the peer is identified.
+ *
+ * Responses are queued on their connection, and written as the client reads
+ * them, so that a client which is slow to read (or which never reads) cannot
+ * block the agent.
+ */
+
+struct stream_conn {
+  pool *pool;
+  int fd;
+  int transport;
+  pr_netaddr_t *remote_addr;
+
+  /* For logging, e.g. "1.2.3.4#5678", or "pid 123, uid 456". */
+  const char *remote_name;
+
+  unsigned char *buf;
+  size_t bufsz, buflen;
+
+  /* The responses not yet written, i.e. outbuf[outstart..outbuflen); the
+   * first of them has had outsent bytes written so far.  Each response is
+   * written separately, as each must be its own record on a Unix socket.
+   */
+  unsigned char *outbuf;
+  size_t outbufsz, outstart, outbuflen, outsent;
+
+  time_t last_active;
+};
+
+static pool *stream_pool = NULL;
+static struct stream_conn stream_conns[SNMP_STREAM_MAX_CONNS];
+static unsigned int stream_nconns = 0;
+
+/* The listening Unix domain socket, and the UIDs, besides root and the
+ * agent's own UID, allowed to use it.
+ */
+static int stream_unix_fd = -1;
+static array_header *stream_unix_uids = NULL;
+
+static const char *trace_channel = "snmp.stream";
+
+/* Returns the total length of the message at the start of the buffer, zero
+ * if more data is needed to tell, or -1 if the data cannot be an SNMP
+ * message.
+ */
+static long stream_get_msglen(const unsigned char *buf, size_t buflen) {
+  register unsigned int i;
+  unsigned int nlen;
+  unsigned long len = 0;
+
+  if (buflen < 2) {
+    return 0;
+  }
+
+  if (buf[0] != (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT)) {
+    return -1;
+  }
+
+  if (!(buf[1] & SNMP_ASN1_LEN_LONG)) {
+    return 2 + buf[1];
+  }
+
+  /* Indefinite lengths are not allowed in SNMP messages. */
+  nlen = buf[1] & ~SNMP_ASN1_LEN_LONG;
+  if (nlen == 0 ||
+      nlen > 4) {
+    return -1;
+  }
+
+  if (buflen < 2 + nlen) {
+    return 0;
+  }
+
+  for (i = 0; i < nlen; i++) {
+    len = (len << 8) | buf[2 + i];
+  }
+
+  if (len > (unsigned long) SNMP_PACKET_MAX_LEN) {
+    return -1;
+  }
+
+  return (long) (2 + nlen + len);
+}
+
+static size_t stream_get_pending(struct stream_conn *conn) {
+  return conn->outbuflen - conn->outstart;
+}
+
+static void stream_close_conn(struct stream_conn *conn) {
+  pr_trace_msg(trace_channel, 9, "closing connection from %s (fd %d)",
+    conn->remote_name, conn->fd);
+
+  if (stream_get_pending(conn) > 0) {
+    size_t off;
+    unsigned int nmsgs = 0;
+
+    for (off = conn->outstart; off < conn->outbuflen;) {
+      long msglen;
+
+      msglen = stream_get_msglen(conn->outbuf + off, conn->outbuflen - off);
+      if (msglen <= 0) {
+        break;
+      }
+
+      (void) snmp_packet_incr_dropped(conn->pool,
+        SNMP_DB_SNMP_F_PKTS_DROPPED_SEND_TOTAL);
+      off += msglen;
+      nmsgs++;
+    }
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "dropping %u unsent %s for %s", nmsgs,
+      nmsgs != 1 ? "responses" : "response", conn->remote_name);
+  }
+
+  (void) close(conn->fd);
+  conn->fd = -1;
+
+  destroy_pool(conn->pool);
+  conn->pool = NULL;
+  conn->remote_addr = NULL;
+  conn->remote_name = NULL;
+  conn->buf = NULL;
+  conn->bufsz = conn->buflen = 0;
+  conn->outbuf = NULL;
+  conn->outbufsz = conn->outstart = conn->outbuflen = conn->outsent = 0;
+
+  stream_nconns--;
+}
+
+/* Writes as much of the queued responses as the client will take, without
+ * blocking.  Returns -1 on error, in which case the connection should be
+ * closed.
+ */
+static int stream_flush_conn(struct stream_conn *conn) {
+  while (stream_get_pending(conn) > 0) {
+    unsigned char *msg;
+    long msglen;
+    ssize_t res;
+
+    msg = conn->outbuf + conn->outstart;
+    msglen = stream_get_msglen(msg, stream_get_pending(conn));
+
+    res = write(conn->fd, msg + conn->outsent, msglen - conn->outsent);
+    if (res < 0) {
+      int xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (xerrno == EAGAIN ||
+          xerrno == EWOULDBLOCK) {
+        /* Wait for select(2) to say that the client has made room. */
+        pr_trace_msg(trace_channel, 15,
+          "%lu response bytes pending for %s",
+          (unsigned long) stream_get_pending(conn), conn->remote_name);
+        return 0;
+      }
+
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error sending %lu message bytes to %s: %s", (unsigned long) msglen,
+        conn->remote_name, strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
+
+    conn->outsent += res;
+    conn->last_active = time(NULL);
+
+    if (conn->outsent < (size_t) msglen) {
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 3, "sent %lu message bytes to %s",
+      (unsigned long) msglen, conn->remote_name);
+
+    if (snmp_db_incr_value(conn->pool, SNMP_DB_SNMP_F_PKTS_SENT_TOTAL,
+        1) < 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "error incrementing SNMP database for "
+        "snmp.packetsSentTotal: %s", strerror(errno));
+    }
+
+    conn->outstart += msglen;
+    conn->outsent = 0;
+  }
+
+  conn->outstart = conn->outbuflen = 0;
+  return 0;
+}
+
+/* Appends a response to the connection's queue, growing the queue as
+ * needed.
+ */
+static void stream_queue_msg(struct stream_conn *conn,
+    const unsigned char *msg, size_t msglen) {
+
+  if (conn->outbuflen + msglen > conn->outbufsz &&
+      conn->outstart > 0) {
+    /* Make room by discarding the responses already written. */
+    conn->outbuflen -= conn->outstart;
+    memmove(conn->outbuf, conn->outbuf + conn->outstart, conn->outbuflen);
+    conn->outstart = 0;
+  }
+
+  if (conn->outbuflen + msglen > conn->outbufsz) {
+    unsigned char *new_outbuf;
+    size_t new_outbufsz;
+
+    new_outbufsz = conn->outbufsz > 0 ? conn->outbufsz :
+      snmp_packet_get_max_len();
+    while (new_outbufsz < conn->outbuflen + msglen) {
+      new_outbufsz *= 2;
+    }
+
+    new_outbuf = palloc(conn->pool, new_outbufsz);
+    if (conn->outbuflen > 0) {
+      memcpy(new_outbuf, conn->outbuf, conn->outbuflen);
+    }
+
+    conn->outbuf = new_outbuf;
+    conn->outbufsz = new_outbufsz;
+  }
+
+  memcpy(conn->outbuf + conn->outbuflen, msg, msglen);
+  conn->outbuflen += msglen;
+}
+
+/* Handles every complete message in the buffer; the client may have sent
+ * several requests without waiting for the responses.  Once too many
+ * responses are waiting for the client to read them, the remaining requests
+ * are left in the buffer until it does.
+ */
+static int stream_handle_msgs(pool *p, struct stream_conn *conn,
+    snmp_stream_msg_cb cb) {
+
+  while (conn->buflen > 0) {
+    struct snmp_packet *pkt;
+    long msglen;
+    int res;
+
+    pr_signals_handle();
+
+    if (stream_get_pending(conn) >= SNMP_STREAM_MAX_PENDING) {
+      pr_trace_msg(trace_channel, 9,
+        "%lu response bytes pending for %s, deferring its requests",
+        (unsigned long) stream_get_pending(conn), conn->remote_name);
+      break;
+    }
+
+    msglen = stream_get_msglen(conn->buf, conn->buflen);
+    if (msglen < 0 ||
+        (size_t) msglen > conn->bufsz) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "%s message from %s, closing connection",
+        msglen < 0 ? "malformed" : "too large", conn->remote_name);
+      stream_close_conn(conn);
+
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (msglen == 0 ||
+        (size_t) msglen > conn->buflen) {
+      /* Wait for the rest of the message. */
+      break;
+    }
+
+    pkt = snmp_packet_create(p);
+    memcpy(pkt->req_data, conn->buf, msglen);
+    pkt->req_datalen = msglen;
+    pkt->remote_addr = conn->remote_addr;
+    pkt->remote_name = conn->remote_name;
+    pkt->transport = conn->transport;
+
+    /* The callback takes ownership of the packet. */
+    res = cb(conn->fd, pkt);
+
+    conn->buflen -= msglen;
+    if (conn->buflen > 0) {
+      memmove(conn->buf, conn->buf + msglen, conn->buflen);
+    }
+
+    if (res < 0) {
+      int xerrno = errno;
+
+      stream_close_conn(conn);
+
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int stream_read_conn(pool *p, struct stream_conn *conn,
+    snmp_stream_msg_cb cb) {
+  ssize_t nread;
+
+  nread = read(conn->fd, conn->buf + conn->buflen,
+    conn->bufsz - conn->buflen);
+  if (nread < 0) {
+    int xerrno = errno;
+
+    if (xerrno == EAGAIN ||
+        xerrno == EINTR) {
+      return 0;
+    }
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error reading from %s: %s", conn->remote_name, strerror(xerrno));
+    stream_close_conn(conn);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (nread == 0) {
+    if (conn->buflen > 0) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "connection from %s closed with partial message (%lu bytes) "
+        "pending", conn->remote_name, (unsigned long) conn->buflen);
+    }
+
+    stream_close_conn(conn);
+    return 0;
+  }
+
+  conn->buflen += nread;
+  conn->last_active = time(NULL);
+
+  pr_trace_msg(trace_channel, 3, "read %ld bytes from %s", (long) nread,
+    conn->remote_name);
+
+  return stream_handle_msgs(p, conn, cb);
+}
+
+static void stream_init(pool *p) {
+  register unsigned int i;
+
+  if (stream_pool != NULL) {
+    return;
+  }
+
+  stream_pool = make_sub_pool(p);
+  pr_pool_tag(stream_pool, "SNMP stream pool");
+
+  for (i = 0; i < SNMP_STREAM_MAX_CONNS; i++) {
+    stream_conns[i].fd = -1;
+  }
+}
+
+static void stream_set_nonblock(int fd) {
+  int flags;
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags >= 0) {
+    (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+  }
+}
+
+/* Checks the credentials of the process on the other end of a Unix domain
+ * socket connection, filling in the name used for logging.  Returns -1 if
+ * the peer is not allowed to use the agent.
+ */
+static int stream_check_unix_peer(pool *p, int fd, const char **name) {
+#if defined(SO_PEERCRED)
+  register unsigned int i;
+  struct ucred cred;
+  socklen_t credlen;
+  uid_t *uids;
+  char peer_str[64];
+
+  credlen = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) < 0) {
+    int xerrno = errno;
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to get Unix socket peer credentials: %s", strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(peer_str, '\0', sizeof(peer_str));
+  snprintf(peer_str, sizeof(peer_str)-1, "pid %lu, uid %lu",
+    (unsigned long) cred.pid, (unsigned long) cred.uid);
+  *name = pstrdup(p, peer_str);
+
+  if (cred.uid == 0 ||
+      cred.uid == geteuid()) {
+    return 0;
+  }
+
+  if (stream_unix_uids != NULL) {
+    uids = stream_unix_uids->elts;
+    for (i = 0; i < stream_unix_uids->nelts; i++) {
+      if (uids[i] == cred.uid) {
+        return 0;
+      }
+    }
+  }
+
+  errno = EACCES;
+  return -1;
+#else
+  /* Without peer credentials, access is controlled solely by the socket
+   * file's permissions.
+   */
+  *name = "Unix socket peer";
+  return 0;
+#endif /* SO_PEERCRED */
+}
+
+int snmp_stream_listen(pool *p, const pr_netaddr_t *addr) {
+  int fd, on = 1, xerrno;
+
+  fd = socket(pr_netaddr_get_family(addr), SOCK_STREAM, snmp_proto_tcp);
+  if (fd < 0) {
+    return -1;
+  }
+
+  (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if (bind(fd, pr_netaddr_get_sockaddr(addr),
+      pr_netaddr_get_sockaddr_len(addr)) < 0) {
+    xerrno = errno;
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to bind TCP socket to %s#%u: %s", pr_netaddr_get_ipstr(addr),
+      ntohs(pr_netaddr_get_port(addr)), strerror(xerrno));
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (listen(fd, 5) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Make sure that accept(2) never blocks the agent, e.g. should the client
+   * go away between select(2) and accept(2).
+   */
+  stream_set_nonblock(fd);
+  stream_init(p);
+
+  return fd;
+}
+
+int snmp_stream_listen_unix(pool *p, const char *path, array_header *uids) {
+  struct sockaddr_un sock;
+  int fd, xerrno;
+  mode_t mode, prev_mask;
+
+  if (strlen(path) >= sizeof(sock.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset(&sock, 0, sizeof(sock));
+  sock.sun_family = AF_UNIX;
+  sstrncpy(sock.sun_path, path, sizeof(sock.sun_path));
+
+  /* Remove any socket left behind by a previous agent. */
+  (void) unlink(path);
+
+  /* Only root (and the agent) may connect, unless other users have been
+   * allowed; those users are still checked via their peer credentials.
+   * Create the socket with the restrictive mode, so that there is no window
+   * in which others could connect.
+   */
+  mode = (uids != NULL && uids->nelts > 0) ? 0666 : 0600;
+
+  prev_mask = umask(0177);
+  if (bind(fd, (struct sockaddr *) &sock, sizeof(sock)) < 0) {
+    xerrno = errno;
+    (void) umask(prev_mask);
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to bind Unix socket to '%s': %s", path, strerror(xerrno));
+
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+  (void) umask(prev_mask);
+
+  if (chmod(path, mode) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to set perms %04o on '%s': %s", (unsigned int) mode, path,
+      strerror(errno));
+  }
+
+  if (listen(fd, 5) < 0) {
+    xerrno = errno;
+
+    (void) close(fd);
+    (void) unlink(path);
+    errno = xerrno;
+    return -1;
+  }
+
+  stream_set_nonblock(fd);
+  stream_init(p);
+
+  stream_unix_fd = fd;
+  stream_unix_uids = uids;
+
+  return fd;
+}
+
+int snmp_stream_accept(pool *p, int listen_fd) {
+  register unsigned int i;
+  struct sockaddr_storage from_sockaddr;
+  socklen_t from_sockaddrlen;
+  pr_netaddr_t from_addr;
+  struct stream_conn *conn = NULL;
+  const char *remote_name = NULL;
+  char port_str[32];
+  int fd, transport;
+
+  from_sockaddrlen = sizeof(from_sockaddr);
+  fd = accept(listen_fd, (struct sockaddr *) &from_sockaddr,
+    &from_sockaddrlen);
+  if (fd < 0) {
+    if (errno == EAGAIN ||
+        errno == EINTR ||
+        errno == ECONNABORTED) {
+      return 0;
+    }
+
+    return -1;
+  }
+
+  if (listen_fd == stream_unix_fd) {
+    transport = SNMP_PACKET_TRANSPORT_UNIX;
+
+    if (stream_check_unix_peer(p, fd, &remote_name) < 0) {
+      int xerrno = errno;
+
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "refusing Unix socket connection from %s: %s",
+        remote_name ? remote_name : "unknown peer", strerror(xerrno));
+
+      (void) close(fd);
+      errno = xerrno;
+      return -1;
+    }
+
+  } else {
+    transport = SNMP_PACKET_TRANSPORT_TCP;
+
+    pr_netaddr_clear(&from_addr);
+    pr_netaddr_set_family(&from_addr, from_sockaddr.ss_family);
+    pr_netaddr_set_sockaddr(&from_addr, (struct sockaddr *) &from_sockaddr);
+
+    memset(port_str, '\0', sizeof(port_str));
+    snprintf(port_str, sizeof(port_str)-1, "%u",
+      ntohs(pr_netaddr_get_port(&from_addr)));
+    remote_name = pstrcat(p, pr_netaddr_get_ipstr(&from_addr), "#", port_str,
+      NULL);
+  }
+
+  for (i = 0; i < SNMP_STREAM_MAX_CONNS; i++) {
+    if (stream_conns[i].fd < 0) {
+      conn = &(stream_conns[i]);
+      break;
+    }
+  }
+
+  if (conn == NULL ||
+      fd >= FD_SETSIZE) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "too many open connections (%u), refusing connection from %s",
+      stream_nconns, remote_name);
+
+    (void) close(fd);
+    errno = EMFILE;
+    return -1;
+  }
+
+  /* The agent must never block on a client; reads are only done once
+   * select(2) says there is data, and responses which the client is not
+   * ready for are queued, and written once select(2) says there is room.
+   */
+  stream_set_nonblock(fd);
+
+  conn->pool = make_sub_pool(stream_pool);
+  pr_pool_tag(conn->pool, "SNMP stream connection pool");
+
+  conn->fd = fd;
+  conn->transport = transport;
+  conn->remote_addr = NULL;
+  if (transport == SNMP_PACKET_TRANSPORT_TCP) {
+    conn->remote_addr = pr_netaddr_dup(conn->pool, &from_addr);
+  }
+  conn->remote_name = pstrdup(conn->pool, remote_name);
+  conn->bufsz = snmp_packet_get_max_len();
+  conn->buf = palloc(conn->pool, conn->bufsz);
+  conn->buflen = 0;
+  conn->outbuf = NULL;
+  conn->outbufsz = conn->outstart = conn->outbuflen = conn->outsent = 0;
+  conn->last_active = time(NULL);
+
+  stream_nconns++;
+
+  (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+    "accepted %s connection from %s",
+    transport == SNMP_PACKET_TRANSPORT_UNIX ? "Unix socket" : "TCP",
+    conn->remote_name);
+
+  return 0;
+}
+
+int snmp_stream_set_fds(fd_set *readfds, fd_set *writefds, int maxfd) {
+  register unsigned int i;
+
+  for (i = 0; i < SNMP_STREAM_MAX_CONNS; i++) {
+    struct stream_conn *conn;
+    size_t pending;
+
+    conn = &(stream_conns[i]);
+    if (conn->fd < 0) {
+      continue;
+    }
+
+    /* Stop reading requests from a client which is not reading the
+     * responses, until it catches up.
+     */
+    pending = stream_get_pending(conn);
+    if (pending < SNMP_STREAM_MAX_PENDING) {
+      FD_SET(conn->fd, readfds);
+    }
+
+    if (pending > 0) {
+      FD_SET(conn->fd, writefds);
+    }
+
+    if (conn->fd > maxfd) {
+      maxfd = conn->fd;
+    }
+  }
+
+  return maxfd;
+}
+
+int snmp_stream_handle(pool *p, fd_set *readfds, fd_set *writefds,
+    snmp_stream_msg_cb cb) {
+  register unsigned int i;
+
+  for (i = 0; i < SNMP_STREAM_MAX_CONNS; i++) {
+    struct stream_conn *conn;
+
+    conn = &(stream_conns[i]);
+    if (conn->fd >= 0 &&
+        FD_ISSET(conn->fd, writefds)) {
+      if (stream_flush_conn(conn) < 0) {
+        stream_close_conn(conn);
+        continue;
+      }
+
+      /* Now that the client has caught up, handle any requests deferred
+       * while it had too many responses pending.
+       */
+      if (stream_handle_msgs(p, conn, cb) < 0) {
+        continue;
+      }
+    }
+
+    if (conn->fd < 0 ||
+        !FD_ISSET(conn->fd, readfds)) {
+      continue;
+    }
+
+    /* Errors are logged, and the connection closed, by stream_read_conn(). */
+    (void) stream_read_conn(p, conn, cb);
+  }
+
+  return 0;
+}
+
+int snmp_stream_write(int sockfd, struct snmp_packet *pkt) {
+  register unsigned int i;
+  struct stream_conn *conn = NULL;
+
+  for (i = 0; i < SNMP_STREAM_MAX_CONNS; i++) {
+    if (stream_conns[i].fd == sockfd) {
+      conn = &(stream_conns[i]);
+      break;
+    }
+  }
+
+  if (conn == NULL) {
+    errno = EBADF;
+    return -1;
+  }
+
+  /* The queue relies on each response's BER header for its length. */
+  if (stream_get_msglen(pkt->resp_data, pkt->resp_datalen) !=
+      (long) pkt->resp_datalen) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  stream_queue_msg(conn, pkt->resp_data, pkt->resp_datalen);
+
+  /* If nothing else was waiting, the response can usually be written
+   * straight away.
+   */
+  if (stream_get_pending(conn) == pkt->resp_datalen) {
+    if (stream_flush_conn(conn) < 0) {
+      int xerrno = errno;
+
+      (void) snmp_packet_incr_dropped(pkt->pool,
+        SNMP_DB_SNMP_F_PKTS_DROPPED_SEND_TOTAL);
+
+      /* Discard the queue, so that its responses are not counted as
+       * dropped again when the connection is closed.
+       */
+      conn->outstart = conn->outbuflen = conn->outsent = 0;
+
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void snmp_stream_expire(void) {
+  register unsigned int i;
+  time_t now;
+
+  if (stream_nconns == 0) {
+    return;
+  }
+
+  now = time(NULL);
+
+  for (i = 0; i < SNMP_STREAM_MAX_CONNS; i++) {
+    struct stream_conn *conn;
+
+    conn = &(stream_conns[i]);
+    if (conn->fd < 0) {
+      continue;
+    }
+
+    if (now - conn->last_active > SNMP_STREAM_IDLE_TIMEOUT) {
+      (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+        "closing connection from %s after %d secs idle", conn->remote_name,
+        SNMP_STREAM_IDLE_TIMEOUT);
+      stream_close_conn(conn);
+    }
+  }
+}
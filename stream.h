@@ -0,0 +1,86 @@
+/*
+ * ProFTPD - mod_snmp stream transports
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "packet.h"
+
+#ifndef MOD_SNMP_STREAM_H
+#define MOD_SNMP_STREAM_H
+
+/* The most connections the agent will keep open at once. */
+#define SNMP_STREAM_MAX_CONNS			32
+
+/* How long, in seconds, an idle connection is kept open. */
+#define SNMP_STREAM_IDLE_TIMEOUT		300
+
+/* How many response bytes may be waiting for a client to read them, before
+ * no more of its requests are read (or handled) until it does.
+ */
+#define SNMP_STREAM_MAX_PENDING			(64 * 1024)
+
+/* Handles a single request message read from a connection.  The packet's
+ * req_data holds exactly one BER-encoded SNMP message; any response should
+ * be written to the given socket.  Returning -1 closes the connection.
+ */
+typedef int (*snmp_stream_msg_cb)(int sockfd, struct snmp_packet *pkt);
+
+/* Creates a listening TCP socket for SNMP over TCP (RFC 3430).  Returns the
+ * listening socket, or -1 (with errno set) on error.
+ */
+int snmp_stream_listen(pool *p, const pr_netaddr_t *addr);
+
+/* Creates a listening Unix domain SOCK_SEQPACKET socket at the given path,
+ * for local clients.  Only root and the agent's own user may connect, plus
+ * any users whose UIDs (uid_t) are in the given array.  Returns the listening
+ * socket, or -1 (with errno set) on error.
+ */
+int snmp_stream_listen_unix(pool *p, const char *path, array_header *uids);
+
+/* Accepts a new connection on the given listening socket. */
+int snmp_stream_accept(pool *p, int listen_fd);
+
+/* Adds the sockets of the open connections to the given sets: to the read
+ * set, unless too many responses are pending, and to the write set, if any
+ * responses are pending.  Returns the highest socket, or maxfd if higher.
+ */
+int snmp_stream_set_fds(fd_set *readfds, fd_set *writefds, int maxfd);
+
+/* Writes pending responses to every connection whose socket is in the write
+ * set, and reads from every connection whose socket is in the read set,
+ * handing each complete message to the callback.  Requests may be pipelined;
+ * they are handled, and answered, in the order received.
+ */
+int snmp_stream_handle(pool *p, fd_set *readfds, fd_set *writefds,
+  snmp_stream_msg_cb cb);
+
+/* Sends the packet's response on the given connection, queueing whatever
+ * the client is not yet ready to read; the queue is written by
+ * snmp_stream_handle().
+ */
+int snmp_stream_write(int sockfd, struct snmp_packet *pkt);
+
+/* Closes any connections idle for longer than SNMP_STREAM_IDLE_TIMEOUT. */
+void snmp_stream_expire(void);
+
+#endif
@@ -68,6 +68,11 @@ my $TESTS = {
     test_class => [qw(forking snmp)],
   },
 
+  snmp_v1_get_daemon_conn_rates => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
   snmp_v1_get_daemon_restart_count => {
     order => ++$order,
     test_class => [qw(forking snmp)],
@@ -94,6 +99,86 @@ my $TESTS = {
     test_class => [qw(forking snmp)],
   },
 
+  snmp_v1_get_ftp_xfer_hist => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_ftp_cmd_stats => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_persistent_tables => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_metrics_scrape => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_acl_cache_counts => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_rate_limit => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_rxq_counts => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_replay => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_template => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_bulk_counter_table => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_next_counter_history => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_ftp_xfer_upload_in_flight => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_conn_count_session_killed => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_ftp_sess_count_no_login => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v1_get_pkts_dropped_too_big => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_bulk_request_deadline => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
   snmp_v1_get_multi => {
     order => ++$order,
     test_class => [qw(forking snmp)],
@@ -148,6 +233,11 @@ my $TESTS = {
     test_class => [qw(forking snmp)],
   },
 
+  snmp_v2_get_view => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
   snmp_v2_get_missing_instance_id => {
     order => ++$order,
     test_class => [qw(forking snmp)],
@@ -173,12 +263,40 @@ my $TESTS = {
     test_class => [qw(forking snmp)],
   },
 
+  snmp_v2_get_bulk_max_msg_size => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_bulk_config_max_msg_size => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_bulk_tcp => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v2_get_unix_socket => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
   snmp_v2_set_no_access => {
     order => ++$order,
     test_class => [qw(forking snmp)],
   },
 
-  # snmp_v3_XXX
+  snmp_v3_get_authpriv => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
+
+  snmp_v3_get_wrong_passwd => {
+    order => ++$order,
+    test_class => [qw(forking snmp)],
+  },
 
   snmp_config_limit => {
     order => ++$order,
@@ -289,6 +407,43 @@ sub get_conn_info {
   return ($conn_count, $conn_total);
 }
 
+sub get_pid_from_file {
+  my $pid_file = shift;
+
+  my $pid;
+  if (open(my $fh, "< $pid_file")) {
+    $pid = <$fh>;
+    chomp($pid);
+    close($fh);
+
+  } else {
+    die("Can't read $pid_file: $!");
+  }
+
+  return $pid;
+}
+
+sub get_child_pids {
+  my $ppid = shift;
+
+  my $pids = [];
+
+  foreach my $stat_file (glob('/proc/[0-9]*/stat')) {
+    if (open(my $fh, "< $stat_file")) {
+      my $stat = <$fh>;
+      close($fh);
+
+      # The command name may contain spaces, so skip past it first
+      if (defined($stat) &&
+          $stat =~ /^(\d+) \(.*\) \S+ (\d+) /) {
+        push(@$pids, $1) if $2 == $ppid;
+      }
+    }
+  }
+
+  return @$pids;
+}
+
 sub get_ftp_sess_info {
   my $agent_port = shift;
   my $snmp_community = shift;
@@ -434,6 +589,75 @@ sub get_ftp_xfer_upload_info {
   return ($file_count, $file_total, $kb_count);
 }
 
+sub get_ftp_xfer_hist_info {
+  my $agent_port = shift;
+  my $snmp_community = shift;
+
+  my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+    -hostname => '127.0.0.1',
+    -port => $agent_port,
+    -version => 'snmpv1',
+    -community => $snmp_community,
+    -retries => 1,
+    -timeout => 3,
+    -translate => 1,
+  );
+  unless ($snmp_sess) {
+    die("Unable to create Net::SNMP session: $snmp_err");
+  }
+
+  if ($ENV{TEST_VERBOSE}) {
+    # From the Net::SNMP debug perldocs
+    my $debug_mask = (0x02|0x10|0x20);
+    $snmp_sess->debug($debug_mask);
+  }
+
+  # xferHistUpperBound, for the size metric (2), bucket 4
+  my $upper_bound_oid = '1.3.6.1.4.1.17852.2.2.3.3.20.1.3.2.4';
+
+  # xferHistCount, for the size metric (2), bucket 4
+  my $count_oid = '1.3.6.1.4.1.17852.2.2.3.3.20.1.4.2.4';
+
+  my $oids = [
+    $upper_bound_oid,
+    $count_oid,
+  ];
+
+  my $snmp_resp = $snmp_sess->get_request(
+    -varbindList => $oids,
+  );
+  unless ($snmp_resp) {
+    die("No SNMP response received: " . $snmp_sess->error());
+  }
+
+  my ($upper_bound, $count);
+
+  # Do we have the requested OIDs in the response?
+
+  foreach my $oid (@$oids) {
+    unless (defined($snmp_resp->{$oid})) {
+      die("Missing required OID $oid in response");
+    }
+
+    my $value = $snmp_resp->{$oid};
+    if ($ENV{TEST_VERBOSE}) {
+      print STDERR "Requested OID $oid = $value\n";
+    }
+
+    if ($oid eq $upper_bound_oid) {
+      $upper_bound = $value;
+
+    } elsif ($oid eq $count_oid) {
+      $count = $value;
+    }
+  }
+
+  $snmp_sess->close();
+  $snmp_sess = undef;
+
+  return ($upper_bound, $count);
+}
+
 sub upload_file {
   my $port = shift;
   my $user = shift;
@@ -2113,7 +2337,7 @@ sub snmp_v1_get_daemon_conn_counts {
   unlink($log_file);
 }
 
-sub snmp_v1_get_daemon_restart_count {
+sub snmp_v1_get_daemon_conn_rates {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -2154,7 +2378,8 @@ sub snmp_v1_get_daemon_restart_count {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.6.0';
+  my $delay_nsecs = 45;
+  my $use_delay = 0;
 
   my $config = {
     TraceLog => $log_file,
@@ -2213,13 +2438,12 @@ sub snmp_v1_get_daemon_restart_count {
         die("Unable to create Net::SNMP session: $snmp_err");
       }
 
-      if ($ENV{TEST_VERBOSE}) {
-        # From the Net::SNMP debug perldocs
-        my $debug_mask = (0x02|0x10|0x20);
-        $snmp_sess->debug($debug_mask);
-      }
-
-      my $oids = [$request_oid];
+      # connectionRate1Min, connectionRate5Min, connectionRate15Min
+      my $oids = [
+        '1.3.6.1.4.1.17852.2.2.1.14.0',
+        '1.3.6.1.4.1.17852.2.2.1.15.0',
+        '1.3.6.1.4.1.17852.2.2.1.16.0',
+      ];
 
       my $snmp_resp = $snmp_sess->get_request(
         -varbindList => $oids,
@@ -2228,24 +2452,47 @@ sub snmp_v1_get_daemon_restart_count {
         die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      # Do we have the requested OID in the response?
-      unless (defined($snmp_resp->{$request_oid})) {
-        die("Missing required OID $request_oid in response");
-      }
+      foreach my $oid (@$oids) {
+        my $rate = $snmp_resp->{$oid};
+        unless (defined($rate)) {
+          die("Missing required OID $oid in response");
+        }
 
-      my $value = $snmp_resp->{$request_oid};
+        $self->assert($rate == 0,
+          test_msg("Expected rate 0 for OID $oid, got $rate"));
+      }
 
-      if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $request_oid = $value\n";
+      # Connect several times, then wait for the agent to sample the
+      # connection total at least once.
+      my $nconnects = 10;
+      for (my $i = 0; $i < $nconnects; $i++) {
+        my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+        $client->quit();
       }
 
-      my $expected = 0;
+      sleep(11);
 
-      $self->assert($expected == $value,
-        test_msg("Expected value $expected for OID, got $value"));
+      $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
 
       $snmp_sess->close();
       $snmp_sess = undef;
+
+      my ($rate_1min, $rate_5min, $rate_15min) = map { $snmp_resp->{$_} } @$oids;
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Connection rates: $rate_1min, $rate_5min, $rate_15min\n";
+      }
+
+      $self->assert($rate_1min > 0,
+        test_msg("Expected 1 minute rate greater than 0, got $rate_1min"));
+
+      # The shorter averages react to the burst faster than the longer ones.
+      $self->assert($rate_1min >= $rate_5min && $rate_5min >= $rate_15min,
+        test_msg("Expected decreasing rates, got $rate_1min, $rate_5min, $rate_15min"));
     };
 
     if ($@) {
@@ -2256,7 +2503,7 @@ sub snmp_v1_get_daemon_restart_count {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, $delay_nsecs + 10) };
     if ($@) {
       warn($@);
       exit 1;
@@ -2280,7 +2527,7 @@ sub snmp_v1_get_daemon_restart_count {
   unlink($log_file);
 }
 
-sub snmp_v1_get_daemon_segfault_count {
+sub snmp_v1_get_daemon_restart_count {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -2321,7 +2568,7 @@ sub snmp_v1_get_daemon_segfault_count {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.7.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.6.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -2447,7 +2694,7 @@ sub snmp_v1_get_daemon_segfault_count {
   unlink($log_file);
 }
 
-sub snmp_v1_get_daemon_maxinsts_count {
+sub snmp_v1_get_daemon_segfault_count {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -2488,7 +2735,7 @@ sub snmp_v1_get_daemon_maxinsts_count {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.8.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.7.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -2614,7 +2861,7 @@ sub snmp_v1_get_daemon_maxinsts_count {
   unlink($log_file);
 }
 
-sub snmp_v1_get_ftp_sess_counts {
+sub snmp_v1_get_daemon_maxinsts_count {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -2655,7 +2902,7 @@ sub snmp_v1_get_ftp_sess_counts {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $timeout_idle = 45;
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.8.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -2666,7 +2913,6 @@ sub snmp_v1_get_ftp_sess_counts {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
-    TimeoutIdle => $timeout_idle + 1,
 
     IfModules => {
       'mod_delay.c' => {
@@ -2702,24 +2948,192 @@ sub snmp_v1_get_ftp_sess_counts {
   defined(my $pid = fork()) or die("Can't fork: $!");
   if ($pid) {
     eval {
-      my $expected;
-
-      # First, get the session count
-      my ($sess_count, $sess_total) = get_ftp_sess_info($agent_port,
-        $snmp_community);
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
 
-      $expected = 0;
-      $self->assert($sess_count == $expected,
-        test_msg("Expected session count $expected, got $sess_count"));
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
 
-      $expected = 0;
-      $self->assert($sess_total == $expected,
-        test_msg("Expected session total $expected, got $sess_total"));
+      my $oids = [$request_oid];
 
-      # Now, login
-      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
 
-      # Get the session counts again.  We've only connected, not logged in,
+      # Do we have the requested OID in the response?
+      unless (defined($snmp_resp->{$request_oid})) {
+        die("Missing required OID $request_oid in response");
+      }
+
+      my $value = $snmp_resp->{$request_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $request_oid = $value\n";
+      }
+
+      my $expected = 0;
+
+      $self->assert($expected == $value,
+        test_msg("Expected value $expected for OID, got $value"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_ftp_sess_counts {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $expected;
+
+      # First, get the session count
+      my ($sess_count, $sess_total) = get_ftp_sess_info($agent_port,
+        $snmp_community);
+
+      $expected = 0;
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      $expected = 0;
+      $self->assert($sess_total == $expected,
+        test_msg("Expected session total $expected, got $sess_total"));
+
+      # Now, login
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+
+      # Get the session counts again.  We've only connected, not logged in,
       # so the session counts should not have changed.
       ($sess_count, $sess_total) = get_ftp_sess_info($agent_port, $snmp_community);
 
@@ -2737,30 +3151,4136 @@ sub snmp_v1_get_ftp_sess_counts {
       # Then, get the session counts again
       ($sess_count, $sess_total) = get_ftp_sess_info($agent_port, $snmp_community);
 
-      $expected = 1;
-      $self->assert($sess_count == $expected,
-        test_msg("Expected session count $expected, got $sess_count"));
+      $expected = 1;
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      $expected = 1;
+      $self->assert($sess_total == $expected,
+        test_msg("Expected session total $expected, got $sess_total"));
+
+      # Now log out
+      $client->quit();
+      $client = undef;
+
+      # And get the session counts one more time, make sure it's what we expect
+      ($sess_count, $sess_total) = get_ftp_sess_info($agent_port, $snmp_community);
+
+      # We MIGHT see a value of 1 here; I suspect it is leftover from the
+      # previous test (and in anonymous memory).  Tolerate it, for now.
+      $expected = 0;
+      $self->assert($sess_count == 0 || $sess_count == 1,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      $expected = 1;
+      $self->assert($sess_total == $expected,
+        test_msg("Expected session total $expected, got $sess_total"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_ftp_xfer_upload_counts {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $expected;
+
+      # First, get the upload count/KB
+      my ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port,
+        $snmp_community);
+
+      $expected = 0;
+      $self->assert($file_count == $expected,
+        test_msg("Expected upload file count $expected, got $file_count"));
+
+      $expected = 0;
+      $self->assert($file_total == $expected,
+        test_msg("Expected upload file total $expected, got $file_total"));
+
+      $expected = 0;
+      $self->assert($kb_count == $expected,
+        test_msg("Expected upload KB count $expected, got $kb_count"));
+
+      # Next, upload a file
+      my $file_path = 'test1.txt';
+      my $file_kb_len = 4;
+      upload_file($port, $user, $passwd, $file_path, $file_kb_len);
+
+      # Then, get the upload count/KB again
+      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
+
+      $expected = 0;
+      $self->assert($file_count == $expected,
+        test_msg("Expected upload file count $expected, got $file_count"));
+
+      $expected = 1;
+      $self->assert($file_total == $expected,
+        test_msg("Expected upload file total $expected, got $file_total"));
+
+      $expected = $file_kb_len;
+      $self->assert($kb_count == $expected,
+        test_msg("Expected upload KB count $expected, got $kb_count"));
+
+      # Upload another file
+      $file_path = 'test2.txt';
+      upload_file($port, $user, $passwd, $file_path, $file_kb_len);
+
+      # Get the upload count/KB one more time, make sure it's what we expect
+      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
+
+      $expected = 0;
+      $self->assert($file_count == $expected,
+        test_msg("Expected upload file count $expected, got $file_count"));
+
+      $expected = 2;
+      $self->assert($file_total == $expected,
+        test_msg("Expected upload file total $expected, got $file_total"));
+
+      $expected = ($file_kb_len * 2);
+      $self->assert($kb_count == $expected,
+        test_msg("Expected upload KB count $expected, got $kb_count"));
+
+      # Now wait for 5 secs, then try again (make sure the counters aren't
+      # reset somehow on the server's side).
+      sleep(5);
+
+      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
+
+      $expected = 0;
+      $self->assert($file_count == $expected,
+        test_msg("Expected upload file count $expected, got $file_count"));
+
+      $expected = 2;
+      $self->assert($file_total == $expected,
+        test_msg("Expected upload file total $expected, got $file_total"));
+
+      $expected = ($file_kb_len * 2);
+      $self->assert($kb_count == $expected,
+        test_msg("Expected upload KB count $expected, got $kb_count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_ftp_xfer_hist {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $expected;
+
+      my ($upper_bound, $count) = get_ftp_xfer_hist_info($agent_port,
+        $snmp_community);
+
+      # Bucket 4 covers sizes of more than 3 KB, up to 4 KB.
+      $expected = 4;
+      $self->assert($upper_bound == $expected,
+        test_msg("Expected upper bound $expected, got $upper_bound"));
+
+      $expected = 0;
+      $self->assert($count == $expected,
+        test_msg("Expected bucket count $expected, got $count"));
+
+      # Upload two files which should land in that bucket, and one which
+      # should not.
+      my $file_kb_len = 4;
+      upload_file($port, $user, $passwd, 'test1.txt', $file_kb_len);
+      upload_file($port, $user, $passwd, 'test2.txt', $file_kb_len);
+      upload_file($port, $user, $passwd, 'test3.txt', 16);
+
+      ($upper_bound, $count) = get_ftp_xfer_hist_info($agent_port,
+        $snmp_community);
+
+      $expected = 2;
+      $self->assert($count == $expected,
+        test_msg("Expected bucket count $expected, got $count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_ftp_cmd_stats {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPOptions => 'CommandStats',
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->cwd('.');
+      eval { $client->cwd('foo') };
+      $client->quit();
+
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      # ftp.commands.cmdName, cmdCount, and cmdErrorCount for CWD (index 9)
+      my $name_oid = '1.3.6.1.4.1.17852.2.2.3.6.1.1.2.9';
+      my $count_oid = '1.3.6.1.4.1.17852.2.2.3.6.1.1.3.9';
+      my $err_count_oid = '1.3.6.1.4.1.17852.2.2.3.6.1.1.4.9';
+
+      my $oids = [$name_oid, $count_oid, $err_count_oid];
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      foreach my $oid (@$oids) {
+        unless (defined($snmp_resp->{$oid})) {
+          die("Missing required OID $oid in response");
+        }
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $oid = $snmp_resp->{$oid}\n";
+        }
+      }
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+
+      my $expected = 'CWD';
+      my $name = $snmp_resp->{$name_oid};
+      $self->assert($name eq $expected,
+        test_msg("Expected command name '$expected', got '$name'"));
+
+      $expected = 2;
+      my $count = $snmp_resp->{$count_oid};
+      $self->assert($count == $expected,
+        test_msg("Expected command count $expected, got $count"));
+
+      $expected = 1;
+      my $err_count = $snmp_resp->{$err_count_oid};
+      $self->assert($err_count == $expected,
+        test_msg("Expected command error count $expected, got $err_count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_metrics_scrape {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+  my $metrics_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPMetrics => "127.0.0.1:$metrics_port",
+        SNMPOptions => 'CommandStats',
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->cwd('.');
+      eval { $client->cwd('foo') };
+      $client->quit();
+
+      my $sock = IO::Socket::INET->new(
+        PeerAddr => '127.0.0.1',
+        PeerPort => $metrics_port,
+        Proto => 'tcp',
+        Timeout => 3,
+      );
+      unless ($sock) {
+        die("Unable to connect to 127.0.0.1:$metrics_port: $!");
+      }
+
+      $sock->print("GET /metrics HTTP/1.0\r\n\r\n");
+      $sock->flush();
+
+      my $resp = '';
+      while (my $line = <$sock>) {
+        $resp .= $line;
+      }
+      $sock->close();
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Metrics response:\n$resp\n";
+      }
+
+      $self->assert($resp =~ /^HTTP\/1\.0 200 OK\r\n/,
+        test_msg("Expected 200 response, got '$resp'"));
+
+      $self->assert($resp =~ /\nproftpd_ftp_logins_login_total 1\n/,
+        test_msg("Expected login total of 1 in metrics"));
+
+      $self->assert($resp =~ /\nproftpd_ftp_command_total\{command="CWD"\} 2\n/,
+        test_msg("Expected CWD command count of 2 in metrics"));
+
+      $self->assert($resp =~ /\n# EOF\n$/,
+        test_msg("Expected metrics to end with EOF marker"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_persistent_tables {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPOptions => 'PersistentTables',
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # First run: log in, so that there is a counter to be persisted.
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  my $table_file = "$table_dir/ftp.dat";
+  my $magic = '';
+  if (open(my $fh, '<', $table_file)) {
+    binmode($fh);
+    read($fh, $magic, 8);
+    close($fh);
+  }
+
+  $self->assert($magic eq 'PRSNMPDB',
+    test_msg("Expected header magic in $table_file, got '$magic'"));
+
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  # Second run: the login counted by the first run should still be there.
+  defined($pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      # ftp.logins.loginsTotal, ftp.sessions.sessionCount
+      my $login_total_oid = '1.3.6.1.4.1.17852.2.2.3.2.1.0';
+      my $sess_count_oid = '1.3.6.1.4.1.17852.2.2.3.1.1.0';
+
+      my $oids = [$login_total_oid, $sess_count_oid];
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      foreach my $oid (@$oids) {
+        unless (defined($snmp_resp->{$oid})) {
+          die("Missing required OID $oid in response");
+        }
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $oid = $snmp_resp->{$oid}\n";
+        }
+      }
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+
+      my $expected = 1;
+      my $login_total = $snmp_resp->{$login_total_oid};
+      $self->assert($login_total == $expected,
+        test_msg("Expected login total $expected, got $login_total"));
+
+      $expected = 0;
+      my $sess_count = $snmp_resp->{$sess_count_oid};
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_acl_cache_counts {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $hits_oid = '1.3.6.1.4.1.17852.2.2.4.6.0';
+  my $misses_oid = '1.3.6.1.4.1.17852.2.2.4.7.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      # The first request evaluates the ACLs for our address; the rest
+      # should use the cached decision.
+      for (my $i = 0; $i < 3; $i++) {
+        my $snmp_resp = $snmp_sess->get_request(
+          -varbindList => [$request_oid],
+        );
+        unless ($snmp_resp) {
+          die("No SNMP response received: " . $snmp_sess->error());
+        }
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$hits_oid, $misses_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $hits = $snmp_resp->{$hits_oid};
+      my $misses = $snmp_resp->{$misses_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "ACL cache hits = $hits, misses = $misses\n";
+      }
+
+      my $expected = 3;
+      $self->assert($expected == $hits,
+        test_msg("Expected ACL cache hits $expected, got $hits"));
+
+      $expected = 1;
+      $self->assert($expected == $misses,
+        test_msg("Expected ACL cache misses $expected, got $misses"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_rxq_counts {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $stale_oid = '1.3.6.1.4.1.17852.2.2.4.11.0';
+  my $rxq_bytes_oid = '1.3.6.1.4.1.17852.2.2.4.12.0';
+  my $rxq_dropped_oid = '1.3.6.1.4.1.17852.2.2.4.13.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPRequestDeadline => 2000,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      # None of these requests should be stale, or dropped by the kernel.
+      for (my $i = 0; $i < 3; $i++) {
+        my $snmp_resp = $snmp_sess->get_request(
+          -varbindList => [$request_oid],
+        );
+        unless ($snmp_resp) {
+          die("No SNMP response received: " . $snmp_sess->error());
+        }
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$stale_oid, $rxq_bytes_oid, $rxq_dropped_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $stale = $snmp_resp->{$stale_oid};
+      my $rxq_bytes = $snmp_resp->{$rxq_bytes_oid};
+      my $rxq_dropped = $snmp_resp->{$rxq_dropped_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Stale packets = $stale, receive queue bytes = $rxq_bytes, receive queue drops = $rxq_dropped\n";
+      }
+
+      my $expected = 0;
+      $self->assert($expected == $stale,
+        test_msg("Expected stale packets $expected, got $stale"));
+
+      $self->assert($expected == $rxq_dropped,
+        test_msg("Expected receive queue drops $expected, got $rxq_dropped"));
+
+      $self->assert($rxq_bytes =~ /^\d+$/,
+        test_msg("Expected receive queue bytes, got '$rxq_bytes'"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_replay {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $replayed_oid = '1.3.6.1.4.1.17852.2.2.4.14.0';
+
+  # A SNMPv1 GetRequest, request ID 1234, for ftp.daemon.software, using the
+  # 'public' community.  Sending the exact same bytes again, from the same
+  # port, looks like a retransmission.
+  my $request = pack('H*', '302c02010004067075626c6963a01f020204d202010002010030133011060d2b06010401818b3c02020101000500');
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $sock = IO::Socket::INET->new(
+        PeerAddr => '127.0.0.1',
+        PeerPort => $agent_port,
+        Proto => 'udp',
+      );
+      unless ($sock) {
+        die("Unable to create UDP socket: $!");
+      }
+
+      my $responses = [];
+      for (my $i = 0; $i < 2; $i++) {
+        $sock->send($request);
+
+        my $resp = '';
+        my $rin = '';
+        vec($rin, fileno($sock), 1) = 1;
+        unless (select(my $rout = $rin, undef, undef, 3)) {
+          die("No SNMP response received for request #" . ($i + 1));
+        }
+
+        $sock->recv($resp, 8192);
+        push(@$responses, $resp);
+      }
+      $sock->close();
+
+      $self->assert($responses->[0] eq $responses->[1],
+        test_msg("Expected identical responses to retransmitted request"));
+
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$replayed_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $replayed = $snmp_resp->{$replayed_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Replayed packets = $replayed\n";
+      }
+
+      my $expected = 1;
+      $self->assert($expected == $replayed,
+        test_msg("Expected replayed packets $expected, got $replayed"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_rate_limit {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $dropped_oid = '1.3.6.1.4.1.17852.2.2.4.5.0';
+  my $rate_limit_oid = '1.3.6.1.4.1.17852.2.2.4.8.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPRateLimit => '1 2',
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 0,
+        -timeout => 2,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      # The first two requests use up the burst; the third should be
+      # dropped.
+      for (my $i = 0; $i < 2; $i++) {
+        my $snmp_resp = $snmp_sess->get_request(
+          -varbindList => [$request_oid],
+        );
+        unless ($snmp_resp) {
+          die("No SNMP response received: " . $snmp_sess->error());
+        }
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$request_oid],
+      );
+      if ($snmp_resp) {
+        die("Unexpectedly received SNMP response for rate-limited request");
+      }
+
+      # Wait for the bucket to refill.
+      sleep(2);
+
+      $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$dropped_oid, $rate_limit_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $dropped = $snmp_resp->{$dropped_oid};
+      my $rate_limited = $snmp_resp->{$rate_limit_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Packets dropped = $dropped, rate limited = $rate_limited\n";
+      }
+
+      my $expected = 1;
+      $self->assert($expected == $dropped,
+        test_msg("Expected dropped packets $expected, got $dropped"));
+
+      $self->assert($expected == $rate_limited,
+        test_msg("Expected rate-limited packets $expected, got $rate_limited"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v2_get_template {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  # ftp.daemon.software, and an unknown OID
+  my $software_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $unknown_oid = '1.3.6.1.4.1.17852.1.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv2c',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $oids = [$software_oid, $unknown_oid];
+
+      # The second, identical request is answered using the template made
+      # for the first.
+      for (my $i = 0; $i < 2; $i++) {
+        my $snmp_resp = $snmp_sess->get_request(
+          -varbindList => $oids,
+        );
+        unless ($snmp_resp) {
+          die("No SNMP response received: " . $snmp_sess->error());
+        }
+
+        my $value = $snmp_resp->{$software_oid};
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $software_oid = $value\n";
+        }
+
+        my $expected = 'proftpd';
+        $self->assert($expected eq $value,
+          test_msg("Expected value $expected for OID, got $value"));
+
+        $value = $snmp_resp->{$unknown_oid};
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $unknown_oid = $value\n";
+        }
+
+        $expected = 'noSuchObject';
+        $self->assert($expected eq $value,
+          test_msg("Expected value $expected for OID, got $value"));
+      }
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v2_get_bulk_counter_table {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  # The counter table row for snmp.packetsReceivedTotal
+  my $name_oid = '1.3.6.1.4.1.17852.2.2.13.1.1.2.200';
+  my $type_oid = '1.3.6.1.4.1.17852.2.2.13.1.1.3.200';
+  my $value_col_oid = '1.3.6.1.4.1.17852.2.2.13.1.1.4';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv2c',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $oids = [$name_oid, $type_oid];
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $name = $snmp_resp->{$name_oid};
+      my $expected = 'snmp.packetsReceivedTotal';
+      $self->assert($expected eq $name,
+        test_msg("Expected value '$expected' for OID, got '$name'"));
+
+      my $type = $snmp_resp->{$type_oid};
+      $expected = 1;
+      $self->assert($expected == $type,
+        test_msg("Expected value '$expected' for OID, got '$type'"));
+
+      # Walk the value column; every row should be in it.
+      $snmp_resp = $snmp_sess->get_bulk_request(
+        -nonrepeaters => 0,
+        -maxrepetitions => 5,
+        -varbindList => [$value_col_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $resp_oids = [keys(%$snmp_resp)];
+      my $count = scalar(@$resp_oids);
+      $expected = 5;
+      $self->assert($expected == $count,
+        test_msg("Expected $expected OIDs in response, got $count"));
+
+      foreach my $resp_oid (@$resp_oids) {
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $resp_oid = $snmp_resp->{$resp_oid}\n";
+        }
+
+        $self->assert(index($resp_oid, "$value_col_oid.") == 0,
+          test_msg("Unexpected OID $resp_oid in response"));
+      }
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v2_get_next_counter_history {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  # The counter history rows for snmp.packetsReceivedTotal
+  my $time_oid = '1.3.6.1.4.1.17852.2.2.13.2.1.3.200';
+  my $value_oid = '1.3.6.1.4.1.17852.2.2.13.2.1.4.200';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.history:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPHistory => '5 10',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv2c',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      # Give the agent time to take its first sample.
+      sleep(2);
+
+      my $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => [$value_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $resp_oids = [keys(%$snmp_resp)];
+      my $count = scalar(@$resp_oids);
+      my $expected = 1;
+      $self->assert($expected == $count,
+        test_msg("Expected $expected OIDs in response, got $count"));
+
+      # The first sample is sample 1.
+      my $resp_oid = $resp_oids->[0];
+      $expected = "$value_oid.1";
+      $self->assert($expected eq $resp_oid,
+        test_msg("Expected OID $expected in response, got $resp_oid"));
+
+      my $sample_oid = "$time_oid.1";
+      $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$sample_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $sample_time = $snmp_resp->{$sample_oid};
+      my $now = time();
+      $self->assert($sample_time > ($now - 60) && $sample_time <= $now,
+        test_msg("Expected sample time near $now, got '$sample_time'"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_ftp_xfer_upload_in_flight {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+        SNMPTransferUpdates => 1,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $expected;
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+
+      my $conn = $client->stor_raw('test.txt');
+      unless ($conn) {
+        die("Failed to STOR: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      # Send half of the file, and give the transfer updates time to run
+      my $file_kb_len = 8;
+      my $buf = ("A" x (($file_kb_len / 2) * 1024));
+      $conn->write($buf, length($buf), 25);
+      sleep(3);
+
+      # The KB sent so far should be counted before the upload completes
+      my ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port,
+        $snmp_community);
+
+      $expected = 1;
+      $self->assert($file_count == $expected,
+        test_msg("Expected upload file count $expected, got $file_count"));
+
+      $expected = 0;
+      $self->assert($file_total == $expected,
+        test_msg("Expected upload file total $expected, got $file_total"));
+
+      $expected = ($file_kb_len / 2);
+      $self->assert($kb_count == $expected,
+        test_msg("Expected upload KB count $expected, got $kb_count"));
+
+      # Send the rest of the file
+      $conn->write($buf, length($buf), 25);
+      eval { $conn->close() };
+
+      my $resp_code = $client->response_code();
+      my $resp_msg = $client->response_msg();
+
+      $expected = 226;
+      $self->assert($expected == $resp_code,
+        test_msg("Expected response code $expected, got $resp_code"));
+
+      $client->quit();
+
+      # The KB already counted must not be counted again
+      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
+
+      $expected = 0;
+      $self->assert($file_count == $expected,
+        test_msg("Expected upload file count $expected, got $file_count"));
+
+      $expected = 1;
+      $self->assert($file_total == $expected,
+        test_msg("Expected upload file total $expected, got $file_total"));
+
+      $expected = $file_kb_len;
+      $self->assert($kb_count == $expected,
+        test_msg("Expected upload KB count $expected, got $kb_count"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_conn_count_session_killed {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $expected;
+
+      # Note the master's existing children (i.e. the agent), so that the
+      # session process can be told apart from them
+      sleep(1);
+      my $master_pid = get_pid_from_file($pid_file);
+      my %agent_pids = map { $_ => 1 } get_child_pids($master_pid);
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+
+      my ($conn_count, $conn_total) = get_conn_info($agent_port,
+        $snmp_community);
+
+      $expected = 1;
+      $self->assert($conn_count == $expected,
+        test_msg("Expected connection count $expected, got $conn_count"));
+
+      my @sess_pids = grep { !$agent_pids{$_} } get_child_pids($master_pid);
+      $expected = 1;
+      $self->assert(scalar(@sess_pids) == $expected,
+        test_msg("Expected $expected session process, got " .
+          scalar(@sess_pids)));
+
+      # Kill the session, so that it has no chance to update the gauges
+      kill('KILL', $sess_pids[0]);
+
+      # Give the agent time to notice, and reconcile the gauges
+      sleep(7);
+
+      ($conn_count, $conn_total) = get_conn_info($agent_port, $snmp_community);
+
+      $expected = 0;
+      $self->assert($conn_count == $expected,
+        test_msg("Expected connection count $expected, got $conn_count"));
+
+      $expected = 1;
+      $self->assert($conn_total == $expected,
+        test_msg("Expected connection total $expected, got $conn_total"));
+
+      my ($sess_count, $sess_total) = get_ftp_sess_info($agent_port,
+        $snmp_community);
+
+      $expected = 0;
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      $expected = 1;
+      $self->assert($sess_total == $expected,
+        test_msg("Expected session total $expected, got $sess_total"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_ftp_sess_count_no_login {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $timeout_idle = 45;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    TimeoutIdle => $timeout_idle + 1,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $expected;
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+
+      my ($sess_count, $sess_total) = get_ftp_sess_info($agent_port,
+        $snmp_community);
+
+      $expected = 1;
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      # A second connection which never logs in was never counted, and so
+      # must not take the first session's count away when it ends
+      my $client2 = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client2->quit();
+      $client2 = undef;
+
+      # Allow the second session process time to exit
+      sleep(1);
+
+      ($sess_count, $sess_total) = get_ftp_sess_info($agent_port,
+        $snmp_community);
+
+      $expected = 1;
+      $self->assert($sess_count == $expected,
+        test_msg("Expected session count $expected, got $sess_count"));
+
+      $expected = 1;
+      $self->assert($sess_total == $expected,
+        test_msg("Expected session total $expected, got $sess_total"));
+
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_pkts_dropped_too_big {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $too_big_oid = '1.3.6.1.4.1.17852.2.2.4.15.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPMaxMessageSize => 484,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require IO::Socket::INET;
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      # Send a datagram larger than SNMPMaxMessageSize; the agent should drop
+      # it, and count it as too big.
+      my $udp_sock = IO::Socket::INET->new(
+        PeerAddr => '127.0.0.1',
+        PeerPort => $agent_port,
+        Proto => 'udp',
+      );
+      unless ($udp_sock) {
+        die("Can't connect to 127.0.0.1:$agent_port: $!");
+      }
+
+      $udp_sock->send('A' x 1024);
+      $udp_sock->close();
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$too_big_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $too_big = $snmp_resp->{$too_big_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Too big packets = $too_big\n";
+      }
+
+      my $expected = 1;
+      $self->assert($expected == $too_big,
+        test_msg("Expected too big packets $expected, got $too_big"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v2_get_bulk_request_deadline {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $bulk_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+  my $stale_oid = '1.3.6.1.4.1.17852.2.2.4.11.0';
+
+  # A GETBULK filling the largest message allowed keeps the agent busy for
+  # longer than the 1 ms deadline, so that the requests sent right after it
+  # wait too long, and are dropped.
+  my $max_repetitions = 10000;
+  my $nrequests = 5;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPMaxMessageSize => 65507,
+        SNMPRequestDeadline => 1,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv2c',
+        -community => $snmp_community,
+        -nonblocking => 1,
+        -retries => 0,
+        -timeout => 2,
+        -translate => 1,
+        -maxmsgsize => 65535,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      # Queue the GETBULK, and the requests behind it; they are all sent at
+      # once, by the dispatcher.  No request is retried, so a dropped request
+      # gets no response at all.
+      my $nanswered = 0;
+      my $nunanswered = 0;
+
+      my $cb = sub {
+        my $sess = shift;
+
+        if (defined($sess->var_bind_list())) {
+          $nanswered++;
+
+        } else {
+          $nunanswered++;
+        }
+      };
+
+      my $res = $snmp_sess->get_bulk_request(
+        -maxrepetitions => $max_repetitions,
+        -varbindList => [$bulk_oid],
+        -callback => $cb,
+      );
+      unless ($res) {
+        die("Unable to queue GETBULK request: " . $snmp_sess->error());
+      }
+
+      for (my $i = 0; $i < $nrequests; $i++) {
+        $res = $snmp_sess->get_request(
+          -varbindList => [$request_oid],
+          -callback => $cb,
+        );
+        unless ($res) {
+          die("Unable to queue GET request: " . $snmp_sess->error());
+        }
+      }
+
+      Net::SNMP::snmp_dispatcher();
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Answered = $nanswered, unanswered = $nunanswered\n";
+      }
+
+      $self->assert($nunanswered > 0,
+        test_msg("Expected some requests to be unanswered, got none"));
+
+      # Now read the stale counter, with an idle agent.  The deadline is
+      # short, so allow for retries.
+      ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv2c',
+        -community => $snmp_community,
+        -retries => 3,
+        -timeout => 1,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => [$stale_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      my $stale = $snmp_resp->{$stale_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Stale packets = $stale\n";
+      }
+
+      # Every unanswered request was dropped as stale; so too may have been
+      # some of the attempts to read the counter.
+      $self->assert($stale >= $nunanswered,
+        test_msg("Expected at least $nunanswered stale packets, got $stale"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_multi {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oids = [
+    '1.3.6.1.4.1.17852.2.2.1.1.0',
+    '1.3.6.1.4.1.17852.2.2.1.3.0',
+  ];
+
+  my $expected_oid_values = {
+    '1.3.6.1.4.1.17852.2.2.1.1.0' => 'proftpd',
+    '1.3.6.1.4.1.17852.2.2.1.3.0' => 'root@127.0.0.1',
+  };
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $request_oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      # Do we have the requested OIDs in the response?
+      foreach my $request_oid (@$request_oids) {
+        unless (defined($snmp_resp->{$request_oid})) {
+          die("Missing required OID $request_oid in response");
+        }
+
+        my $value = $snmp_resp->{$request_oid};
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $request_oid = $value\n";
+        }
+
+        my $expected = $expected_oid_values->{$request_oid};
+
+        $self->assert($expected eq $value,
+          test_msg("Expected value '$expected' for OID, got '$value'"));
+      }
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_multi_with_unknown {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oids = [
+    '1.3.6.1.4.1.17852.2.2.1.1.0',
+    '1.3.6.1.4.1.17852.1.1',
+  ];
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $request_oids,
+      );
+      if ($snmp_resp) {
+        die("SNMP response received unexpectedly");
+      }
+
+      my $err = $snmp_sess->error();
+      my $expected = 'Received noSuchName(2) error-status at error-index 2';
+
+      $self->assert($expected eq $err,
+        test_msg("Expected error '$expected' for OIDs, got '$err'"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_next {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      # Do we have the next OID of the requested OID in the response?
+      unless (defined($snmp_resp->{$next_oid})) {
+        die("Missing required OID $next_oid in response");
+      }
+
+      my $value = $snmp_resp->{$next_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $next_oid = $value\n";
+      }
+
+      # The default proftpd string, without ServerAdmin configured.
+      my $expected = 'root@127.0.0.1';
+
+      $self->assert(qr/$expected/, $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_next_unknown {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.999.0.1';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => $oids,
+      );
+      if ($snmp_resp) {
+        die("SNMP response received unexpectedly");
+      }
+
+      my $err = $snmp_sess->error();
+      my $expected = 'Received noSuchName(2) error-status at error-index 1';
+
+      $self->assert($expected eq $err,
+        test_msg("Expected error '$expected' for OID, got '$err'"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_next_missing_instance_id {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1';
+  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
+
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => $oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
+
+      # Do we have the next OID of the requested OID in the response?
+      unless (defined($snmp_resp->{$next_oid})) {
+        die("Missing required OID $next_oid in response");
+      }
+
+      my $value = $snmp_resp->{$next_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $next_oid = $value\n";
+      }
+
+      my $expected = 'proftpd';
+
+      $self->assert(qr/$expected/, $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
+
+      $snmp_sess->close();
+      $snmp_sess = undef;
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub snmp_v1_get_next_end_of_mib_view {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/snmp.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/snmp.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/snmp.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/snmp.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/snmp.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  my $table_dir = File::Spec->rel2abs("$tmpdir/var/snmp");
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir, $table_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir, $table_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
+  my $snmp_community = "public";
+
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.4.5.0';
+  my $timeout = 30;
+
+  my $config = {
+    TraceLog => $log_file,
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+
+      'mod_snmp.c' => {
+        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPCommunity => $snmp_community,
+        SNMPEngine => 'on',
+        SNMPLog => $log_file,
+        SNMPTables => $table_dir,
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  require Net::SNMP;
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
 
-      $expected = 1;
-      $self->assert($sess_total == $expected,
-        test_msg("Expected session total $expected, got $sess_total"));
+      my $oids = [$request_oid];
 
-      # Now log out
-      $client->quit();
-      $client = undef;
+      my $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => $oids,
+      );
+      if ($snmp_resp) {
+        die("SNMP response received unexpectedly");
+      }
 
-      # And get the session counts one more time, make sure it's what we expect
-      ($sess_count, $sess_total) = get_ftp_sess_info($agent_port, $snmp_community);
+      my $err = $snmp_sess->error();
+      my $expected = 'Received noSuchName(2) error-status at error-index 1';
 
-      # We MIGHT see a value of 1 here; I suspect it is leftover from the
-      # previous test (and in anonymous memory).  Tolerate it, for now.
-      $expected = 0;
-      $self->assert($sess_count == 0 || $sess_count == 1,
-        test_msg("Expected session count $expected, got $sess_count"));
+      $self->assert($expected eq $err,
+        test_msg("Expected error '$expected' for OID, got '$err'"));
 
-      $expected = 1;
-      $self->assert($sess_total == $expected,
-        test_msg("Expected session total $expected, got $sess_total"));
+      $snmp_sess->close();
+      $snmp_sess = undef;
     };
 
     if ($@) {
@@ -2771,7 +7291,7 @@ sub snmp_v1_get_ftp_sess_counts {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    eval { server_wait($config_file, $rfh, $timeout) };
     if ($@) {
       warn($@);
       exit 1;
@@ -2795,7 +7315,7 @@ sub snmp_v1_get_ftp_sess_counts {
   unlink($log_file);
 }
 
-sub snmp_v1_get_ftp_xfer_upload_counts {
+sub snmp_v1_get_next_multi {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -2836,7 +7356,15 @@ sub snmp_v1_get_ftp_xfer_upload_counts {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $timeout_idle = 45;
+  my $request_oids = [
+    '1.3.6.1.4.1.17852.2.2.1.2.0',
+    '1.3.6.1.4.1.17852.2.2.1.4.0',
+  ];
+
+  my $next_oid_values = {
+    '1.3.6.1.4.1.17852.2.2.1.3.0' => 'root@127.0.0.1',
+    '1.3.6.1.4.1.17852.2.2.1.5.0' => '1',
+  };
 
   my $config = {
     TraceLog => $log_file,
@@ -2847,7 +7375,6 @@ sub snmp_v1_get_ftp_xfer_upload_counts {
 
     AuthUserFile => $auth_user_file,
     AuthGroupFile => $auth_group_file,
-    TimeoutIdle => $timeout_idle + 1,
 
     IfModules => {
       'mod_delay.c' => {
@@ -2883,80 +7410,52 @@ sub snmp_v1_get_ftp_xfer_upload_counts {
   defined(my $pid = fork()) or die("Can't fork: $!");
   if ($pid) {
     eval {
-      my $expected;
-
-      # First, get the upload count/KB
-      my ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port,
-        $snmp_community);
-
-      $expected = 0;
-      $self->assert($file_count == $expected,
-        test_msg("Expected upload file count $expected, got $file_count"));
-
-      $expected = 0;
-      $self->assert($file_total == $expected,
-        test_msg("Expected upload file total $expected, got $file_total"));
-
-      $expected = 0;
-      $self->assert($kb_count == $expected,
-        test_msg("Expected upload KB count $expected, got $kb_count"));
-
-      # Next, upload a file
-      my $file_path = 'test1.txt';
-      my $file_kb_len = 4;
-      upload_file($port, $user, $passwd, $file_path, $file_kb_len);
-
-      # Then, get the upload count/KB again
-      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
-
-      $expected = 0;
-      $self->assert($file_count == $expected,
-        test_msg("Expected upload file count $expected, got $file_count"));
-
-      $expected = 1;
-      $self->assert($file_total == $expected,
-        test_msg("Expected upload file total $expected, got $file_total"));
-
-      $expected = $file_kb_len;
-      $self->assert($kb_count == $expected,
-        test_msg("Expected upload KB count $expected, got $kb_count"));
-
-      # Upload another file
-      $file_path = 'test2.txt';
-      upload_file($port, $user, $passwd, $file_path, $file_kb_len);
-
-      # Get the upload count/KB one more time, make sure it's what we expect
-      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
+      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
+        -hostname => '127.0.0.1',
+        -port => $agent_port,
+        -version => 'snmpv1',
+        -community => $snmp_community,
+        -retries => 1,
+        -timeout => 3,
+        -translate => 1,
+      );
+      unless ($snmp_sess) {
+        die("Unable to create Net::SNMP session: $snmp_err");
+      }
 
-      $expected = 0;
-      $self->assert($file_count == $expected,
-        test_msg("Expected upload file count $expected, got $file_count"));
+      if ($ENV{TEST_VERBOSE}) {
+        # From the Net::SNMP debug perldocs
+        my $debug_mask = (0x02|0x10|0x20);
+        $snmp_sess->debug($debug_mask);
+      }
 
-      $expected = 2;
-      $self->assert($file_total == $expected,
-        test_msg("Expected upload file total $expected, got $file_total"));
+      my $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => $request_oids,
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
+      }
 
-      $expected = ($file_kb_len * 2);
-      $self->assert($kb_count == $expected,
-        test_msg("Expected upload KB count $expected, got $kb_count"));
+      # Do we have the expected OIDs in the response?
+      foreach my $next_oid (keys(%$next_oid_values)) {
+        unless (defined($snmp_resp->{$next_oid})) {
+          die("Missing required OID $next_oid in response");
+        }
 
-      # Now wait for 5 secs, then try again (make sure the counters aren't
-      # reset somehow on the server's side).
-      sleep(5);
+        my $value = $snmp_resp->{$next_oid};
 
-      ($file_count, $file_total, $kb_count) = get_ftp_xfer_upload_info($agent_port, $snmp_community);
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $next_oid = $value\n";
+        }
 
-      $expected = 0;
-      $self->assert($file_count == $expected,
-        test_msg("Expected upload file count $expected, got $file_count"));
+        my $expected = $next_oid_values->{$next_oid};
 
-      $expected = 2;
-      $self->assert($file_total == $expected,
-        test_msg("Expected upload file total $expected, got $file_total"));
+        $self->assert($expected eq $value,
+          test_msg("Expected value '$expected' for OID, got '$value'"));
+      }
 
-      $expected = ($file_kb_len * 2);
-      $self->assert($kb_count == $expected,
-        test_msg("Expected upload KB count $expected, got $kb_count"));
+      $snmp_sess->close();
+      $snmp_sess = undef;
     };
 
     if ($@) {
@@ -2967,7 +7466,7 @@ sub snmp_v1_get_ftp_xfer_upload_counts {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, $timeout_idle) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -2991,7 +7490,7 @@ sub snmp_v1_get_ftp_xfer_upload_counts {
   unlink($log_file);
 }
 
-sub snmp_v1_get_multi {
+sub snmp_v1_get_next_multi_with_unknown {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3033,15 +7532,10 @@ sub snmp_v1_get_multi {
   my $snmp_community = "public";
 
   my $request_oids = [
-    '1.3.6.1.4.1.17852.2.2.1.1.0',
-    '1.3.6.1.4.1.17852.2.2.1.3.0',
+    '1.3.6.1.4.1.17852.2.2.1.2.0',
+    '1.3.6.1.4.1.17852.1.1.0',
   ];
 
-  my $expected_oid_values = {
-    '1.3.6.1.4.1.17852.2.2.1.1.0' => 'proftpd',
-    '1.3.6.1.4.1.17852.2.2.1.3.0' => 'root@127.0.0.1',
-  };
-
   my $config = {
     TraceLog => $log_file,
     Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
@@ -3105,30 +7599,18 @@ sub snmp_v1_get_multi {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $snmp_resp = $snmp_sess->get_request(
+      my $snmp_resp = $snmp_sess->get_next_request(
         -varbindList => $request_oids,
       );
-      unless ($snmp_resp) {
-        die("No SNMP response received: " . $snmp_sess->error());
+      if ($snmp_resp) {
+        die("SNMP response received unexpectedly");
       }
 
-      # Do we have the requested OIDs in the response?
-      foreach my $request_oid (@$request_oids) {
-        unless (defined($snmp_resp->{$request_oid})) {
-          die("Missing required OID $request_oid in response");
-        }
-
-        my $value = $snmp_resp->{$request_oid};
-
-        if ($ENV{TEST_VERBOSE}) {
-          print STDERR "Requested OID $request_oid = $value\n";
-        }
-
-        my $expected = $expected_oid_values->{$request_oid};
+      my $err = $snmp_sess->error();
+      my $expected = 'Received noSuchName(2) error-status at error-index 2';
 
-        $self->assert($expected eq $value,
-          test_msg("Expected value '$expected' for OID, got '$value'"));
-      }
+      $self->assert($expected eq $err,
+        test_msg("Expected error '$expected', got '$err'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -3166,7 +7648,7 @@ sub snmp_v1_get_multi {
   unlink($log_file);
 }
 
-sub snmp_v1_get_multi_with_unknown {
+sub snmp_v1_set {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3207,10 +7689,7 @@ sub snmp_v1_get_multi_with_unknown {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oids = [
-    '1.3.6.1.4.1.17852.2.2.1.1.0',
-    '1.3.6.1.4.1.17852.1.1',
-  ];
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -3248,6 +7727,7 @@ sub snmp_v1_get_multi_with_unknown {
   }
 
   require Net::SNMP;
+  require Net::SNMP::Message;
 
   my $ex;
 
@@ -3275,18 +7755,19 @@ sub snmp_v1_get_multi_with_unknown {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $snmp_resp = $snmp_sess->get_request(
-        -varbindList => $request_oids,
+      my $snmp_resp = $snmp_sess->set_request(
+        -varbindList => [ $request_oid, Net::SNMP::Message::OCTET_STRING(),
+                          'mod_smp' ],
       );
       if ($snmp_resp) {
         die("SNMP response received unexpectedly");
       }
 
       my $err = $snmp_sess->error();
-      my $expected = 'Received noSuchName(2) error-status at error-index 2';
+      my $expected = 'Received noSuchName(2) error-status at error-index 1';
 
       $self->assert($expected eq $err,
-        test_msg("Expected error '$expected' for OIDs, got '$err'"));
+        test_msg("Expected error '$expected' for OID, got '$err'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -3300,7 +7781,7 @@ sub snmp_v1_get_multi_with_unknown {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, 10) };
     if ($@) {
       warn($@);
       exit 1;
@@ -3324,7 +7805,7 @@ sub snmp_v1_get_multi_with_unknown {
   unlink($log_file);
 }
 
-sub snmp_v1_get_next {
+sub snmp_v1_trap {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3365,8 +7846,7 @@ sub snmp_v1_get_next {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
-  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -3404,6 +7884,7 @@ sub snmp_v1_get_next {
   }
 
   require Net::SNMP;
+  require Net::SNMP::Message;
 
   my $ex;
 
@@ -3431,31 +7912,19 @@ sub snmp_v1_get_next {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $oids = [$request_oid];
-
-      my $snmp_resp = $snmp_sess->get_next_request(
-        -varbindList => $oids,
+      my $snmp_resp = $snmp_sess->trap(
+        -varbindList => [ $request_oid, Net::SNMP::Message::OCTET_STRING(),
+                          'mod_smp' ],
       );
-      unless ($snmp_resp) {
-        die("No SNMP response received: " . $snmp_sess->error());
-      }
-
-      # Do we have the next OID of the requested OID in the response?
-      unless (defined($snmp_resp->{$next_oid})) {
-        die("Missing required OID $next_oid in response");
-      }
-
-      my $value = $snmp_resp->{$next_oid};
-
-      if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $next_oid = $value\n";
+      if ($snmp_resp) {
+        die("SNMP response received unexpectedly");
       }
 
-      # The default proftpd string, without ServerAdmin configured.
-      my $expected = 'root@127.0.0.1';
+      my $err = $snmp_sess->error();
+      my $expected = 'Received noSuchName(2) error-status at error-index 1';
 
-      $self->assert(qr/$expected/, $value,
-        test_msg("Expected value '$expected' for OID, got '$value'"));
+      $self->assert($expected eq $err,
+        test_msg("Expected error '$expected' for OID, got '$err'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -3469,7 +7938,7 @@ sub snmp_v1_get_next {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, 10) };
     if ($@) {
       warn($@);
       exit 1;
@@ -3493,7 +7962,7 @@ sub snmp_v1_get_next {
   unlink($log_file);
 }
 
-sub snmp_v1_get_next_unknown {
+sub snmp_v2_get_unknown {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3534,7 +8003,7 @@ sub snmp_v1_get_next_unknown {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.999.0.1';
+  my $request_oid = '1.3.6.1.4.1.17852.1.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -3583,7 +8052,7 @@ sub snmp_v1_get_next_unknown {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
@@ -3601,18 +8070,28 @@ sub snmp_v1_get_next_unknown {
 
       my $oids = [$request_oid];
 
-      my $snmp_resp = $snmp_sess->get_next_request(
+      my $snmp_resp = $snmp_sess->get_request(
         -varbindList => $oids,
       );
-      if ($snmp_resp) {
-        die("SNMP response received unexpectedly");
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      my $err = $snmp_sess->error();
-      my $expected = 'Received noSuchName(2) error-status at error-index 1';
+      # Do we have the requested OID in the response?
+      unless (defined($snmp_resp->{$request_oid})) {
+        die("Missing required OID $request_oid in response");
+      }
 
-      $self->assert($expected eq $err,
-        test_msg("Expected error '$expected' for OID, got '$err'"));
+      my $value = $snmp_resp->{$request_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $request_oid = $value\n";
+      }
+
+      my $expected = 'noSuchObject';
+
+      $self->assert($expected eq $value,
+        test_msg("Expected value $expected for OID, got $value"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -3650,7 +8129,7 @@ sub snmp_v1_get_next_unknown {
   unlink($log_file);
 }
 
-sub snmp_v1_get_next_missing_instance_id {
+sub snmp_v2_get_view {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3691,8 +8170,11 @@ sub snmp_v1_get_next_missing_instance_id {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1';
-  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $noc_community = "noc";
+
+  # daemon.software is in the view, daemon.version is not
+  my $software_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $version_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -3711,10 +8193,17 @@ sub snmp_v1_get_next_missing_instance_id {
 
       'mod_snmp.c' => {
         SNMPAgent => "master 127.0.0.1:$agent_port",
-        SNMPCommunity => $snmp_community,
+        SNMPCommunity => [
+          $noc_community,
+          "$snmp_community customer",
+        ],
         SNMPEngine => 'on',
         SNMPLog => $log_file,
         SNMPTables => $table_dir,
+        SNMPView => [
+          'customer included 1.3.6.1.4.1.17852.2.2',
+          'customer excluded 1.3.6.1.4.1.17852.2.2.1.2',
+        ],
       },
     },
   };
@@ -3741,7 +8230,7 @@ sub snmp_v1_get_next_missing_instance_id {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
@@ -3757,30 +8246,36 @@ sub snmp_v1_get_next_missing_instance_id {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $oids = [$request_oid];
+      my $oids = [$software_oid, $version_oid];
 
-      my $snmp_resp = $snmp_sess->get_next_request(
+      my $snmp_resp = $snmp_sess->get_request(
         -varbindList => $oids,
       );
       unless ($snmp_resp) {
         die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      # Do we have the next OID of the requested OID in the response?
-      unless (defined($snmp_resp->{$next_oid})) {
-        die("Missing required OID $next_oid in response");
-      }
+      my $value = $snmp_resp->{$software_oid};
+      my $expected = 'proftpd';
+      $self->assert($expected eq $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
 
-      my $value = $snmp_resp->{$next_oid};
+      $value = $snmp_resp->{$version_oid};
+      $expected = 'noSuchObject';
+      $self->assert($expected eq $value,
+        test_msg("Expected value $expected for OID, got $value"));
 
-      if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $next_oid = $value\n";
+      # GetNext from daemon.software should skip over daemon.version
+      $snmp_resp = $snmp_sess->get_next_request(
+        -varbindList => [$software_oid],
+      );
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      my $expected = 'proftpd';
-
-      $self->assert(qr/$expected/, $value,
-        test_msg("Expected value '$expected' for OID, got '$value'"));
+      if (defined($snmp_resp->{$version_oid})) {
+        die("Unexpectedly received OID $version_oid outside of view");
+      }
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -3818,7 +8313,7 @@ sub snmp_v1_get_next_missing_instance_id {
   unlink($log_file);
 }
 
-sub snmp_v1_get_next_end_of_mib_view {
+sub snmp_v2_get_missing_instance_id {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -3859,8 +8354,7 @@ sub snmp_v1_get_next_end_of_mib_view {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.4.5.0';
-  my $timeout = 30;
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1';
 
   my $config = {
     TraceLog => $log_file,
@@ -3909,7 +8403,7 @@ sub snmp_v1_get_next_end_of_mib_view {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
@@ -3927,18 +8421,28 @@ sub snmp_v1_get_next_end_of_mib_view {
 
       my $oids = [$request_oid];
 
-      my $snmp_resp = $snmp_sess->get_next_request(
+      my $snmp_resp = $snmp_sess->get_request(
         -varbindList => $oids,
       );
-      if ($snmp_resp) {
-        die("SNMP response received unexpectedly");
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      my $err = $snmp_sess->error();
-      my $expected = 'Received noSuchName(2) error-status at error-index 1';
+      # Do we have the requested OID in the response?
+      unless (defined($snmp_resp->{$request_oid})) {
+        die("Missing required OID $request_oid in response");
+      }
 
-      $self->assert($expected eq $err,
-        test_msg("Expected error '$expected' for OID, got '$err'"));
+      my $value = $snmp_resp->{$request_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $request_oid = $value\n";
+      }
+
+      my $expected = 'noSuchInstance';
+
+      $self->assert($expected eq $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -3952,7 +8456,7 @@ sub snmp_v1_get_next_end_of_mib_view {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, $timeout) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -3976,7 +8480,7 @@ sub snmp_v1_get_next_end_of_mib_view {
   unlink($log_file);
 }
 
-sub snmp_v1_get_next_multi {
+sub snmp_v2_get_next_end_of_mib_view {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4017,15 +8521,7 @@ sub snmp_v1_get_next_multi {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oids = [
-    '1.3.6.1.4.1.17852.2.2.1.2.0',
-    '1.3.6.1.4.1.17852.2.2.1.4.0',
-  ];
-
-  my $next_oid_values = {
-    '1.3.6.1.4.1.17852.2.2.1.3.0' => 'root@127.0.0.1',
-    '1.3.6.1.4.1.17852.2.2.1.5.0' => '1',
-  };
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.4.5.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -4074,7 +8570,7 @@ sub snmp_v1_get_next_multi {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
@@ -4090,30 +8586,30 @@ sub snmp_v1_get_next_multi {
         $snmp_sess->debug($debug_mask);
       }
 
+      my $oids = [$request_oid];
+
       my $snmp_resp = $snmp_sess->get_next_request(
-        -varbindList => $request_oids,
+        -varbindList => $oids,
       );
       unless ($snmp_resp) {
         die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      # Do we have the expected OIDs in the response?
-      foreach my $next_oid (keys(%$next_oid_values)) {
-        unless (defined($snmp_resp->{$next_oid})) {
-          die("Missing required OID $next_oid in response");
-        }
+      # Do we have the requested OID in the response?
+      unless (defined($snmp_resp->{$request_oid})) {
+        die("Missing required OID $request_oid in response");
+      }
 
-        my $value = $snmp_resp->{$next_oid};
+      my $value = $snmp_resp->{$request_oid};
 
-        if ($ENV{TEST_VERBOSE}) {
-          print STDERR "Requested OID $next_oid = $value\n";
-        }
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $request_oid = $value\n";
+      }
 
-        my $expected = $next_oid_values->{$next_oid};
+      my $expected = 'endOfMibView';
 
-        $self->assert($expected eq $value,
-          test_msg("Expected value '$expected' for OID, got '$value'"));
-      }
+      $self->assert($expected eq $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -4151,7 +8647,7 @@ sub snmp_v1_get_next_multi {
   unlink($log_file);
 }
 
-sub snmp_v1_get_next_multi_with_unknown {
+sub snmp_v2_get_bulk {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4192,10 +8688,8 @@ sub snmp_v1_get_next_multi_with_unknown {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oids = [
-    '1.3.6.1.4.1.17852.2.2.1.2.0',
-    '1.3.6.1.4.1.17852.1.1.0',
-  ];
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -4244,7 +8738,7 @@ sub snmp_v1_get_next_multi_with_unknown {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
@@ -4260,18 +8754,32 @@ sub snmp_v1_get_next_multi_with_unknown {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $snmp_resp = $snmp_sess->get_next_request(
-        -varbindList => $request_oids,
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_bulk_request(
+        -nonrepeaters => 1,
+        -varbindList => $oids,
       );
-      if ($snmp_resp) {
-        die("SNMP response received unexpectedly");
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      my $err = $snmp_sess->error();
-      my $expected = 'Received noSuchName(2) error-status at error-index 2';
+      # Do we have the next OID of the requested OID in the response?
+      unless (defined($snmp_resp->{$next_oid})) {
+        die("Missing required OID $next_oid in response");
+      }
 
-      $self->assert($expected eq $err,
-        test_msg("Expected error '$expected', got '$err'"));
+      my $value = $snmp_resp->{$next_oid};
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $next_oid = $value\n";
+      }
+
+      # The default proftpd string, without ServerAdmin configured.
+      my $expected = 'root@127.0.0.1';
+
+      $self->assert(qr/$expected/, $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -4309,7 +8817,7 @@ sub snmp_v1_get_next_multi_with_unknown {
   unlink($log_file);
 }
 
-sub snmp_v1_set {
+sub snmp_v2_get_bulk_max_repetitions_only {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4350,7 +8858,12 @@ sub snmp_v1_set {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+
+  my $next_oids = {
+    '1.3.6.1.4.1.17852.2.2.1.3.0' => 'root@127.0.0.1',
+    '1.3.6.1.4.1.17852.2.2.1.4.0' => '\d+\.\d+',
+  };
 
   my $config = {
     TraceLog => $log_file,
@@ -4388,7 +8901,6 @@ sub snmp_v1_set {
   }
 
   require Net::SNMP;
-  require Net::SNMP::Message;
 
   my $ex;
 
@@ -4400,7 +8912,7 @@ sub snmp_v1_set {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
@@ -4416,19 +8928,33 @@ sub snmp_v1_set {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $snmp_resp = $snmp_sess->set_request(
-        -varbindList => [ $request_oid, Net::SNMP::Message::OCTET_STRING(),
-                          'mod_smp' ],
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_bulk_request(
+        -maxrepetitions => 2,
+        -varbindList => $oids,
       );
-      if ($snmp_resp) {
-        die("SNMP response received unexpectedly");
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      my $err = $snmp_sess->error();
-      my $expected = 'Received noSuchName(2) error-status at error-index 1';
+      foreach my $next_oid (keys(%$next_oids)) {
+        # Do we have the next OID of the requested OID in the response?
+        unless (defined($snmp_resp->{$next_oid})) {
+          die("Missing required OID $next_oid in response");
+        }
 
-      $self->assert($expected eq $err,
-        test_msg("Expected error '$expected' for OID, got '$err'"));
+        my $value = $snmp_resp->{$next_oid};
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $next_oid = $value\n";
+        }
+
+        my $expected = $next_oids->{$next_oid};
+
+        $self->assert(qr/$expected/, $value,
+          test_msg("Expected value '$expected' for OID, got '$value'"));
+      }
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -4442,7 +8968,7 @@ sub snmp_v1_set {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, 10) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -4466,7 +8992,7 @@ sub snmp_v1_set {
   unlink($log_file);
 }
 
-sub snmp_v1_trap {
+sub snmp_v2_get_bulk_max_msg_size {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4507,7 +9033,12 @@ sub snmp_v1_trap {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
+
+  # Far more repetitions than will fit into a single response message; the
+  # agent should fill the message, and drop the rest.
+  my $max_repetitions = 10000;
 
   my $config = {
     TraceLog => $log_file,
@@ -4545,7 +9076,6 @@ sub snmp_v1_trap {
   }
 
   require Net::SNMP;
-  require Net::SNMP::Message;
 
   my $ex;
 
@@ -4557,11 +9087,12 @@ sub snmp_v1_trap {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv1',
+        -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
         -translate => 1,
+        -maxmsgsize => 65535,
       );
       unless ($snmp_sess) {
         die("Unable to create Net::SNMP session: $snmp_err");
@@ -4573,19 +9104,28 @@ sub snmp_v1_trap {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $snmp_resp = $snmp_sess->trap(
-        -varbindList => [ $request_oid, Net::SNMP::Message::OCTET_STRING(),
-                          'mod_smp' ],
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_bulk_request(
+        -maxrepetitions => $max_repetitions,
+        -varbindList => $oids,
       );
-      if ($snmp_resp) {
-        die("SNMP response received unexpectedly");
+      unless ($snmp_resp) {
+        die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      my $err = $snmp_sess->error();
-      my $expected = 'Received noSuchName(2) error-status at error-index 1';
+      unless (defined($snmp_resp->{$next_oid})) {
+        die("Missing required OID $next_oid in response");
+      }
+
+      my $nvars = scalar(keys(%$snmp_resp));
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Received $nvars variables\n";
+      }
 
-      $self->assert($expected eq $err,
-        test_msg("Expected error '$expected' for OID, got '$err'"));
+      $self->assert($nvars > 20 && $nvars < $max_repetitions,
+        test_msg("Expected more than 20 variables, got $nvars"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -4599,7 +9139,7 @@ sub snmp_v1_trap {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, 10) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -4623,7 +9163,7 @@ sub snmp_v1_trap {
   unlink($log_file);
 }
 
-sub snmp_v2_get_unknown {
+sub snmp_v2_get_bulk_config_max_msg_size {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4664,7 +9204,11 @@ sub snmp_v2_get_unknown {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.1.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
+
+  # With a 64KB message size, the entire MIB should fit into one response.
+  my $max_repetitions = 10000;
 
   my $config = {
     TraceLog => $log_file,
@@ -4686,6 +9230,7 @@ sub snmp_v2_get_unknown {
         SNMPCommunity => $snmp_community,
         SNMPEngine => 'on',
         SNMPLog => $log_file,
+        SNMPMaxMessageSize => 65507,
         SNMPTables => $table_dir,
       },
     },
@@ -4718,6 +9263,7 @@ sub snmp_v2_get_unknown {
         -retries => 1,
         -timeout => 3,
         -translate => 1,
+        -maxmsgsize => 65535,
       );
       unless ($snmp_sess) {
         die("Unable to create Net::SNMP session: $snmp_err");
@@ -4731,28 +9277,27 @@ sub snmp_v2_get_unknown {
 
       my $oids = [$request_oid];
 
-      my $snmp_resp = $snmp_sess->get_request(
+      my $snmp_resp = $snmp_sess->get_bulk_request(
+        -maxrepetitions => $max_repetitions,
         -varbindList => $oids,
       );
       unless ($snmp_resp) {
         die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      # Do we have the requested OID in the response?
-      unless (defined($snmp_resp->{$request_oid})) {
-        die("Missing required OID $request_oid in response");
+      unless (defined($snmp_resp->{$next_oid})) {
+        die("Missing required OID $next_oid in response");
       }
 
-      my $value = $snmp_resp->{$request_oid};
+      my $nvars = scalar(keys(%$snmp_resp));
 
       if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $request_oid = $value\n";
+        print STDERR "Received $nvars variables\n";
       }
 
-      my $expected = 'noSuchObject';
-
-      $self->assert($expected eq $value,
-        test_msg("Expected value $expected for OID, got $value"));
+      my $end_of_mib_view = grep { $_ eq 'endOfMibView' } values(%$snmp_resp);
+      $self->assert($end_of_mib_view == 1,
+        test_msg("Expected endOfMibView in response of $nvars variables"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -4790,7 +9335,7 @@ sub snmp_v2_get_unknown {
   unlink($log_file);
 }
 
-sub snmp_v2_get_missing_instance_id {
+sub snmp_v2_get_bulk_tcp {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4831,7 +9376,11 @@ sub snmp_v2_get_missing_instance_id {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
+  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
+
+  # With a 64KB message size, the entire MIB should fit into one response.
+  my $max_repetitions = 10000;
 
   my $config = {
     TraceLog => $log_file,
@@ -4849,10 +9398,11 @@ sub snmp_v2_get_missing_instance_id {
       },
 
       'mod_snmp.c' => {
-        SNMPAgent => "master 127.0.0.1:$agent_port",
+        SNMPAgent => "master 127.0.0.1:$agent_port udp tcp",
         SNMPCommunity => $snmp_community,
         SNMPEngine => 'on',
         SNMPLog => $log_file,
+        SNMPMaxMessageSize => 65507,
         SNMPTables => $table_dir,
       },
     },
@@ -4880,11 +9430,13 @@ sub snmp_v2_get_missing_instance_id {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
+        -domain => 'tcp/ipv4',
         -version => 'snmpv2c',
         -community => $snmp_community,
         -retries => 1,
         -timeout => 3,
         -translate => 1,
+        -maxmsgsize => 65535,
       );
       unless ($snmp_sess) {
         die("Unable to create Net::SNMP session: $snmp_err");
@@ -4898,28 +9450,30 @@ sub snmp_v2_get_missing_instance_id {
 
       my $oids = [$request_oid];
 
-      my $snmp_resp = $snmp_sess->get_request(
-        -varbindList => $oids,
-      );
-      unless ($snmp_resp) {
-        die("No SNMP response received: " . $snmp_sess->error());
-      }
-
-      # Do we have the requested OID in the response?
-      unless (defined($snmp_resp->{$request_oid})) {
-        die("Missing required OID $request_oid in response");
-      }
+      # Send several requests over the same connection.
+      for (my $i = 0; $i < 3; $i++) {
+        my $snmp_resp = $snmp_sess->get_bulk_request(
+          -maxrepetitions => $max_repetitions,
+          -varbindList => $oids,
+        );
+        unless ($snmp_resp) {
+          die("No SNMP response received: " . $snmp_sess->error());
+        }
 
-      my $value = $snmp_resp->{$request_oid};
+        unless (defined($snmp_resp->{$next_oid})) {
+          die("Missing required OID $next_oid in response");
+        }
 
-      if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $request_oid = $value\n";
-      }
+        my $nvars = scalar(keys(%$snmp_resp));
 
-      my $expected = 'noSuchInstance';
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Received $nvars variables\n";
+        }
 
-      $self->assert($expected eq $value,
-        test_msg("Expected value '$expected' for OID, got '$value'"));
+        my $end_of_mib_view = grep { $_ eq 'endOfMibView' } values(%$snmp_resp);
+        $self->assert($end_of_mib_view == 1,
+          test_msg("Expected endOfMibView in response of $nvars variables"));
+      }
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -4957,7 +9511,7 @@ sub snmp_v2_get_missing_instance_id {
   unlink($log_file);
 }
 
-sub snmp_v2_get_next_end_of_mib_view {
+sub snmp_v2_get_unix_socket {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -4998,7 +9552,18 @@ sub snmp_v2_get_next_end_of_mib_view {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.4.5.0';
+  my $socket_path = File::Spec->rel2abs("$tmpdir/snmp.sock");
+
+  # A hand-encoded SNMPv2c GetRequest (request ID 1234) for
+  # 1.3.6.1.4.1.17852.2.2.1.2.0, since Net::SNMP does not support Unix domain
+  # sockets.
+  my $oid = pack('C*', 0x2b, 0x06, 0x01, 0x04, 0x01, 0x81, 0x8b, 0x3c, 0x02,
+    0x02, 0x01, 0x02, 0x00);
+  my $varbind = ber_tlv(0x30, ber_tlv(0x06, $oid) . ber_tlv(0x05, ''));
+  my $pdu = ber_tlv(0xa0, ber_tlv(0x02, pack('n', 1234)) .
+    ber_tlv(0x02, "\0") . ber_tlv(0x02, "\0") . ber_tlv(0x30, $varbind));
+  my $req = ber_tlv(0x30, ber_tlv(0x02, "\x01") .
+    ber_tlv(0x04, $snmp_community) . $pdu);
 
   my $config = {
     TraceLog => $log_file,
@@ -5020,6 +9585,7 @@ sub snmp_v2_get_next_end_of_mib_view {
         SNMPCommunity => $snmp_community,
         SNMPEngine => 'on',
         SNMPLog => $log_file,
+        SNMPSocket => $socket_path,
         SNMPTables => $table_dir,
       },
     },
@@ -5035,7 +9601,8 @@ sub snmp_v2_get_next_end_of_mib_view {
     die("Can't open pipe: $!");
   }
 
-  require Net::SNMP;
+  require IO::Socket::UNIX;
+  require Socket;
 
   my $ex;
 
@@ -5044,52 +9611,59 @@ sub snmp_v2_get_next_end_of_mib_view {
   defined(my $pid = fork()) or die("Can't fork: $!");
   if ($pid) {
     eval {
-      my ($snmp_sess, $snmp_err) = Net::SNMP->session(
-        -hostname => '127.0.0.1',
-        -port => $agent_port,
-        -version => 'snmpv2c',
-        -community => $snmp_community,
-        -retries => 1,
-        -timeout => 3,
-        -translate => 1,
-      );
-      unless ($snmp_sess) {
-        die("Unable to create Net::SNMP session: $snmp_err");
-      }
-
-      if ($ENV{TEST_VERBOSE}) {
-        # From the Net::SNMP debug perldocs
-        my $debug_mask = (0x02|0x10|0x20);
-        $snmp_sess->debug($debug_mask);
-      }
-
-      my $oids = [$request_oid];
+      # Give the agent time to start up
+      sleep(2);
 
-      my $snmp_resp = $snmp_sess->get_next_request(
-        -varbindList => $oids,
+      my $client = IO::Socket::UNIX->new(
+        Type => Socket::SOCK_SEQPACKET(),
+        Peer => $socket_path,
       );
-      unless ($snmp_resp) {
-        die("No SNMP response received: " . $snmp_sess->error());
-      }
-
-      # Do we have the requested OID in the response?
-      unless (defined($snmp_resp->{$request_oid})) {
-        die("Missing required OID $request_oid in response");
+      unless ($client) {
+        die("Unable to connect to $socket_path: $!");
       }
 
-      my $value = $snmp_resp->{$request_oid};
+      # Send several requests over the same connection.
+      for (my $i = 0; $i < 3; $i++) {
+        unless (defined($client->send($req))) {
+          die("Unable to send request: $!");
+        }
 
-      if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $request_oid = $value\n";
-      }
+        my $resp;
+        unless (defined($client->recv($resp, 65536))) {
+          die("Unable to read response: $!");
+        }
 
-      my $expected = 'endOfMibView';
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Received ", length($resp), " bytes\n";
+        }
 
-      $self->assert($expected eq $value,
-        test_msg("Expected value '$expected' for OID, got '$value'"));
+        # Skip the message SEQUENCE header, version and community, to get
+        # to the response PDU.
+        my ($type, $value) = ber_read(\$resp);
+        $self->assert($type == 0x30,
+          test_msg(sprintf("Expected SEQUENCE, got 0x%02x", $type)));
+
+        ber_read(\$value);
+        ber_read(\$value);
+
+        ($type, $value) = ber_read(\$value);
+        $self->assert($type == 0xa2,
+          test_msg(sprintf("Expected GetResponse PDU, got 0x%02x", $type)));
+
+        my ($id_type, $id) = ber_read(\$value);
+        my $expected = 1234;
+        $id = unpack('n', $id);
+        $self->assert($id == $expected,
+          test_msg("Expected request ID $expected, got $id"));
+
+        my ($err_type, $err) = ber_read(\$value);
+        $expected = 0;
+        $err = unpack('C', $err);
+        $self->assert($err == $expected,
+          test_msg("Expected error-status $expected, got $err"));
+      }
 
-      $snmp_sess->close();
-      $snmp_sess = undef;
+      $client->close();
     };
 
     if ($@) {
@@ -5124,7 +9698,7 @@ sub snmp_v2_get_next_end_of_mib_view {
   unlink($log_file);
 }
 
-sub snmp_v2_get_bulk {
+sub snmp_v2_get_bulk_end_of_mib_view {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5165,8 +9739,13 @@ sub snmp_v2_get_bulk {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
-  my $next_oid = '1.3.6.1.4.1.17852.2.2.1.3.0';
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.4.3.0';
+
+  my $next_oids = {
+    '1.3.6.1.4.1.17852.2.2.4.4.0' => '\d+',
+    '1.3.6.1.4.1.17852.2.2.4.5.0' => '\d+',
+    '1.3.6.1.4.1.17852.2.2.4.5.0 ' => 'endOfMibView',
+  };
 
   my $config = {
     TraceLog => $log_file,
@@ -5234,29 +9813,30 @@ sub snmp_v2_get_bulk {
       my $oids = [$request_oid];
 
       my $snmp_resp = $snmp_sess->get_bulk_request(
-        -nonrepeaters => 1,
+        -maxrepetitions => 5,
         -varbindList => $oids,
       );
       unless ($snmp_resp) {
         die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      # Do we have the next OID of the requested OID in the response?
-      unless (defined($snmp_resp->{$next_oid})) {
-        die("Missing required OID $next_oid in response");
-      }
+      foreach my $next_oid (keys(%$next_oids)) {
+        # Do we have the next OID of the requested OID in the response?
+        unless (defined($snmp_resp->{$next_oid})) {
+          die("Missing required OID $next_oid in response");
+        }
 
-      my $value = $snmp_resp->{$next_oid};
+        my $value = $snmp_resp->{$next_oid};
 
-      if ($ENV{TEST_VERBOSE}) {
-        print STDERR "Requested OID $next_oid = $value\n";
-      }
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "Requested OID $next_oid = $value\n";
+        }
 
-      # The default proftpd string, without ServerAdmin configured.
-      my $expected = 'root@127.0.0.1';
+        my $expected = $next_oids->{$next_oid};
 
-      $self->assert(qr/$expected/, $value,
-        test_msg("Expected value '$expected' for OID, got '$value'"));
+        $self->assert(qr/$expected/, $value,
+          test_msg("Expected value '$expected' for OID, got '$value'"));
+      }
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -5294,7 +9874,7 @@ sub snmp_v2_get_bulk {
   unlink($log_file);
 }
 
-sub snmp_v2_get_bulk_max_repetitions_only {
+sub snmp_v2_set_no_access {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5335,12 +9915,7 @@ sub snmp_v2_get_bulk_max_repetitions_only {
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.2.0';
-
-  my $next_oids = {
-    '1.3.6.1.4.1.17852.2.2.1.3.0' => 'root@127.0.0.1',
-    '1.3.6.1.4.1.17852.2.2.1.4.0' => '\d+\.\d+',
-  };
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
 
   my $config = {
     TraceLog => $log_file,
@@ -5378,6 +9953,7 @@ sub snmp_v2_get_bulk_max_repetitions_only {
   }
 
   require Net::SNMP;
+  require Net::SNMP::Message;
 
   my $ex;
 
@@ -5405,33 +9981,19 @@ sub snmp_v2_get_bulk_max_repetitions_only {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $oids = [$request_oid];
-
-      my $snmp_resp = $snmp_sess->get_bulk_request(
-        -maxrepetitions => 2,
-        -varbindList => $oids,
+      my $snmp_resp = $snmp_sess->set_request(
+        -varbindList => [ $request_oid, Net::SNMP::Message::OCTET_STRING(),
+                          'mod_smp' ],
       );
-      unless ($snmp_resp) {
-        die("No SNMP response received: " . $snmp_sess->error());
+      if ($snmp_resp) {
+        die("SNMP response received unexpectedly");
       }
 
-      foreach my $next_oid (keys(%$next_oids)) {
-        # Do we have the next OID of the requested OID in the response?
-        unless (defined($snmp_resp->{$next_oid})) {
-          die("Missing required OID $next_oid in response");
-        }
-
-        my $value = $snmp_resp->{$next_oid};
-
-        if ($ENV{TEST_VERBOSE}) {
-          print STDERR "Requested OID $next_oid = $value\n";
-        }
-
-        my $expected = $next_oids->{$next_oid};
+      my $err = $snmp_sess->error();
+      my $expected = 'Received noAccess(6) error-status at error-index 1';
 
-        $self->assert(qr/$expected/, $value,
-          test_msg("Expected value '$expected' for OID, got '$value'"));
-      }
+      $self->assert($expected eq $err,
+        test_msg("Expected error '$expected' for OID, got '$err'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -5445,7 +10007,7 @@ sub snmp_v2_get_bulk_max_repetitions_only {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh) };
+    eval { server_wait($config_file, $rfh, 10) };
     if ($@) {
       warn($@);
       exit 1;
@@ -5469,7 +10031,7 @@ sub snmp_v2_get_bulk_max_repetitions_only {
   unlink($log_file);
 }
 
-sub snmp_v2_get_bulk_end_of_mib_view {
+sub snmp_v3_get_authpriv {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5509,18 +10071,15 @@ sub snmp_v2_get_bulk_end_of_mib_view {
 
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
+  my $snmp_user = 'monitor';
+  my $snmp_auth_passwd = 'authpass123';
+  my $snmp_priv_passwd = 'privpass123';
 
-  my $request_oid = '1.3.6.1.4.1.17852.2.2.4.3.0';
-
-  my $next_oids = {
-    '1.3.6.1.4.1.17852.2.2.4.4.0' => '\d+',
-    '1.3.6.1.4.1.17852.2.2.4.5.0' => '\d+',
-    '1.3.6.1.4.1.17852.2.2.4.5.0 ' => 'endOfMibView',
-  };
+  my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
 
   my $config = {
     TraceLog => $log_file,
-    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20 snmp.usm:20',
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
@@ -5539,6 +10098,7 @@ sub snmp_v2_get_bulk_end_of_mib_view {
         SNMPEngine => 'on',
         SNMPLog => $log_file,
         SNMPTables => $table_dir,
+        SNMPUser => "$snmp_user SHA $snmp_auth_passwd AES $snmp_priv_passwd",
       },
     },
   };
@@ -5565,8 +10125,12 @@ sub snmp_v2_get_bulk_end_of_mib_view {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv2c',
-        -community => $snmp_community,
+        -version => 'snmpv3',
+        -username => $snmp_user,
+        -authprotocol => 'sha',
+        -authpassword => $snmp_auth_passwd,
+        -privprotocol => 'aes',
+        -privpassword => $snmp_priv_passwd,
         -retries => 1,
         -timeout => 3,
         -translate => 1,
@@ -5583,31 +10147,28 @@ sub snmp_v2_get_bulk_end_of_mib_view {
 
       my $oids = [$request_oid];
 
-      my $snmp_resp = $snmp_sess->get_bulk_request(
-        -maxrepetitions => 5,
+      my $snmp_resp = $snmp_sess->get_request(
         -varbindList => $oids,
       );
       unless ($snmp_resp) {
         die("No SNMP response received: " . $snmp_sess->error());
       }
 
-      foreach my $next_oid (keys(%$next_oids)) {
-        # Do we have the next OID of the requested OID in the response?
-        unless (defined($snmp_resp->{$next_oid})) {
-          die("Missing required OID $next_oid in response");
-        }
+      # Do we have the requested OID in the response?
+      unless (defined($snmp_resp->{$request_oid})) {
+        die("Missing required OID $request_oid in response");
+      }
 
-        my $value = $snmp_resp->{$next_oid};
+      my $value = $snmp_resp->{$request_oid};
 
-        if ($ENV{TEST_VERBOSE}) {
-          print STDERR "Requested OID $next_oid = $value\n";
-        }
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Requested OID $request_oid = $value\n";
+      }
 
-        my $expected = $next_oids->{$next_oid};
+      my $expected = 'proftpd';
 
-        $self->assert(qr/$expected/, $value,
-          test_msg("Expected value '$expected' for OID, got '$value'"));
-      }
+      $self->assert($expected eq $value,
+        test_msg("Expected value '$expected' for OID, got '$value'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -5645,7 +10206,7 @@ sub snmp_v2_get_bulk_end_of_mib_view {
   unlink($log_file);
 }
 
-sub snmp_v2_set_no_access {
+sub snmp_v3_get_wrong_passwd {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
 
@@ -5685,12 +10246,15 @@ sub snmp_v2_set_no_access {
 
   my $agent_port = ProFTPD::TestSuite::Utils::get_high_numbered_port();
   my $snmp_community = "public";
+  my $snmp_user = 'monitor';
+  my $snmp_auth_passwd = 'authpass123';
+  my $snmp_priv_passwd = 'privpass123';
 
   my $request_oid = '1.3.6.1.4.1.17852.2.2.1.1.0';
 
   my $config = {
     TraceLog => $log_file,
-    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20',
+    Trace => 'snmp:20 snmp.asn1:20 snmp.db:20 snmp.msg:20 snmp.pdu:20 snmp.smi:20 snmp.usm:20',
     PidFile => $pid_file,
     ScoreboardFile => $scoreboard_file,
     SystemLog => $log_file,
@@ -5709,6 +10273,7 @@ sub snmp_v2_set_no_access {
         SNMPEngine => 'on',
         SNMPLog => $log_file,
         SNMPTables => $table_dir,
+        SNMPUser => "$snmp_user SHA $snmp_auth_passwd AES $snmp_priv_passwd",
       },
     },
   };
@@ -5724,7 +10289,6 @@ sub snmp_v2_set_no_access {
   }
 
   require Net::SNMP;
-  require Net::SNMP::Message;
 
   my $ex;
 
@@ -5736,8 +10300,12 @@ sub snmp_v2_set_no_access {
       my ($snmp_sess, $snmp_err) = Net::SNMP->session(
         -hostname => '127.0.0.1',
         -port => $agent_port,
-        -version => 'snmpv2c',
-        -community => $snmp_community,
+        -version => 'snmpv3',
+        -username => $snmp_user,
+        -authprotocol => 'sha',
+        -authpassword => 'wrongpass123',
+        -privprotocol => 'aes',
+        -privpassword => $snmp_priv_passwd,
         -retries => 1,
         -timeout => 3,
         -translate => 1,
@@ -5752,19 +10320,23 @@ sub snmp_v2_set_no_access {
         $snmp_sess->debug($debug_mask);
       }
 
-      my $snmp_resp = $snmp_sess->set_request(
-        -varbindList => [ $request_oid, Net::SNMP::Message::OCTET_STRING(),
-                          'mod_smp' ],
+      my $oids = [$request_oid];
+
+      my $snmp_resp = $snmp_sess->get_request(
+        -varbindList => $oids,
       );
       if ($snmp_resp) {
         die("SNMP response received unexpectedly");
       }
 
       my $err = $snmp_sess->error();
-      my $expected = 'Received noAccess(6) error-status at error-index 1';
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "Expected SNMP error: $err\n";
+      }
 
-      $self->assert($expected eq $err,
-        test_msg("Expected error '$expected' for OID, got '$err'"));
+      # The agent's wrongDigests Report should be received
+      $self->assert(qr/digest|authenticat/i, $err,
+        test_msg("Expected authentication error, got '$err'"));
 
       $snmp_sess->close();
       $snmp_sess = undef;
@@ -5778,7 +10350,7 @@ sub snmp_v2_set_no_access {
     $wfh->flush();
 
   } else {
-    eval { server_wait($config_file, $rfh, 10) };
+    eval { server_wait($config_file, $rfh) };
     if ($@) {
       warn($@);
       exit 1;
@@ -6130,4 +10702,39 @@ sub snmp_config_max_variables {
   unlink($log_file);
 }
 
+# Encodes a BER TLV, for hand-built SNMP messages.
+sub ber_tlv {
+  my $type = shift;
+  my $value = shift;
+
+  my $len = length($value);
+  if ($len < 0x80) {
+    return pack('CC', $type, $len) . $value;
+  }
+
+  return pack('CCn', $type, 0x82, $len) . $value;
+}
+
+# Reads the next BER TLV from the given buffer, returning its type and value.
+sub ber_read {
+  my $buf = shift;
+
+  my ($type, $len) = unpack('CC', $$buf);
+  my $offset = 2;
+
+  if ($len & 0x80) {
+    my $nlen = $len & 0x7f;
+    $len = 0;
+
+    for (my $i = 0; $i < $nlen; $i++) {
+      $len = ($len << 8) | unpack('C', substr($$buf, $offset++, 1));
+    }
+  }
+
+  my $value = substr($$buf, $offset, $len);
+  $$buf = substr($$buf, $offset + $len);
+
+  return ($type, $value);
+}
+
 1;
@@ -0,0 +1,238 @@
+/*
+ * ProFTPD - mod_snmp GET response templates
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+#include "asn1.h"
+#include "template.h"
+#include "hash.h"
+
+/* Managers usually poll the same fixed list of OIDs, over and over.  For
+ * such a GET, resolving each OID to its MIB (and checking the view) gives
+ * the same answer every time, so that is done once; the resolved MIBs, and
+ * their encoded OIDs, are kept as a template for the response.  Answering
+ * a repeated request is then a matter of reading the current values, and
+ * encoding them after the pre-encoded OIDs.
+ *
+ * Templates are keyed by the SNMP version, the view, and the requested
+ * OIDs; the OIDs are compared in full on a hash match.
+ */
+
+struct snmp_template_entry {
+  pool *pool;
+  uint32_t hash;
+
+  long snmp_version;
+  const struct snmp_view *view;
+
+  oid_t **names;
+  unsigned int *namelens;
+
+  struct snmp_template tmpl;
+};
+
+static pool *template_pool = NULL;
+static struct snmp_template_entry template_cache[SNMP_TEMPLATE_CACHE_SIZE];
+static unsigned int template_next = 0;
+
+static const char *trace_channel = "snmp.template";
+
+/* Hashes the requested OIDs. */
+static uint32_t template_hash(struct snmp_var *varlist) {
+  struct snmp_var *var;
+  uint32_t h = SNMP_HASH_INIT;
+
+  for (var = varlist; var != NULL; var = var->next) {
+    unsigned char sep = 0xff;
+
+    h = snmp_hash_bytes(h, var->name, var->namelen * sizeof(oid_t));
+
+    /* Separate the OIDs, so that e.g. "1.2" "3" and "1" "2.3" differ. */
+    h = snmp_hash_bytes(h, &sep, sizeof(sep));
+  }
+
+  return h;
+}
+
+static int template_matches(struct snmp_template_entry *entry,
+    struct snmp_var *varlist) {
+  register unsigned int i;
+  struct snmp_var *var;
+
+  for (i = 0, var = varlist; var != NULL; i++, var = var->next) {
+    if (i >= entry->tmpl.nslots ||
+        var->namelen != entry->namelens[i] ||
+        memcmp(var->name, entry->names[i],
+          var->namelen * sizeof(oid_t)) != 0) {
+      return FALSE;
+    }
+  }
+
+  return (i == entry->tmpl.nslots);
+}
+
+struct snmp_template *snmp_template_get(long snmp_version,
+    const struct snmp_view *view, struct snmp_var *varlist,
+    unsigned int varlistlen) {
+  register unsigned int i;
+  uint32_t h;
+
+  if (varlist == NULL ||
+      varlistlen == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  h = template_hash(varlist);
+
+  for (i = 0; i < SNMP_TEMPLATE_CACHE_SIZE; i++) {
+    struct snmp_template_entry *entry;
+
+    entry = &(template_cache[i]);
+    if (entry->pool == NULL ||
+        entry->hash != h ||
+        entry->tmpl.nslots != varlistlen ||
+        entry->snmp_version != snmp_version ||
+        entry->view != view) {
+      continue;
+    }
+
+    if (template_matches(entry, varlist) == FALSE) {
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 17, "found template for GET of %u %s",
+      varlistlen, varlistlen != 1 ? "variables" : "variable");
+    return &(entry->tmpl);
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+/* Exceptions are reported with the requested OID, which is encoded here. */
+static int template_encode_name(pool *p, struct snmp_template_slot *slot,
+    struct snmp_var *var) {
+  unsigned char asn1_type, *buf;
+  size_t buflen;
+
+  buflen = snmp_asn1_get_oid_len(var->name, var->namelen);
+  buf = palloc(p, buflen);
+
+  slot->ber_name = buf;
+  slot->ber_namelen = (unsigned int) buflen;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OID);
+  return snmp_asn1_write_oid(p, &buf, &buflen, asn1_type, var->name,
+    var->namelen);
+}
+
+int snmp_template_add(long snmp_version, const struct snmp_view *view,
+    struct snmp_var *varlist, unsigned int varlistlen,
+    struct snmp_template_slot *slots) {
+  register unsigned int i;
+  struct snmp_template_entry *entry;
+  struct snmp_var *var;
+
+  if (varlist == NULL ||
+      varlistlen == 0 ||
+      slots == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (template_pool == NULL) {
+    template_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(template_pool, MOD_SNMP_VERSION ": Template Pool");
+  }
+
+  entry = &(template_cache[template_next]);
+  template_next = (template_next + 1) % SNMP_TEMPLATE_CACHE_SIZE;
+
+  if (entry->pool != NULL) {
+    destroy_pool(entry->pool);
+  }
+
+  entry->pool = make_sub_pool(template_pool);
+  pr_pool_tag(entry->pool, MOD_SNMP_VERSION ": Template Entry Pool");
+
+  entry->hash = template_hash(varlist);
+  entry->snmp_version = snmp_version;
+  entry->view = view;
+
+  entry->names = palloc(entry->pool, varlistlen * sizeof(oid_t *));
+  entry->namelens = palloc(entry->pool, varlistlen * sizeof(unsigned int));
+  entry->tmpl.slots = pcalloc(entry->pool,
+    varlistlen * sizeof(struct snmp_template_slot));
+  entry->tmpl.nslots = varlistlen;
+
+  for (i = 0, var = varlist; i < varlistlen && var != NULL;
+       i++, var = var->next) {
+    struct snmp_template_slot *slot;
+
+    entry->names[i] = palloc(entry->pool, var->namelen * sizeof(oid_t));
+    memcpy(entry->names[i], var->name, var->namelen * sizeof(oid_t));
+    entry->namelens[i] = var->namelen;
+
+    slot = &(entry->tmpl.slots[i]);
+    slot->mib = slots[i].mib;
+    slot->smi_type = slots[i].smi_type;
+
+    if (slot->mib != NULL) {
+      slot->ber_name = slot->mib->ber_oid;
+      slot->ber_namelen = slot->mib->ber_oidlen;
+
+    } else if (template_encode_name(entry->pool, slot, var) < 0) {
+      int xerrno = errno;
+
+      destroy_pool(entry->pool);
+      entry->pool = NULL;
+
+      errno = xerrno;
+      return -1;
+    }
+  }
+
+  if (i != varlistlen) {
+    destroy_pool(entry->pool);
+    entry->pool = NULL;
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "added template for GET of %u %s",
+    varlistlen, varlistlen != 1 ? "variables" : "variable");
+  return 0;
+}
+
+void snmp_template_clear(void) {
+  if (template_pool != NULL) {
+    destroy_pool(template_pool);
+    template_pool = NULL;
+  }
+
+  memset(template_cache, 0, sizeof(template_cache));
+  template_next = 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * ProFTPD - mod_snmp GET response templates
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_snmp.h"
+#include "mib.h"
+#include "smi.h"
+#include "view.h"
+
+#ifndef MOD_SNMP_TEMPLATE_H
+#define MOD_SNMP_TEMPLATE_H
+
+/* Number of distinct GET variable lists kept */
+#define SNMP_TEMPLATE_CACHE_SIZE	8
+
+/* One variable binding of a GET response: either a MIB, whose value is read
+ * when the response is made, or an exception (e.g. noSuchObject) for the
+ * requested OID.  The encoded OID is the one used in the response binding.
+ */
+struct snmp_template_slot {
+  struct snmp_mib *mib;
+  unsigned char smi_type;
+
+  const unsigned char *ber_name;
+  unsigned int ber_namelen;
+};
+
+struct snmp_template {
+  struct snmp_template_slot *slots;
+  unsigned int nslots;
+};
+
+/* Looks up the template for a GET of the given variables, using the given
+ * SNMP version and view.  Returns NULL, with errno set to ENOENT, if there
+ * is none.
+ */
+struct snmp_template *snmp_template_get(long snmp_version,
+  const struct snmp_view *view, struct snmp_var *varlist,
+  unsigned int varlistlen);
+
+/* Keeps a template, made from the given slots (one per variable, with only
+ * the mib and smi_type fields needed), replacing the oldest template.
+ */
+int snmp_template_add(long snmp_version, const struct snmp_view *view,
+  struct snmp_var *varlist, unsigned int varlistlen,
+  struct snmp_template_slot *slots);
+
+/* Discards all templates, e.g. when the MIB table or views are rebuilt. */
+void snmp_template_clear(void);
+
+#endif
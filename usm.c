@@ -0,0 +1,909 @@
+/*
+ * ProFTPD - mod_snmp SNMPv3 User-based Security Model (USM)
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "asn1.h"
+#include "usm.h"
+
+#ifdef PR_USE_OPENSSL
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+/* RFC 3414 and RFC 3826 are written so that almost all of the expensive work
+ * can be done ahead of time: the localized keys depend only on the password
+ * and our engine ID, and so are computed once per user, at startup.  The
+ * HMAC inner/outer digest states, and the AES key schedules, are kept with
+ * each user as well, so that handling a message only means copying a digest
+ * state (into a context kept for that purpose), and setting a new IV.
+ */
+
+struct snmp_usm_user {
+  struct snmp_usm_user *next;
+
+  const char *name;
+  unsigned int namelen;
+
+  int auth_proto;
+  EVP_MD_CTX *auth_ipad_ctx;
+  EVP_MD_CTX *auth_opad_ctx;
+
+  int priv_proto;
+  EVP_CIPHER_CTX *encrypt_ctx;
+  EVP_CIPHER_CTX *decrypt_ctx;
+};
+
+/* RFC 3414, Section 2.6: the password is repeated to fill 1 MB. */
+#define USM_PASSWD_HASH_LEN		1048576
+
+static pool *usm_pool = NULL;
+static struct snmp_usm_user *usm_users = NULL;
+
+/* The digest context into which a user's precomputed HMAC states are copied,
+ * for each message.
+ */
+static EVP_MD_CTX *usm_hmac_ctx = NULL;
+
+static unsigned char usm_engine_id[SNMP_USM_MAX_ENGINE_ID_LEN];
+static unsigned int usm_engine_idlen = 0;
+static long usm_engine_boots = 0;
+static time_t usm_engine_start = 0;
+
+/* The AES salt, which must never repeat for a given key (RFC 3826, 3.1.2.1).
+ * It is seeded randomly, and incremented per message.
+ */
+static uint64_t usm_salt = 0;
+
+/* usmStats counters, indexed by SNMP_USM_STAT_* */
+static unsigned long usm_stats[SNMP_USM_STAT_DECRYPTION_ERRORS+1];
+
+/* usmStats OIDs, 1.3.6.1.6.3.15.1.1.N.0 */
+static oid_t usm_stats_oid[] = { 1, 3, 6, 1, 6, 3, 15, 1, 1, 0, 0 };
+#define USM_STATS_OIDLEN	(sizeof(usm_stats_oid) / sizeof(oid_t))
+
+static const char *trace_channel = "snmp.usm";
+
+static void usm_free_user(struct snmp_usm_user *user) {
+  if (user->auth_ipad_ctx != NULL) {
+    EVP_MD_CTX_free(user->auth_ipad_ctx);
+    user->auth_ipad_ctx = NULL;
+  }
+
+  if (user->auth_opad_ctx != NULL) {
+    EVP_MD_CTX_free(user->auth_opad_ctx);
+    user->auth_opad_ctx = NULL;
+  }
+
+  if (user->encrypt_ctx != NULL) {
+    EVP_CIPHER_CTX_free(user->encrypt_ctx);
+    user->encrypt_ctx = NULL;
+  }
+
+  if (user->decrypt_ctx != NULL) {
+    EVP_CIPHER_CTX_free(user->decrypt_ctx);
+    user->decrypt_ctx = NULL;
+  }
+}
+
+static void usm_cleanup_cb(void *data) {
+  struct snmp_usm_user *user;
+
+  for (user = usm_users; user; user = user->next) {
+    usm_free_user(user);
+  }
+
+  if (usm_hmac_ctx != NULL) {
+    EVP_MD_CTX_free(usm_hmac_ctx);
+    usm_hmac_ctx = NULL;
+  }
+
+  usm_users = NULL;
+  usm_pool = NULL;
+}
+
+static long usm_get_engine_time(void) {
+  return (long) (time(NULL) - usm_engine_start);
+}
+
+/* The engine boots counter must increase every time the agent starts, or
+ * previously sent messages could be replayed.  It is kept in a small file in
+ * the SNMPTables directory; if it cannot be read and updated, -1 is returned,
+ * and SNMPv3 cannot be used.
+ */
+static long usm_incr_engine_boots(pool *p, const char *tables_dir) {
+  const char *path;
+  char buf[32];
+  long boots = 0;
+  int fd, res, xerrno;
+  ssize_t len;
+
+  path = pdircat(p, tables_dir, "engineBoots", NULL);
+
+  PRIVS_ROOT
+  fd = open(path, O_RDWR|O_CREAT, 0600);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fd < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to open '%s': %s", path, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(buf, '\0', sizeof(buf));
+
+  PRIVS_ROOT
+  len = read(fd, buf, sizeof(buf)-1);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (len < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to read '%s': %s", path, strerror(xerrno));
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (len > 0) {
+    boots = strtol(buf, NULL, 10);
+  }
+
+  if (boots < 0 ||
+      boots >= 2147483647L) {
+    /* RFC 3414, Section 2.2.2: once the counter latches, the engine ID must
+     * change; we simply start over.
+     */
+    boots = 0;
+  }
+
+  boots++;
+
+  memset(buf, '\0', sizeof(buf));
+  snprintf(buf, sizeof(buf)-1, "%ld\n", boots);
+
+  res = 0;
+
+  PRIVS_ROOT
+  if (lseek(fd, 0, SEEK_SET) < 0 ||
+      ftruncate(fd, 0) < 0 ||
+      write(fd, buf, strlen(buf)) != (ssize_t) strlen(buf)) {
+    res = -1;
+  }
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to update '%s': %s", path, strerror(xerrno));
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  if (close(fd) < 0) {
+    xerrno = errno;
+
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unable to update '%s': %s", path, strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  return boots;
+}
+
+/* RFC 3414, Section A.2.2: password to key, then key localization. */
+static int usm_localize_key(const char *passwd, unsigned char *key) {
+  register unsigned int i;
+  EVP_MD_CTX *ctx;
+  unsigned char buf[64], ku[SHA_DIGEST_LENGTH];
+  size_t passwdlen, passwd_idx = 0;
+  unsigned long count = 0;
+  int res = 0;
+
+  ctx = EVP_MD_CTX_new();
+  if (ctx == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  passwdlen = strlen(passwd);
+
+  if (EVP_DigestInit_ex(ctx, EVP_sha1(), NULL) != 1) {
+    res = -1;
+  }
+
+  while (res == 0 &&
+         count < USM_PASSWD_HASH_LEN) {
+    for (i = 0; i < sizeof(buf); i++) {
+      buf[i] = passwd[passwd_idx++ % passwdlen];
+    }
+
+    if (EVP_DigestUpdate(ctx, buf, sizeof(buf)) != 1) {
+      res = -1;
+    }
+
+    count += sizeof(buf);
+  }
+
+  if (res < 0 ||
+      EVP_DigestFinal_ex(ctx, ku, NULL) != 1 ||
+      EVP_DigestInit_ex(ctx, EVP_sha1(), NULL) != 1 ||
+      EVP_DigestUpdate(ctx, ku, sizeof(ku)) != 1 ||
+      EVP_DigestUpdate(ctx, usm_engine_id, usm_engine_idlen) != 1 ||
+      EVP_DigestUpdate(ctx, ku, sizeof(ku)) != 1 ||
+      EVP_DigestFinal_ex(ctx, key, NULL) != 1) {
+    res = -1;
+  }
+
+  EVP_MD_CTX_free(ctx);
+  OPENSSL_cleanse(ku, sizeof(ku));
+  OPENSSL_cleanse(buf, sizeof(buf));
+
+  if (res < 0) {
+    errno = EINVAL;
+  }
+
+  return res;
+}
+
+static int usm_hmac(struct snmp_usm_user *user, const unsigned char *data,
+    size_t datalen, unsigned char *digest) {
+  unsigned char inner[SHA_DIGEST_LENGTH];
+
+  if (EVP_MD_CTX_copy_ex(usm_hmac_ctx, user->auth_ipad_ctx) != 1 ||
+      EVP_DigestUpdate(usm_hmac_ctx, data, datalen) != 1 ||
+      EVP_DigestFinal_ex(usm_hmac_ctx, inner, NULL) != 1 ||
+      EVP_MD_CTX_copy_ex(usm_hmac_ctx, user->auth_opad_ctx) != 1 ||
+      EVP_DigestUpdate(usm_hmac_ctx, inner, sizeof(inner)) != 1 ||
+      EVP_DigestFinal_ex(usm_hmac_ctx, digest, NULL) != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int usm_crypt(EVP_CIPHER_CTX *ctx, long engine_boots, long engine_time,
+    const unsigned char *salt, unsigned char *data, size_t datalen) {
+  unsigned char iv[16];
+  uint32_t val;
+  int outlen;
+
+  /* RFC 3826, Section 3.1.2.1: the IV is the engine boots and time, followed
+   * by the salt.
+   */
+  val = htonl((uint32_t) engine_boots);
+  memcpy(iv, &val, 4);
+  val = htonl((uint32_t) engine_time);
+  memcpy(iv + 4, &val, 4);
+  memcpy(iv + 8, salt, SNMP_USM_PRIV_PARAMS_LEN);
+
+  /* Keep the key schedule; only the IV changes. */
+  if (EVP_CipherInit_ex(ctx, NULL, NULL, NULL, iv, -1) != 1 ||
+      EVP_CipherUpdate(ctx, data, &outlen, data, (int) datalen) != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int usm_fail(struct snmp_usm_msg *msg, int stat) {
+  usm_stats[stat]++;
+
+  msg->report_stat = stat;
+  msg->resp_engine_time = usm_get_engine_time();
+
+  /* Reports are only authenticated for known users, i.e. for the
+   * notInTimeWindows report (RFC 3414, Section 3.2, step 7).
+   */
+  msg->resp_flags = (msg->user != NULL ? SNMP_USM_FL_AUTH : 0);
+
+  errno = EACCES;
+  return -1;
+}
+
+int snmp_usm_init(pool *p, const char *tables_dir) {
+  char hostname[256];
+  size_t hostnamelen;
+
+  if (usm_pool != NULL) {
+    destroy_pool(usm_pool);
+  }
+
+  usm_pool = make_sub_pool(p);
+  pr_pool_tag(usm_pool, "SNMP USM pool");
+  register_cleanup(usm_pool, NULL, usm_cleanup_cb, usm_cleanup_cb);
+
+  usm_users = NULL;
+  memset(usm_stats, 0, sizeof(usm_stats));
+
+  usm_hmac_ctx = EVP_MD_CTX_new();
+  if (usm_hmac_ctx == NULL) {
+    destroy_pool(usm_pool);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  /* RFC 3411, Section 5: our enterprise number, with the high bit set,
+   * followed by the format (text), and the host name.
+   */
+  usm_engine_id[0] = 0x80;
+  usm_engine_id[1] = 0x00;
+  usm_engine_id[2] = 0x45;
+  usm_engine_id[3] = 0xbc;
+  usm_engine_id[4] = 0x04;
+  usm_engine_idlen = 5;
+
+  memset(hostname, '\0', sizeof(hostname));
+  if (gethostname(hostname, sizeof(hostname)-1) < 0) {
+    sstrncpy(hostname, "proftpd", sizeof(hostname));
+  }
+
+  hostnamelen = strlen(hostname);
+  if (hostnamelen > SNMP_USM_MAX_ENGINE_ID_LEN - usm_engine_idlen) {
+    hostnamelen = SNMP_USM_MAX_ENGINE_ID_LEN - usm_engine_idlen;
+  }
+
+  memcpy(usm_engine_id + usm_engine_idlen, hostname, hostnamelen);
+  usm_engine_idlen += hostnamelen;
+
+  /* Without a persistent engine boots counter, replayed messages could not
+   * be detected; better not to support SNMPv3 at all.
+   */
+  usm_engine_boots = usm_incr_engine_boots(p, tables_dir);
+  if (usm_engine_boots < 0) {
+    int xerrno = errno;
+
+    destroy_pool(usm_pool);
+    usm_engine_boots = 0;
+    usm_engine_idlen = 0;
+
+    errno = xerrno;
+    return -1;
+  }
+
+  usm_engine_start = time(NULL);
+
+  if (RAND_bytes((unsigned char *) &usm_salt, sizeof(usm_salt)) != 1) {
+    usm_salt = ((uint64_t) usm_engine_start << 32) | (uint64_t) getpid();
+  }
+
+  pr_trace_msg(trace_channel, 9, "using engine boots %ld", usm_engine_boots);
+  return 0;
+}
+
+int snmp_usm_add_user(const char *user_name, int auth_proto,
+    const char *auth_passwd, int priv_proto, const char *priv_passwd) {
+  register unsigned int i;
+  struct snmp_usm_user *user;
+  unsigned char key[SHA_DIGEST_LENGTH], pad[64];
+  int res = 0;
+
+  if (usm_pool == NULL ||
+      user_name == NULL ||
+      auth_passwd == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (auth_proto != SNMP_USM_AUTH_PROTO_SHA) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  if (priv_proto == SNMP_USM_PRIV_PROTO_AES &&
+      priv_passwd == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  user = pcalloc(usm_pool, sizeof(struct snmp_usm_user));
+  user->name = pstrdup(usm_pool, user_name);
+  user->namelen = strlen(user_name);
+  user->auth_proto = auth_proto;
+  user->priv_proto = priv_proto;
+
+  user->auth_ipad_ctx = EVP_MD_CTX_new();
+  user->auth_opad_ctx = EVP_MD_CTX_new();
+
+  if (user->auth_ipad_ctx == NULL ||
+      user->auth_opad_ctx == NULL ||
+      usm_localize_key(auth_passwd, key) < 0) {
+    usm_free_user(user);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Precompute the HMAC inner and outer digest states (RFC 2104). */
+  memset(pad, 0x36, sizeof(pad));
+  for (i = 0; i < sizeof(key); i++) {
+    pad[i] ^= key[i];
+  }
+
+  if (EVP_DigestInit_ex(user->auth_ipad_ctx, EVP_sha1(), NULL) != 1 ||
+      EVP_DigestUpdate(user->auth_ipad_ctx, pad, sizeof(pad)) != 1) {
+    res = -1;
+  }
+
+  memset(pad, 0x5c, sizeof(pad));
+  for (i = 0; i < sizeof(key); i++) {
+    pad[i] ^= key[i];
+  }
+
+  if (res == 0 &&
+      (EVP_DigestInit_ex(user->auth_opad_ctx, EVP_sha1(), NULL) != 1 ||
+       EVP_DigestUpdate(user->auth_opad_ctx, pad, sizeof(pad)) != 1)) {
+    res = -1;
+  }
+
+  if (res == 0 &&
+      priv_proto == SNMP_USM_PRIV_PROTO_AES) {
+    /* RFC 3826, Section 1.2: the first 16 bytes of the localized key. */
+    user->encrypt_ctx = EVP_CIPHER_CTX_new();
+    user->decrypt_ctx = EVP_CIPHER_CTX_new();
+
+    if (user->encrypt_ctx == NULL ||
+        user->decrypt_ctx == NULL ||
+        usm_localize_key(priv_passwd, key) < 0 ||
+        EVP_EncryptInit_ex(user->encrypt_ctx, EVP_aes_128_cfb128(), NULL, key,
+          NULL) != 1 ||
+        EVP_DecryptInit_ex(user->decrypt_ctx, EVP_aes_128_cfb128(), NULL, key,
+          NULL) != 1) {
+      res = -1;
+    }
+  }
+
+  OPENSSL_cleanse(key, sizeof(key));
+  OPENSSL_cleanse(pad, sizeof(pad));
+
+  if (res < 0) {
+    usm_free_user(user);
+    errno = EINVAL;
+    return -1;
+  }
+
+  user->next = usm_users;
+  usm_users = user;
+
+  pr_trace_msg(trace_channel, 9, "added USM user '%s' (auth SHA, priv %s)",
+    user_name, priv_proto == SNMP_USM_PRIV_PROTO_AES ? "AES" : "none");
+  return 0;
+}
+
+const unsigned char *snmp_usm_get_engine_id(unsigned int *engine_idlen) {
+  *engine_idlen = usm_engine_idlen;
+  return usm_engine_id;
+}
+
+/* RFC 3414, Section 2.4:
+ *
+ *  UsmSecurityParameters ::=
+ *    SEQUENCE {
+ *      msgAuthoritativeEngineID     OCTET STRING,
+ *      msgAuthoritativeEngineBoots  INTEGER (0..2147483647),
+ *      msgAuthoritativeEngineTime   INTEGER (0..2147483647),
+ *      msgUserName                  OCTET STRING (SIZE(0..32)),
+ *      msgAuthenticationParameters  OCTET STRING,
+ *      msgPrivacyParameters         OCTET STRING
+ *    }
+ */
+int snmp_usm_read_params(pool *p, unsigned char *buf, size_t buflen,
+    struct snmp_usm_msg *msg) {
+  unsigned char asn1_type, *user_name;
+  unsigned int asn1_len;
+  int res;
+
+  res = snmp_asn1_read_header(p, &buf, &buflen, &asn1_type, &asn1_len, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  if (asn1_type != (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT)) {
+    pr_trace_msg(trace_channel, 3,
+      "unable to read USM security parameters (tag '%s')",
+      snmp_asn1_get_tagstr(p, asn1_type));
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = snmp_asn1_read_octets(p, &buf, &buflen, &asn1_type, &(msg->engine_id),
+    &(msg->engine_idlen));
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_int(p, &buf, &buflen, &asn1_type,
+    &(msg->engine_boots), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_int(p, &buf, &buflen, &asn1_type,
+    &(msg->engine_time), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_octets(p, &buf, &buflen, &asn1_type, &user_name,
+    &(msg->user_namelen));
+  if (res < 0) {
+    return -1;
+  }
+
+  if (msg->user_namelen > SNMP_USM_MAX_USER_NAME_LEN) {
+    pr_trace_msg(trace_channel, 3,
+      "USM user name too long (%u bytes)", msg->user_namelen);
+    errno = EINVAL;
+    return -1;
+  }
+
+  memcpy(msg->user_name, user_name, msg->user_namelen);
+  msg->user_name[msg->user_namelen] = '\0';
+
+  res = snmp_asn1_read_octets(p, &buf, &buflen, &asn1_type,
+    &(msg->auth_params), &(msg->auth_paramslen));
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_read_octets(p, &buf, &buflen, &asn1_type,
+    &(msg->priv_params), &(msg->priv_paramslen));
+  if (res < 0) {
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 17,
+    "read USM security parameters: user = '%s', engine boots %ld, "
+    "engine time %ld", msg->user_name, msg->engine_boots, msg->engine_time);
+  return 0;
+}
+
+/* RFC 3414, Section 3.2: processing an incoming message. */
+int snmp_usm_process_msg(pool *p, struct snmp_usm_msg *msg,
+    unsigned char *msg_data, size_t msg_datalen) {
+  register unsigned int i;
+  struct snmp_usm_user *user;
+  unsigned char digest[SHA_DIGEST_LENGTH], *auth_params;
+  unsigned char recvd_digest[SNMP_USM_AUTH_PARAMS_LEN], diff = 0;
+  long engine_time;
+
+  msg->user = NULL;
+  msg->report_stat = 0;
+
+  if (usm_pool == NULL) {
+    /* SNMPv3 is disabled, e.g. for lack of an engine boots counter. */
+    pr_trace_msg(trace_channel, 9, "%s",
+      "SNMPv3 not available, ignoring message");
+    errno = EPERM;
+    return -1;
+  }
+
+  /* Step 3: is the message for us?  Discovery requests, with an empty engine
+   * ID, end here.
+   */
+  if (msg->engine_idlen != usm_engine_idlen ||
+      memcmp(msg->engine_id, usm_engine_id, usm_engine_idlen) != 0) {
+    pr_trace_msg(trace_channel, 9, "%s",
+      "unknown engine ID in message, reporting local engine ID");
+    return usm_fail(msg, SNMP_USM_STAT_UNKNOWN_ENGINE_IDS);
+  }
+
+  /* Step 4: do we know the user? */
+  for (user = usm_users; user; user = user->next) {
+    if (user->namelen == msg->user_namelen &&
+        memcmp(user->name, msg->user_name, user->namelen) == 0) {
+      break;
+    }
+  }
+
+  if (user == NULL) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unknown SNMPv3 user '%s'", msg->user_name);
+    return usm_fail(msg, SNMP_USM_STAT_UNKNOWN_USER_NAMES);
+  }
+
+  /* Step 5: every user authenticates, and only users with a privacy
+   * protocol may ask for privacy.
+   */
+  if (!(msg->msg_flags & SNMP_USM_FL_AUTH) ||
+      ((msg->msg_flags & SNMP_USM_FL_PRIV) &&
+       user->priv_proto == SNMP_USM_PRIV_PROTO_NONE)) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "unsupported security level (flags 0x%02x) for SNMPv3 user '%s'",
+      msg->msg_flags, msg->user_name);
+    return usm_fail(msg, SNMP_USM_STAT_UNSUPPORTED_SEC_LEVELS);
+  }
+
+  /* Step 6: check the digest, computed with the digest zeroed.  The digest
+   * bytes are within msg_data, so they can be zeroed in place.
+   */
+  if (msg->auth_paramslen != SNMP_USM_AUTH_PARAMS_LEN) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "wrong digest length (%u bytes) for SNMPv3 user '%s'",
+      msg->auth_paramslen, msg->user_name);
+    return usm_fail(msg, SNMP_USM_STAT_WRONG_DIGESTS);
+  }
+
+  auth_params = msg->auth_params;
+  memcpy(recvd_digest, auth_params, SNMP_USM_AUTH_PARAMS_LEN);
+  memset(auth_params, 0, SNMP_USM_AUTH_PARAMS_LEN);
+
+  if (usm_hmac(user, msg_data, msg_datalen, digest) < 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "error computing digest for SNMPv3 user '%s'", msg->user_name);
+    return usm_fail(msg, SNMP_USM_STAT_WRONG_DIGESTS);
+  }
+
+  for (i = 0; i < SNMP_USM_AUTH_PARAMS_LEN; i++) {
+    diff |= (digest[i] ^ recvd_digest[i]);
+  }
+
+  if (diff != 0) {
+    (void) pr_log_writefile(snmp_logfd, MOD_SNMP_VERSION,
+      "wrong digest for SNMPv3 user '%s'", msg->user_name);
+    return usm_fail(msg, SNMP_USM_STAT_WRONG_DIGESTS);
+  }
+
+  msg->user = user;
+
+  /* Step 7: is the message timely? */
+  engine_time = usm_get_engine_time();
+  if (usm_engine_boots == 2147483647L ||
+      msg->engine_boots != usm_engine_boots ||
+      labs(msg->engine_time - engine_time) > SNMP_USM_TIME_WINDOW) {
+    pr_trace_msg(trace_channel, 9,
+      "message not in time window (boots %ld, time %ld; local boots %ld, "
+      "time %ld)", msg->engine_boots, msg->engine_time, usm_engine_boots,
+      engine_time);
+    return usm_fail(msg, SNMP_USM_STAT_NOT_IN_TIME_WINDOWS);
+  }
+
+  msg->resp_flags = (msg->msg_flags & (SNMP_USM_FL_AUTH|SNMP_USM_FL_PRIV));
+  msg->resp_engine_time = engine_time;
+
+  return 0;
+}
+
+int snmp_usm_decrypt(struct snmp_usm_msg *msg, unsigned char *data,
+    size_t datalen) {
+  if (msg->user == NULL ||
+      msg->user->decrypt_ctx == NULL ||
+      msg->priv_paramslen != SNMP_USM_PRIV_PARAMS_LEN) {
+    return usm_fail(msg, SNMP_USM_STAT_DECRYPTION_ERRORS);
+  }
+
+  /* The IV uses the boots/time values sent by the client. */
+  if (usm_crypt(msg->user->decrypt_ctx, msg->engine_boots, msg->engine_time,
+      msg->priv_params, data, datalen) < 0) {
+    return usm_fail(msg, SNMP_USM_STAT_DECRYPTION_ERRORS);
+  }
+
+  return 0;
+}
+
+int snmp_usm_encrypt(struct snmp_usm_msg *msg, unsigned char *data,
+    size_t datalen) {
+  if (msg->user == NULL ||
+      msg->user->encrypt_ctx == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return usm_crypt(msg->user->encrypt_ctx, usm_engine_boots,
+    msg->resp_engine_time, msg->resp_salt, data, datalen);
+}
+
+int snmp_usm_write_params(pool *p, unsigned char **buf, size_t *buflen,
+    struct snmp_usm_msg *msg, unsigned char **auth_params) {
+  unsigned char asn1_type, *params_hdr_start, *params_hdr_end;
+  unsigned char *seq_hdr_start, *seq_hdr_end;
+  size_t params_hdr_startlen, seq_hdr_startlen;
+  unsigned char zeros[SNMP_USM_AUTH_PARAMS_LEN];
+  int res;
+
+  /* The parameters are carried in an OCTET STRING. */
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+  params_hdr_start = *buf;
+  params_hdr_startlen = *buflen;
+
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  params_hdr_end = *buf;
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  seq_hdr_start = *buf;
+  seq_hdr_startlen = *buflen;
+
+  res = snmp_asn1_write_header(p, buf, buflen, asn1_type, 0, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  seq_hdr_end = *buf;
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+  res = snmp_asn1_write_string(p, buf, buflen, asn1_type,
+    (const char *) usm_engine_id, usm_engine_idlen);
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_INTEGER);
+  res = snmp_asn1_write_int(p, buf, buflen, asn1_type, usm_engine_boots, 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  res = snmp_asn1_write_int(p, buf, buflen, asn1_type, msg->resp_engine_time,
+    0);
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+  res = snmp_asn1_write_string(p, buf, buflen, asn1_type, msg->user_name,
+    msg->user_namelen);
+  if (res < 0) {
+    return -1;
+  }
+
+  /* The digest is filled in by snmp_usm_sign(), once the whole message has
+   * been written.
+   */
+  memset(zeros, 0, sizeof(zeros));
+  *auth_params = NULL;
+
+  if (msg->resp_flags & SNMP_USM_FL_AUTH) {
+    res = snmp_asn1_write_string(p, buf, buflen, asn1_type,
+      (const char *) zeros, sizeof(zeros));
+    *auth_params = *buf - sizeof(zeros);
+
+  } else {
+    res = snmp_asn1_write_string(p, buf, buflen, asn1_type, "", 0);
+  }
+
+  if (res < 0) {
+    return -1;
+  }
+
+  if (msg->resp_flags & SNMP_USM_FL_PRIV) {
+    register unsigned int i;
+    uint64_t salt;
+
+    salt = ++usm_salt;
+    for (i = 0; i < SNMP_USM_PRIV_PARAMS_LEN; i++) {
+      msg->resp_salt[SNMP_USM_PRIV_PARAMS_LEN - 1 - i] =
+        (unsigned char) (salt & 0xff);
+      salt >>= 8;
+    }
+
+    res = snmp_asn1_write_string(p, buf, buflen, asn1_type,
+      (const char *) msg->resp_salt, SNMP_USM_PRIV_PARAMS_LEN);
+
+  } else {
+    res = snmp_asn1_write_string(p, buf, buflen, asn1_type, "", 0);
+  }
+
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_TYPE_SEQUENCE|SNMP_ASN1_CONSTRUCT);
+  res = snmp_asn1_write_header(p, &seq_hdr_start, &seq_hdr_startlen,
+    asn1_type, (*buf - seq_hdr_end), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  asn1_type = (SNMP_ASN1_CLASS_UNIVERSAL|SNMP_ASN1_PRIMITIVE|SNMP_ASN1_TYPE_OCTETSTRING);
+  res = snmp_asn1_write_header(p, &params_hdr_start, &params_hdr_startlen,
+    asn1_type, (*buf - params_hdr_end), 0);
+  if (res < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int snmp_usm_sign(struct snmp_usm_msg *msg, unsigned char *msg_data,
+    size_t msg_datalen, unsigned char *auth_params) {
+  unsigned char digest[SHA_DIGEST_LENGTH];
+
+  if (msg->user == NULL ||
+      auth_params == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (usm_hmac(msg->user, msg_data, msg_datalen, digest) < 0) {
+    return -1;
+  }
+
+  memcpy(auth_params, digest, SNMP_USM_AUTH_PARAMS_LEN);
+
+  return 0;
+}
+
+unsigned int snmp_usm_get_params_len(struct snmp_usm_msg *msg) {
+  unsigned int params_len;
+
+  /* The OCTET STRING and SEQUENCE headers are written before their lengths
+   * are known.
+   */
+  params_len = (2 * snmp_asn1_get_header_len(0, 0));
+
+  params_len += snmp_asn1_get_string_len(usm_engine_idlen);
+  params_len += snmp_asn1_get_int_len(usm_engine_boots);
+  params_len += snmp_asn1_get_int_len(msg->resp_engine_time);
+
+  params_len += snmp_asn1_get_string_len(msg->user_namelen);
+
+  params_len += snmp_asn1_get_string_len(
+    (msg->resp_flags & SNMP_USM_FL_AUTH) ? SNMP_USM_AUTH_PARAMS_LEN : 0);
+  params_len += snmp_asn1_get_string_len(
+    (msg->resp_flags & SNMP_USM_FL_PRIV) ? SNMP_USM_PRIV_PARAMS_LEN : 0);
+
+  return params_len;
+}
+
+int snmp_usm_get_stat(int stat, oid_t **name, unsigned int *namelen,
+    unsigned long *value) {
+  if (stat < SNMP_USM_STAT_UNSUPPORTED_SEC_LEVELS ||
+      stat > SNMP_USM_STAT_DECRYPTION_ERRORS) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Only one Report is built at a time, so the OID can be shared. */
+  usm_stats_oid[USM_STATS_OIDLEN - 2] = stat;
+
+  *name = usm_stats_oid;
+  *namelen = USM_STATS_OIDLEN;
+  *value = usm_stats[stat];
+
+  return 0;
+}
+
+#else /* !PR_USE_OPENSSL */
+
+int snmp_usm_init(pool *p, const char *tables_dir) {
+  errno = ENOSYS;
+  return -1;
+}
+
+int snmp_usm_add_user(const char *user_name, int auth_proto,
+    const char *auth_passwd, int priv_proto, const char *priv_passwd) {
+  errno = ENOSYS;
+  return -1;
+}
+
+#endif /* PR_USE_OPENSSL */
@@ -0,0 +1,147 @@
+/*
+ * ProFTPD - mod_snmp SNMPv3 User-based Security Model (USM)
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "asn1.h"
+
+#ifndef MOD_SNMP_USM_H
+#define MOD_SNMP_USM_H
+
+/* RFC 3411 securityModel value for the USM */
+#define SNMP_USM_SECURITY_MODEL			3
+
+/* RFC 3412, Section 6.4: msgFlags */
+#define SNMP_USM_FL_AUTH			0x01
+#define SNMP_USM_FL_PRIV			0x02
+#define SNMP_USM_FL_REPORTABLE			0x04
+
+/* Authentication/privacy protocols */
+#define SNMP_USM_AUTH_PROTO_SHA			1
+
+#define SNMP_USM_PRIV_PROTO_NONE		0
+#define SNMP_USM_PRIV_PROTO_AES			1
+
+/* HMAC-SHA-96 digest (RFC 3414), and AES salt (RFC 3826), lengths */
+#define SNMP_USM_AUTH_PARAMS_LEN		12
+#define SNMP_USM_PRIV_PARAMS_LEN		8
+
+#define SNMP_USM_MAX_ENGINE_ID_LEN		32
+#define SNMP_USM_MAX_USER_NAME_LEN		32
+
+/* RFC 3414, Section 2.2.3: the time window, in seconds */
+#define SNMP_USM_TIME_WINDOW			150
+
+/* RFC 3414, Section 5: the usmStats counters, which are also the reasons
+ * for which Report PDUs are sent.
+ */
+#define SNMP_USM_STAT_UNSUPPORTED_SEC_LEVELS	1
+#define SNMP_USM_STAT_NOT_IN_TIME_WINDOWS	2
+#define SNMP_USM_STAT_UNKNOWN_USER_NAMES	3
+#define SNMP_USM_STAT_UNKNOWN_ENGINE_IDS	4
+#define SNMP_USM_STAT_WRONG_DIGESTS		5
+#define SNMP_USM_STAT_DECRYPTION_ERRORS		6
+
+struct snmp_usm_user;
+
+/* The SNMPv3 header fields, and USM security parameters, of a message.  The
+ * pointers refer to the request buffer; nothing here is allocated.
+ */
+struct snmp_usm_msg {
+  long msg_id;
+  long msg_max_size;
+  unsigned char msg_flags;
+
+  unsigned char *engine_id;
+  unsigned int engine_idlen;
+  long engine_boots;
+  long engine_time;
+
+  char user_name[SNMP_USM_MAX_USER_NAME_LEN+1];
+  unsigned int user_namelen;
+
+  unsigned char *auth_params;
+  unsigned int auth_paramslen;
+  unsigned char *priv_params;
+  unsigned int priv_paramslen;
+
+  /* The user as which the message was authenticated, if any. */
+  struct snmp_usm_user *user;
+
+  /* Why the message was rejected, i.e. the Report PDU to send. */
+  int report_stat;
+
+  /* The msgFlags, engine time and salt of the response; fixed when the
+   * request is processed, so that the response size can be computed.
+   */
+  unsigned char resp_flags;
+  long resp_engine_time;
+  unsigned char resp_salt[SNMP_USM_PRIV_PARAMS_LEN];
+};
+
+/* Sets up the local engine ID, and the engine boots counter (kept in the
+ * given SNMPTables directory), discarding any previously added users.
+ */
+int snmp_usm_init(pool *p, const char *tables_dir);
+
+/* Adds a user, localizing the passwords to the local engine ID.  This is
+ * expensive (hashing 1 MB per password), and is done once, at startup.
+ */
+int snmp_usm_add_user(const char *user_name, int auth_proto,
+  const char *auth_passwd, int priv_proto, const char *priv_passwd);
+
+const unsigned char *snmp_usm_get_engine_id(unsigned int *engine_idlen);
+
+/* Parses the contents of the msgSecurityParameters OCTET STRING. */
+int snmp_usm_read_params(pool *p, unsigned char *buf, size_t buflen,
+  struct snmp_usm_msg *msg);
+
+/* Performs the RFC 3414 incoming message checks (engine ID, user, security
+ * level, digest, timeliness) for the given whole message.  On failure, the
+ * usmStats counter to report is set in the report_stat field.
+ */
+int snmp_usm_process_msg(pool *p, struct snmp_usm_msg *msg,
+  unsigned char *msg_data, size_t msg_datalen);
+
+/* Decrypts/encrypts the scopedPDU, in place. */
+int snmp_usm_decrypt(struct snmp_usm_msg *msg, unsigned char *data,
+  size_t datalen);
+int snmp_usm_encrypt(struct snmp_usm_msg *msg, unsigned char *data,
+  size_t datalen);
+
+/* Writes the msgSecurityParameters of the response, returning a pointer
+ * to the (zeroed) msgAuthenticationParameters, for snmp_usm_sign().
+ */
+int snmp_usm_write_params(pool *p, unsigned char **buf, size_t *buflen,
+  struct snmp_usm_msg *msg, unsigned char **auth_params);
+int snmp_usm_sign(struct snmp_usm_msg *msg, unsigned char *msg_data,
+  size_t msg_datalen, unsigned char *auth_params);
+
+/* Returns the number of bytes which snmp_usm_write_params() would write. */
+unsigned int snmp_usm_get_params_len(struct snmp_usm_msg *msg);
+
+/* Returns the usmStats OID and current value for the given counter. */
+int snmp_usm_get_stat(int stat, oid_t **name, unsigned int *namelen,
+  unsigned long *value);
+
+#endif
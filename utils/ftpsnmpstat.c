@@ -0,0 +1,458 @@
+/*
+ * ProFTPD - ftpsnmpstat: local reader for the mod_snmp tables
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+/* Usage: ftpsnmpstat [-l] [-t tables-dir] [-w interval] [name ...]
+ *
+ * Reads the mod_snmp tables directly from their files, as written when
+ * "SNMPOptions PersistentTables" is used.  The files are mapped read-only,
+ * and the values read straight from memory, without taking any of the locks
+ * used by proftpd (or making any other system calls), so this is cheap
+ * enough to be run frequently, e.g. by local health checks.
+ *
+ * Each table file describes its own layout; see the snmp_db_header and
+ * snmp_db_field_desc structures in db.h.
+ */
+
+#include "mod_snmp.h"
+#include "db.h"
+#include "smi.h"
+
+#include <dirent.h>
+#include <getopt.h>
+
+#define FTPSNMPSTAT_DEFAULT_TABLES_DIR	"/var/proftpd/snmp"
+
+struct stat_table {
+  struct stat_table *next;
+  const char *path;
+  const struct snmp_db_header *hdr;
+  const struct snmp_db_field_desc *fields;
+  const volatile uint32_t *data;
+
+  /* The values as of the previous interval, when watching. */
+  uint32_t *prev_data;
+};
+
+static struct stat_table *tables = NULL;
+static char **name_filters = NULL;
+static int nname_filters = 0;
+
+static const char *program = "ftpsnmpstat";
+
+static void usage(int exit_code) {
+  fprintf(stderr,
+    "usage: %s [-l] [-t tables-dir] [-w interval] [name ...]\n\n"
+    "  -l\t\tList the fields described by each table, then exit\n"
+    "  -t dir\tRead the tables in dir (default %s)\n"
+    "  -w secs\tWatch the values, printing changes every secs seconds\n\n"
+    "If any names are given, only the fields whose names start with one of\n"
+    "them are shown.\n", program, FTPSNMPSTAT_DEFAULT_TABLES_DIR);
+  exit(exit_code);
+}
+
+/* The same log-linear bounds as snmp_db_hist_get_upper_bound(). */
+static uint32_t get_upper_bound(unsigned int bucket) {
+  if (bucket >= SNMP_DB_HIST_NBUCKETS - 1) {
+    return (uint32_t) INT_MAX;
+  }
+
+  if (bucket < 2) {
+    return bucket + 1;
+  }
+
+  if (bucket % 2 == 0) {
+    return ((uint32_t) 3 << ((bucket / 2) - 1));
+  }
+
+  return ((uint32_t) 1 << ((bucket + 1) / 2));
+}
+
+static const char *get_type_str(const struct snmp_db_field_desc *desc) {
+  switch (desc->kind) {
+    case SNMP_DB_FIELD_KIND_HISTOGRAM:
+      return "histogram";
+
+    case SNMP_DB_FIELD_KIND_COMMAND:
+      return "command";
+
+    default:
+      break;
+  }
+
+  switch (desc->smi_type) {
+    case SNMP_SMI_COUNTER32:
+      return "counter";
+
+    case SNMP_SMI_GAUGE32:
+      return "gauge";
+
+    case SNMP_SMI_INTEGER:
+      return "integer";
+
+    default:
+      break;
+  }
+
+  return "unknown";
+}
+
+static int matches_filters(const char *name) {
+  register int i;
+
+  if (nname_filters == 0) {
+    return 1;
+  }
+
+  for (i = 0; i < nname_filters; i++) {
+    if (strncmp(name, name_filters[i], strlen(name_filters[i])) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void open_table(const char *path) {
+  struct stat st;
+  struct snmp_db_header *hdr;
+  struct stat_table *tab;
+  void *map;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: unable to open '%s': %s\n", program, path,
+      strerror(errno));
+    return;
+  }
+
+  if (fstat(fd, &st) < 0 ||
+      (size_t) st.st_size < SNMP_DB_HEADER_SIZE) {
+    (void) close(fd);
+    return;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  (void) close(fd);
+
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: unable to map '%s': %s\n", program, path,
+      strerror(errno));
+    return;
+  }
+
+  hdr = map;
+  if (memcmp(hdr->magic, SNMP_DB_HEADER_MAGIC, sizeof(hdr->magic)) != 0) {
+    /* Not a table file (or one from before tables were persistent). */
+    (void) munmap(map, st.st_size);
+    return;
+  }
+
+  if (hdr->version != SNMP_DB_HEADER_VERSION ||
+      hdr->fieldsz != sizeof(struct snmp_db_field_desc) ||
+      (size_t) hdr->hdrsz < SNMP_DB_HEADER_SIZE +
+        (hdr->nfields * sizeof(struct snmp_db_field_desc)) ||
+      (size_t) hdr->hdrsz + hdr->datasz > (size_t) st.st_size) {
+    fprintf(stderr, "%s: '%s' has an unsupported layout (version %lu), "
+      "skipping\n", program, path, (unsigned long) hdr->version);
+    (void) munmap(map, st.st_size);
+    return;
+  }
+
+  tab = calloc(1, sizeof(struct stat_table));
+  if (tab == NULL) {
+    fprintf(stderr, "%s: Out of memory!\n", program);
+    exit(1);
+  }
+
+  tab->path = strdup(path);
+  tab->hdr = hdr;
+  tab->fields = (const struct snmp_db_field_desc *)
+    (((const char *) map) + SNMP_DB_HEADER_SIZE);
+  tab->data = (const volatile uint32_t *) (((const char *) map) + hdr->hdrsz);
+
+  /* Keep the tables sorted by path, for stable output. */
+  if (tables == NULL ||
+      strcmp(tab->path, tables->path) < 0) {
+    tab->next = tables;
+    tables = tab;
+
+  } else {
+    struct stat_table *prev;
+
+    for (prev = tables; prev->next != NULL; prev = prev->next) {
+      if (strcmp(tab->path, prev->next->path) < 0) {
+        break;
+      }
+    }
+
+    tab->next = prev->next;
+    prev->next = tab;
+  }
+}
+
+static void open_tables(const char *tables_dir) {
+  DIR *dirh;
+  struct dirent *dent;
+
+  dirh = opendir(tables_dir);
+  if (dirh == NULL) {
+    fprintf(stderr, "%s: unable to read directory '%s': %s\n", program,
+      tables_dir, strerror(errno));
+    exit(1);
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    size_t namelen;
+    char path[PR_TUNABLE_PATH_MAX+1];
+
+    namelen = strlen(dent->d_name);
+    if (namelen < 5 ||
+        strcmp(dent->d_name + namelen - 4, ".dat") != 0) {
+      continue;
+    }
+
+    memset(path, '\0', sizeof(path));
+    snprintf(path, sizeof(path)-1, "%s/%s", tables_dir, dent->d_name);
+    open_table(path);
+  }
+
+  (void) closedir(dirh);
+
+  if (tables == NULL) {
+    fprintf(stderr, "%s: no tables found in '%s' (is "
+      "'SNMPOptions PersistentTables' configured?)\n", program, tables_dir);
+    exit(1);
+  }
+}
+
+static void list_fields(void) {
+  struct stat_table *tab;
+
+  printf("%-8s %-6s %-6s %-5s %-9s %s\n", "TABLE", "FIELD", "OFFSET",
+    "COUNT", "TYPE", "NAME");
+
+  for (tab = tables; tab != NULL; tab = tab->next) {
+    register unsigned int i;
+    const char *table_name;
+
+    table_name = strrchr(tab->path, '/');
+    table_name = (table_name != NULL ? table_name + 1 : tab->path);
+
+    for (i = 0; i < tab->hdr->nfields; i++) {
+      const struct snmp_db_field_desc *desc = &(tab->fields[i]);
+
+      if (!matches_filters(desc->name)) {
+        continue;
+      }
+
+      printf("%-8s %-6lu %-6lu %-5lu %-9s %.*s\n", table_name,
+        (unsigned long) desc->field, (unsigned long) desc->offset,
+        (unsigned long) desc->nelts, get_type_str(desc),
+        (int) sizeof(desc->name), desc->name);
+    }
+  }
+}
+
+/* Prints a single value; when watching, only changed values are printed,
+ * along with the change.
+ */
+static void print_value(struct stat_table *tab, const char *name,
+    const char *suffix, unsigned int idx) {
+  uint32_t value;
+
+  value = tab->data[idx];
+
+  if (tab->prev_data == NULL) {
+    printf("%s%s %lu\n", name, suffix, (unsigned long) value);
+    return;
+  }
+
+  if (value != tab->prev_data[idx]) {
+    printf("%s%s %lu (%+ld)\n", name, suffix, (unsigned long) value,
+      (long) value - (long) tab->prev_data[idx]);
+  }
+}
+
+static void print_buckets(struct stat_table *tab, const char *name,
+    const char *prefix, unsigned int idx) {
+  register unsigned int i;
+
+  for (i = 0; i < SNMP_DB_HIST_NBUCKETS; i++) {
+    char suffix[64];
+
+    /* Empty buckets are not interesting. */
+    if (tab->data[idx + i] == 0 &&
+        (tab->prev_data == NULL || tab->prev_data[idx + i] == 0)) {
+      continue;
+    }
+
+    memset(suffix, '\0', sizeof(suffix));
+    if (i == SNMP_DB_HIST_NBUCKETS - 1) {
+      snprintf(suffix, sizeof(suffix)-1, "%s{le=+Inf}", prefix);
+
+    } else {
+      snprintf(suffix, sizeof(suffix)-1, "%s{le=%lu}", prefix,
+        (unsigned long) get_upper_bound(i));
+    }
+
+    print_value(tab, name, suffix, idx + i);
+  }
+}
+
+static void print_fields(void) {
+  struct stat_table *tab;
+
+  for (tab = tables; tab != NULL; tab = tab->next) {
+    register unsigned int i;
+
+    for (i = 0; i < tab->hdr->nfields; i++) {
+      const struct snmp_db_field_desc *desc = &(tab->fields[i]);
+      char name[SNMP_DB_FIELD_NAMESZ+1];
+      unsigned int idx;
+
+      /* The directory comes from the file; make sure it stays in bounds. */
+      if (((size_t) desc->offset + (desc->nelts * sizeof(uint32_t))) >
+          tab->hdr->datasz) {
+        continue;
+      }
+
+      memset(name, '\0', sizeof(name));
+      memcpy(name, desc->name, sizeof(desc->name));
+
+      if (!matches_filters(name)) {
+        continue;
+      }
+
+      idx = desc->offset / sizeof(uint32_t);
+
+      switch (desc->kind) {
+        case SNMP_DB_FIELD_KIND_HISTOGRAM:
+          if (desc->nelts >= SNMP_DB_HIST_NBUCKETS) {
+            print_buckets(tab, name, "", idx);
+          }
+          break;
+
+        case SNMP_DB_FIELD_KIND_COMMAND:
+          /* Commands which have never been seen are omitted. */
+          if (desc->nelts < SNMP_DB_CMD_NSLOTS ||
+              tab->data[idx] == 0) {
+            break;
+          }
+
+          print_value(tab, name, ".count", idx);
+          print_value(tab, name, ".errors", idx + 1);
+          print_buckets(tab, name, ".latency", idx + 2);
+          break;
+
+        default:
+          if (desc->nelts > 0) {
+            print_value(tab, name, "", idx);
+          }
+          break;
+      }
+    }
+  }
+}
+
+static void save_values(void) {
+  struct stat_table *tab;
+
+  for (tab = tables; tab != NULL; tab = tab->next) {
+    if (tab->prev_data == NULL) {
+      tab->prev_data = malloc(tab->hdr->datasz);
+      if (tab->prev_data == NULL) {
+        fprintf(stderr, "%s: Out of memory!\n", program);
+        exit(1);
+      }
+    }
+
+    memcpy(tab->prev_data, (const void *) tab->data, tab->hdr->datasz);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *tables_dir = FTPSNMPSTAT_DEFAULT_TABLES_DIR;
+  int c, list = 0, interval = 0;
+
+  program = argv[0];
+
+  while ((c = getopt(argc, argv, "hlt:w:")) != -1) {
+    switch (c) {
+      case 'h':
+        usage(0);
+        break;
+
+      case 'l':
+        list = 1;
+        break;
+
+      case 't':
+        tables_dir = optarg;
+        break;
+
+      case 'w':
+        interval = atoi(optarg);
+        if (interval < 1) {
+          fprintf(stderr, "%s: interval must be at least 1 second\n",
+            program);
+          usage(1);
+        }
+        break;
+
+      default:
+        usage(1);
+    }
+  }
+
+  name_filters = &(argv[optind]);
+  nname_filters = argc - optind;
+
+  open_tables(tables_dir);
+
+  if (list) {
+    list_fields();
+    return 0;
+  }
+
+  print_fields();
+
+  while (interval > 0) {
+    time_t now;
+    char ts[32];
+
+    save_values();
+    fflush(stdout);
+    sleep(interval);
+
+    now = time(NULL);
+    memset(ts, '\0', sizeof(ts));
+    strftime(ts, sizeof(ts)-1, "%Y-%m-%d %H:%M:%S", localtime(&now));
+    printf("--- %s\n", ts);
+
+    print_fields();
+  }
+
+  return 0;
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env perl
+#
+# snmpbench.pl: measures how many Get requests per second the mod_snmp agent
+# answers, using SNMPv2c and (when a user is given) SNMPv3 authPriv, so that
+# the cost of the SNMPv3 security can be compared with plain SNMPv2.
+#
+# Usage:
+#
+#   snmpbench.pl [-h host] [-p port] [-c community] [-n count]
+#     [-u user -a auth-passwd [-x priv-passwd]] [-o oid]
+
+use strict;
+
+use Getopt::Std;
+use Net::SNMP;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $opts = {};
+getopts('a:c:h:n:o:p:u:x:', $opts);
+
+my $host = $opts->{h} || '127.0.0.1';
+my $port = $opts->{p} || 161;
+my $count = $opts->{n} || 1000;
+
+# ftp.daemon.software, by default
+my $oid = $opts->{o} || '1.3.6.1.4.1.17852.2.2.1.1.0';
+
+sub bench {
+  my $label = shift;
+  my $sess_opts = [@_];
+
+  my ($sess, $err) = Net::SNMP->session(
+    -hostname => $host,
+    -port => $port,
+    -retries => 0,
+    -timeout => 3,
+    @$sess_opts,
+  );
+  unless ($sess) {
+    die("$label: unable to create Net::SNMP session: $err\n");
+  }
+
+  # The first request does any SNMPv3 engine discovery; leave it out of the
+  # timing.
+  unless ($sess->get_request(-varbindList => [$oid])) {
+    die("$label: no response: " . $sess->error() . "\n");
+  }
+
+  my $errors = 0;
+  my $start = [gettimeofday()];
+
+  for (my $i = 0; $i < $count; $i++) {
+    unless ($sess->get_request(-varbindList => [$oid])) {
+      $errors++;
+    }
+  }
+
+  my $elapsed = tv_interval($start);
+  $sess->close();
+
+  printf("%-12s %8d requests in %7.3f secs: %9.1f req/sec, %d errors\n",
+    $label, $count, $elapsed, ($elapsed > 0 ? $count / $elapsed : 0), $errors);
+
+  return $elapsed > 0 ? $count / $elapsed : 0;
+}
+
+my $v2c_rate = bench('v2c', -version => 'snmpv2c',
+  -community => ($opts->{c} || 'public'));
+
+if (defined($opts->{u})) {
+  my $v3_opts = [
+    -version => 'snmpv3',
+    -username => $opts->{u},
+    -authprotocol => 'sha',
+    -authpassword => $opts->{a},
+  ];
+
+  my $label = 'v3 authNoPriv';
+  if (defined($opts->{x})) {
+    push(@$v3_opts, -privprotocol => 'aes', -privpassword => $opts->{x});
+    $label = 'v3 authPriv';
+  }
+
+  my $v3_rate = bench($label, @$v3_opts);
+  if ($v2c_rate > 0) {
+    printf("%s throughput is %.1f%% of v2c\n", $label,
+      ($v3_rate / $v2c_rate) * 100);
+  }
+}
+
+exit 0;
@@ -0,0 +1,256 @@
+/*
+ * ProFTPD - mod_snmp MIB views
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "mib.h"
+#include "view.h"
+
+/* The subtrees only matter when a view is compiled.  Afterwards, checking
+ * whether a variable is in a view is a single bit test, using the variable's
+ * MIB index.
+ */
+
+struct snmp_view_subtree {
+  oid_t oid[SNMP_MIB_MAX_OIDLEN];
+  unsigned int oidlen;
+  int included;
+};
+
+struct snmp_view {
+  struct snmp_view *next;
+  const char *name;
+
+  array_header *subtrees;
+
+  unsigned char *bitmap;
+  unsigned int nbits;
+};
+
+static pool *view_pool = NULL;
+static struct snmp_view *views = NULL;
+
+static const char *trace_channel = "snmp.view";
+
+static void view_cleanup_cb(void *data) {
+  view_pool = NULL;
+  views = NULL;
+}
+
+int snmp_view_init(pool *p) {
+  if (view_pool != NULL) {
+    destroy_pool(view_pool);
+  }
+
+  view_pool = make_sub_pool(p);
+  pr_pool_tag(view_pool, MOD_SNMP_VERSION ": View Pool");
+  register_cleanup(view_pool, NULL, view_cleanup_cb, view_cleanup_cb);
+
+  views = NULL;
+  return 0;
+}
+
+struct snmp_view *snmp_view_get(const char *name) {
+  struct snmp_view *view;
+
+  for (view = views; view != NULL; view = view->next) {
+    if (strcmp(view->name, name) == 0) {
+      return view;
+    }
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+int snmp_view_add_subtree(const char *name, int included, oid_t *subtree,
+    unsigned int subtreelen) {
+  struct snmp_view *view;
+  struct snmp_view_subtree *st;
+
+  if (view_pool == NULL ||
+      name == NULL ||
+      subtree == NULL ||
+      subtreelen > SNMP_MIB_MAX_OIDLEN) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  view = snmp_view_get(name);
+  if (view == NULL) {
+    view = pcalloc(view_pool, sizeof(struct snmp_view));
+    view->name = pstrdup(view_pool, name);
+    view->subtrees = make_array(view_pool, 1,
+      sizeof(struct snmp_view_subtree));
+
+    view->next = views;
+    views = view;
+  }
+
+  st = push_array(view->subtrees);
+  memmove(st->oid, subtree, subtreelen * sizeof(oid_t));
+  st->oidlen = subtreelen;
+  st->included = included;
+
+  return 0;
+}
+
+/* Returns TRUE if the most specific of the view's subtrees containing the
+ * given OID is an included subtree.  For subtrees of equal length, the one
+ * configured last wins.
+ */
+static int view_includes(struct snmp_view *view, oid_t *oid,
+    unsigned int oidlen) {
+  register unsigned int i;
+  struct snmp_view_subtree *subtrees;
+  int included = FALSE, matchlen = -1;
+
+  subtrees = view->subtrees->elts;
+  for (i = 0; i < view->subtrees->nelts; i++) {
+    if (subtrees[i].oidlen > oidlen ||
+        (int) subtrees[i].oidlen < matchlen) {
+      continue;
+    }
+
+    if (memcmp(subtrees[i].oid, oid,
+        subtrees[i].oidlen * sizeof(oid_t)) == 0) {
+      included = subtrees[i].included;
+      matchlen = subtrees[i].oidlen;
+    }
+  }
+
+  return included;
+}
+
+int snmp_view_compile(void) {
+  struct snmp_view *view;
+  int max_idx;
+
+  max_idx = snmp_mib_get_max_idx();
+  if (max_idx < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (view = views; view != NULL; view = view->next) {
+    register int i;
+    unsigned int count = 0;
+
+    pr_signals_handle();
+
+    view->nbits = max_idx + 1;
+    view->bitmap = pcalloc(view_pool, (view->nbits + 7) / 8);
+
+    for (i = 1; i <= max_idx; i++) {
+      struct snmp_mib *mib;
+
+      mib = snmp_mib_get_by_idx(i);
+      if (mib == NULL ||
+          mib->mib_oidlen == 0) {
+        continue;
+      }
+
+      if (view_includes(view, mib->mib_oid, mib->mib_oidlen) == TRUE) {
+        view->bitmap[i / 8] |= (1 << (i % 8));
+        count++;
+      }
+    }
+
+    pr_trace_msg(trace_channel, 9,
+      "compiled view '%s' (%d %s): %u of %d MIBs included", view->name,
+      view->subtrees->nelts, view->subtrees->nelts != 1 ? "subtrees" :
+      "subtree", count, max_idx);
+  }
+
+  return 0;
+}
+
+int snmp_view_allows(const struct snmp_view *view, int mib_idx) {
+  if (view == NULL) {
+    return TRUE;
+  }
+
+  if (mib_idx < 0 ||
+      (unsigned int) mib_idx >= view->nbits) {
+    return FALSE;
+  }
+
+  return (view->bitmap[mib_idx / 8] & (1 << (mib_idx % 8))) ? TRUE : FALSE;
+}
+
+int snmp_view_allows_oid(const struct snmp_view *view, oid_t *oid,
+    unsigned int oidlen) {
+  if (view == NULL) {
+    return TRUE;
+  }
+
+  return view_includes((struct snmp_view *) view, oid, oidlen);
+}
+
+int snmp_view_parse_oid(const char *text, oid_t *oid, unsigned int *oidlen) {
+  const char *ptr;
+  unsigned int len = 0;
+
+  ptr = text;
+  if (*ptr == '.') {
+    ptr++;
+  }
+
+  while (*ptr != '\0') {
+    char *endp = NULL;
+    unsigned long subid;
+
+    if (!isdigit((int) *ptr) ||
+        len >= SNMP_MIB_MAX_OIDLEN) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    subid = strtoul(ptr, &endp, 10);
+    if (endp == NULL ||
+        (*endp != '.' && *endp != '\0') ||
+        subid > 0xffffffffUL) {
+      errno = EINVAL;
+      return -1;
+    }
+
+    oid[len++] = (oid_t) subid;
+
+    ptr = endp;
+    if (*ptr == '.') {
+      ptr++;
+      if (*ptr == '\0') {
+        errno = EINVAL;
+        return -1;
+      }
+    }
+  }
+
+  if (len == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *oidlen = len;
+  return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * ProFTPD - mod_snmp MIB views
+ * Copyright (c) 2013 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_snmp.h"
+#include "asn1.h"
+
+#ifndef MOD_SNMP_VIEW_H
+#define MOD_SNMP_VIEW_H
+
+struct snmp_view;
+
+/* Discards any previously defined views. */
+int snmp_view_init(pool *p);
+
+/* Adds an included, or excluded, OID subtree to the named view, creating
+ * the view if needed.  As with VACM (RFC 3415), the most specific subtree
+ * containing an OID decides whether that OID is in the view; OIDs in no
+ * subtree are excluded.
+ */
+int snmp_view_add_subtree(const char *name, int included, oid_t *subtree,
+  unsigned int subtreelen);
+
+/* Compiles every view into a bitmap over the MIB table, which must have
+ * been built (via snmp_mib_init()) first.
+ */
+int snmp_view_compile(void);
+
+struct snmp_view *snmp_view_get(const char *name);
+
+/* Returns TRUE if the MIB at the given index is in the view, FALSE
+ * otherwise.  A NULL view includes everything.
+ */
+int snmp_view_allows(const struct snmp_view *view, int mib_idx);
+
+/* As snmp_view_allows(), for OIDs which are not in the MIB table, e.g. the
+ * counter history rows.
+ */
+int snmp_view_allows_oid(const struct snmp_view *view, oid_t *oid,
+  unsigned int oidlen);
+
+/* Parses a dotted numeric OID, e.g. "1.3.6.1.4.1.17852", with or without
+ * a leading dot.
+ */
+int snmp_view_parse_oid(const char *text, oid_t *oid, unsigned int *oidlen);
+
+#endif